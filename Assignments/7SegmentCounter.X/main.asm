@@ -2,22 +2,26 @@
 ; Title: 7-Segment Counter
 ;-------------------------
 ; Program Details:
-; The purpose of this project is to create a system that can increment, decrement, and reset 
-;    a displayed number based on user input. The 7-segment display, connected directly to PORTB, shows 
-;    the current count (0-15 in hexadecimal). Switch A (RA0) increments the count, 
-;    Switch B (RA1) decrements it, and pressing both switches resets it to zero. The 
-;    program uses assembly language with a lookup table for segment encoding, a delay 
-;    function using CALL, and table pointers for efficiency.
-    
-    
-; Inputs: RA1 (decrement switch), RA0 (increment switch)
+; The purpose of this project is to create a system that can increment, decrement, and reset
+;    a displayed number based on user input. The 7-segment display, connected directly to PORTB, shows
+;    the current count (0-15 in hexadecimal). Switch A (RA0) increments the count,
+;    Switch B (RA1) decrements it, and pressing both switches resets it to zero.
+;    Holding a switch repeats it, slowly at first and then faster.
+; The core sleeps whenever it has nothing to do. A press wakes it through interrupt-on-change
+;    and is shown at once; while a switch is held, Timer0 wakes it every tick (16 ms) to
+;    look at the switches again, which both debounces them and times the auto-repeat.
+;    The digit is one table read of Common/seg_font.inc, indexed by the count.
+
+
+; Inputs: RA1 (decrement switch), RA0 (increment switch), high = pressed
 ; Outputs: PORTB(RB0-RB7)
 ; Setup: The Curiosity Board, Common Cathode 7-Segment Display, Breadboard Power Supply (9v battery)
 ;   Microchip: PIC18F46K42
-    
+
 ; Date: Mar 25, 2025
-; File Dependencies / Libraries: It is required to include the 
-;   myConfigFile.inc in the Header Folder
+; File Dependencies / Libraries: It is required to include the
+;   myConfigFile.inc in the Header Folder, and ../Common/seg_font.inc
+;   (generated from Common/seg_font.def by "make font" in HostSim)
 ; Compiler: pic-as, 3.0
 ; System Information:
 ;   Name:Dell Inspiron 16 Plus 7630
@@ -27,166 +31,197 @@
 ; Author: Christian Gonzalez
 ; Versions:
 ;       V1.0: First implementation
-; Useful links: 
-;       Datasheet: https://ww1.microchip.com/downloads/en/DeviceDoc/PIC18(L)F26-27-45-46-47-55-56-57K42-Data-Sheet-40001919G.pdf 
-;       PIC18F Instruction Sets: https://onlinelibrary.wiley.com/doi/pdf/10.1002/9781119448457.app4 
-;       List of Instrcutions: http://143.110.227.210/faridfarahmand/sonoma/courses/es310/resources/20140217124422790.pdf 
+;       V2.0: Sleep between events instead of polling with a 784403-cycle DELAY after each
+;             step: IOC on RA0/RA1 wakes the core for a press, which is acted on at once,
+;             and Timer0 ticks (LFINTOSC, running in Sleep) debounce the switches and time
+;             hold-to-repeat (first repeat after 0.5 s, then every 240 ms down to 48 ms).
+;             The switches moved from RD0/RD1 to RA0/RA1, as the comments always said:
+;             PORTD has no interrupt-on-change. The clock is switched to LFINTOSC at start,
+;             so a wake does not wait 1024 cycles for the LP crystal. The segment table is
+;             the shared seg_hex of Common/seg_font.inc, read at seg_hex + count.
+; Useful links:
+;       Datasheet: https://ww1.microchip.com/downloads/en/DeviceDoc/PIC18(L)F26-27-45-46-47-55-56-57K42-Data-Sheet-40001919G.pdf
+;       PIC18F Instruction Sets: https://onlinelibrary.wiley.com/doi/pdf/10.1002/9781119448457.app4
+;       List of Instrcutions: http://143.110.227.210/faridfarahmand/sonoma/courses/es310/resources/20140217124422790.pdf
 
 ; === Initialization ===
 #include "./myConfigFile.inc"
 #include <xc.inc>
-    
+
 ; === Program Inputs ===
-Inner_loop  equ 255 // in decimal
-Middle_loop equ	255
-Outer_loop  equ 4
-  
+// (// comments here: these are used in #if and EQU expressions)
+#define	TICK_COUNTS	31  // Timer0 counts a tick: 31 x 16 / 31 kHz LFINTOSC = 16 ms
+#define	REPEAT_FIRST	31  // ticks held before the first repeat (0.5 s)
+#define	REPEAT_START	15  // ticks to the second repeat (240 ms), one less after each...
+#define	REPEAT_MIN	3   // ...down to this (48 ms, about 20 steps a second)
+
+#if TICK_COUNTS < 1 || TICK_COUNTS > 256
+#error "TICK_COUNTS must be 1 to 256 (Timer0 in 8-bit mode)"
+#endif
+#if REPEAT_MIN < 1 || REPEAT_MIN > REPEAT_START
+#error "REPEAT_MIN must be 1 to REPEAT_START"
+#endif
+
 ; === Program Constants ===
-REG10   equ     10h   // in HEX
-REG11   equ     11h
-REG12	equ	12h
-   
+COUNT   equ     10h   // value shown, 0-15
+KEYS    equ     11h   // switches acted on: bit 0 = A, bit 1 = B
+NOW     equ     12h   // switches at this tick
+WAIT    equ     13h   // ticks left to the next repeat
+GAP     equ     14h   // ticks between repeats, shrinking while held
+
 ; === Definitions ===
-#define	SW_A	PORTD, 0  ; RA0 (Switch A - Increment)
-#define SW_B	PORTD, 1  ; RA1 (Switch B - Decrement)
+#define SW_MASK	0b00000011 // PORTA bits: RA0 (Switch A - Increment), RA1 (Switch B - Decrement)
 
-; === Main Program ===   
+; === Main Program ===
     PSECT absdata,abs,ovrld ; Do not change
-    
+
     ORG	    0               ;Reset vector
+    GOTO    START
 
-    ORG 0x100  ; starting address of table
+    ORG 0x100  ; starting address of the tables: seg_hex (0-F) and seg_font (ASCII)
 
-; === Segment Table ===
-SEG_TABLE:
-    ; the following two lines place the values 0 through F
-    ; (based on the 7-segment display output needed) starting
-    ; at address 0x100 through 0x10F
-    DB 0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07
-    DB 0x7F, 0x6F, 0x77, 0x7C, 0x39, 0x5E, 0x79, 0x71
+; === Segment Tables ===
+#include "../Common/seg_font.inc"
 
     ORG 0x200  ; start of program, placed far for no problems
 
 ; === Initialize ===
 START:
-    CLRF    TBLPTRU	    ; ensure upper byte of table pointer is clear
-    MOVLW   HIGH SEG_TABLE  ; the high byte where SEG_TABLE starts
-    MOVWF   TBLPTRH	    ; set high byte of table pointer to 0x10
-    MOVLW   LOW SEG_TABLE   ; the low byte where SEG_TABLE starts
-    MOVWF   TBLPTRL	    ; set low byte of table pointer to 0x00
+    ; run from LFINTOSC: it keeps running in Sleep, so a wake starts at once
+    ; (the LP crystal of myConfigFile.inc needs 1024 cycles, 31 ms, to restart)
+    BANKSEL OSCCON1	    ; select bank for OSCCON1
+    MOVLW   0b01010000	    ; NOSC = LFINTOSC, NDIV = 1:1
+    MOVWF   OSCCON1
+CLOCK_WAIT:
+    BTFSS   OSCCON3, 4	    ; ORDY: the switch is done
+    BRA     CLOCK_WAIT
+
+    CLRF    TBLPTRU	    ; table pointer at the page of seg_hex;
+    MOVLW   high(seg_hex)   ; SHOW only sets the low byte
+    MOVWF   TBLPTRH
 
 ; === Setup PORTB for 7-segment display ===
-    BANKSEL	PORTB	    ; select bank for PORTB register
-    CLRF	PORTB	    ; clear PORTB
-    BANKSEL	LATB	    ; select bank for LATB register
-    CLRF	LATB	    ; clear LATB
-    BANKSEL	ANSELB	    ; select bank for ANSELB register
-    CLRF	ANSELB	    ; set PORTB as digital
-    BANKSEL	TRISB	    ; select bank for TRISB register
-    MOVLW	0b00000000  ; load WREG with 0
-    MOVWF	TRISB	    ; set RB[7:0] as outputs
-    
-; === Setup PORTD for switches ===
-    BANKSEL PORTD	; select bank for PORTD register
-    CLRF    PORTD	; clear PORTD
-    BANKSEL LATD	; select bank for LATD register
-    CLRF    LATD	; clear LATD
-    BANKSEL ANSELD	; select bank for ANSELD register
-    CLRF    ANSELD	; set PORTD as digital
-    BANKSEL TRISD	; select bank for TRISD register
-    MOVLW   0b00000011	; load WREG with 0b00000011
-    MOVWF   TRISD	; set RD[1:0] as inputs
-    TBLRD*		; read table memory at TBLPTR
-    MOVF    TABLAT, 0	; move first table value to WREG
-    MOVWF   PORTB	; output to 7-segment display
-    CALL    DELAY	; wait before updating display
-
-CHECK_SWITCHES:
-    ; check switch A (PORTD, 0)
-    BTFSC   SW_A	    ; skip next instruction if Switch A is not pressed
-    GOTO    CHECK_B_WHILE_A ; if switch A is pressed, check switch B next
-
-    ; if switch A is NOT pressed, check switch B
-    BTFSC   SW_B	    ; skip next instruction if switch B is not pressed
-    CALL    DECREMENT       ; call DECREMENT if only switch B is pressed
-    GOTO    CHECK_SWITCHES  ; loop back if neither switch is pressed
-
-CHECK_B_WHILE_A:
-    ; if switch A is pressed, check if switch B is also pressed
-    BTFSS   SW_B	    ; skip next instruction if switch B is also pressed
-    CALL    INCREMENT       ; if only switch A is pressed, call INCREMENT
-
-    CALL    RESET_COUNTER   ; if both switches are pressed, call RESET_COUNTER
-    GOTO    CHECK_SWITCHES  ; loop back to continue checking
-
-INCREMENT:
-    MOVLW   0x0F	    ; max limit for TBLPTRL (end of table)
-    CPFSLT  TBLPTRL	    ; if TBLPTRL is at max, reset pointer to start
-    CALL    TO_START	    ; reset pointer to beginning if at end
-    TBLRD+*		    ; increment table pointer, then read value
-    MOVF    TABLAT, 0	    ; move table value to WREG
-    MOVWF   PORTB	    ; output to 7-segment display
-    CALL    DELAY	    ; wait before allowing another input
-    GOTO    CHECK_SWITCHES  ; continue checking for inputs
-
-DECREMENT:
-    MOVLW   0x00	    ; min limit for TBLPTRL (start of table)
-    CPFSGT  TBLPTRL	    ; if at start, need to wrap around to end
-    CALL    TO_END	    ; have table pointer point at end + 1
-    DECF    TBLPTRL, F	    ; TBLPTRL = TBLPTRL - 1
-    TBLRD*		    ; read value at TBLPTR
-    MOVF    TABLAT, 0	    ; move table value to WREG
-    MOVWF   PORTB	    ; output to 7-segment display
-    CALL    DELAY	    ; wait before allowing another input
-    GOTO    CHECK_SWITCHES  ; continue checking for inputs
-
-RESET_COUNTER:
-    MOVLW   HIGH SEG_TABLE  ; WREG = high byte of SEG_TABLE
-    MOVWF   TBLPTRH	    ; set high byte of table pointer to SEG_TABLE high byte
-    MOVLW   LOW SEG_TABLE   ; WREG = low byte of SEG_TABLE
-    MOVWF   TBLPTRL	    ; set low byte of table pointer to SEG_TABLE low byte
-    TBLRD*		    ; read value that table pointer is pointing to
-    MOVF    TABLAT, 0	    ; move table value to WREG
-    MOVWF   PORTB	    ; output to 7-segment display
-    CALL    DELAY           ; wait before updating display
+    CLRF    LATB	    ; clear LATB
+    CLRF    TRISB	    ; set RB[7:0] as outputs
+    BANKSEL ANSELB	    ; select bank for ANSELB register
+    CLRF    ANSELB	    ; set PORTB as digital
+
+; === Setup RA0/RA1 for switches ===
+    BANKSEL ANSELA	    ; select bank for ANSELA and IOCAx
+    BCF     ANSELA, 0	    ; RA0 digital (TRISA is all inputs from reset)
+    BCF     ANSELA, 1	    ; RA1 digital
+    BSF     IOCAP, 0	    ; a rising edge (press) on RA0 or RA1 sets its IOCAF bit
+    BSF     IOCAP, 1
+
+; === Setup Timer0 for the ticks ===
+    BANKSEL T0CON1	    ; select bank for Timer0
+    CLRF    T0CON0	    ; off until a switch is held
+    MOVLW   0b10010100	    ; CS = LFINTOSC, ASYNC (counts in Sleep), prescaler 1:16
+    MOVWF   T0CON1
+    MOVLW   TICK_COUNTS - 1 ; 8-bit mode: TMR0H is the period
+    MOVWF   TMR0H
+    ; GIE stays off: IOCIE and TMR0IE only wake the core, which goes on after its SLEEP
+
+    CLRF    COUNT
+    RCALL   SHOW	    ; show 0
+
+IDLE:
+    ; nothing held: Timer0 off, sleep until a press
+    BANKSEL T0CON0
+    CLRF    T0CON0	    ; Timer0 off
+    BANKSEL PIE3	    ; select bank for PIE0/PIR0 and PIE3/PIR3
+    BCF     PIE3, 7	    ; TMR0IE off
+    BCF     PIR3, 7	    ; TMR0IF
+    BANKSEL IOCAF
+    CLRF    IOCAF	    ; forget the edges of the last press and its bounces
+    BANKSEL PIE0
+    BSF     PIE0, 7	    ; IOCIE: the next edge wakes the core
+    MOVF    PORTA, W	    ; already pressed again (no edge will come)?
+    ANDLW   SW_MASK
+    BNZ     PRESS
+    SLEEP
+    MOVF    PORTA, W	    ; woken by an edge: which switches
+    ANDLW   SW_MASK
+    BZ      IDLE	    ; a glitch, already gone
+
+PRESS:
+    ; leading edge: act now, the timer does the debouncing from here
+    MOVWF   NOW
+    RCALL   NEW_KEYS
+    BANKSEL PIE0
+    BCF     PIE0, 7	    ; IOCIE off: bounces do not wake the core
+    BSF     PIE3, 7	    ; TMR0IE: each tick does
+    BANKSEL TMR0L
+    CLRF    TMR0L
+    MOVLW   0b10000000	    ; EN, 8-bit, postscaler 1:1
+    MOVWF   T0CON0
+
+HOLD:
+    SLEEP		    ; until the next tick
+    BANKSEL PIR3
+    BCF     PIR3, 7	    ; TMR0IF
+    MOVF    PORTA, W
+    ANDLW   SW_MASK
+    BZ      RELEASED
+    MOVWF   NOW
+    COMF    KEYS, W
+    ANDWF   NOW, W	    ; switches pressed since the last look
+    BZ      HELD
+    RCALL   NEW_KEYS	    ; another switch: act on it and start the repeats over
+    BRA     HOLD
+
+HELD:
+    ; the same switches held (or one of both let go: still a reset)
+    MOVLW   SW_MASK
+    CPFSLT  KEYS	    ; both pressed never repeat
+    BRA     HOLD
+    DECFSZ  WAIT, F	    ; not time for the next repeat yet
+    BRA     HOLD
+    RCALL   ACT		    ; repeat
+    MOVF    GAP, W	    ; next one after GAP ticks,
+    MOVWF   WAIT
+    MOVLW   REPEAT_MIN
+    CPFSEQ  GAP		    ; the one after that a tick sooner, down to REPEAT_MIN
+    DECF    GAP, F
+    BRA     HOLD
+
+RELEASED:
+    ; let go: one more tick, so a bounce of the release is not a press
+    SLEEP
+    BCF     PIR3, 7	    ; TMR0IF (BSR still at PIR3)
+    BRA     IDLE
+
+NEW_KEYS:
+    ; act on the switches in NOW and restart the repeat timing
+    MOVF    NOW, W
+    MOVWF   KEYS
+    RCALL   ACT
+    MOVLW   REPEAT_FIRST
+    MOVWF   WAIT
+    MOVLW   REPEAT_START
+    MOVWF   GAP
     RETURN
 
-TO_START:
-    ; moves table pointer back to the beginning of SEG_TABLE - 1 (bc we use pre-increment)
-    MOVLW   0x00    ; SEG_TABLE address - 1 is equal to 0x00 for high byte
-    MOVWF   TBLPTRH ; set high byte of table pointer to SEG_TABLE - 1 high byte
-    MOVLW   0xFF    ; SEG_TABLE address - 1 is equal to 0xFF for low byte
-    MOVWF   TBLPTRL ; set low byte of table pointer to SEG_TABLE - 1 low byte
-    RETURN
-    
-TO_END:
-    ; moves table pointer to the end of SEG_TABLE + 1 (bc we use pre-decrement)
-    MOVLW   0x01    ; SEG_TABLE end address + 1 is equal to 0x01 for high byte
-    MOVWF   TBLPTRH ; set high byte of table pointer to SEG_TABLE end + 1 high byte
-    MOVLW   0x10    ; SEG_TABLE end address + 1 is equal to 0x10 for low byte
-    MOVWF   TBLPTRL ; set low byte of table pointer to SEG_TABLE end + 1 low byte
+ACT:
+    ; KEYS: A = count up, B = count down, both = back to 0
+    BTFSS   KEYS, 1	    ; skip if switch B is pressed
+    INCF    COUNT, F	    ; A alone: up
+    BTFSS   KEYS, 0	    ; skip if switch A is pressed
+    DECF    COUNT, F	    ; B alone: down
+    MOVLW   SW_MASK
+    CPFSLT  KEYS	    ; skip unless both are pressed
+    CLRF    COUNT	    ; both: reset
+    MOVLW   0x0F
+    ANDWF   COUNT, F	    ; 0-15, F wraps to 0 and 0 to F
+
+SHOW:
+    ; segments of COUNT: seg_hex + COUNT, in the same page as seg_hex
+    MOVLW   low(seg_hex)
+    ADDWF   COUNT, W
+    MOVWF   TBLPTRL
+    TBLRD*		    ; read table memory at TBLPTR
+    MOVF    TABLAT, W	    ; move table value to WREG
+    MOVWF   LATB	    ; output to 7-segment display
     RETURN
 
-; ==== Delay Subroutine ====
-DELAY:
-    MOVLW   Inner_loop	; load inner loop value
-    MOVWF   REG10       ; store in REG10
-    MOVLW   Middle_loop	; load middle loop value
-    MOVWF   REG11       ; store in REG11
-    MOVLW   Outer_loop  ; load outer loop value
-    MOVWF   REG12       ; store in REG12
-
-_loop1:
-    DECF    REG10, 1    ; decrement inner loop counter
-    BNZ     _loop1      ; repeat until inner loop counter is zero
-    MOVLW   Inner_loop  ; re-initialize the inner loop when outer loop decrements
-    MOVWF   REG10	; copy WREG value to REG10
-    DECF    REG11, 1    ; decrement middle loop counter
-    BNZ     _loop1      ; repeat until middle loop counter is zero
-    MOVLW   Middle_loop ; re-initialize the middle loop when outer loop decrements
-    MOVWF   REG11	; copy WREG value to REG11
-    DECF    REG12, 1    ; decrement outer loop counter
-    BNZ     _loop1      ; repeat until outer loop counter is zero
-    RETURN              ; return from delay subroutine
-
     END
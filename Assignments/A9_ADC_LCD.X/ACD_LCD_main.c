@@ -4,12 +4,12 @@
  *  This program demonstrates how to read analog signals using the built-in ADC 
  * on the PIC18F47K42 and display the corresponding voltage or light intensity 
  * (lux) on a 20x2 character LCD. It also incorporates an external interrupt 
- * using a button to trigger an LED blinking sequence and halt the program. 
+ * using a button to trigger an LED blinking sequence while the readings go on. 
  *  
  * I/O:
  * Inputs: 
- *  - Potentiometer (analog input) to RA0
- *  - Photo-resistor (analog input) to RA0 (need to switch between what input we want)
+ *  - Photo-resistor (analog input) to RA0
+ *  - Potentiometer (analog input) to RA1 (both are scanned, no need to switch)
  *  - Pushbutton (digital interrupt) to RC2 (Interrupt-On-Change)
  * Outputs:
  *  - LCD 20x2 Character Display
@@ -17,13 +17,21 @@
  *      - EN to RD1
  *      - D0-D7 to RB0-RB7
  *  - LED to RC3 (blinks on interrupt)
+ *  - Profile dump out of UART1 TX on RC6, 38400 baud (only built with PROF_ENABLE)
+ *  - Or the telemetry stream, same pin, 125000 baud (only built with TLM_ENABLE)
  * 
  * Setup: C-Simulator
  * Date: May 4, 2025
  * File Dependencies / Libraries: 
  *      - <xc.h> for compiler-specific and device-specific features
- *      - <stdio.h> for sprintf
- *      - <string.h> for strcat
+ *      - "../Common/text_format.h" for the number fields on the LCD
+ *      - "../Common/power.h" for the module gating and the time in each power state
+ *      - "../Common/events.h" for the interrupt events and the Timer1 time stamps
+ *      - "../Common/tone.h" for the LED blink on PWM5
+ *      - "../Common/profile.h" for the cycle probes (empty unless PROF_ENABLE)
+ *      - "../Common/telemetry.h" for the sample packets (only with TLM_ENABLE)
+ *      - <stdint.h> for the 16-bit DMA ring entries
+ *      - <string.h> for memset
  *      - <stdlib.h> for general purposes
  * IDE: MPLAB X IDE v6.20
  * Compiler: XC8, 3.00
@@ -37,6 +45,40 @@
  *            displays on the LCD
  *      V3.0: Adds an external interrupt (via pushbutton on RC2) to flash an LED 
  *            for 10 seconds and halts ADC
+ *      V3.1: LCD written through a RAM shadow, only changed characters are sent
+ *      V3.2: LCD bytes queued and paced out by Timer0 (LCD_ISR), no blocking delays
+ *      V3.3: ADC triggered by Timer2 in burst average mode (16 samples), main() sleeps
+ *            and only wakes when the average leaves a band around the shown value
+ *      V3.4: ADC code to lux through a flash table built from the calibration points,
+ *            and to millivolts in fixed point; no floating point left
+ *      V3.5: Reading written into the LCD shadow by Common/text_format.h, right-aligned
+ *            in a fixed field, instead of sprintf + strcat through a 10-byte buffer
+ *      V3.6: RA0 and RA1 scanned in turn; DMA1 copies every burst average into a ring
+ *            and DMA2 selects the next channel, so light and voltage show together
+ *      V3.7: ISRs only clear their flag and post an event (Common/events.h); the readings
+ *            and the button's 10 s blink run from main(), the blink paced by Timer1
+ *            overflows, so the ADC and the LCD keep going while it blinks
+ *      V3.8: The blink is PWM5 on Timer6 routed to RC3 (Common/tone.h): one interrupt
+ *            per blink instead of sixteen Timer1 overflows
+ *      V3.9: Cycle probes (Common/profile.h) on the ISRs, the readings, LCD_Flush() and
+ *            LCD_Put(); built with PROF_ENABLE, the button also sends the profile out
+ *            of RC6
+ *      V4.0: Telemetry build (TLM_ENABLE): a burst every 1.03 ms, each channel in turn
+ *            for blocks of 8, every block sent out of RC6 as a binary packet by DMA2
+ *            (Common/telemetry.h); the LCD shows the block averages. LCD_Put() Idles
+ *            while the queue is full instead of spinning
+ *      V4.1: Unused modules switched off in PMD0-PMD7; the Idle waits go through
+ *            "../Common/power.h", which counts the time in Run and Idle
+ *      V4.2: Telemetry build: LCD_Flush() leaves out a run the LCD queue has no room
+ *            for and sends it with a later flush, so main() never waits on the LCD
+ *            (it held up two blocks during the power-on wait); adc_skipped counts
+ *            any block overwritten before it was sent
+ *      V4.3: Runs on HFINTOSC at 4 MHz instead of the 32.768 kHz crystal, at which
+ *            neither the UART baud rates nor the LCD pacing could be made
+ *      V4.4: The ADC threshold interrupt wakes main() again, as in V3.3: ADTIF only
+ *            when a burst leaves the band around its channel's shown reading. DMA1
+ *            and DMA2 run on Timer4 between bursts and only fill the ring and select
+ *            the channel; main() no longer wakes on every ring wrap
  * 
  * Useful links:
  *      V3.0 from GitHub: 
@@ -52,8 +94,8 @@
 // 'C' source line config statements
 
 // CONFIG1L
-#pragma config FEXTOSC = LP     // External Oscillator Selection (LP (crystal oscillator) optimized for 32.768 kHz; PFM set to low power)
-#pragma config RSTOSC = EXTOSC  // Reset Oscillator Selection (EXTOSC operating per FEXTOSC bits (device manufacturing default))
+#pragma config FEXTOSC = OFF    // External Oscillator Selection (Oscillator not enabled)
+#pragma config RSTOSC = HFINTOSC_1MHZ// Reset Oscillator Selection (HFINTOSC with HFFRQ = 4 MHz and CDIV = 4:1); main() sets 1:1, Fosc 4 MHz
 
 // CONFIG1H
 #pragma config CLKOUTEN = OFF   // Clock out Enable bit (CLKOUT function is disabled)
@@ -104,13 +146,70 @@
 #include <xc.h> // must have this
 //#include "../../../../../Program Files/Microchip/xc8/v2.40/pic/include/proc/pic18f46k42.h"
 //#include "C:\Program Files\Microchip\xc8\v2.40\pic\include\proc\pic18f46k42"
-#include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
+#define FMT_FIXED                 /* fmt_fixed() for the voltage */
+#include "../Common/text_format.h"
+
+                                  /* Modules left on: IOC, Timers 0-3 and 6 (and 4 for the
+                                     scan), the ADC, PWM5, DMA1-2 and UART1 in the profile
+                                     and telemetry builds */
+#define PWR_PMD0 (_PMD0_NVMMD_MASK | _PMD0_FVRMD_MASK | _PMD0_HLVDMD_MASK | _PMD0_CRCMD_MASK | \
+                  _PMD0_SCANMD_MASK | _PMD0_CLKRMD_MASK)
+#ifndef TLM_ENABLE
+#define PWR_PMD1 (_PMD1_NCO1MD_MASK | _PMD1_TMR5MD_MASK)
+#else
+#define PWR_PMD1 (_PMD1_NCO1MD_MASK | _PMD1_TMR4MD_MASK | _PMD1_TMR5MD_MASK)
+#endif
+#define PWR_PMD2 (_PMD2_DACMD_MASK | _PMD2_CMP1MD_MASK | _PMD2_CMP2MD_MASK | _PMD2_ZCDMD_MASK)
+#define PWR_PMD3 (_PMD3_PWM6MD_MASK | _PMD3_PWM7MD_MASK | _PMD3_PWM8MD_MASK | \
+                  _PMD3_CCP1MD_MASK | _PMD3_CCP2MD_MASK | _PMD3_CCP3MD_MASK | _PMD3_CCP4MD_MASK)
+#define PWR_PMD4 (_PMD4_CWG1MD_MASK | _PMD4_CWG2MD_MASK | _PMD4_CWG3MD_MASK)
+#define PWR_PMD5 (_PMD5_SMT1MD_MASK | _PMD5_CLC1MD_MASK | _PMD5_CLC2MD_MASK | \
+                  _PMD5_CLC3MD_MASK | _PMD5_CLC4MD_MASK)
+#if defined(PROF_ENABLE) || defined(TLM_ENABLE)
+#define PWR_PMD6 (_PMD6_U2MD_MASK | _PMD6_SPI1MD_MASK | _PMD6_I2C1MD_MASK | _PMD6_I2C2MD_MASK)
+#else
+#define PWR_PMD6 (_PMD6_U1MD_MASK | _PMD6_U2MD_MASK | _PMD6_SPI1MD_MASK | \
+                  _PMD6_I2C1MD_MASK | _PMD6_I2C2MD_MASK)
+#endif
+#define PWR_PMD7 0x00             /* DMA1-2 on */
+#include "../Common/power.h"
+#define EVT_WAIT() pwr_wait(PWR_IDLE) /* Idle: the DMA, Timer0 (LCD) and Timer1 (time stamps) need the system clock */
+
+#define EVT_READING 0             /* ADT_ISR: a reading left its band (telemetry: ADC_Ring_ISR, a block is full) */
+#define EVT_BUTTON 1              /* IOC_ISR: the RC2 button was pressed */
+#define BLINK_EVENT 2             /* Blink_ISR: the last blink is over */
+#define EVT_SOURCES 3
+#include "../Common/events.h"
+#define BLINK_PPS RC3PPS          /* LED on RC3 blinked by PWM5 */
+#include "../Common/tone.h"
+
 #define _XTAL_FREQ 4000000                 // Fosc  frequency for _delay()  library
 #define FCY    _XTAL_FREQ/4
 
+#define PROF_IOC_ISR 0            /* Probes, timed only when built with PROF_ENABLE */
+#define PROF_LCD_ISR 1
+#define PROF_ADC_ISR 2            /* ADT_ISR() (ADC_Ring_ISR() in the telemetry build) */
+#define PROF_READINGS 3           /* Show_Readings(): the new readings to the LCD queue */
+#define PROF_FLUSH 4              /* LCD_Flush() */
+#define PROF_LCD_PUT 5            /* LCD_Command() and LCD_Char(), one byte queued */
+#define PROF_PROBES 6
+#define PROF_NAMES "IOC_ISR,LCD_ISR,ADT_ISR,Show_Readings,LCD_Flush,LCD_Put"
+#define PROF_TX_PPS RC6PPS        /* Profile dump on RC6 */
+#include "../Common/profile.h"
+
+#ifdef TLM_ENABLE
+#ifdef PROF_ENABLE
+#error "The profile dump and the telemetry both need UART1: build with one of them"
+#endif
+#define TLM_SAMPLES 8             /* Bursts per block, and samples per packet */
+#define TLM_TX_PPS RC6PPS         /* Telemetry on RC6 */
+#include "../Common/telemetry.h"
+#endif
+
 #define RS LATD0                   /* PORTD 0 pin is used for Register Select */
 #define EN LATD1                   /* PORTD 1 pin is used for Enable */
 #define ldata LATB                 /* PORTB is used for transmitting data to LCD */
@@ -118,92 +217,331 @@
 #define LCD_Port TRISB              
 #define LCD_Control TRISD
 
-#define Vref 5.0 // voltage reference 
-int digital; // holds the digital value 
-float voltage; // hold the analog value (volt))
-char data[10];
+#define LCD_ROWS 2
+#define LCD_COLS 20
+#define LCD_RUN_GAP 2             /* Unchanged cells worth resending instead of a new cursor move */
+
+#define LCD_QUEUE_SIZE 32         /* Bytes waiting for the LCD, power of two */
+#define LCD_DATA 0x100            /* Queue entry flag for RS = 1 (character) */
+#define LCD_EXEC_COUNTS 6         /* Timer0 counts of 8 us: 48 us > 37 us for most instructions */
+#define LCD_CLEAR_COUNTS 200      /* 1.6 ms > 1.52 ms for clear display / return home */
+#define LCD_POWER_TICKS 20        /* Full 2.048 ms Timer0 periods, > 40 ms power-on wait */
+
+#define VALUE_COL 9               /* Reading fields: VALUE_WIDTH characters after the label, then the unit */
+#define VALUE_WIDTH 5             /* Widest unsigned int, or "5.000" */
+
+#define ADC_BURST 16              /* Conversions averaged per reading (ADRPT) */
+#define ADC_BURST_SHIFT 4         /* log2(ADC_BURST), the ADCRS right shift */
+#define ADC_BAND 24               /* ADC codes (29 mV, about 2.5 lux) a channel may drift before it is redrawn;
+                                     ADLTH/ADUTH outside the telemetry build */
+#ifndef TLM_ENABLE
+#define ADC_PERIOD_COUNTS 12      /* Timer2 counts of 4.13 ms (LFINTOSC / 128): a burst every 49.5 ms */
+#define ADC_TIMER_CON 0b11110000  /* T2CON and T4CON: on, 1:128 prescaler, 1:1 postscaler */
+#else
+#define ADC_PERIOD_COUNTS 8       /* Timer2 counts of 129 us (LFINTOSC / 4): a burst every 1.03 ms */
+#define ADC_TIMER_CON 0b10100000  /* T2CON: on, 1:4 prescaler, 1:1 postscaler */
+#define ADC_PERIOD_US 1032        /* The same in us, sent with the samples */
+#endif
+#define ADC_TRIGGER_TMR2 0x04     /* ADACT: Timer2 postscaler output */
+
+#define ADC_CHANNELS 2            /* Scan slots, one burst each in turn: 99 ms per channel */
+#define ADC_LIGHT 0               /* Slot of the photo-resistor, RA0 (ANA0) */
+#define ADC_POT 1                 /* Slot of the potentiometer, RA1 (ANA1) */
+#define ADC_RING_DEPTH 4          /* Readings kept per channel */
+#ifndef TLM_ENABLE
+#define ADC_RING (ADC_CHANNELS * ADC_RING_DEPTH)
+#else
+#define ADC_RING (2 * TLM_SAMPLES)  /* Telemetry: two blocks, one filled while the other is sent */
+#endif
+#define ADC_NOT_SHOWN 0x7FFF      /* Setpoint before the first draw, far from any code (also as a signed ADSTPT) */
+#define DMA_TRIGGER_TMR4 0x38     /* DMAxSIRQ: TMR4IF, half a scan period after each burst started */
+#define DMA_TRIGGER_ADT 0x0B      /* DMAxSIRQ: ADTIF, the end of every burst with ADTMD = 111 (telemetry) */
+
+#define BLINK_PERIOD_MS 500       /* LED blinks after a press: 250 ms on, 250 ms off, 20 times */
+#define BLINK_ON_MS 250
+#define BLINK_COUNT 20
+
+/*
+ * Light calibration: straight pieces between points measured on the board,
+ * as (mV, tenths of a lux) at both ends. Consecutive rows share their end
+ * point, the first piece is extended down and the last one has to reach
+ * 5000 mV. The two points below are the y = mx + b fit of V2.0
+ * (lux = 85.19 * V - 135.33).
+ */
+#define LUX_CALIBRATION(PIECE, k)                   \
+    PIECE(k, 1589,    0, 5000, 2906)
+
+/*
+ * The compiler evaluates the calibration at every 64th ADC code into
+ * lux_table (lux * 16, below 0 kept so the zero crossing interpolates
+ * right) in flash; ADC_To_Lux() interpolates between two neighbours.
+ * A piece may climb at most 0.5 lux per code.
+ */
+#define LUX_KNOT_SHIFT 6          /* 64 codes between table entries */
+#define LUX_KNOTS 65              /* 4096 / 64, plus the end point */
+#define LUX_FRAC 16               /* Table entries are lux * 16 */
+#define LUX_PIECE(k, mv0, lux0, mv1, lux1)          /* knot k is at k * 625 mV / 8 */ \
+    ((k) * 625L <= (mv1) * 8L) ?                                                      \
+        ((lux0) * 8L * ((mv1) - (mv0)) + ((k) * 625L - (mv0) * 8L) * ((lux1) - (lux0)) \
+         + 5L * ((mv1) - (mv0)) / 2) / (5L * ((mv1) - (mv0))) :
+#define LUX_KNOT(k) ((int)(LUX_CALIBRATION(LUX_PIECE, k) 0L))
+#define LUX_KNOTS_8(k) LUX_KNOT(k), LUX_KNOT(k + 1), LUX_KNOT(k + 2), LUX_KNOT(k + 3), \
+                       LUX_KNOT(k + 4), LUX_KNOT(k + 5), LUX_KNOT(k + 6), LUX_KNOT(k + 7)
+
+const int lux_table[LUX_KNOTS] = {
+    LUX_KNOTS_8(0), LUX_KNOTS_8(8), LUX_KNOTS_8(16), LUX_KNOTS_8(24),
+    LUX_KNOTS_8(32), LUX_KNOTS_8(40), LUX_KNOTS_8(48), LUX_KNOTS_8(56),
+    LUX_KNOT(64)
+};
+
+char lcd_shadow[LCD_ROWS][LCD_COLS];    /* What the application wants on the LCD */
+char lcd_shown[LCD_ROWS][LCD_COLS];     /* What the LCD shows once the queue has gone out */
+
+volatile unsigned int lcd_queue[LCD_QUEUE_SIZE];    /* LCD bytes, LCD_DATA set for characters */
+volatile unsigned char lcd_head = 0;    /* Next free entry, moved by LCD_Put() only */
+volatile unsigned char lcd_tail = 0;    /* Next entry to send, moved by LCD_ISR() only */
+volatile unsigned char lcd_busy = 0;    /* Timer0 is pacing bytes out */
+volatile unsigned char lcd_power_ticks = 0; /* Power-on wait left, in Timer0 periods */
+
+/*
+ * Scan: entry i of adc_ring holds slot i % ADC_CHANNELS. DMA1 writes it and
+ * DMA2 moves ADPCH on, both on Timer4 between two bursts. The ADC tests
+ * every burst against the band around its slot's setpoint (the reading the
+ * row shows) and only a burst outside it raises ADTIF and wakes main();
+ * ADC_Setpoint_ISR() loads the next slot's setpoint into ADSTPT.
+ * The telemetry build has DMA2 on the UART instead: DMA1 fills half the
+ * ring with a block of TLM_SAMPLES bursts of one slot on every ADTIF, and
+ * ADC_Ring_ISR() points it at the other half and ADPCH at the next slot.
+ */
+const unsigned char adc_scan_next[ADC_CHANNELS] = {
+    0x01,                               /* After the light (ANA0): ANA1 */
+    0x00                                /* After the potentiometer (ANA1): ANA0 */
+};
+volatile uint16_t adc_ring[ADC_RING];   /* ADFLTR of each burst, written by DMA1 only */
+#ifndef TLM_ENABLE
+volatile unsigned int adc_setpoint[ADC_CHANNELS] = {ADC_NOT_SHOWN, ADC_NOT_SHOWN}; /* ADSTPT of each slot, moved by ADT_ISR() */
+volatile unsigned int adc_reading[ADC_CHANNELS]; /* ADFLTR that left the band, from ADT_ISR() */
+volatile unsigned char adc_new = 0;     /* Bit n: adc_reading[n] not shown yet */
+#else
+unsigned int adc_shown[ADC_CHANNELS] = {ADC_NOT_SHOWN, ADC_NOT_SHOWN};  /* Code each row was last drawn from */
+volatile uint32_t adc_blocks = 0;       /* Blocks DMA1 has filled, counted by ADC_Ring_ISR() */
+uint32_t adc_sent = 0;                  /* Blocks Show_Readings() has sent or skipped */
+uint32_t adc_skipped = 0;               /* Blocks overwritten before Show_Readings() got to them */
+#endif
 
 void ADC_Init(void);
+void DMA_Init(void);
+unsigned int ADC_Latest(unsigned char );
+unsigned char ADC_Block(unsigned char ,unsigned int *,unsigned char );
+void Show_Reading(unsigned char ,unsigned int );
+void Show_Readings(void);
+void Button_Pressed(void);
 void LCD_Init();
 void LCD_Command(char );
 void LCD_Char(char x);
-void LCD_String(const char *);
-void LCD_String_xy(char ,char ,const char*);
-void MSdelay(unsigned int );
+void LCD_Shadow_Clear(void);
+void LCD_Shadow_String_xy(char ,char ,const char*);
+void LCD_Flush(void);
+void LCD_Put(unsigned int );
+#ifdef TLM_ENABLE
+unsigned char LCD_Room(void);
+#endif
+unsigned int ADC_To_Lux(unsigned int );
+unsigned int ADC_To_mV(unsigned int );
 void IOCC2_Init(void);
+EVT_ISR(IOC_ISR, irq(IRQ_IOC));
+EVT_ISR(LCD_ISR, irq(IRQ_TMR0));
+#ifndef TLM_ENABLE
+EVT_ISR(ADT_ISR, irq(IRQ_ADT));
+EVT_ISR(ADC_Setpoint_ISR, irq(IRQ_DMA2DCNT));
+#else
+EVT_ISR(ADC_Ring_ISR, irq(IRQ_DMA1DCNT));
+#endif
+
+
+// Interrupt: the blink is started from main() (Button_Pressed)
+EVT_ISR(IOC_ISR, irq(IRQ_IOC))
+{
+    EVT_ISR_BEGIN();
+    PROF_ENTER(PROF_IOC_ISR);
+    if (IOCCFbits.IOCCF2)               // Check if RC2 caused the interrupt
+    {
+        IOCCFbits.IOCCF2 = 0;           // Clear IOC flag first, a new press is not lost
+        evt_post(EVT_BUTTON);
+    }
+    PROF_EXIT(PROF_IOC_ISR);
+    EVT_ISR_END();
+}
 
 
-// Interrupt
-void __interrupt(irq(IRQ_IOC), base(0x4008)) IOC_ISR(void)
+/*
+ * LCD pacing: sends the oldest queued byte, then sets Timer0 to the time the
+ * HD44780 needs to execute it before the next one may follow. Stops Timer0
+ * once the queue is empty; LCD_Put() starts it again.
+ */
+EVT_ISR(LCD_ISR, irq(IRQ_TMR0))
 {
-    if (IOCCFbits.IOCCF2)               // Check if RC3 caused the interrupt
+    EVT_ISR_BEGIN();
+    PROF_ENTER(PROF_LCD_ISR);
+    PIR3bits.TMR0IF = 0;
+
+    if (lcd_power_ticks != 0)           // Still waiting for the LCD to power up
     {
-        for (int i = 0; i < 20; i++) {  // 20 cycles of 500ms = 10s
-                LATCbits.LATC3 = 1;     // Turn ON LED
-                __delay_ms(250);
-                LATCbits.LATC3 = 0;     // Turn OFF LED
-                __delay_ms(250);
-            }
-        IOCCFbits.IOCCF2 = 0;           // Clear IOC flag
-        PIR0bits.IOCIF = 0;             // Clear peripheral IOC flag
+        lcd_power_ticks--;
+        PROF_EXIT(PROF_LCD_ISR);
+        EVT_ISR_END();
+        return;
     }
+    if (lcd_tail == lcd_head)           // Nothing left to send
+    {
+        T0CON0bits.T0EN = 0;
+        lcd_busy = 0;
+        PROF_EXIT(PROF_LCD_ISR);
+        EVT_ISR_END();
+        return;
+    }
+
+    unsigned int entry = lcd_queue[lcd_tail];
+    lcd_tail = (lcd_tail + 1) & (LCD_QUEUE_SIZE - 1);
+
+    ldata = (char)entry;                // Byte on D0-D7
+    RS = (entry & LCD_DATA) ? 1 : 0;    // Character or command
+    EN = 1;                             // High-to-Low pulse on Enable pin to latch data
+    NOP();
+    EN = 0;
+
+    if (entry == 0x01 || entry == 0x02 || entry == 0x03)
+        TMR0H = LCD_CLEAR_COUNTS - 1;   // Clear display / return home
+    else
+        TMR0H = LCD_EXEC_COUNTS - 1;
+    PROF_EXIT(PROF_LCD_ISR);
+    EVT_ISR_END();
+}
+
+
+#ifndef TLM_ENABLE
+/*
+ * ADC threshold: the burst just done, on the channel still in ADPCH, is
+ * more than ADC_BAND from its slot's setpoint. Hands it to Show_Readings()
+ * and moves the band onto it, so that channel wakes main() again only
+ * after another ADC_BAND of change. DMA1 copies it into the ring later,
+ * like every other burst.
+ */
+EVT_ISR(ADT_ISR, irq(IRQ_ADT))
+{
+    EVT_ISR_BEGIN();
+    PROF_ENTER(PROF_ADC_ISR);
+    unsigned char slot = ADPCH;         // ANA0 and ANA1: slots 0 and 1
+
+    PIR1bits.ADTIF = 0;
+    adc_reading[slot] = ((unsigned int)ADFLTRH << 8) | ADFLTRL;
+    adc_setpoint[slot] = adc_reading[slot];
+    ADSTPTH = ADFLTRH;
+    ADSTPTL = ADFLTRL;
+    adc_new |= 1 << slot;
+    evt_post(EVT_READING);
+    PROF_EXIT(PROF_ADC_ISR);
+    EVT_ISR_END();
 }
 
+/*
+ * DMA2 moved ADPCH on: the next slot's setpoint goes into ADSTPT before
+ * Timer2 starts its burst. The one thing the scan needs the CPU for per
+ * burst, since the ADC has a single ADSTPT and both DMA channels are taken
+ * (the ring and ADPCH).
+ */
+EVT_ISR(ADC_Setpoint_ISR, irq(IRQ_DMA2DCNT))
+{
+    EVT_ISR_BEGIN();
+    unsigned int setpoint = adc_setpoint[ADPCH];
+
+    PIR5bits.DMA2DCNTIF = 0;
+    ADSTPTH = (unsigned char)(setpoint >> 8);
+    ADSTPTL = (unsigned char)setpoint;
+    EVT_ISR_END();
+}
+#else
+/*
+ * DMA1 filled a block: the next one goes into the other half of the ring,
+ * from the next slot (the next burst is a period away), and
+ * Show_Readings() sends this one.
+ */
+EVT_ISR(ADC_Ring_ISR, irq(IRQ_DMA1DCNT))
+{
+    EVT_ISR_BEGIN();
+    PROF_ENTER(PROF_ADC_ISR);
+    PIR2bits.DMA1DCNTIF = 0;
+    ADPCH = adc_scan_next[adc_blocks % ADC_CHANNELS];
+    adc_blocks++;
+    DMA1CON0 = 0x00;                    // Off and on again reloads the destination
+    DMA1DSA = (__uint24)&adc_ring[(adc_blocks & 1) * TLM_SAMPLES];
+    DMA1CON0 = 0b11000000;              // EN, SIRQEN
+    evt_post(EVT_READING);
+    PROF_EXIT(PROF_ADC_ISR);
+    EVT_ISR_END();
+}
+#endif
+
 
 /*****************************Main Program*******************************/
 
 void main(void)
 {
     // MAIN INITIALIZATION
+    OSCFRQ = 0b00000010;   // Fosc 4 MHz (_XTAL_FREQ): HFINTOSC at 4 MHz,
+    OSCCON1 = 0b01100000;  // NOSC = HFINTOSC, NDIV = 1:1 (the reset one is 4:1)
+    pwr_init();            // Unused modules off, Timer3 counts the time in each power state
+    evt_init();            // IVTBASE for the EVT_ISR()s and Timer1 time stamps, interrupts still off
+#ifdef PROF_ENABLE
+    TRISCbits.TRISC6 = 0;  // RC6: UART1 TX for the profile dump
+#endif
+    PROF_INIT();           // Probe counters on Timer1, UART1 (nothing without PROF_ENABLE)
+    tone_init();           // PWM5 and Timer6 for the LED blink
     ADC_Init();            // Initialize Analog-to-Digital Converter
-    LCD_Init();            // Initialize LCD display in 8-bit mode
-    IOCC2_Init();          // Set up Interrupt-On-Change for button on RC2
+#ifdef TLM_ENABLE
+    TRISCbits.TRISC6 = 0;  // RC6: UART1 TX for the telemetry
+    tlm_init();            // UART1 and DMA2 (ADC_Init() locked the arbiter)
+#endif
+    IOCC2_Init();          // Set up Interrupt-On-Change for button on RC2 (and interrupts)
+    LCD_Init();            // Initialize LCD display in 8-bit mode, sent from LCD_ISR
 
     TRISCbits.TRISC3 = 0;  // Configure RC3 as output (LED)
     LATCbits.LATC3 = 0;    // Ensure LED is off at startup
 
     
 /****************************** THIS IS PART 2 ***************************/   
-    LCD_String_xy(1, 0, "The Input Light:");          // Display top label
+    LCD_Shadow_String_xy(1, 0, "Light:");             // Row labels, the readings follow
+    LCD_Shadow_String_xy(2, 0, "Voltage:");           // from ADT_ISR()
+    LCD_Flush();
 
+    evt_on(EVT_READING, Show_Readings);
+    evt_on(EVT_BUTTON, Button_Pressed);
+
+    // Conversions and copies run on their own, so Idle until the next
+    // interrupt.
     while (1)
     {
-        ADCON0bits.GO = 1;                            //Start conversion
-        while (ADCON0bits.GO);                        //Wait for conversion done
-        digital = (ADRESH*256) | (ADRESL);            // Combine 8-bit LSB and 2-bit MSB
-        voltage = digital * ((float)Vref / 4096.0); 
-        
-        int lux = (int)(85.19 * voltage + -135.33);   // Conversion using measured 2 measured values and y=mx+b
-        if (lux < 0) lux =0;                          // Don't want negatives
-
-        //print on LCD 
-        /*It is used to convert integer value to ASCII string*/    
-        sprintf(data,"%d", lux);
-    
-        strcat(data," LUX    ");      //Concatenate result and unit to print
-        LCD_String_xy(2,4,data);      // Display LUX value
-
-        
-        __delay_ms(500);  
+        evt_dispatch();                 // Bottom halves of whatever came in
+        evt_idle();
     }
 /****************************** END OF PART 2 ***************************/
     
 /****************************** THIS IS PART 1 ***************************/
-//    LCD_String_xy(1, 0, "Voltage:");        // Display top label
+//    LCD_Shadow_String_xy(1, 0, "Voltage:"); // Display top label
 //    
 //    while (1)
 //    {
 //        ADCON0bits.GO = 1;                  // Start conversion
 //        while (ADCON0bits.GO);              // Wait for conversion done
-//        digital = (ADRESH*256) | (ADRESL);  // Combine 8-bit LSB and 2-bit MSB
-//        voltage= digital*((float)Vref/(float)(4096)); 
+//        unsigned int digital = (ADRESH*256) | (ADRESL);  // Combine 8-bit LSB and 2-bit MSB
+//        unsigned int mv = ADC_To_mV(digital);
 //        
-//        //print on LCD 
-//        /*It is used to convert integer value to ASCII string*/
-//        sprintf(data,"%.2f",voltage);
-//
-//        strcat(data," V");          // Concatenate result and unit to print
-//        LCD_String_xy(2,4,data);    // Send string data for printing
+//        //print on LCD: volts with 2 places, then the unit
+//        char line[LCD_COLS - 4 + 1];
+//        char *cell = fmt_fixed(line, (mv + 5) / 10, 2, VALUE_WIDTH);
+//        *fmt_text(cell, " V", sizeof(line) - 1 - VALUE_WIDTH) = 0;
+//        LCD_Shadow_String_xy(2,4,line); // Put the reading in the shadow
+//        LCD_Flush();                // Send only the cells that changed
 //        
 //        __delay_ms(500);            // Small delay to avoid flickering on the display
 //    }
@@ -222,84 +560,356 @@ void IOCC2_Init(void) {
     PIR0bits.IOCIF = 0;
 
     PIE0bits.IOCIE = 1;             // Enable IOC
-    INTCON0bits.GIE = 1;
-    INTCON0bits.IPEN = 0;
 
-    IVTBASEU = 0x00;
-    IVTBASEH = 0x40;
-    IVTBASEL = 0x08;
+    INTCON0bits.IPEN = 0;           // IVTBASE was set by evt_init()
+    INTCON0bits.GIE = 1;
 }
 
 
 
 void LCD_Init()
 {
-    MSdelay(500);           /* 15ms,16x2 LCD Power on delay */
     LCD_Port = 0x00;       /* Set PORTB as output PORT for LCD data(D0-D7) pins */
     LCD_Control = 0x00;    /* Set PORTD as output PORT LCD Control(RS,EN) Pins */
-    LCD_Command(0x01);     /* clear display screen */
+
+    // Timer0 paces the queue: Fosc/4 with a 1:8 prescaler = 8 us per count, 8-bit
+    T0CON0 = 0b00000000;   /* off, 8-bit, 1:1 postscaler */
+    T0CON1 = 0b01000011;   /* Fosc/4 (CS = 010), synchronous, 1:8 prescaler */
+    PIR3bits.TMR0IF = 0;
+    PIE3bits.TMR0IE = 1;
+
+    // Power-on wait runs on Timer0 too, the commands queue up behind it
+    lcd_power_ticks = LCD_POWER_TICKS;
+    lcd_busy = 1;
+    TMR0H = 255;
+    TMR0L = 0;
+    T0CON0bits.T0EN = 1;   /* T0EN, since EN is the LCD enable pin here */
+
     LCD_Command(0x38);     /* uses 2 line and initialize 5*7 matrix of LCD */
     LCD_Command(0x0c);     /* display on cursor off */
     LCD_Command(0x06);     /* increment cursor (shift cursor to right) */
+    LCD_Command(0x01);     /* clear display screen */
+    memset(lcd_shown, ' ', sizeof(lcd_shown)); /* blank after the clear */
+    LCD_Shadow_Clear();
 }
 
-void LCD_Clear()
+/*
+ * LCD_Command() and LCD_Char() only queue the byte and return; LCD_ISR()
+ * sends it. They wait only if the queue is full, which needs interrupts on.
+ */
+void LCD_Command(char cmd )
 {
-        LCD_Command(0x01); /* clear display screen */
+    LCD_Put((unsigned char)cmd);
 }
 
-void LCD_Command(char cmd )
+void LCD_Char(char dat)
 {
-    ldata= cmd;            /* Send data to PORT as a command for LCD */   
-    RS = 0;                /* Command Register is selected */
-    EN = 1;                /* High-to-Low pulse on Enable pin to latch data */ 
-    NOP();
-    EN = 0;
-    MSdelay(3); 
+    LCD_Put(LCD_DATA | (unsigned char)dat);
 }
 
-void LCD_Char(char dat)
+void LCD_Put(unsigned int entry)
 {
-    ldata= dat;            /* Send data to LCD */  
-    RS = 1;                /* Data Register is selected */
-    EN=1;                  /* High-to-Low pulse on Enable pin to latch data */   
-    NOP();
-    EN=0;
-    MSdelay(1);
+    unsigned char next = (lcd_head + 1) & (LCD_QUEUE_SIZE - 1);
+
+    PROF_ENTER(PROF_LCD_PUT);
+    while (next == lcd_tail)            /* Full: Idle until LCD_ISR() makes room */
+    {
+        di();
+        if (next == lcd_tail)
+            pwr_wait(PWR_IDLE);
+        ei();
+    }
+    lcd_queue[lcd_head] = entry;
+    lcd_head = next;
+
+    if (!lcd_busy)                      /* Timer0 stopped: start it, first byte after 48 us */
+    {
+        lcd_busy = 1;
+        TMR0H = LCD_EXEC_COUNTS - 1;
+        TMR0L = 0;
+        T0CON0bits.T0EN = 1;
+    }
+    PROF_EXIT(PROF_LCD_PUT);
 }
 
+#ifdef TLM_ENABLE
+/* Entries LCD_Put() can queue without waiting */
+unsigned char LCD_Room(void)
+{
+    return (lcd_tail - lcd_head - 1) & (LCD_QUEUE_SIZE - 1);
+}
+#endif
+
+
+/*
+ * Shadow framebuffer: the application only writes into lcd_shadow, and
+ * LCD_Flush() sends the cells that differ from lcd_shown. Changed cells that
+ * are close together go out as one run after a single cursor move, since a
+ * cursor move (LCD_Command, 3 ms) costs more than resending a couple of
+ * unchanged characters (LCD_Char, 1 ms each).
+ * The telemetry build never waits for the queue: a run that does not fit
+ * stays different from lcd_shown and goes out with a later flush, merged
+ * with whatever changed in between.
+ */
+void LCD_Shadow_Clear(void)
+{
+    memset(lcd_shadow, ' ', sizeof(lcd_shadow));
+}
 
-void LCD_String(const char *msg)
+void LCD_Shadow_String_xy(char row, char pos, const char *msg)
 {
-    while((*msg)!=0)
-    {       
-      LCD_Char(*msg);
-      msg++;    
+    char *line = lcd_shadow[(row <= 1) ? 0 : 1];   /* Row 1 or 2, as on the LCD */
+    unsigned char col = (unsigned char)pos;
+
+    while (*msg != 0 && col < LCD_COLS)
+        line[col++] = *msg++;
+}
+
+void LCD_Flush(void)
+{
+    PROF_ENTER(PROF_FLUSH);
+    for (unsigned char row = 0; row < LCD_ROWS; row++)
+    {
+        unsigned char col = 0;
+        while (col < LCD_COLS)
+        {
+            if (lcd_shadow[row][col] == lcd_shown[row][col])
+            {
+                col++;
+                continue;
+            }
+
+            // Find the end of the run, allowing up to LCD_RUN_GAP unchanged cells inside it
+            unsigned char end = col + 1;
+            unsigned char last = col;
+            while (end < LCD_COLS && end - last <= LCD_RUN_GAP + 1)
+            {
+                if (lcd_shadow[row][end] != lcd_shown[row][end])
+                    last = end;
+                end++;
+            }
+
+#ifdef TLM_ENABLE
+            if (LCD_Room() < last - col + 2)               /* Cursor move + the run */
+                break;
+#endif
+            LCD_Command((row == 0 ? 0x80 : 0xC0) + col);   /* Cursor to the start of the run */
+            for (; col <= last; col++)
+            {
+                LCD_Char(lcd_shadow[row][col]);
+                lcd_shown[row][col] = lcd_shadow[row][col];
+            }
         }
+    }
+    PROF_EXIT(PROF_FLUSH);
+}
+/*****************************ADC Conversions*****************************/
+/*
+ * Lux from a 12-bit ADC code: the two table entries around the code, and a
+ * straight line between them for the low 6 bits. Integer only.
+ */
+unsigned int ADC_To_Lux(unsigned int code)
+{
+    unsigned char i = (unsigned char)(code >> LUX_KNOT_SHIFT);
+    int frac = code & ((1 << LUX_KNOT_SHIFT) - 1);
+    int lux = lux_table[i];
+
+    lux += ((lux_table[i + 1] - lux) * frac + (1 << (LUX_KNOT_SHIFT - 1))) >> LUX_KNOT_SHIFT;
+    if (lux <= 0)
+        return 0;                               /* Don't want negatives */
+    return (unsigned int)(lux + LUX_FRAC / 2) / LUX_FRAC;   /* Rounded to whole lux */
+}
+
+/* Millivolts from a 12-bit ADC code: 5000 mV / 4096 = 625 / 512, rounded */
+unsigned int ADC_To_mV(unsigned int code)
+{
+    return (unsigned int)(((unsigned long)code * 625 + 256) >> 9);
 }
 
-void LCD_String_xy(char row,char pos,const char *msg)
+#ifndef TLM_ENABLE
+/* Newest reading of a scan slot */
+unsigned int ADC_Latest(unsigned char slot)
 {
-    char location=0;
-    if(row<=1)
+    unsigned int block;
+
+    ADC_Block(slot, &block, 1);
+    return block;
+}
+
+/*
+ * The newest count readings of a slot, newest first (at most
+ * ADC_RING_DEPTH). DMA1DPTR is where the next burst goes, so the entry
+ * before it is the newest. Read twice in case a copy moves it between its
+ * bytes; an odd offset (copy half done) counts the entry as not there yet.
+ */
+unsigned char ADC_Block(unsigned char slot, unsigned int *out, unsigned char count)
+{
+    unsigned int offset;
+    unsigned char i;
+
+    do {
+        offset = (unsigned int)(DMA1DPTR - (__uint24)adc_ring);
+    } while (offset != (unsigned int)(DMA1DPTR - (__uint24)adc_ring));
+
+    i = (unsigned char)(offset / sizeof(adc_ring[0]));      /* Entries written this round */
+    i = (i == 0) ? ADC_RING - 1 : i - 1;                    /* Newest entry */
+    while (i % ADC_CHANNELS != slot)                        /* Newest entry of this slot */
+        i = (i == 0) ? ADC_RING - 1 : i - 1;
+
+    if (count > ADC_RING_DEPTH)
+        count = ADC_RING_DEPTH;
+    for (unsigned char n = 0; n < count; n++)
+    {
+        out[n] = adc_ring[i];
+        i = (i >= ADC_CHANNELS) ? i - ADC_CHANNELS : i + ADC_RING - ADC_CHANNELS;
+    }
+    return count;
+}
+#endif
+
+/* Writes a slot's reading into its row of the shadow */
+void Show_Reading(unsigned char slot, unsigned int code)
+{
+    char *cell;
+
+    cell = &lcd_shadow[slot][VALUE_COL];                    /* Slot n on row n + 1 */
+    if (slot == ADC_LIGHT)
     {
-        location=(0x80) | ((pos) & 0x0f); /*Print message on 1st row and desired location*/
-        LCD_Command(location);
+        cell = fmt_uint(cell, ADC_To_Lux(code), VALUE_WIDTH);
+        fmt_text(cell, " LUX", LCD_COLS - VALUE_COL - VALUE_WIDTH);
     }
     else
     {
-        location=(0xC0) | ((pos) & 0x0f); /*Print message on 2nd row and desired location*/
-        LCD_Command(location);    
-    }  
-    LCD_String(msg);
+        cell = fmt_fixed(cell, ADC_To_mV(code), 3, VALUE_WIDTH);
+        fmt_text(cell, " V", LCD_COLS - VALUE_COL - VALUE_WIDTH);
+    }
+}
+
+#ifndef TLM_ENABLE
+/* EVT_READING: the rows whose reading left its band, then only the changed cells out */
+void Show_Readings(void)
+{
+    unsigned int code[ADC_CHANNELS];
+    unsigned char pending;
+
+    PROF_ENTER(PROF_READINGS);
+    di();
+    pending = adc_new;
+    adc_new = 0;
+    for (unsigned char slot = 0; slot < ADC_CHANNELS; slot++)
+        code[slot] = adc_reading[slot];
+    ei();
+    for (unsigned char slot = 0; slot < ADC_CHANNELS; slot++)
+    {
+        if (pending & (1 << slot))
+            Show_Reading(slot, code[slot]);
+    }
+    LCD_Flush();
+    PROF_EXIT(PROF_READINGS);
+}
+#else
+/*
+ * EVT_READING, telemetry build: the block just filled goes out as one
+ * packet (dropped if the UART is two packets behind) and its average to its
+ * row, once that has moved more than ADC_BAND from what the row shows.
+ * It has to be copied before DMA1 comes back to its half, TLM_SAMPLES
+ * bursts later. Events that piled up while main() was held up find it sent
+ * already; the blocks they stood for are overwritten, and counted in
+ * adc_skipped. Nothing here waits (LCD_Flush() only queues what fits), so
+ * that should stay 0.
+ */
+void Show_Readings(void)
+{
+    uint16_t codes[TLM_SAMPLES];
+    uint32_t block;
+    unsigned long sum = 0;
+    unsigned int code;
+    unsigned char slot;
+
+    di();
+    block = adc_blocks - 1;
+    ei();
+    if (block < adc_sent)
+        return;
+    adc_skipped += block - adc_sent;
+    adc_sent = block + 1;
+    slot = (unsigned char)(block % ADC_CHANNELS);
+    for (unsigned char n = 0; n < TLM_SAMPLES; n++)
+    {
+        codes[n] = adc_ring[(block & 1) * TLM_SAMPLES + n];
+        sum += codes[n];
+    }
+    tlm_send(slot, block * TLM_SAMPLES, ADC_PERIOD_US, codes, TLM_SAMPLES);
+    code = (unsigned int)((sum + TLM_SAMPLES / 2) / TLM_SAMPLES);
+    if ((code > adc_shown[slot] ? code - adc_shown[slot] : adc_shown[slot] - code) > ADC_BAND)
+    {
+        adc_shown[slot] = code;
+        Show_Reading(slot, code);
+    }
+    LCD_Flush();
+}
+#endif
 
+/*
+ * EVT_BUTTON: 10 s of blinking done by PWM5 (a press while it blinks starts
+ * it over). A profiling build also sends the profile out of RC6, which
+ * holds up main() for about 65 ms; the ISRs go on.
+ */
+void Button_Pressed(void)
+{
+    blink_start(TONE_MS(BLINK_PERIOD_MS), TONE_MS(BLINK_ON_MS), BLINK_COUNT, 0);
+    PROF_DUMP();
 }
-/*********************************Delay Function********************************/
-void MSdelay(unsigned int val)
+
+/*
+ * DMA1: ADFLTRL:H (2 bytes) into the next adc_ring entry on every TMR4IF,
+ * the destination wrapping round the ring.
+ * DMA2: the next ADPCH from adc_scan_next (in flash) on the same trigger,
+ * after DMA1; DMA2DCNTIF has ADC_Setpoint_ISR() follow with ADSTPT.
+ * The telemetry build has DMA1 copy on every ADTIF, one block (half the
+ * ring) at a time with DMA1DCNTIF at its end, and leaves DMA2 to
+ * tlm_init().
+ * The arbiter puts both ahead of the CPU and has to be locked before any
+ * DMA runs, so this is called with interrupts still off.
+ */
+void DMA_Init(void)
 {
-     unsigned int i,j;
-        for(i=0;i<val;i++)
-            for(j=0;j<165;j++);      /*This count Provide delay of 1 ms for 8MHz Frequency */
+    ISRPR = 2;                  // Priorities, lower wins: DMA1, DMA2, ISR, main
+    MAINPR = 3;
+    DMA1PR = 0;
+    DMA2PR = 1;
+    PRLOCK = 0x55;              // Unlock sequence, then lock
+    PRLOCK = 0xAA;
+    PRLOCKbits.PRLOCKED = 1;
+
+    DMA1CON0 = 0x00;
+    DMA1CON1 = 0b01000010;      // DMODE = 01 increment, SMR = 00 data space, SMODE = 01 increment
+    DMA1SSA = (__uint24)&ADFLTRL;
+    DMA1SSZ = 2;
+    DMA1DSA = (__uint24)adc_ring;
+#ifndef TLM_ENABLE
+    DMA1DSZ = sizeof(adc_ring);
+    DMA1SIRQ = DMA_TRIGGER_TMR4;
+#else
+    DMA1DSZ = sizeof(adc_ring) / 2;
+    DMA1SIRQ = DMA_TRIGGER_ADT;
+    PIR2bits.DMA1DCNTIF = 0;
+    PIE2bits.DMA1DCNTIE = 1;
+#endif
+    DMA1CON0 = 0b11000000;      // EN, SIRQEN
+
+#ifndef TLM_ENABLE
+    DMA2CON0 = 0x00;
+    DMA2CON1 = 0b00001010;      // DMODE = 00 fixed, SMR = 01 program flash, SMODE = 01 increment
+    DMA2SSA = (__uint24)adc_scan_next;
+    DMA2SSZ = ADC_CHANNELS;
+    DMA2DSA = (__uint24)&ADPCH;
+    DMA2DSZ = 1;
+    DMA2SIRQ = DMA_TRIGGER_TMR4;
+    PIR5bits.DMA2DCNTIF = 0;
+    PIE5bits.DMA2DCNTIE = 1;
+    DMA2CON0 = 0b11000000;      // EN, SIRQEN
+#endif
 }
 
 void ADC_Init(void)
@@ -310,8 +920,10 @@ void ADC_Init(void)
     
     TRISAbits.TRISA0 = 1; //Set RA0 to input
     ANSELAbits.ANSELA0 = 1; //Set RA0 to analog
+    TRISAbits.TRISA1 = 1; //Set RA1 to input
+    ANSELAbits.ANSELA1 = 1; //Set RA1 to analog
     // Added 
-    ADPCH = 0x00; //Set RA0 as Analog channel in ADC ADPCH
+    ADPCH = 0x00; //Scan starts on RA0 (slot ADC_LIGHT), DMA2 (or ADC_Ring_ISR) moves it on
     ADCLK = 0x00; //set ADC CLOCK Selection register to zero
     
     ADRESH = 0x00; // Clear ADC Result registers
@@ -322,6 +934,50 @@ void ADC_Init(void)
     
     ADACQL = 0x00;  // set acquisition low and high byte to zero 
     ADACQH = 0x00;    
-    
+
+    ADCON2 = (ADC_BURST_SHIFT << 4) | 0x03;    // ADCRS: sum >> 4, ADMD = 011 burst average
+    ADRPT = ADC_BURST;
+#ifndef TLM_ENABLE
+    // Computation engine: average every burst and test it against the band
+    // around the setpoint of its slot; ADTIF (and main()) only for a burst
+    // outside it. Both setpoints start far off, so the first bursts are.
+    ADCON3 = 0b01010011;        // ADCALC = 101 ADFLTR - ADSTPT, ADTMD = 011 outside ADLTH..ADUTH
+    ADSTPTH = (unsigned char)(ADC_NOT_SHOWN >> 8);
+    ADSTPTL = (unsigned char)ADC_NOT_SHOWN;
+    ADLTHH = (unsigned char)((-ADC_BAND) >> 8);
+    ADLTHL = (unsigned char)(-ADC_BAND);
+    ADUTHH = (unsigned char)(ADC_BAND >> 8);
+    ADUTHL = (unsigned char)ADC_BAND;
+    PIR1bits.ADTIF = 0;
+    PIE1bits.ADTIE = 1;
+#else
+    // Computation engine: average every burst and raise ADTIF at its end,
+    // which starts the DMA (ADTIE stays off, the CPU is not involved)
+    ADCON3 = 0b00000111;        // ADTMD = 111 ADTIF after every computation
+#endif
+
+    DMA_Init();
+
+    // Timer2 starts a burst every ADC_PERIOD_COUNTS on the channel in ADPCH
+    ADACT = ADC_TRIGGER_TMR2;
+    T2CLKCON = 0x04;            // LFINTOSC
+    T2HLT = 0x00;               // Free-running period mode, not synchronized to Fosc
+    T2PR = ADC_PERIOD_COUNTS - 1;
+#ifndef TLM_ENABLE
+    T2TMR = ADC_PERIOD_COUNTS / 2;  // First burst half a period in, ahead of Timer4
+#else
+    T2TMR = 0x00;
+#endif
+    T2CON = ADC_TIMER_CON;      // On, 1:128 (telemetry 1:4) prescaler, 1:1 postscaler
+#ifndef TLM_ENABLE
+    // Timer4: the same period half a period behind, so the DMA copies the
+    // burst and moves ADPCH on while the ADC is idle
+    T4CLKCON = 0x04;            // LFINTOSC
+    T4HLT = 0x00;               // Free-running period mode, not synchronized to Fosc
+    T4PR = ADC_PERIOD_COUNTS - 1;
+    T4TMR = 0x00;
+    T4CON = ADC_TIMER_CON;      // On, 1:128 prescaler, 1:1 postscaler
+#endif
+
     ADCON0bits.ON = 1; //Turn ADC On 
 }
\ No newline at end of file
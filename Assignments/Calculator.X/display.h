@@ -0,0 +1,64 @@
+/*
+ * File:   display.h
+ * Author: Christian Gonzalez
+ *
+ * 8-digit common-cathode 7-segment bank for the results, using the shared
+ * driver in Common/seg_display.h: segments a-g and the point on RD0-RD7,
+ * digit selects on RA0-RA7 (RA0 = rightmost digit) through one transistor
+ * per cathode. RA6 and RA7 are free for them because the core runs on
+ * HFINTOSC (header.h), not a crystal on OSC1/OSC2.
+ *
+ * Timer2 runs from MFINTOSC (500 kHz) with a 1:4 prescaler, 8 us a count,
+ * and calls display_tick() on every period match: a 128-count slot per
+ * digit is 1.024 ms, so each digit is refreshed at 122 Hz. MFINTOSC keeps
+ * running in Sleep, so the display stays lit while main() sleeps between
+ * keys (Timer2 wakes the core for each slot and it goes straight back).
+ *
+ * Fosc is 4 MHz (setup()), so a slot is 1024 instruction cycles and the
+ * refresh ISR takes about 33 of them, 3% of the CPU. On the 32.768 kHz
+ * crystal a slot would be 8 instruction cycles, too few for the ISR.
+ */
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <xc.h>
+#include <stdint.h>
+
+#define DISPLAY_SEG_PORT    D
+#define DISPLAY_DIG_PORT    A
+#define DISPLAY_DIG_FIRST   0       // RA0-RA7
+#define DISPLAY_DIGITS      8
+#define DISPLAY_PR          T2PR
+
+#include "../Common/seg_display.h"
+
+void display_setup(void);
+void __interrupt(irq(IRQ_TMR2), base(0x8)) TMR2_ISR(void);
+
+/*
+ * This function is used to set up the display pins and start Timer2.
+ * Interrupts still have to be turned on with INTCON0bits.GIE.
+ * params: none
+ * return: none
+ */
+void display_setup(void) {
+    // Timer2: off while it is set up, 1:4 prescaler, 1:1 postscaler
+    T2CON = 0b00100000;
+    T2CLKCON = 0b00000101;  // MFINTOSC 500 kHz
+    T2HLT = 0b00000000;     // free-running period mode, not synchronized (runs in Sleep)
+    T2TMR = 0;
+    display_init();         // sets T2PR to the first slot
+
+    PIR4bits.TMR2IF = 0;
+    PIE4bits.TMR2IE = 1;
+    T2CONbits.ON = 1;
+}
+
+// One refresh step per period match
+void __interrupt(irq(IRQ_TMR2), base(0x8)) TMR2_ISR(void) {
+    PIR4bits.TMR2IF = 0;
+    display_tick();
+}
+
+#endif /* DISPLAY_H */
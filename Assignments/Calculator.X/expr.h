@@ -0,0 +1,138 @@
+/*
+ * File:   expr.h
+ * Author: Christian Gonzalez
+ *
+ * Chained expressions with precedence (2 A 3 C 4 = 2 + 3 x 4 = 14), worked
+ * out as they are typed by shunting-yard over two fixed stacks: the values
+ * and the operators still waiting. No heap and no recursion.
+ *
+ * Before an operator is pushed, every waiting operator of the same or a
+ * higher precedence is applied (left to right, as usual). So the operator
+ * stack always climbs in precedence from the bottom, and with two levels it
+ * never holds more than two operators, or the value stack more than three:
+ * EXPR_DEPTH is that bound, not a limit the user can reach. It also bounds
+ * the work of one key: an operator or the end applies at most two
+ * operators.
+ *
+ * Every step returns an arith.h status. On an error the stacks are
+ * emptied and the expression is over.
+ */
+
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <xc.h>
+#include <stdint.h>
+
+#define EXPR_ADD            0
+#define EXPR_SUB            1
+#define EXPR_MUL            2
+#define EXPR_DIV            3
+#define EXPR_DEPTH          3       // values; operators are one fewer
+
+typedef uint8_t (*expr_fn_t)(arith_t *r, const arith_t *x, const arith_t *y);
+
+typedef struct {
+    expr_fn_t apply;
+    uint8_t precedence;
+} expr_op_t;
+
+arith_t expr_values[EXPR_DEPTH];
+uint8_t expr_value_count = 0;
+uint8_t expr_ops[EXPR_DEPTH - 1];
+uint8_t expr_op_count = 0;
+arith_t expr_remainder;                     // remainder of the last division
+
+uint8_t expr_div(arith_t *r, const arith_t *x, const arith_t *y);
+
+const expr_op_t expr_table[4] = {
+    {arith_add, 1},                         // EXPR_ADD
+    {arith_sub, 1},                         // EXPR_SUB
+    {arith_mul, 2},                         // EXPR_MUL
+    {expr_div, 2}                           // EXPR_DIV
+};
+
+void expr_clear(void);
+void expr_value(const arith_t *x);
+uint8_t expr_operator(uint8_t op);
+void expr_drop_operator(void);
+uint8_t expr_finish(arith_t *result);
+uint8_t expr_reduce(void);
+const arith_t *expr_top(void);
+
+void expr_clear(void) {
+    expr_value_count = 0;
+    expr_op_count = 0;
+    arith_clear(&expr_remainder);
+}
+
+// Next operand, after an operator or at the start
+void expr_value(const arith_t *x) {
+    expr_values[expr_value_count++] = *x;
+}
+
+/*
+ * This function is used to add an operator after a value, first applying
+ * the waiting ones that go before it.
+ * params: op (EXPR_ADD ... EXPR_DIV)
+ * return: ARITH_OK, or the error that ended the expression
+ */
+uint8_t expr_operator(uint8_t op) {
+    uint8_t precedence = expr_table[op].precedence;
+
+    while (expr_op_count > 0 && expr_table[expr_ops[expr_op_count - 1]].precedence >= precedence) {
+        uint8_t status = expr_reduce();
+        if (status != ARITH_OK)
+            return status;
+    }
+    expr_ops[expr_op_count++] = op;
+    return ARITH_OK;
+}
+
+// Takes back the last operator, when another one is typed in its place
+void expr_drop_operator(void) {
+    if (expr_op_count > 0)
+        expr_op_count--;
+}
+
+/*
+ * This function is used to apply every waiting operator, ending the
+ * expression.
+ * params: result (written only on ARITH_OK)
+ * return: ARITH_OK, or the error that ended the expression
+ */
+uint8_t expr_finish(arith_t *result) {
+    while (expr_op_count > 0) {
+        uint8_t status = expr_reduce();
+        if (status != ARITH_OK)
+            return status;
+    }
+    *result = expr_values[0];
+    expr_value_count = 0;
+    return ARITH_OK;
+}
+
+// Applies the top operator to the top two values
+uint8_t expr_reduce(void) {
+    arith_t *x = &expr_values[expr_value_count - 2];
+    uint8_t status = expr_table[expr_ops[--expr_op_count]].apply(x, x, x + 1);
+
+    if (status != ARITH_OK) {
+        expr_value_count = 0;
+        expr_op_count = 0;
+        return status;
+    }
+    expr_value_count--;
+    return ARITH_OK;
+}
+
+// Value the next operator will work on (the running result)
+const arith_t *expr_top(void) {
+    return &expr_values[expr_value_count - 1];
+}
+
+uint8_t expr_div(arith_t *r, const arith_t *x, const arith_t *y) {
+    return arith_div(r, &expr_remainder, x, y);
+}
+
+#endif /* EXPR_H */
@@ -0,0 +1,96 @@
+/*
+ * File:   keypad.h
+ * Author: Christian Gonzalez
+ *
+ * Interrupt-driven 4x4 keypad on PORTB (rows RB0-RB3, columns RB4-RB7),
+ * using the shared driver in Common/matrix_keypad.h.
+ *
+ * While no key is down all four rows are driven low, so any key pulls its
+ * column low and interrupt-on-change (falling edge on RB4-RB7) fires. The
+ * IOC ISR turns IOC off and starts Timer0, and every Timer0 tick scans one
+ * row with keypad_tick(). Once a whole scan finds the keypad empty, Timer0
+ * stops and IOC takes over again, so the core can sleep between keys.
+ *
+ * Timer0 runs from LFINTOSC in asynchronous mode, so it keeps counting (and
+ * wakes the core) while main() is in SLEEP.
+ */
+
+#ifndef KEYPAD_H
+#define KEYPAD_H
+
+#include <xc.h>
+#include <stdint.h>
+
+#define KEYPAD_PORT         B
+#define KEYPAD_ROWS         4
+#define KEYPAD_ROW_FIRST    0       // RB0-RB3
+#define KEYPAD_COLS         4
+#define KEYPAD_COL_FIRST    4       // RB4-RB7
+#define KEYPAD_LAYOUT   {                 \
+        {'1', '2', '3', 'A'},             \
+        {'4', '5', '6', 'B'},             \
+        {'7', '8', '9', 'C'},             \
+        {'*', '0', '#', 'D'}              \
+    }
+#define KEYPAD_QUEUE_SIZE   16      // press + release for 8 keys typed ahead
+
+#include "../Common/matrix_keypad.h"
+
+// Timer0 period in 8-bit mode for one row per tick: LFINTOSC (31 kHz) with a
+// 1:4 prescaler gives 15 counts = 1.9 ms, so a press is reported after two
+// scans (about 16 ms)
+#define KEYPAD_TICK_COUNTS  15
+
+void keypad_setup(void);
+void __interrupt(irq(IRQ_IOC), base(0x8)) IOC_ISR(void);
+void __interrupt(irq(IRQ_TMR0), base(0x8)) TMR0_ISR(void);
+
+/*
+ * This function is used to set up the keypad pins, IOC and Timer0.
+ * Interrupts still have to be turned on with INTCON0bits.GIE.
+ * params: none
+ * return: none
+ */
+void keypad_setup(void) {
+    keypad_init();
+    keypad_park();
+
+    // Timer0: off until a key goes down, 8-bit, 1:1 postscaler
+    T0CON0 = 0b00000000;
+    // LFINTOSC (CS = 100), asynchronous so it runs in Sleep, 1:4 prescaler
+    T0CON1 = 0b10010010;
+    TMR0H = KEYPAD_TICK_COUNTS - 1;
+    TMR0L = 0;
+    PIR3bits.TMR0IF = 0;
+    PIE3bits.TMR0IE = 1;
+
+    // Any column going low starts scanning
+    IOCBP = 0x00;
+    IOCBN = KEYPAD_COL_MASK;
+    IOCBF = 0x00;
+    PIE0bits.IOCIE = 1;
+}
+
+// A column went low: scan on Timer0 until the keypad is empty again
+void __interrupt(irq(IRQ_IOC), base(0x8)) IOC_ISR(void) {
+    PIE0bits.IOCIE = 0;
+    IOCBF = 0x00;
+    keypad_start();
+    TMR0L = 0;
+    T0CON0bits.EN = 1;
+}
+
+// One row per tick; after a full scan with nothing down, back to IOC
+void __interrupt(irq(IRQ_TMR0), base(0x8)) TMR0_ISR(void) {
+    PIR3bits.TMR0IF = 0;
+    keypad_tick();
+
+    if (keypad_row == 0 && keypad_idle()) {
+        T0CON0bits.EN = 0;
+        keypad_park();
+        IOCBF = 0x00;           // Edges from the scan itself
+        PIE0bits.IOCIE = 1;
+    }
+}
+
+#endif /* KEYPAD_H */
@@ -1,22 +1,40 @@
 /*
- * Title: 4x4 Keypad Calculator with LED Display
+ * Title: 4x4 Keypad Calculator with 7-Segment Display
  * ---------------------
  * Program Details:
  *  The purpose of this program is to read inputs from a 4x4 matrix keypad, perform 
  *  basic arithmetic operations (addition, subtraction, multiplication, and division), 
- *  and display the binary result on 8 LEDs.
- *  The calculator supports two-digit inputs for both operands, and the result is 
- *  displayed on PORTD (8 LEDs).
+ *  and display the result in decimal on 8 multiplexed 7-segment digits.
+ *  The calculator supports operands of up to 8 digits and signed results, and the
+ *  digits are driven from PORTD (segments) and PORTA (digit selects).
  * Inputs: Keypad (4x4 matrix keypad)
- * Outputs: PORTA (8 LEDs)
+ * Outputs: PORTD (segments a-g and point), PORTA (digit selects, RA0 = rightmost)
  * Setup: C-Simulator
  * Date: April 7, 2025
  * File Dependencies / Libraries: 
  *      - Header file "header.h" for microcontroller settings
+ *      - Header file "keypad.h" for the interrupt-driven keypad and key queue
+ *      - Shared keypad driver "../Common/matrix_keypad.h"
+ *      - Shared arithmetic "../Common/arith.h" for the N-digit signed operations
+ *      - Header file "display.h" for the 7-segment bank refreshed from Timer2
+ *      - Shared display driver "../Common/seg_display.h"
+ *      - Header file "expr.h" for the chained expressions (shunting-yard)
+ *      - Shared power states "../Common/power.h" for the module gating and Sleep
  * Compiler: xc8, 3.00
  * Author: Christian Gonzalez
  * Versions:
  *      V1.0: Initial implementation
+ *      V2.0: Keypad read from interrupts into a queue, core sleeps between keys
+ *      V2.1: Operands of up to 8 digits with signed results, remainders and explicit
+ *            overflow and divide-by-zero states (Common/arith.h)
+ *      V2.2: Results and operands on a multiplexed 8-digit 7-segment bank refreshed from
+ *            Timer2, in place of the 8 LEDs
+ *      V2.3: Keys dispatched through a table to an input state machine; chained expressions
+ *            with precedence and reuse of the last result (expr.h)
+ *      V2.4: Unused modules switched off in PMD0-PMD7 and the time in Run and Sleep
+ *            counted (Common/power.h)
+ *      V2.5: Runs on HFINTOSC at 4 MHz instead of the 32.768 kHz crystal, which left no
+ *            time for the display refresh and took RA6/RA7 from the digit selects
  * Useful links:
  *      Datasheet: https://ww1.microchip.com/downloads/en/DeviceDoc/PIC18(L)F26-27-45-46-47-55-56-57K42-Data-Sheet-40001919G.pdf 
  *      PIC18F Instruction Sets: https://onlinelibrary.wiley.com/doi/pdf/10.1002/9781119448457.app4 
@@ -24,32 +42,90 @@
  * 
  * Code Description:
  *  - The program scans the 4x4 keypad for key presses, which correspond to numbers or operators.
- *  - When a digit key (0-9) is pressed, the program updates the first or second operand based on the 
- *    current state.
+ *  - Every key is looked up in `key_table`, which gives the action it runs, so dispatch takes the
+ *    same time for every key. The actions move the input state (`Entry_State_REG`) along.
+ *  - When a digit key (0-9) is pressed, the program adds it to the operand being typed
+ *    (`Entry_REG`). Digits past the 8th are ignored.
  *  - Operation keys ('A' for addition, 'B' for subtraction, 'C' for multiplication, 'D' for division) 
- *    are stored in the `Operation_REG` variable.
- *  - Pressing the `#` key will trigger the calculation and display the result on the LEDs connected to PORTD.
+ *    end the operand. Any number of them can be chained, and 'C' and 'D' go before 'A' and 'B':
+ *    2 A 3 C 4 # is 14. Typing one straight after another replaces it, and starting with one
+ *    works on the last result ('C' 2 '#' doubles it).
+ *  - Pressing the `#` key will finish the expression and display the result. After an error
+ *    only `*` is taken.
+ *  - The arithmetic (Common/arith.h) works a byte at a time on the hardware multiplier, and every
+ *    result comes with a status in `Calc_Status_REG`: ARITH_OK, ARITH_OVERFLOW (more than 8 digits)
+ *    or ARITH_DIV_ZERO. A division also leaves its remainder in `expr_remainder`.
+ *  - The display shows the operand being typed. After an operation key it shows the result so
+ *    far, dimmed, until the next operand replaces it with its first digit. A result is shown in
+ *    decimal with a '-' in front; a negative result that needs all 8 digits shows its sign as
+ *    the point of the leftmost digit. An error shows "Err oF" (overflow) or "Err d0" (divide by 0).
  *  - Pressing the `*` key resets the calculator to its initial state.
  *  
  *  Keypad functionality:
  *  - Rows (RB0-RB3) are used as output to activate one row at a time.
  *  - Columns (RB4-RB7) are inputs used to detect which key is pressed.
- *  - The program scans the keypad by setting one row to LOW and checking each column to detect which key is pressed.
- *  - If a key is pressed, it updates the corresponding operand or operator, or performs the calculation.
- *  - After the calculation, the result is displayed on the 8 LEDs connected to PORTD.
+ *  - A key going down triggers interrupt-on-change on RB4-RB7. Timer0 then scans one row per
+ *    tick by setting it LOW and checking each column, and debounced presses are queued
+ *    (keypad.h, Common/matrix_keypad.h). Main takes keys from the queue and sleeps while it
+ *    is empty.
+ *  - If a key is pressed, it updates the operand, adds an operator, or finishes the expression.
+ *  - After the calculation, the result is displayed on the 7-segment digits.
+ *  
+ *  Display functionality:
+ *  - Timer2 interrupts refresh one digit per 1.024 ms slot from a RAM buffer (display.h,
+ *    Common/seg_display.h), 122 Hz per digit. Main only writes the buffer, and a digit can be
+ *    dimmed by lighting it for part of its slot.
  * 
  */
 
 #include <xc.h> // must have this
-#include "C:/Program Files/Microchip/xc8/v3.00/pic/include/proc/pic18f47k42.h"
 #include "header.h"
+#include "keypad.h"
+#include "display.h"
 
 #define _XTAL_FREQ 4000000                 // Fosc  frequency for _delay()  library
 #define FCY    _XTAL_FREQ/4
 
+#define ARITH_DIGITS    8                   // digits of an operand or a result
+#include "../Common/arith.h"
+
+// Modules left on: IOC, Timer0 (keypad scan), Timer2 (display refresh) and
+// Timer3 (power counts); everything else is off
+#define PWR_PMD0        (_PMD0_FVRMD_MASK | _PMD0_HLVDMD_MASK | _PMD0_CRCMD_MASK | \
+                         _PMD0_SCANMD_MASK | _PMD0_NVMMD_MASK | _PMD0_CLKRMD_MASK)
+#define PWR_PMD1        (_PMD1_NCO1MD_MASK | _PMD1_TMR1MD_MASK | _PMD1_TMR4MD_MASK | \
+                         _PMD1_TMR5MD_MASK | _PMD1_TMR6MD_MASK)
+#define PWR_PMD2        (_PMD2_DACMD_MASK | _PMD2_ADCMD_MASK | _PMD2_CMP1MD_MASK | \
+                         _PMD2_CMP2MD_MASK | _PMD2_ZCDMD_MASK)
+#define PWR_PMD3        (_PMD3_PWM5MD_MASK | _PMD3_PWM6MD_MASK | _PMD3_PWM7MD_MASK | \
+                         _PMD3_PWM8MD_MASK | _PMD3_CCP1MD_MASK | _PMD3_CCP2MD_MASK | \
+                         _PMD3_CCP3MD_MASK | _PMD3_CCP4MD_MASK)
+#define PWR_PMD4        (_PMD4_CWG1MD_MASK | _PMD4_CWG2MD_MASK | _PMD4_CWG3MD_MASK)
+#define PWR_PMD5        (_PMD5_SMT1MD_MASK | _PMD5_CLC1MD_MASK | _PMD5_CLC2MD_MASK | \
+                         _PMD5_CLC3MD_MASK | _PMD5_CLC4MD_MASK)
+#define PWR_PMD6        (_PMD6_U1MD_MASK | _PMD6_U2MD_MASK | _PMD6_SPI1MD_MASK | \
+                         _PMD6_I2C1MD_MASK | _PMD6_I2C2MD_MASK)
+#define PWR_PMD7        (_PMD7_DMA1MD_MASK | _PMD7_DMA2MD_MASK)
+#include "../Common/power.h"
+
+#include "expr.h"
+
+#define FIRST_DONE_LEVEL 2                  // brightness of a finished first operand (of DISPLAY_LEVELS)
+
+// Keys looked up in key_table, '#' (0x23) to 'D' (0x44)
+#define KEY_FIRST       '#'
+#define KEY_LAST        'D'
+
+// Input states
+#define ENTRY_START     0                   // waiting for the first digit of an operand
+#define ENTRY_NUMBER    1                   // digits going into Entry_REG
+#define ENTRY_RESULT    2                   // result shown: an operator goes on from it, a digit starts over
+#define ENTRY_ERROR     3                   // error shown: only '*' starts over
+
 // Keypad connections on PORTB
 // RB0-RB3 = Rows (outputs)
 // RB4-RB7 = Columns (inputs)
+// Scanned from interrupts, see keypad.h
 
 /*
  * This function is used to configure the microcontroller for inputs and outputs
@@ -57,148 +133,218 @@
  * return: N/A
  */
 void setup() {
-    // Setup keypad: RB0-RB3 as outputs (rows), RB4-RB7 as inputs (columns)
-    LATB = 0x0F;
-    ANSELB = 0x00;
-    TRISB = 0b11110000;  // Lower 4 bits output, upper 4 bits input
-    PORTB = 0xFF;        // Make sure PORTB is initialized
-
-    // Setup LEDs: PORTD as output
-    ANSELD = 0x00;
-    TRISD = 0x00;
-    LATD = 0x00;
-    PORTD = 0x00;
+    // Fosc 4 MHz: HFINTOSC at 4 MHz, divider 1:1 (the reset one is 4:1)
+    OSCFRQ = 0b00000010;
+    OSCCON1 = 0b01100000;   // NOSC = HFINTOSC, NDIV = 1:1
+
+    // Unused modules off, Timer3 counting the time in each power state
+    pwr_init();
+
+    // Setup keypad: rows, columns, IOC and the scan timer
+    keypad_setup();
+
+    // Setup display: segments on PORTD, digit selects on PORTA, Timer2 refresh
+    display_setup();
+
+    INTCON0bits.GIE = 1;    // Keypad and display interrupts on
 }
 
+// Global variables
+arith_t Entry_REG;          // Operand being typed
+arith_t Display_Result_REG; // Result of the last expression, reused when it starts with an operator
+uint8_t Calc_Status_REG = ARITH_OK; // Status of the last result (ARITH_OK, ARITH_OVERFLOW, ARITH_DIV_ZERO)
+uint8_t Entry_State_REG = ENTRY_START; // Input state (ENTRY_START ... ENTRY_ERROR)
+
+void keyDigit(uint8_t digit);
+void keyOperator(uint8_t op);
+void keyEquals(uint8_t unused);
+void keyClear(uint8_t unused);
+
+// What each key does: one lookup, whatever the key (0 = key ignored)
+typedef struct {
+    void (*action)(uint8_t arg);
+    uint8_t arg;
+} key_entry_t;
+
+const key_entry_t key_table[KEY_LAST - KEY_FIRST + 1] = {
+    ['0' - KEY_FIRST] = {keyDigit, 0},
+    ['1' - KEY_FIRST] = {keyDigit, 1},
+    ['2' - KEY_FIRST] = {keyDigit, 2},
+    ['3' - KEY_FIRST] = {keyDigit, 3},
+    ['4' - KEY_FIRST] = {keyDigit, 4},
+    ['5' - KEY_FIRST] = {keyDigit, 5},
+    ['6' - KEY_FIRST] = {keyDigit, 6},
+    ['7' - KEY_FIRST] = {keyDigit, 7},
+    ['8' - KEY_FIRST] = {keyDigit, 8},
+    ['9' - KEY_FIRST] = {keyDigit, 9},
+    ['A' - KEY_FIRST] = {keyOperator, EXPR_ADD},
+    ['B' - KEY_FIRST] = {keyOperator, EXPR_SUB},
+    ['C' - KEY_FIRST] = {keyOperator, EXPR_MUL},
+    ['D' - KEY_FIRST] = {keyOperator, EXPR_DIV},
+    ['#' - KEY_FIRST] = {keyEquals, 0},
+    ['*' - KEY_FIRST] = {keyClear, 0}
+};
+
 /*
- * This function is used to scan the keypad for inputs using row activation
- * (checks row by row).
- * params: none
- * return: key pressed
+ * This function is used to put a number in the display buffer, right-aligned
+ * with a '-' in front (or the point of the leftmost digit if it needs all 8)
+ * params: value: the number, level: brightness of every digit
+ * return: none
  */
-char getKeyPressed() {
-    char keys[4][4] = {
-        {'1', '2', '3', 'A'},
-        {'4', '5', '6', 'B'},
-        {'7', '8', '9', 'C'},
-        {'*', '0', '#', 'D'}
-    };
-
-    // Array for row output patterns to check rows one by one
-    unsigned char row_values[4] = {0b11111110, 0b11111101, 0b11111011, 0b11110111};
-
-    for (int row = 0; row < 4; row++) {
-        LATB = row_values[row]; // Set one row LOW, others HIGH
-        //__delay_ms(5);          // Make sure there's no misinterpretation
-
-        // Depending on he key pressed, will return the corresponding char from the 
-        // keys 2D array
-        if (!PORTBbits.RB4) return keys[row][0];
-        if (!PORTBbits.RB5) return keys[row][1];
-        if (!PORTBbits.RB6) return keys[row][2];
-        if (!PORTBbits.RB7) return keys[row][3];
-    }
+void displayNumber(const arith_t *value, uint8_t level) {
+    char digits[ARITH_DIGITS];
+    uint8_t count = arith_digits(digits, value);
 
-    return 0; // No key is pressed
+    display_clear();
+    for (uint8_t i = 0; i < DISPLAY_DIGITS; i++)
+        display_brightness(i, level);
+    for (uint8_t i = 0; i < count; i++)
+        display_set(i, display_glyph(digits[ARITH_DIGITS - 1 - i]));
+    if (value->neg) {
+        if (count < DISPLAY_DIGITS)
+            display_set(count, DISPLAY_MINUS);
+        else
+            display_set(DISPLAY_DIGITS - 1, display_buffer[DISPLAY_DIGITS - 1] | DISPLAY_POINT);
+    }
 }
 
-// Global variables
-int X_Input_REG = 0;        // First input
-int Y_Input_REG = 0;        // Second input
-int Display_Result_REG = 0; // Result
-char Operation_REG = 0;     // Type of operation (Holds A-D)
-int digitCount = 0;         // Keeps track of how many digits have been input for each operand
-int isSecond = 0;           // Keeps track of whether we are on the second operand
-
 /*
- * This function is used to reset all variables and LEDs
+ * This function is used to reset all variables and the display
  * params: none
  * return: none
  */
 void resetAll() {
-    X_Input_REG = 0;
-    Y_Input_REG = 0;
-    Display_Result_REG = 0;
-    Operation_REG = 0;
-    digitCount = 0;
-    isSecond = 0;
-    PORTD = 0x00; // Turn off LEDs
+    arith_clear(&Entry_REG);
+    arith_clear(&Display_Result_REG);
+    expr_clear();
+    Calc_Status_REG = ARITH_OK;
+    Entry_State_REG = ENTRY_START;
+    displayNumber(&Entry_REG, DISPLAY_LEVELS); // Show 0
+}
+
+/*
+ * This function is used to show the result, or the error in its place
+ * params: status: how the calculation went, value: the result
+ * return: none
+ */void displayResult(uint8_t status, const arith_t *value) {
+    if (status == ARITH_OK) {
+        displayNumber(value, DISPLAY_LEVELS);
+        return;
+    }
+    for (uint8_t i = 0; i < DISPLAY_DIGITS; i++)
+        display_brightness(i, DISPLAY_LEVELS);
+    display_text(status == ARITH_OVERFLOW ? "Err oF" : "Err d0");
+}
+
+/*
+ * This function is used to end the expression on an error: there is no
+ * result, not even the one before it
+ * params: status: the error
+ * return: none
+ */
+void showError(uint8_t status) {
+    Calc_Status_REG = status;
+    arith_clear(&Display_Result_REG);
+    Entry_State_REG = ENTRY_ERROR;
+    displayResult(status, &Display_Result_REG);
 }
 
 /*
- * This function is used to show the result in binary on the 8 LEDs
- * params: value: the result in hex
+ * This function is used for a digit key: it starts a new operand, or a new
+ * expression after a result, and adds the digit to it. A digit that would
+ * make the operand longer than ARITH_DIGITS is ignored.
+ * params: digit: 0-9
  * return: none
- */void displayOnLEDs(int value) {
-    if (value < 0)          // If the result is negative we negate the result and add 1
-        value = ~value + 1; // This is the same as 2s complement
-    PORTD = (char)value;    // Output the result to the LEDs, char because only need 8 bits
+ */
+void keyDigit(uint8_t digit) {
+    if (Entry_State_REG == ENTRY_ERROR)
+        return;
+    if (Entry_State_REG == ENTRY_RESULT)
+        expr_clear();
+    if (Entry_State_REG != ENTRY_NUMBER) {
+        arith_clear(&Entry_REG);
+        Entry_State_REG = ENTRY_NUMBER;
+    }
+    arith_digit(&Entry_REG, digit);
+    displayNumber(&Entry_REG, DISPLAY_LEVELS);
 }
 
 /*
- * This function is used to do the calculation needed based on the inputs
+ * This function is used for an operation key. It ends the operand typed (or
+ * takes the last result when the expression starts with it, or replaces an
+ * operator typed just before), applies what goes before it and shows the
+ * running result dimmed until the next operand is typed.
+ * params: op: EXPR_ADD ... EXPR_DIV
+ * return: none
+ */
+void keyOperator(uint8_t op) {
+    uint8_t status;
+
+    if (Entry_State_REG == ENTRY_ERROR)
+        return;
+    if (Entry_State_REG == ENTRY_NUMBER)
+        expr_value(&Entry_REG);
+    else if (Entry_State_REG == ENTRY_START && expr_op_count > 0)
+        expr_drop_operator();
+    else if (expr_value_count == 0)
+        expr_value(&Display_Result_REG);
+
+    status = expr_operator(op);
+    if (status != ARITH_OK) {
+        showError(status);
+        return;
+    }
+    Entry_State_REG = ENTRY_START;
+    displayNumber(expr_top(), FIRST_DONE_LEVEL);
+}
+
+/*
+ * This function is used for '#': it finishes the expression and shows the
+ * result. An operator with nothing after it is dropped.
  * params: none
  * return: none
- */void calculate() {
-    if (Operation_REG == 'A') Display_Result_REG = X_Input_REG + Y_Input_REG;      
-    else if (Operation_REG == 'B') Display_Result_REG = X_Input_REG - Y_Input_REG;  
-    else if (Operation_REG == 'C') Display_Result_REG = X_Input_REG * Y_Input_REG;
-    else if (Operation_REG == 'D' && Y_Input_REG != 0) Display_Result_REG = X_Input_REG / Y_Input_REG;
+ */
+void keyEquals(uint8_t unused) {
+    uint8_t status;
 
-    displayOnLEDs(Display_Result_REG);  
-    
-    // Reset variables to 0. Similar to resetAll but resetAll turns LEDs off too
-    // Not necessarily needed as reset when * is pressed, just precaution
-    X_Input_REG = 0;
-    Y_Input_REG = 0;
-    digitCount = 0;
-    isSecond = 0;
+    if (Entry_State_REG == ENTRY_RESULT || Entry_State_REG == ENTRY_ERROR)
+        return;
+    if (Entry_State_REG == ENTRY_NUMBER)
+        expr_value(&Entry_REG);
+    else if (expr_op_count > 0)
+        expr_drop_operator();
+    else if (expr_value_count == 0)
+        expr_value(&Display_Result_REG);
+
+    status = expr_finish(&Display_Result_REG);
+    if (status != ARITH_OK) {
+        showError(status);
+        return;
+    }
+    Calc_Status_REG = ARITH_OK;
+    Entry_State_REG = ENTRY_RESULT;
+    displayResult(ARITH_OK, &Display_Result_REG);
+}
+
+void keyClear(uint8_t unused) {
+    resetAll();
 }
 
  /*
-  * This function is used to handle the input from the keypad. If it is a digit
-  * it places it it in its corresponding operand variable. If it is a letter, it 
-  * places it in the operation variable. If it is # it calculates. And if it is 
-  * *, then it resets everything.
+  * This function is used to handle the input from the keypad: the key is
+  * looked up in key_table and its action runs, so every key takes the same
+  * path whatever it is.
   * params: key: the input from the keyboard
   * return: none
   */
 void handleInput(char key) {
-    // If digit
-    if (key >= '0' && key <= '9') {
-        if (isSecond == 0) {
-            X_Input_REG = (X_Input_REG * 10) + (key - '0');
-            digitCount++;
-            if (digitCount == 2) {
-                isSecond = 1;
-                digitCount = 0;
-                PORTD = 0x01; // LED1 ON
-            }
-        } else {
-            Y_Input_REG = (Y_Input_REG * 10) + (key - '0');
-            digitCount++;
-            if (digitCount == 2) {
-                digitCount = 0;
-                PORTD = 0x02; // LED2 ON
-            }
-        }
-    }
-
-    // If operation key
-    else if (key == 'A' || key == 'B' || key == 'C' || key == 'D') {
-        Operation_REG = key;
-    }
+    const key_entry_t *entry;
 
-    // If '#' = calculate
-    else if (key == '#') {
-        PORTD = 0x00;
-        calculate();
-    }
-
-    // If '*' = reset
-    else if (key == '*') {
-        resetAll();
-    }
+    if (key < KEY_FIRST || key > KEY_LAST)
+        return;
+    entry = &key_table[key - KEY_FIRST];
+    if (entry->action != 0)
+        entry->action(entry->arg);
 }
 
 /*
@@ -227,11 +373,19 @@ void main(void) {
     
     
     while (1) {
-        char key = getKeyPressed();     // Variable for key pressed
-        if (key != 0) {             
+        char key = keypad_get();        // Oldest key from the interrupt queue
+        if (key != 0) {
             handleInput(key);
-            //__delay_ms(300);            // Not really needed as we have the next line (precaution))
-            while (getKeyPressed());    // Wait until key released for no issues
+        } else {
+            // Nothing to do: sleep until IOC, Timer0 or the Timer2 display
+            // refresh wakes us (the refresh only runs its ISR). Interrupts
+            // are off across the check so a key queued just before SLEEP
+            // still wakes the core (a set flag ends Sleep even with GIE = 0).
+            // Sleep, not Idle: both timers run on the internal oscillators
+            di();
+            if (keypad_tail == keypad_head)
+                pwr_wait(PWR_SLEEP);
+            ei();
         }
     }
 }
\ No newline at end of file
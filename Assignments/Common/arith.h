@@ -0,0 +1,366 @@
+/*
+ * File:   arith.h
+ * Author: Christian Gonzalez
+ *
+ * Signed arithmetic on decimal numbers of up to ARITH_DIGITS digits, with
+ * a status for every result instead of a wrong value. Include this file
+ * once after setting:
+ *
+ *   ARITH_DIGITS       digits of an operand or a result, 1 to 9 (default 8)
+ *
+ * A number (arith_t) is a sign and a binary magnitude of ARITH_BYTES
+ * bytes, least significant first: 1 byte for up to 2 digits, 2 for up to
+ * 4 and 4 for up to 9. Every routine works one byte at a time. Products
+ * are 8 x 8 bit, which XC8 turns into one MULWF (MULLW for the x10 of
+ * arith_digit()) with the result in PRODH:PRODL, and division is shift and
+ * subtract over the significant bytes of the dividend only, so XC8's
+ * software divide (__awdiv, __aldiv and friends) is never pulled in and
+ * short operands cost less than long ones.
+ *
+ *   ARITH_OK           the result is in range
+ *   ARITH_OVERFLOW     the result needs more than ARITH_DIGITS digits
+ *   ARITH_DIV_ZERO     the divisor was 0
+ *
+ * The result is only written when the status is ARITH_OK, and it may be
+ * one of the operands. Division truncates toward zero and the remainder
+ * takes the sign of the dividend, as in C.
+ *
+ * arith_digits() gives the decimal digits of a result for display by
+ * subtracting powers of ten, so that has no division either.
+ *
+ * ARITH_COST(cycles) is called once per step with the cycles of the PIC18
+ * code the step stands for (FSRs with POSTINC, MULWF into PRODH:PRODL).
+ * It does nothing on the chip; HostSim defines it to advance its clock so
+ * the routines can be timed there.
+ */
+
+#ifndef ARITH_H
+#define ARITH_H
+
+#include <xc.h>
+#include <stdint.h>
+
+#ifndef ARITH_DIGITS
+#define ARITH_DIGITS        8
+#endif
+#ifndef ARITH_COST
+#define ARITH_COST(cycles)
+#endif
+
+#if ARITH_DIGITS < 1 || ARITH_DIGITS > 9
+#error "ARITH_DIGITS must be 1 to 9"
+#elif ARITH_DIGITS <= 2
+#define ARITH_BYTES         1
+#elif ARITH_DIGITS <= 4
+#define ARITH_BYTES         2
+#else
+#define ARITH_BYTES         4
+#endif
+
+#if ARITH_DIGITS == 1
+#define ARITH_MAX           9UL
+#elif ARITH_DIGITS == 2
+#define ARITH_MAX           99UL
+#elif ARITH_DIGITS == 3
+#define ARITH_MAX           999UL
+#elif ARITH_DIGITS == 4
+#define ARITH_MAX           9999UL
+#elif ARITH_DIGITS == 5
+#define ARITH_MAX           99999UL
+#elif ARITH_DIGITS == 6
+#define ARITH_MAX           999999UL
+#elif ARITH_DIGITS == 7
+#define ARITH_MAX           9999999UL
+#elif ARITH_DIGITS == 8
+#define ARITH_MAX           99999999UL
+#else
+#define ARITH_MAX           999999999UL
+#endif
+
+#define ARITH_OK            0
+#define ARITH_OVERFLOW      1
+#define ARITH_DIV_ZERO      2
+
+#define ARITH_BYTE_CYCLES   5       // one byte of an add, subtract, compare or shift loop
+#define ARITH_MUL_CYCLES    12      // one MULWF product added into the partial product
+#define ARITH_CALL_CYCLES   10      // call, return and pointer set-up of a routine
+
+// 8 x 8 bit product: one MULWF (or MULLW with a constant)
+#define ARITH_MUL8(a, b)    ((uint16_t)(uint8_t)(a) * (uint8_t)(b))
+#define ARITH_BYTE(v, i)    ((uint8_t)((v) >> (8 * (i))))
+
+const uint32_t arith_power[8] = {100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10};
+
+typedef struct {
+    uint8_t neg;                    // 1 = negative, never set on 0
+    uint8_t mag[ARITH_BYTES];       // magnitude, least significant byte first
+} arith_t;
+
+#if ARITH_BYTES == 1
+const uint8_t arith_max[ARITH_BYTES] = { ARITH_BYTE(ARITH_MAX, 0) };
+#elif ARITH_BYTES == 2
+const uint8_t arith_max[ARITH_BYTES] = { ARITH_BYTE(ARITH_MAX, 0), ARITH_BYTE(ARITH_MAX, 1) };
+#else
+const uint8_t arith_max[ARITH_BYTES] = { ARITH_BYTE(ARITH_MAX, 0), ARITH_BYTE(ARITH_MAX, 1),
+                                         ARITH_BYTE(ARITH_MAX, 2), ARITH_BYTE(ARITH_MAX, 3) };
+#endif
+
+void arith_clear(arith_t *x);
+uint8_t arith_is_zero(const arith_t *x);
+int32_t arith_to_long(const arith_t *x);
+uint8_t arith_digits(char *digits, const arith_t *x);
+uint8_t arith_digit(arith_t *x, uint8_t digit);
+uint8_t arith_add(arith_t *r, const arith_t *x, const arith_t *y);
+uint8_t arith_sub(arith_t *r, const arith_t *x, const arith_t *y);
+uint8_t arith_mul(arith_t *r, const arith_t *x, const arith_t *y);
+uint8_t arith_div(arith_t *q, arith_t *rem, const arith_t *x, const arith_t *y);
+int8_t arith_compare(const uint8_t *a, const uint8_t *b);
+uint8_t arith_add_mag(uint8_t *sum, const uint8_t *a, const uint8_t *b);
+void arith_sub_mag(uint8_t *diff, const uint8_t *a, const uint8_t *b);
+uint8_t arith_add_signed(arith_t *r, const arith_t *x, const arith_t *y, uint8_t y_neg);
+void arith_store(arith_t *r, const uint8_t *mag, uint8_t neg);
+
+void arith_clear(arith_t *x) {
+    for (uint8_t i = 0; i < ARITH_BYTES; i++)
+        x->mag[i] = 0;
+    x->neg = 0;
+}
+
+uint8_t arith_is_zero(const arith_t *x) {
+    for (uint8_t i = 0; i < ARITH_BYTES; i++)
+        if (x->mag[i] != 0)
+            return 0;
+    return 1;
+}
+
+// Whole value as a long, for display (never more than 999999999)
+int32_t arith_to_long(const arith_t *x) {
+    uint32_t value = 0;
+
+    for (uint8_t i = ARITH_BYTES; i-- > 0;)
+        value = (value << 8) | x->mag[i];
+    return x->neg ? -(int32_t)value : (int32_t)value;
+}
+
+/*
+ * This function is used to split the magnitude of x into its ARITH_DIGITS
+ * decimal digits, leading zeros included.
+ * params: ARITH_DIGITS-char digit buffer, x
+ * return: digits without the leading zeros (at least 1)
+ */
+uint8_t arith_digits(char *digits, const arith_t *x) {
+    uint32_t value = 0;
+    uint8_t count = 0;
+
+    for (uint8_t i = ARITH_BYTES; i-- > 0;)
+        value = (value << 8) | x->mag[i];
+    for (uint8_t i = 0; i < ARITH_DIGITS - 1; i++) {
+        uint32_t power = arith_power[i + 9 - ARITH_DIGITS];
+        char digit = '0';
+        while (value >= power) {
+            value -= power;
+            digit++;
+        }
+        digits[i] = digit;
+        if (count == 0 && digit != '0')
+            count = ARITH_DIGITS - i;
+    }
+    digits[ARITH_DIGITS - 1] = '0' + (char)value;
+    return count ? count : 1;
+}
+
+/*
+ * This function is used to enter a number a digit at a time: x = 10x + digit.
+ * params: x, digit 0-9
+ * return: ARITH_OK, or ARITH_OVERFLOW with x unchanged
+ */
+uint8_t arith_digit(arith_t *x, uint8_t digit) {
+    uint8_t mag[ARITH_BYTES];
+    uint8_t carry = digit;
+
+    ARITH_COST(ARITH_CALL_CYCLES);
+    for (uint8_t i = 0; i < ARITH_BYTES; i++) {
+        uint16_t p = ARITH_MUL8(x->mag[i], 10) + carry;
+        mag[i] = (uint8_t)p;
+        carry = (uint8_t)(p >> 8);
+        ARITH_COST(ARITH_MUL_CYCLES);
+    }
+    if (carry != 0 || arith_compare(mag, arith_max) > 0)
+        return ARITH_OVERFLOW;
+    arith_store(x, mag, x->neg);
+    return ARITH_OK;
+}
+
+uint8_t arith_add(arith_t *r, const arith_t *x, const arith_t *y) {
+    return arith_add_signed(r, x, y, y->neg);
+}
+
+uint8_t arith_sub(arith_t *r, const arith_t *x, const arith_t *y) {
+    return arith_add_signed(r, x, y, y->neg ^ 1);
+}
+
+/*
+ * This function is used to multiply, a row of MULWF products for each
+ * non-zero byte of x, into a product twice as wide.
+ * params: result, x, y
+ * return: ARITH_OK or ARITH_OVERFLOW
+ */
+uint8_t arith_mul(arith_t *r, const arith_t *x, const arith_t *y) {
+    uint8_t product[2 * ARITH_BYTES];
+
+    ARITH_COST(ARITH_CALL_CYCLES);
+    for (uint8_t i = 0; i < 2 * ARITH_BYTES; i++)
+        product[i] = 0;
+    for (uint8_t i = 0; i < ARITH_BYTES; i++) {
+        uint8_t a = x->mag[i];
+        uint8_t carry = 0;
+
+        ARITH_COST(ARITH_BYTE_CYCLES);
+        if (a == 0)
+            continue;
+        for (uint8_t j = 0; j < ARITH_BYTES; j++) {
+            // At most 0xFE01 + 0xFF + 0xFF, so it never leaves 16 bits
+            uint16_t p = ARITH_MUL8(a, y->mag[j]) + product[i + j] + carry;
+            product[i + j] = (uint8_t)p;
+            carry = (uint8_t)(p >> 8);
+            ARITH_COST(ARITH_MUL_CYCLES);
+        }
+        product[i + ARITH_BYTES] = carry;
+    }
+
+    for (uint8_t i = ARITH_BYTES; i < 2 * ARITH_BYTES; i++)
+        if (product[i] != 0)
+            return ARITH_OVERFLOW;
+    if (arith_compare(product, arith_max) > 0)
+        return ARITH_OVERFLOW;
+    arith_store(r, product, x->neg ^ y->neg);
+    return ARITH_OK;
+}
+
+/*
+ * This function is used to divide by shift and subtract: the bits of x go
+ * one at a time from the top into a running remainder, and each time y
+ * fits it is taken away and a 1 goes into the quotient.
+ * params: quotient, remainder (or 0 when not needed), x, y
+ * return: ARITH_OK or ARITH_DIV_ZERO
+ */
+uint8_t arith_div(arith_t *q, arith_t *rem, const arith_t *x, const arith_t *y) {
+    uint8_t quot[ARITH_BYTES];
+    uint8_t part[ARITH_BYTES];     // running remainder, below 2y so never past 31 bits
+    uint8_t top = ARITH_BYTES;
+    uint8_t q_neg = x->neg ^ y->neg;
+    uint8_t rem_neg = x->neg;
+
+    ARITH_COST(ARITH_CALL_CYCLES);
+    if (arith_is_zero(y))
+        return ARITH_DIV_ZERO;
+    for (uint8_t i = 0; i < ARITH_BYTES; i++) {
+        quot[i] = x->mag[i];
+        part[i] = 0;
+    }
+    while (top > 0 && quot[top - 1] == 0) {
+        top--;
+        ARITH_COST(ARITH_BYTE_CYCLES);
+    }
+
+    for (uint8_t bits = top * 8; bits > 0; bits--) {
+        uint8_t carry = 0;
+
+        // part:quot one bit left, the quotient bits filling quot from the bottom
+        for (uint8_t i = 0; i < top; i++) {
+            uint8_t out = quot[i] >> 7;
+            quot[i] = (uint8_t)(quot[i] << 1) | carry;
+            carry = out;
+            ARITH_COST(ARITH_BYTE_CYCLES);
+        }
+        for (uint8_t i = 0; i < ARITH_BYTES; i++) {
+            uint8_t out = part[i] >> 7;
+            part[i] = (uint8_t)(part[i] << 1) | carry;
+            carry = out;
+            ARITH_COST(ARITH_BYTE_CYCLES);
+        }
+        if (arith_compare(part, y->mag) >= 0) {
+            arith_sub_mag(part, part, y->mag);
+            quot[0] |= 1;
+        }
+    }
+
+    if (rem != 0)
+        arith_store(rem, part, rem_neg);
+    arith_store(q, quot, q_neg);
+    return ARITH_OK;
+}
+
+// Compares two magnitudes from the top byte down: -1, 0 or 1
+int8_t arith_compare(const uint8_t *a, const uint8_t *b) {
+    for (uint8_t i = ARITH_BYTES; i-- > 0;) {
+        ARITH_COST(ARITH_BYTE_CYCLES);
+        if (a[i] != b[i])
+            return a[i] > b[i] ? 1 : -1;
+    }
+    return 0;
+}
+
+// sum = a + b, returns the carry out of the top byte
+uint8_t arith_add_mag(uint8_t *sum, const uint8_t *a, const uint8_t *b) {
+    uint8_t carry = 0;
+
+    for (uint8_t i = 0; i < ARITH_BYTES; i++) {
+        uint16_t s = (uint16_t)a[i] + b[i] + carry;
+        sum[i] = (uint8_t)s;
+        carry = (uint8_t)(s >> 8);
+        ARITH_COST(ARITH_BYTE_CYCLES);
+    }
+    return carry;
+}
+
+// diff = a - b, for a >= b
+void arith_sub_mag(uint8_t *diff, const uint8_t *a, const uint8_t *b) {
+    uint8_t borrow = 0;
+
+    for (uint8_t i = 0; i < ARITH_BYTES; i++) {
+        uint16_t d = (uint16_t)a[i] - b[i] - borrow;
+        diff[i] = (uint8_t)d;
+        borrow = (uint8_t)(d >> 8) & 1;
+        ARITH_COST(ARITH_BYTE_CYCLES);
+    }
+}
+
+/*
+ * This function is used for both add and subtract: x + y with the sign of
+ * y given apart. Equal signs add the magnitudes, different ones take the
+ * smaller from the larger.
+ * params: result, x, y, sign of y (1 = negative)
+ * return: ARITH_OK or ARITH_OVERFLOW
+ */
+uint8_t arith_add_signed(arith_t *r, const arith_t *x, const arith_t *y, uint8_t y_neg) {
+    uint8_t mag[ARITH_BYTES];
+
+    ARITH_COST(ARITH_CALL_CYCLES);
+    if (x->neg == y_neg) {
+        if (arith_add_mag(mag, x->mag, y->mag) != 0 || arith_compare(mag, arith_max) > 0)
+            return ARITH_OVERFLOW;
+        arith_store(r, mag, y_neg);
+    } else if (arith_compare(x->mag, y->mag) >= 0) {
+        arith_sub_mag(mag, x->mag, y->mag);
+        arith_store(r, mag, x->neg);
+    } else {
+        arith_sub_mag(mag, y->mag, x->mag);
+        arith_store(r, mag, y_neg);
+    }
+    return ARITH_OK;
+}
+
+// Copies a finished magnitude into r, with no sign on 0
+void arith_store(arith_t *r, const uint8_t *mag, uint8_t neg) {
+    uint8_t any = 0;
+
+    for (uint8_t i = 0; i < ARITH_BYTES; i++) {
+        r->mag[i] = mag[i];
+        any |= mag[i];
+        ARITH_COST(ARITH_BYTE_CYCLES);
+    }
+    r->neg = any ? neg : 0;
+}
+
+#endif /* ARITH_H */
@@ -0,0 +1,37 @@
+/*
+ * File:   bcd.h
+ * Author: Christian Gonzalez
+ *
+ * C side of Common/bcd.s, the constant-time binary to BCD routines: add
+ * bcd.s to the project's source files and include this header. The
+ * routines take no arguments and return nothing; they work on the
+ * registers below, as the assembly projects call them:
+ *
+ *   bcd_value = (uint16_t)temperature;
+ *   bcd_s16();
+ *   ones = bcd_digits[0]; ... negative = bcd_sign;
+ *
+ * bcd_u8() and bcd_s8() only read the low byte of bcd_value. The digits
+ * are unpacked BCD, ones first; bcd_sign is 1 for a negative number and
+ * the digits are those of its magnitude. See bcd.s for the cycle counts
+ * and the registers it uses. The routines are not reentrant, so call them
+ * from main() or from one ISR, not both.
+ */
+
+#ifndef BCD_H
+#define BCD_H
+
+#include <stdint.h>
+
+#define BCD_DIGITS          5
+
+extern uint16_t bcd_value;
+extern uint8_t bcd_digits[BCD_DIGITS];
+extern uint8_t bcd_sign;
+
+void bcd_u8(void);
+void bcd_s8(void);
+void bcd_u16(void);
+void bcd_s16(void);
+
+#endif /* BCD_H */
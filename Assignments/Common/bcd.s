@@ -0,0 +1,193 @@
+;-------------------------
+; Title: Binary to BCD
+;-------------------------
+; Program Details:
+; Splits an 8-bit or 16-bit number, signed or unsigned, into its decimal
+;    digits in a fixed number of cycles, whatever the value. Each digit is a
+;    division by 10 done as a multiply by the reciprocal with MULLW (no
+;    repeated subtraction and no loop), so the routines are bounded:
+;       _bcd_u8, _bcd_s8     25 / 31 cycles
+;       _bcd_u16, _bcd_s16   156 / 168 cycles
+;    counted from the first instruction to the RETURN, plus 2 for the CALL.
+;
+;    x / 10 = (x * 205) >> 11           for x up to 1028 (8-bit)
+;    x / 10 = (x * 0xCCCD) >> 19        for every 16-bit x
+;    x / 10 = (x * 26) >> 8             for x up to 68 (last two digits)
+;    x % 10 = x - 10 * (x / 10), on the low byte only
+;
+;    The SFRs are read with MOVF, not MOVFF: on the K42 MOVFF only reaches
+;    0x000-0xFFF, below PRODH:PRODL.
+;
+; Register contract:
+;   In:   _bcd_value      number, low byte first (the 8-bit routines only
+;                         read the low byte); signed routines take it as
+;                         two's complement
+;   Out:  _bcd_digits     5 unpacked BCD digits, ones first; digits 3 and 4
+;                         are 0 for the 8-bit routines
+;         _bcd_sign       1 if the number was negative, else 0 (the digits
+;                         are those of the magnitude, -128 and -32768 included)
+;   Uses: W, STATUS, PRODH:PRODL and its own scratch registers
+;   Keeps: BSR, FSR0-FSR2, TBLPTR and _bcd_value. Every register is reached
+;         through the access bank, so BSR can be left anywhere.
+;   Stack: 1 level for the 8-bit routines, 2 for the 16-bit ones.
+;   Not reentrant: call it from the main loop or from an ISR, not both.
+;
+; From C (XC8) include bcd.h, which names the same registers without the
+;    leading underscore:  bcd_value = t; bcd_s8(); ... bcd_digits[0] ...
+; From assembly:          MOVFF t, _bcd_value
+;                         CALL  _bcd_u8
+;
+; Compiler: pic-as, 3.0
+; Author: Christian Gonzalez
+; Versions:
+;       V1.0: First implementation (replaces CONVERT_DECIMAL of HVAC_Control_System.X)
+
+#include <xc.inc>
+
+    GLOBAL  _bcd_value, _bcd_digits, _bcd_sign
+    GLOBAL  _bcd_u8, _bcd_s8, _bcd_u16, _bcd_s16
+
+;---------------------
+; Memory Register Assignments (access RAM, placed by the linker)
+;---------------------
+    PSECT   udata_acs
+_bcd_value:     DS  2       ; number to convert, low byte first
+_bcd_digits:    DS  5       ; ones, tens, hundreds, thousands, ten thousands
+_bcd_sign:      DS  1       ; 1 = negative
+bcd_n:          DS  2       ; number left to divide
+bcd_r:          DS  3       ; bytes 1-3 of the reciprocal product (mask in bcd_r for _bcd_s16)
+
+    PSECT   bcd_code,class=CODE,reloc=2
+
+;---------------------
+; 8-bit: _bcd_value low byte -> 3 digits
+;---------------------
+_bcd_s8:
+    CLRF    _bcd_sign, c
+    BTFSC   _bcd_value, 7, c    ; skip or not, 2 cycles either way
+    INCF    _bcd_sign, f, c
+    MOVF    _bcd_value, w, c
+    BTFSC   _bcd_sign, 0, c
+    NEGF    WREG, c             ; magnitude, 128 for -128
+    BRA     bcd_byte
+
+_bcd_u8:
+    CLRF    _bcd_sign, c
+    MOVF    _bcd_value, w, c
+
+bcd_byte:                       ; n in W
+    MOVWF   bcd_n, c
+    MULLW   205                 ; q = (n * 205) >> 11
+    RRNCF   PRODH, w, c
+    RRNCF   WREG, w, c
+    RRNCF   WREG, w, c
+    ANDLW   0x1F
+    MOVWF   bcd_n+1, c          ; q, 0-25
+    MULLW   10
+    MOVF    PRODL, w, c
+    SUBWF   bcd_n, w, c         ; ones = n - 10q
+    MOVWF   _bcd_digits, c
+    MOVF    bcd_n+1, w, c
+    MULLW   26                  ; hundreds = (q * 26) >> 8
+    MOVF    PRODH, w, c
+    MOVWF   _bcd_digits+2, c
+    MULLW   10
+    MOVF    PRODL, w, c
+    SUBWF   bcd_n+1, w, c       ; tens = q - 10 * hundreds
+    MOVWF   _bcd_digits+1, c
+    CLRF    _bcd_digits+3, c
+    CLRF    _bcd_digits+4, c
+    RETURN
+
+;---------------------
+; 16-bit: _bcd_value -> 5 digits
+;---------------------
+_bcd_s16:
+    CLRF    _bcd_sign, c
+    BTFSC   _bcd_value+1, 7, c
+    INCF    _bcd_sign, f, c
+    MOVF    _bcd_sign, w, c     ; magnitude = (value ^ mask) + sign,
+    NEGF    WREG, c             ; mask = 0x00 or 0xFF
+    MOVWF   bcd_r, c
+    XORWF   _bcd_value, w, c
+    MOVWF   bcd_n, c
+    MOVF    bcd_r, w, c
+    XORWF   _bcd_value+1, w, c
+    MOVWF   bcd_n+1, c
+    MOVF    _bcd_sign, w, c
+    ADDWF   bcd_n, f, c
+    MOVLW   0
+    ADDWFC  bcd_n+1, f, c
+    BRA     bcd_word
+
+_bcd_u16:
+    CLRF    _bcd_sign, c
+    MOVFF   _bcd_value, bcd_n
+    MOVFF   _bcd_value+1, bcd_n+1
+
+bcd_word:                       ; n in bcd_n
+    RCALL   bcd_div10
+    MOVWF   _bcd_digits, c
+    RCALL   bcd_div10
+    MOVWF   _bcd_digits+1, c
+    RCALL   bcd_div10           ; leaves n at most 65
+    MOVWF   _bcd_digits+2, c
+    MOVF    bcd_n, w, c
+    MULLW   26                  ; ten thousands = (n * 26) >> 8
+    MOVF    PRODH, w, c
+    MOVWF   _bcd_digits+4, c
+    MULLW   10
+    MOVF    PRODL, w, c
+    SUBWF   bcd_n, w, c         ; thousands = n - 10 * ten thousands
+    MOVWF   _bcd_digits+3, c
+    RETURN
+
+;---------------------
+; bcd_n = bcd_n / 10, remainder in W
+; Product n * 0xCCCD from four 8 x 8 products; byte 0 never carries, so
+;    only bytes 1-3 are kept (bcd_r), and bytes 2-3 >> 3 are the quotient.
+;---------------------
+bcd_div10:
+    CLRF    bcd_r+2, c
+    MOVF    bcd_n, w, c         ; low * 0xCD: byte 1
+    MULLW   0xCD
+    MOVF    PRODH, w, c
+    MOVWF   bcd_r, c
+    MOVF    bcd_n, w, c         ; low * 0xCC: bytes 1-2
+    MULLW   0xCC
+    MOVF    PRODL, w, c
+    ADDWF   bcd_r, f, c
+    MOVLW   0
+    ADDWFC  PRODH, w, c
+    MOVWF   bcd_r+1, c
+    MOVF    bcd_n+1, w, c       ; high * 0xCD: bytes 1-2, carry into 3
+    MULLW   0xCD
+    MOVF    PRODL, w, c
+    ADDWF   bcd_r, f, c
+    MOVF    PRODH, w, c
+    ADDWFC  bcd_r+1, f, c
+    RLCF    bcd_r+2, f, c
+    MOVF    bcd_n+1, w, c       ; high * 0xCC: bytes 2-3
+    MULLW   0xCC
+    MOVF    PRODL, w, c
+    ADDWF   bcd_r+1, f, c
+    MOVF    PRODH, w, c
+    ADDWFC  bcd_r+2, f, c
+    BCF     STATUS, 0, c        ; q = bytes 2-3 >> 3
+    RRCF    bcd_r+2, f, c
+    RRCF    bcd_r+1, f, c
+    BCF     STATUS, 0, c
+    RRCF    bcd_r+2, f, c
+    RRCF    bcd_r+1, f, c
+    BCF     STATUS, 0, c
+    RRCF    bcd_r+2, f, c
+    RRCF    bcd_r+1, f, c
+    MOVF    bcd_r+1, w, c       ; remainder = n - 10q, low bytes
+    MULLW   10
+    MOVF    PRODL, w, c
+    SUBWF   bcd_n, w, c
+    MOVFF   bcd_r+1, bcd_n
+    MOVFF   bcd_r+2, bcd_n+1
+    RETURN
+
+    END
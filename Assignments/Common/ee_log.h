@@ -0,0 +1,221 @@
+/*
+ * File:   ee_log.h
+ * Author: Christian Gonzalez
+ *
+ * A few bytes kept across resets in the data EEPROM, written as a log so
+ * no cell wears out first. The EEPROM is cut into slots of one record
+ * each, and every ee_log_write() goes to the slot after the newest one,
+ * round the ring, so all slots take their turn. Include this file once,
+ * after "../Common/events.h", having set:
+ *
+ *   EE_LOG_SIZE        bytes of data in a record (default 1)
+ *   EE_LOG_EVENT       event source posted when a write is done
+ *   EE_LOG_START       first EEPROM address of the log (default 0)
+ *   EE_LOG_BYTES       EEPROM bytes it may use (default 1024, all of it)
+ *
+ * A record is the data, a CRC-8 of sequence number and data, then the
+ * 16-bit sequence number, written in that order: a write cut off by a
+ * reset leaves a record whose CRC does not match (the old sequence number
+ * is still there, or half of the new one), so the one before stays the
+ * newest. Sequence numbers count up from 0, skipping 0xFFFF, which is
+ * what an erased slot reads.
+ *
+ * ee_log_init() reads every slot once, sequence number first, and only
+ * reads the rest of a slot that is not blank, so boot takes at most
+ * EE_LOG_BYTES reads. It keeps the newest valid record and the slot to
+ * write next.
+ *
+ * A write does not wait for the EEPROM (4 ms a byte): ee_log_write()
+ * builds the record in RAM and starts its first byte, and NVM_ISR() starts
+ * each next one. A write asked for while one is going waits in RAM, the
+ * last one asked for winning, and starts when the other is done. Call
+ * ee_log_write() from main(), not from an ISR (it turns interrupts off
+ * and on around the unlock sequence).
+ *
+ * NVM_ISR() posts, so with priorities on (IPEN) ee_log_init() puts it at
+ * the high level, with the other ISRs that post.
+ */
+
+#ifndef EE_LOG_H
+#define EE_LOG_H
+
+#include <xc.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef EE_LOG_SIZE
+#define EE_LOG_SIZE         1
+#endif
+#ifndef EE_LOG_START
+#define EE_LOG_START        0
+#endif
+#ifndef EE_LOG_BYTES
+#define EE_LOG_BYTES        1024
+#endif
+
+#define EE_LOG_RECORD       (EE_LOG_SIZE + 3)   // data, CRC, sequence number
+#define EE_LOG_SLOTS        (EE_LOG_BYTES / EE_LOG_RECORD)
+#define EE_LOG_BLANK        0xFFFF              // sequence number of an erased slot
+
+#if EE_LOG_START + EE_LOG_BYTES > 1024
+#error "EE_LOG_START + EE_LOG_BYTES must fit the 1024-byte data EEPROM"
+#endif
+#if EE_LOG_SLOTS < 2
+#error "EE_LOG_BYTES must hold at least two records"
+#endif
+
+#define EE_LOG_NVM_READ     0x00    // NVMCON1: REG = data EEPROM
+#define EE_LOG_NVM_WRITE    0x04    // and WREN
+
+uint8_t ee_log_data[EE_LOG_SIZE];           // newest record's data
+uint8_t ee_log_found = 0;                   // a valid record was read or written
+uint16_t ee_log_seq = 0;                    // its sequence number
+uint16_t ee_log_slot = EE_LOG_SLOTS - 1;    // and its slot
+uint8_t ee_log_record[EE_LOG_RECORD];       // being written
+volatile uint8_t ee_log_written = 0;        // bytes of it done
+volatile uint16_t ee_log_addr;              // its first EEPROM address
+volatile uint8_t ee_log_busy = 0;
+uint8_t ee_log_next[EE_LOG_SIZE];           // asked for while busy
+volatile uint8_t ee_log_queued = 0;
+
+uint8_t ee_log_init(void *data);
+void ee_log_write(const void *data);
+uint8_t ee_log_crc(const uint8_t *bytes, uint8_t count, uint8_t crc);
+uint8_t ee_log_read_byte(uint16_t addr);
+void ee_log_write_byte(uint16_t addr, uint8_t value);
+void ee_log_start(const uint8_t *data);
+EVT_ISR(NVM_ISR, irq(IRQ_NVM));
+
+/*
+ * This function is used to find the newest valid record at boot. Call it
+ * once, before the first ee_log_write().
+ * params: where to copy its data
+ * return: 1 if there was one, 0 if the log is blank (data untouched)
+ */
+uint8_t ee_log_init(void *data) {
+    uint8_t record[EE_LOG_RECORD];
+    uint16_t addr = EE_LOG_START;
+
+    ee_log_found = 0;
+    ee_log_slot = EE_LOG_SLOTS - 1;     // blank: the first write goes to slot 0
+    ee_log_busy = 0;
+    ee_log_queued = 0;
+    for (uint16_t slot = 0; slot < EE_LOG_SLOTS; slot++, addr += EE_LOG_RECORD) {
+        uint16_t seq;
+
+        record[EE_LOG_SIZE + 1] = ee_log_read_byte(addr + EE_LOG_SIZE + 1);
+        record[EE_LOG_SIZE + 2] = ee_log_read_byte(addr + EE_LOG_SIZE + 2);
+        seq = ((uint16_t)record[EE_LOG_SIZE + 2] << 8) | record[EE_LOG_SIZE + 1];
+        if (seq == EE_LOG_BLANK)
+            continue;
+        if (ee_log_found && (int16_t)(seq - ee_log_seq) <= 0)
+            continue;                   // older than the newest so far
+        for (uint8_t i = 0; i <= EE_LOG_SIZE; i++)
+            record[i] = ee_log_read_byte(addr + i);
+        if (ee_log_crc(record, EE_LOG_SIZE, ee_log_crc(&record[EE_LOG_SIZE + 1], 2, 0)) !=
+            record[EE_LOG_SIZE])
+            continue;                   // cut off while being written
+        memcpy(ee_log_data, record, EE_LOG_SIZE);
+        ee_log_seq = seq;
+        ee_log_slot = slot;
+        ee_log_found = 1;
+    }
+
+    PIR0bits.NVMIF = 0;
+    IPR0bits.NVMIP = 1;
+    PIE0bits.NVMIE = 1;
+    if (ee_log_found)
+        memcpy(data, ee_log_data, EE_LOG_SIZE);
+    return ee_log_found;
+}
+
+/*
+ * This function is used to keep new data: it starts the record and returns
+ * at once, or leaves it for after the write going on. EE_LOG_EVENT is
+ * posted when it is in the EEPROM.
+ * params: EE_LOG_SIZE bytes
+ * return: none
+ */
+void ee_log_write(const void *data) {
+    di();
+    if (ee_log_busy) {
+        memcpy(ee_log_next, data, EE_LOG_SIZE);
+        ee_log_queued = 1;
+    } else {
+        ee_log_start(data);
+    }
+    ei();
+}
+
+// CRC-8, polynomial x^8 + x^2 + x + 1 (0x07), bit by bit
+uint8_t ee_log_crc(const uint8_t *bytes, uint8_t count, uint8_t crc) {
+    while (count--) {
+        crc ^= *bytes++;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+uint8_t ee_log_read_byte(uint16_t addr) {
+    NVMADRH = (uint8_t)(addr >> 8);
+    NVMADRL = (uint8_t)addr;
+    NVMCON1 = EE_LOG_NVM_READ;
+    NVMCON1bits.RD = 1;
+    return NVMDAT;
+}
+
+// Starts one byte; interrupts must be off for the unlock sequence
+void ee_log_write_byte(uint16_t addr, uint8_t value) {
+    NVMADRH = (uint8_t)(addr >> 8);
+    NVMADRL = (uint8_t)addr;
+    NVMDAT = value;
+    NVMCON1 = EE_LOG_NVM_WRITE;
+    NVMCON2 = 0x55;
+    NVMCON2 = 0xAA;
+    NVMCON1bits.WR = 1;
+    NVMCON1bits.WREN = 0;           // the write goes on, no other can start
+}
+
+// Record of data in the slot after the newest, first byte started (with
+// interrupts off, from ee_log_write() or NVM_ISR())
+void ee_log_start(const uint8_t *data) {
+    uint16_t seq = ee_log_found ? ee_log_seq + 1 : 0;
+
+    if (seq == EE_LOG_BLANK)
+        seq = 0;
+    if (++ee_log_slot == EE_LOG_SLOTS)
+        ee_log_slot = 0;
+    memcpy(ee_log_record, data, EE_LOG_SIZE);
+    ee_log_record[EE_LOG_SIZE + 1] = (uint8_t)seq;
+    ee_log_record[EE_LOG_SIZE + 2] = (uint8_t)(seq >> 8);
+    ee_log_record[EE_LOG_SIZE] = ee_log_crc(data, EE_LOG_SIZE,
+                                            ee_log_crc(&ee_log_record[EE_LOG_SIZE + 1], 2, 0));
+    memcpy(ee_log_data, data, EE_LOG_SIZE);
+    ee_log_seq = seq;
+    ee_log_found = 1;
+
+    ee_log_addr = EE_LOG_START + ee_log_slot * EE_LOG_RECORD;
+    ee_log_written = 0;
+    ee_log_busy = 1;
+    ee_log_write_byte(ee_log_addr, ee_log_record[0]);
+}
+
+// A byte is written: the next one, or the end of the record
+EVT_ISR(NVM_ISR, irq(IRQ_NVM)) {
+    EVT_ISR_BEGIN();
+    PIR0bits.NVMIF = 0;
+    if (++ee_log_written < EE_LOG_RECORD) {
+        ee_log_write_byte(ee_log_addr + ee_log_written, ee_log_record[ee_log_written]);
+    } else {
+        ee_log_busy = 0;
+        evt_post(EE_LOG_EVENT);
+        if (ee_log_queued) {
+            ee_log_queued = 0;
+            ee_log_start(ee_log_next);
+        }
+    }
+    EVT_ISR_END();
+}
+
+#endif /* EE_LOG_H */
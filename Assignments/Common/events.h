@@ -0,0 +1,196 @@
+/*
+ * File:   events.h
+ * Author: Christian Gonzalez
+ *
+ * Interrupts split into a top half and a bottom half. The vectored ISR (the
+ * top half) clears its flag first, then only posts an event: a source
+ * number and the time it came in. The handler for that source (the bottom
+ * half) runs later from main(), in evt_dispatch(), where it may take as
+ * long as it likes without holding up the other interrupts. Include this
+ * file once after setting:
+ *
+ *   EVT_SOURCES        event sources, numbered from 0 (default 4)
+ *   EVT_QUEUE_SIZE     events waiting for main(), power of two (default 8)
+ *   EVT_IVT_BASE       vector table address (default 0x4008)
+ *   EVT_WAIT()         how evt_idle() waits for the next interrupt, with
+ *                      interrupts off (default SLEEP(): Idle or Sleep, as
+ *                      CPUDOZE.IDLEN says; pwr_wait() of power.h counts it)
+ *
+ * Every ISR of the project is declared and defined with EVT_ISR(), which
+ * puts base(EVT_IVT_BASE) in its __interrupt(), and evt_init() writes the
+ * same address into IVTBASE, so the two cannot disagree.
+ *
+ * Time stamps are Timer1 counts, free-running on Fosc/4 (1 us at 4 MHz), so
+ * evt_init() takes Timer1 and it keeps counting in Idle but not in Sleep.
+ * Two counters record the worst cases seen since evt_init():
+ *
+ *   evt_isr_worst      longest top half, from EVT_ISR_BEGIN() to
+ *                      EVT_ISR_END() (the context save is not in it)
+ *   evt_latency_worst  longest wait from evt_post() to the start of the
+ *                      handler, up to 65535 us
+ *
+ * Only ISRs of one priority level may post (the queue head has a single
+ * writer); an ISR of the other level can still be timed.
+ */
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <xc.h>
+#include <stdint.h>
+
+#ifndef EVT_SOURCES
+#define EVT_SOURCES         4
+#endif
+#ifndef EVT_QUEUE_SIZE
+#define EVT_QUEUE_SIZE      8
+#endif
+#ifndef EVT_IVT_BASE
+#define EVT_IVT_BASE        0x4008
+#endif
+#ifndef EVT_WAIT
+#define EVT_WAIT()          SLEEP()
+#endif
+
+#if (EVT_QUEUE_SIZE & (EVT_QUEUE_SIZE - 1)) != 0
+#error "EVT_QUEUE_SIZE must be a power of two"
+#endif
+#if (EVT_IVT_BASE & 0x07) != 0 || EVT_IVT_BASE > 0x1FFFFF
+#error "EVT_IVT_BASE must be a multiple of 8 in program memory"
+#endif
+
+// ISR prototype and definition: EVT_ISR(name, irq(IRQ_x)[, low_priority])
+#define EVT_ISR(name, ...)  void __interrupt(__VA_ARGS__, base(EVT_IVT_BASE)) name(void)
+#define EVT_ISR_BEGIN()     uint16_t evt_isr_start = evt_now()
+#define EVT_ISR_END()       evt_isr_end(evt_isr_start)
+
+typedef void (*evt_handler_t)(void);
+
+typedef struct {
+    uint8_t source;
+    uint16_t stamp;         // Timer1 when it was posted
+} evt_t;
+
+volatile evt_t evt_queue[EVT_QUEUE_SIZE];
+volatile uint8_t evt_head = 0;              // next free entry, evt_post() only
+volatile uint8_t evt_tail = 0;              // next entry to run, evt_dispatch() only
+evt_handler_t evt_handlers[EVT_SOURCES];
+uint16_t evt_stamp;                         // post time of the event being handled
+uint8_t evt_source;                         // and its source, for a handler of several
+volatile uint16_t evt_posts = 0;            // events posted
+volatile uint8_t evt_dropped = 0;           // events lost to a full queue
+volatile uint16_t evt_isr_worst = 0;        // Timer1 counts
+uint16_t evt_latency_worst = 0;             // Timer1 counts
+
+void evt_init(void);
+uint16_t evt_now(void);
+void evt_on(uint8_t source, evt_handler_t handler);
+void evt_post(uint8_t source);
+void evt_isr_end(uint16_t start);
+uint8_t evt_pending(void);
+void evt_dispatch(void);
+void evt_idle(void);
+
+/*
+ * This function is used to empty the queue and the handler table, start
+ * the Timer1 time stamps and point IVTBASE at the vector table. Call it
+ * before any interrupt is enabled.
+ * params: none
+ * return: none
+ */
+void evt_init(void) {
+    for (uint8_t i = 0; i < EVT_SOURCES; i++)
+        evt_handlers[i] = 0;
+    evt_head = 0;
+    evt_tail = 0;
+    evt_posts = 0;
+    evt_dropped = 0;
+    evt_isr_worst = 0;
+    evt_latency_worst = 0;
+
+    T1CON = 0b00000010;     // off, 16-bit reads (RD16), synchronous, 1:1 prescaler
+    T1CLK = 0b00000001;     // Fosc/4
+    TMR1H = 0;
+    TMR1L = 0;
+    PIR4bits.TMR1IF = 0;
+    T1CONbits.ON = 1;
+
+    IVTBASEU = (uint8_t)((uint32_t)EVT_IVT_BASE >> 16);
+    IVTBASEH = (uint8_t)(EVT_IVT_BASE >> 8);
+    IVTBASEL = (uint8_t)EVT_IVT_BASE;
+}
+
+// Reading TMR1L latches TMR1H (RD16), so the two bytes belong together
+uint16_t evt_now(void) {
+    uint8_t low = TMR1L;
+    return ((uint16_t)TMR1H << 8) | low;
+}
+
+// Handler for a source; 0 drops its events
+void evt_on(uint8_t source, evt_handler_t handler) {
+    evt_handlers[source] = handler;
+}
+
+/*
+ * This function is used by an ISR to queue an event with the time now.
+ * params: source
+ * return: none
+ */
+void evt_post(uint8_t source) {
+    uint8_t next = (evt_head + 1) & (EVT_QUEUE_SIZE - 1);
+
+    if (next == evt_tail) {
+        evt_dropped++;
+        return;
+    }
+    evt_queue[evt_head].source = source;
+    evt_queue[evt_head].stamp = evt_now();
+    evt_head = next;
+    evt_posts++;
+}
+
+// Last thing in a top half: keeps the longest one
+void evt_isr_end(uint16_t start) {
+    uint16_t length = evt_now() - start;
+
+    if (length > evt_isr_worst)
+        evt_isr_worst = length;
+}
+
+uint8_t evt_pending(void) {
+    return evt_head != evt_tail;
+}
+
+/*
+ * This function is used to run the handler of every queued event, oldest
+ * first, including any that come in while it runs.
+ * params: none
+ * return: none
+ */
+void evt_dispatch(void) {
+    while (evt_tail != evt_head) {
+        uint8_t source = evt_queue[evt_tail].source;
+        uint16_t stamp = evt_queue[evt_tail].stamp;
+        uint16_t latency;
+
+        evt_tail = (evt_tail + 1) & (EVT_QUEUE_SIZE - 1);
+        latency = evt_now() - stamp;
+        if (latency > evt_latency_worst)
+            evt_latency_worst = latency;
+        evt_stamp = stamp;
+        evt_source = source;
+        if (source < EVT_SOURCES && evt_handlers[source])
+            evt_handlers[source]();
+    }
+}
+
+// Idle (or Sleep, as CPUDOZE.IDLEN says) until the next interrupt, unless
+// an event came in since evt_dispatch() looked
+void evt_idle(void) {
+    di();
+    if (evt_head == evt_tail)
+        EVT_WAIT();
+    ei();
+}
+
+#endif /* EVENTS_H */
@@ -0,0 +1,224 @@
+/*
+ * File:   light_gate.h
+ * Author: Christian Gonzalez
+ *
+ * Photo-resistors read as analog "gates" that are covered or uncovered,
+ * with no polling: Timer2 starts a conversion every millisecond, one gate
+ * after the other, and Light_ISR() only looks at the ADC's threshold bits
+ * and posts an event when a gate changes. Include this file once, after
+ * "../Common/events.h", having set:
+ *
+ *   LIGHT_GATES        photo-resistors, 1 to 8 (default 2)
+ *   LIGHT_CHANNELS     their ADPCH codes, e.g. { 0x20, 0x21 } for RE0, RE1
+ *   LIGHT_EVENT        event source of gate 0; gate n posts LIGHT_EVENT + n
+ *   LIGHT_COVER        reading above which a gate is covered (default 2458, 60%)
+ *   LIGHT_UNCOVER      reading below which it is uncovered again (default
+ *                      1638, 40%); in between nothing changes
+ *   LIGHT_QUEUE_SIZE   edges waiting for main(), power of two (default 8)
+ *
+ * The divider must rise in the dark (photo-resistor on the ground side).
+ * The ADC's computation unit does the compare: ADERR = ADRES - 0, and
+ * ADSTAT.UTHR and LTHR say whether it is above ADUTH (LIGHT_COVER) or
+ * below ADLTH (LIGHT_UNCOVER); light_thresholds() moves both at run time.
+ *
+ * Time stamps are counted in conversions, so in ms, by Light_ISR(): the
+ * conversions are started by Timer2 on LFINTOSC, not by the CPU, so a
+ * cover is timed to the millisecond whatever main() was doing. A gate is
+ * read every LIGHT_GATES ms, so an edge is seen that much later at most.
+ *
+ * The handler given to light_init() runs from evt_dispatch() as
+ * handler(gate, covered, ms), ms being how long the gate was covered when
+ * it is uncovered (0 when it is covered). Light_ISR() queues every edge
+ * with its state and time before posting, and light_event() hands over
+ * all the queued ones in order, so a cover and an uncover that both come
+ * in before main() runs are two edges, not the state at dispatch twice;
+ * an edge that finds the queue full is counted in light_lost. light_response_worst is the
+ * longest time, in Timer1 counts (us), from the conversion that saw an
+ * edge to the return of the handler, light_response_last the last one.
+ *
+ * Light_ISR() posts, so with priorities on (IPEN) light_init() puts it at
+ * the high level, with the other ISRs that post.
+ */
+
+#ifndef LIGHT_GATE_H
+#define LIGHT_GATE_H
+
+#include <xc.h>
+#include <stdint.h>
+
+#ifndef LIGHT_GATES
+#define LIGHT_GATES         2
+#endif
+#ifndef LIGHT_COVER
+#define LIGHT_COVER         2458
+#endif
+#ifndef LIGHT_UNCOVER
+#define LIGHT_UNCOVER       1638
+#endif
+#ifndef LIGHT_QUEUE_SIZE
+#define LIGHT_QUEUE_SIZE    8
+#endif
+
+#if LIGHT_GATES < 1 || LIGHT_GATES > 8
+#error "LIGHT_GATES must be 1 to 8"
+#endif
+#if LIGHT_UNCOVER > LIGHT_COVER
+#error "LIGHT_UNCOVER must not be above LIGHT_COVER"
+#endif
+#if (LIGHT_QUEUE_SIZE & (LIGHT_QUEUE_SIZE - 1)) != 0
+#error "LIGHT_QUEUE_SIZE must be a power of two"
+#endif
+
+#define LIGHT_TRIGGER_TMR2  0x04    // ADACT: Timer2 postscaler output
+#define LIGHT_TIMER_LFINTOSC 0x04   // T2CLKCON: LFINTOSC
+#define LIGHT_PERIOD_COUNTS 31      // 31 counts of 31 kHz: one conversion a ms
+
+typedef void (*light_handler_t)(uint8_t gate, uint8_t covered, uint16_t ms);
+
+typedef struct {
+    uint8_t gate;
+    uint8_t covered;
+    uint16_t ms;            // how long it was covered, on an uncover
+} light_edge_t;
+
+const uint8_t light_channels[LIGHT_GATES] = LIGHT_CHANNELS;
+light_handler_t light_handler;
+volatile uint8_t light_state = 0;           // bit n: gate n covered
+volatile uint8_t light_gate = 0;            // gate being converted
+volatile uint16_t light_ms = 0;             // conversions since light_init()
+volatile uint16_t light_since[LIGHT_GATES]; // light_ms at the last edge
+volatile uint16_t light_held[LIGHT_GATES];  // ms covered, at the last uncover
+volatile light_edge_t light_edges[LIGHT_QUEUE_SIZE];
+volatile uint8_t light_head = 0;            // next free edge, Light_ISR() only
+volatile uint8_t light_tail = 0;            // next edge to hand over, light_event() only
+volatile uint16_t light_lost = 0;           // edges that found the queue full
+uint16_t light_response_last = 0;           // Timer1 counts
+uint16_t light_response_worst = 0;
+
+void light_init(light_handler_t handler);
+void light_thresholds(uint16_t cover, uint16_t uncover);
+uint8_t light_covered(uint8_t gate);
+void light_event(void);
+void light_edge(uint8_t gate, uint8_t covered, uint16_t ms);
+EVT_ISR(Light_ISR, irq(IRQ_AD));
+
+/*
+ * This function is used to start the conversions: ADC on ADCRC, triggered
+ * by Timer2, comparing each reading to the thresholds. The gate pins must
+ * be analog inputs (ANSELx, TRISx) already.
+ * params: handler for the edges
+ * return: none
+ */
+void light_init(light_handler_t handler) {
+    light_handler = handler;
+    for (uint8_t i = 0; i < LIGHT_GATES; i++) {
+        light_since[i] = 0;
+        light_held[i] = 0;
+        evt_on(LIGHT_EVENT + i, light_event);
+    }
+    light_state = 0;
+    light_gate = 0;
+    light_ms = 0;
+    light_head = 0;
+    light_tail = 0;
+    light_lost = 0;
+    light_response_last = 0;
+    light_response_worst = 0;
+
+    ADCON0 = 0b00010100;            // off, right justified, ADCRC (runs without Fosc)
+    ADREF = 0x00;                   // Vdd and Vss
+    ADPCH = light_channels[0];
+    ADACQL = 0x00;                  // a conversion a ms leaves time to acquire
+    ADACQH = 0x00;
+    ADCON2 = 0x00;                  // basic mode: compare every reading
+    ADCON3 = 0b00010000;            // ADERR = ADRES - ADSTPT, ADTIF never (ADSTAT is read)
+    ADSTPTL = 0;
+    ADSTPTH = 0;
+    light_thresholds(LIGHT_COVER, LIGHT_UNCOVER);
+    ADACT = LIGHT_TRIGGER_TMR2;
+
+    T2CON = 0x00;                   // off, 1:1 prescaler, 1:1 postscaler
+    T2CLKCON = LIGHT_TIMER_LFINTOSC;
+    T2HLT = 0x00;                   // free-running period mode
+    T2PR = LIGHT_PERIOD_COUNTS - 1;
+    T2TMR = 0;
+
+    PIR1bits.ADIF = 0;
+    IPR1bits.ADIP = 1;
+    PIE1bits.ADIE = 1;
+    ADCON0bits.ON = 1;
+    T2CONbits.ON = 1;
+}
+
+// Cover above cover, uncover below uncover (ADC codes)
+void light_thresholds(uint16_t cover, uint16_t uncover) {
+    ADUTHH = (uint8_t)(cover >> 8);
+    ADUTHL = (uint8_t)cover;
+    ADLTHH = (uint8_t)(uncover >> 8);
+    ADLTHL = (uint8_t)uncover;
+}
+
+uint8_t light_covered(uint8_t gate) {
+    return (light_state >> gate) & 1;
+}
+
+// LIGHT_EVENT + n: hands every queued edge to the handler, oldest first,
+// and times it. An event whose edge an earlier one took finds none.
+void light_event(void) {
+    if (light_tail == light_head)
+        return;
+    while (light_tail != light_head) {
+        volatile light_edge_t *edge = &light_edges[light_tail];
+
+        if (light_handler)
+            light_handler(edge->gate, edge->covered, edge->ms);
+        light_tail = (light_tail + 1) & (LIGHT_QUEUE_SIZE - 1);
+    }
+    light_response_last = evt_now() - evt_stamp;
+    if (light_response_last > light_response_worst)
+        light_response_worst = light_response_last;
+}
+
+// Queues one edge and posts its event (Light_ISR() only)
+void light_edge(uint8_t gate, uint8_t covered, uint16_t ms) {
+    uint8_t next = (light_head + 1) & (LIGHT_QUEUE_SIZE - 1);
+
+    if (next == light_tail) {
+        light_lost++;
+        return;
+    }
+    light_edges[light_head].gate = gate;
+    light_edges[light_head].covered = covered;
+    light_edges[light_head].ms = ms;
+    light_head = next;
+    evt_post(LIGHT_EVENT + gate);
+}
+
+// A conversion is done: a new state for its gate, then the next gate
+EVT_ISR(Light_ISR, irq(IRQ_AD)) {
+    EVT_ISR_BEGIN();
+    uint8_t gate = light_gate;
+    uint8_t bit = (uint8_t)(1 << gate);
+
+    PIR1bits.ADIF = 0;
+    light_ms++;
+    if (ADSTATbits.UTHR) {
+        if (!(light_state & bit)) {
+            light_state |= bit;
+            light_since[gate] = light_ms;
+            light_edge(gate, 1, 0);
+        }
+    } else if (ADSTATbits.LTHR && (light_state & bit)) {
+        light_state &= (uint8_t)~bit;
+        light_held[gate] = light_ms - light_since[gate];
+        light_since[gate] = light_ms;
+        light_edge(gate, 0, light_held[gate]);
+    }
+    if (++gate == LIGHT_GATES)
+        gate = 0;
+    light_gate = gate;
+    ADPCH = light_channels[gate];
+    EVT_ISR_END();
+}
+
+#endif /* LIGHT_GATE_H */
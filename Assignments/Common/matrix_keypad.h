@@ -0,0 +1,185 @@
+/*
+ * File:   matrix_keypad.h
+ * Author: Christian Gonzalez
+ *
+ * Matrix keypad driver shared by the keypad projects (Calculator.X and
+ * InterfacingWithSensors_A8.X). The matrix is fixed at compile time: define
+ * the settings below, then include this file once from the project.
+ *
+ *   KEYPAD_PORT        port letter the keypad sits on, e.g. B
+ *   KEYPAD_ROWS        number of rows, driven low one at a time
+ *   KEYPAD_ROW_FIRST   pin of row 0; the rows use consecutive pins
+ *   KEYPAD_COLS        number of columns, read with pull-ups
+ *   KEYPAD_COL_FIRST   pin of column 0; the columns use consecutive pins
+ *   KEYPAD_LAYOUT      { {row 0 keys}, {row 1 keys}, ... } as chars
+ *   KEYPAD_DEBOUNCE    scans a row has to read the same (default 2)
+ *   KEYPAD_QUEUE_SIZE  events kept for main(), power of two (default 8)
+ *
+ * keypad_tick() does one row per call and never waits, so it is meant to
+ * run from a timer interrupt: it reads the columns of the row driven on the
+ * previous tick (the tick period is the settling time) and then drives the
+ * next row. A key change is accepted once its row has read the same for
+ * KEYPAD_DEBOUNCE full scans. Every key is tracked on its own, so any
+ * number of keys can be held and each gets its own press and release event
+ * (without diodes, three keys on the corners of a rectangle also show the
+ * fourth).
+ *
+ * Events are queued as KEYPAD_PRESS or KEYPAD_RELEASE plus the key number
+ * (row * KEYPAD_COLS + col); 0 means no event. The queue has one writer
+ * (keypad_tick() moves keypad_head) and one reader (keypad_event() moves
+ * keypad_tail), both single bytes, so no di()/ei() is needed around it.
+ *
+ * The layout and the row bit table are const, so XC8 keeps them in program
+ * memory.
+ */
+
+#ifndef MATRIX_KEYPAD_H
+#define MATRIX_KEYPAD_H
+
+#include <xc.h>
+#include <stdint.h>
+
+#ifndef KEYPAD_DEBOUNCE
+#define KEYPAD_DEBOUNCE     2
+#endif
+#ifndef KEYPAD_QUEUE_SIZE
+#define KEYPAD_QUEUE_SIZE   8
+#endif
+
+#define KEYPAD_PRESS        0x40
+#define KEYPAD_RELEASE      0x80
+#define KEYPAD_KEY          0x3F    // key number part of an event
+
+// Port registers from the port letter: KEYPAD_SFR(LAT) -> LATB
+#define KEYPAD_CAT(reg, port)   reg##port
+#define KEYPAD_SFR_(reg, port)  KEYPAD_CAT(reg, port)
+#define KEYPAD_SFR(reg)         KEYPAD_SFR_(reg, KEYPAD_PORT)
+
+#define KEYPAD_ROW_MASK     ((uint8_t)(((1u << KEYPAD_ROWS) - 1) << KEYPAD_ROW_FIRST))
+#define KEYPAD_COL_MASK     ((uint8_t)(((1u << KEYPAD_COLS) - 1) << KEYPAD_COL_FIRST))
+
+const char keypad_layout[KEYPAD_ROWS][KEYPAD_COLS] = KEYPAD_LAYOUT;
+const uint8_t keypad_bit[8] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+
+uint8_t keypad_row = 0;                     // row driven right now
+uint8_t keypad_last[KEYPAD_ROWS];           // columns down on the last read
+uint8_t keypad_same[KEYPAD_ROWS];           // scans keypad_last has held
+uint8_t keypad_state[KEYPAD_ROWS];          // debounced columns down
+
+volatile uint8_t keypad_queue[KEYPAD_QUEUE_SIZE];
+volatile uint8_t keypad_head = 0;           // next free slot, keypad_tick() only
+volatile uint8_t keypad_tail = 0;           // oldest event, keypad_event() only
+volatile uint8_t keypad_dropped = 0;        // events lost to a full queue
+
+void keypad_init(void);
+void keypad_start(void);
+void keypad_park(void);
+void keypad_push(uint8_t event);
+void keypad_tick(void);
+uint8_t keypad_idle(void);
+uint8_t keypad_event(void);
+char keypad_char(uint8_t event);
+char keypad_get(void);
+
+// Set the keypad pins up and start scanning from row 0
+void keypad_init(void) {
+    KEYPAD_SFR(ANSEL) &= (uint8_t)~(KEYPAD_ROW_MASK | KEYPAD_COL_MASK);
+    KEYPAD_SFR(WPU) |= KEYPAD_COL_MASK;
+    KEYPAD_SFR(TRIS) = (uint8_t)((KEYPAD_SFR(TRIS) & ~KEYPAD_ROW_MASK) | KEYPAD_COL_MASK);
+
+    for (uint8_t row = 0; row < KEYPAD_ROWS; row++) {
+        keypad_last[row] = 0;
+        keypad_same[row] = KEYPAD_DEBOUNCE;
+        keypad_state[row] = 0;
+    }
+    keypad_start();
+}
+
+// Drive row 0; the next keypad_tick() reads it
+void keypad_start(void) {
+    keypad_row = 0;
+    KEYPAD_SFR(LAT) = (uint8_t)((KEYPAD_SFR(LAT) | KEYPAD_ROW_MASK) &
+                                ~keypad_bit[KEYPAD_ROW_FIRST]);
+}
+
+// Drive every row low so any key pulls its column low (wake-up on IOC)
+void keypad_park(void) {
+    KEYPAD_SFR(LAT) &= (uint8_t)~KEYPAD_ROW_MASK;
+}
+
+// Add an event to the queue, keeping the older ones if it is full
+void keypad_push(uint8_t event) {
+    uint8_t next = (keypad_head + 1) & (KEYPAD_QUEUE_SIZE - 1);
+
+    if (next == keypad_tail) {
+        keypad_dropped++;
+        return;
+    }
+    keypad_queue[keypad_head] = event;
+    keypad_head = next;
+}
+
+// Read the driven row, queue its debounced changes, drive the next row
+void keypad_tick(void) {
+    uint8_t row = keypad_row;
+    uint8_t down = (uint8_t)((uint8_t)~KEYPAD_SFR(PORT) >> KEYPAD_COL_FIRST) &
+                   (uint8_t)((1u << KEYPAD_COLS) - 1);
+
+    if (down != keypad_last[row]) {
+        keypad_last[row] = down;
+        keypad_same[row] = 1;
+    } else if (keypad_same[row] < KEYPAD_DEBOUNCE) {
+        keypad_same[row]++;
+    }
+
+    if (keypad_same[row] == KEYPAD_DEBOUNCE && down != keypad_state[row]) {
+        uint8_t changed = down ^ keypad_state[row];
+        uint8_t key = row * KEYPAD_COLS;
+
+        keypad_state[row] = down;
+        for (uint8_t col = 0; col < KEYPAD_COLS; col++, key++, changed >>= 1, down >>= 1)
+            if (changed & 1)
+                keypad_push((down & 1 ? KEYPAD_PRESS : KEYPAD_RELEASE) | key);
+    }
+
+    if (++row == KEYPAD_ROWS)
+        row = 0;
+    keypad_row = row;
+    KEYPAD_SFR(LAT) = (uint8_t)((KEYPAD_SFR(LAT) | KEYPAD_ROW_MASK) &
+                                ~keypad_bit[KEYPAD_ROW_FIRST + row]);
+}
+
+// 1 when no key is down or still settling
+uint8_t keypad_idle(void) {
+    for (uint8_t row = 0; row < KEYPAD_ROWS; row++)
+        if (keypad_state[row] | keypad_last[row])
+            return 0;
+    return 1;
+}
+
+// Oldest event, 0 if there is none
+uint8_t keypad_event(void) {
+    if (keypad_tail == keypad_head)
+        return 0;
+
+    uint8_t event = keypad_queue[keypad_tail];
+    keypad_tail = (keypad_tail + 1) & (KEYPAD_QUEUE_SIZE - 1);
+    return event;
+}
+
+// Layout character of the key in an event
+char keypad_char(uint8_t event) {
+    return ((const char *)keypad_layout)[event & KEYPAD_KEY];
+}
+
+// Next key pressed, 0 if none; release events are skipped
+char keypad_get(void) {
+    uint8_t event;
+
+    while ((event = keypad_event()) != 0)
+        if (event & KEYPAD_PRESS)
+            return keypad_char(event);
+    return 0;
+}
+
+#endif /* MATRIX_KEYPAD_H */
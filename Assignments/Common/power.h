@@ -0,0 +1,190 @@
+/*
+ * File:   power.h
+ * Author: Christian Gonzalez
+ *
+ * Power states of a project. pwr_init() switches off, in PMD0-PMD7, every
+ * module the project does not use, and main() waits for its next interrupt
+ * with pwr_wait() in the lowest state that keeps running what it needs.
+ * The time spent in each state is counted, so two builds of a project can
+ * be compared. Include this file once, before "../Common/events.h" or
+ * "../Common/scheduler.h" when their waits go through pwr_wait()
+ * (EVT_WAIT(), SCHED_WAIT()), having set:
+ *
+ *   PWR_PMD0 ... PWR_PMD7  PMD0-PMD7, 1 = module off (default 0x00: all
+ *                      on), ORed from the device header's
+ *                      _PMDn_<module>MD_MASK names, so that no bit position
+ *                      is written out here. A module that is off ignores
+ *                      its registers, so call pwr_init() before setting any
+ *                      of them up.
+ *                      SYSCMD (PMD0 bit 7) would stop the clock of every
+ *                      peripheral and Timer3 (PMD1 bit 3) is the time base
+ *                      below; both are kept on whatever these say
+ *   PWR_DOZE_RATIO     CPUDOZE.DOZE of PWR_DOZE: the core runs one cycle in
+ *                      2^(PWR_DOZE_RATIO + 1) (default 7, 1:256)
+ *
+ * The states, from the most current to the least:
+ *
+ *   PWR_RUN            the core at full speed
+ *   PWR_DOZE           the core slowed down until an interrupt comes (ROI),
+ *                      the peripherals at full speed. Only worth it in a
+ *                      wait that polls a flag with no interrupt behind it
+ *   PWR_IDLE           the core stopped, Fosc running: timers on Fosc/4,
+ *                      the DMA and the ADC on Fosc keep going
+ *   PWR_SLEEP          Fosc stopped too: only what runs on LFINTOSC,
+ *                      MFINTOSC, SOSC or ADCRC keeps going and can wake it
+ *
+ * Any enabled interrupt ends a wait: an IOC edge, a timer period, an ADC
+ * threshold (ADTIF), and so on. pwr_wait() is called with interrupts off,
+ * once main() has found nothing to do, so an interrupt that comes in
+ * between is not slept through (a raised flag ends Sleep and Idle with GIE
+ * clear as well); it returns with them off, and the ISR runs at the ei():
+ *
+ *       di();
+ *       if (nothing to do)
+ *           pwr_wait(PWR_IDLE);
+ *       ei();
+ *
+ * Time is counted on Timer3, free-running on LFINTOSC (31 kHz, 32 us a
+ * count, PWR_COUNT_HZ) in every state. pwr_wait() adds the time since the
+ * last one returned to pwr_time[PWR_RUN] and the time it waited to
+ * pwr_time[state]; the ISR that ends a wait counts as PWR_RUN, except in
+ * Doze, where it runs inside the wait. TMR3IF marks one wrap (2.1 s), so
+ * a stretch of over 4.2 s between two reads comes up 2.1 s short for every
+ * wrap past the first.
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <xc.h>
+#include <stdint.h>
+
+#ifndef PWR_PMD0
+#define PWR_PMD0            0x00
+#endif
+#ifndef PWR_PMD1
+#define PWR_PMD1            0x00
+#endif
+#ifndef PWR_PMD2
+#define PWR_PMD2            0x00
+#endif
+#ifndef PWR_PMD3
+#define PWR_PMD3            0x00
+#endif
+#ifndef PWR_PMD4
+#define PWR_PMD4            0x00
+#endif
+#ifndef PWR_PMD5
+#define PWR_PMD5            0x00
+#endif
+#ifndef PWR_PMD6
+#define PWR_PMD6            0x00
+#endif
+#ifndef PWR_PMD7
+#define PWR_PMD7            0x00
+#endif
+#ifndef PWR_DOZE_RATIO
+#define PWR_DOZE_RATIO      7
+#endif
+
+#if PWR_DOZE_RATIO < 0 || PWR_DOZE_RATIO > 7
+#error "PWR_DOZE_RATIO must be 0 (1:2) to 7 (1:256)"
+#endif
+
+#define PWR_RUN             0
+#define PWR_DOZE            1
+#define PWR_IDLE            2
+#define PWR_SLEEP           3
+#define PWR_STATES          4
+
+#define PWR_COUNT_HZ        31000UL // LFINTOSC: Timer3 counts a second
+#define PWR_SYSCMD          _PMD0_SYSCMD_MASK
+#define PWR_TMR3MD          _PMD1_TMR3MD_MASK
+
+uint32_t pwr_time[PWR_STATES];              // Timer3 counts spent in each state
+uint32_t pwr_waits[PWR_STATES];             // pwr_wait() calls per state
+uint16_t pwr_wraps = 0;                     // Timer3 overflows seen, the top half of the count
+uint32_t pwr_mark = 0;                      // count when the current state began
+
+void pwr_init(void);
+uint32_t pwr_now(void);
+void pwr_wait(uint8_t state);
+
+/*
+ * This function is used to switch off the modules in PWR_PMD0-PWR_PMD7,
+ * start Timer3 and clear the counts. Call it first thing in main().
+ * params: none
+ * return: none
+ */
+void pwr_init(void) {
+    PMD0 = PWR_PMD0 & (uint8_t)~PWR_SYSCMD;
+    PMD1 = PWR_PMD1 & (uint8_t)~PWR_TMR3MD;
+    PMD2 = PWR_PMD2;
+    PMD3 = PWR_PMD3;
+    PMD4 = PWR_PMD4;
+    PMD5 = PWR_PMD5;
+    PMD6 = PWR_PMD6;
+    PMD7 = PWR_PMD7;
+
+    T3CON = 0b00000110;             // off, 16-bit reads (RD16), not synchronized (runs in Sleep), 1:1
+    T3CLK = 0b00000100;             // LFINTOSC
+    TMR3H = 0;
+    TMR3L = 0;
+    PIR6bits.TMR3IF = 0;
+    T3CONbits.ON = 1;
+
+    for (uint8_t s = 0; s < PWR_STATES; s++) {
+        pwr_time[s] = 0;
+        pwr_waits[s] = 0;
+    }
+    pwr_wraps = 0;
+    pwr_mark = 0;
+}
+
+// Timer3 with its overflows on top (interrupts off). Reading TMR3L latches
+// TMR3H (RD16); a wrap just after it shows in TMR3IF, and then the count is
+// read again.
+uint32_t pwr_now(void) {
+    uint8_t low = TMR3L;
+    uint16_t count = ((uint16_t)TMR3H << 8) | low;
+
+    if (PIR6bits.TMR3IF) {
+        PIR6bits.TMR3IF = 0;
+        pwr_wraps++;
+        low = TMR3L;
+        count = ((uint16_t)TMR3H << 8) | low;
+    }
+    return ((uint32_t)pwr_wraps << 16) | count;
+}
+
+/*
+ * This function is used to wait in the given state for the next interrupt
+ * and count the time. Call it with interrupts off; they are off again when
+ * it returns.
+ * params: PWR_DOZE, PWR_IDLE or PWR_SLEEP (PWR_RUN only counts)
+ * return: none
+ */
+void pwr_wait(uint8_t state) {
+    uint32_t now = pwr_now();
+
+    pwr_time[PWR_RUN] += now - pwr_mark;
+    pwr_mark = now;
+
+    if (state == PWR_DOZE) {
+        CPUDOZE = 0b01100000 | PWR_DOZE_RATIO;  // DOZEN, ROI: the next ISR ends it
+        ei();
+        while (CPUDOZEbits.DOZEN)
+            NOP();
+        di();
+    } else if (state == PWR_IDLE || state == PWR_SLEEP) {
+        CPUDOZE = state == PWR_IDLE ? 0b10000000 : 0x00;  // IDLEN: SLEEP keeps Fosc
+        SLEEP();
+    }
+
+    now = pwr_now();
+    pwr_time[state] += now - pwr_mark;
+    pwr_waits[state]++;
+    pwr_mark = now;
+}
+
+#endif /* POWER_H */
@@ -0,0 +1,279 @@
+/*
+ * File:   profile.h
+ * Author: Christian Gonzalez
+ *
+ * Cycle profiler that runs on the chip: PROF_ENTER(id) and PROF_EXIT(id)
+ * around a piece of code time it with Timer1, keep the count, shortest,
+ * longest and total time of every probe, and the last enters and exits in
+ * a RAM ring. PROF_DUMP() sends all of it out of UART1 as one binary
+ * record, which HostSim/prof_decode turns into a table. Include this file
+ * once, after defining _XTAL_FREQ, having set:
+ *
+ *   PROF_ENABLE        define it (-DPROF_ENABLE) to build the probes in;
+ *                      without it every PROF_ macro is empty and nothing
+ *                      here is compiled, so the probes can stay in the code
+ *   PROF_PROBES        probes, ids 0 to PROF_PROBES - 1 (default 8)
+ *   PROF_NAMES         their names in one string, comma separated, e.g.
+ *                      "LCD_ISR,LCD_Flush", under 256 characters; sent
+ *                      with the dump
+ *   PROF_TRACE_SIZE    enters/exits kept, power of two (default 32)
+ *   PROF_TX_PPS        RxyPPS register of the TX pin (default RC6PPS); the
+ *                      pin must be an output (TRISx) already
+ *   PROF_BAUD          default 38400 (0.2% off at 4 MHz); the build stops
+ *                      if _XTAL_FREQ cannot make it within 2%
+ *
+ * Times are Timer1 counts, free-running on Fosc/4 (1 us at 4 MHz), the
+ * same set-up as Common/events.h, so the two share Timer1; prof_init()
+ * only starts it if it is off. A time covers everything that ran in
+ * between, ISRs included, and must stay under 65536 counts.
+ *
+ * An enter or exit turns interrupts off for a few instructions, so ISRs
+ * and main() can both have probes; a probe must not be entered again
+ * before its exit. Nothing is recorded while PROF_DUMP() is sending, which
+ * waits on the UART (about 25 ms per 100 bytes at 38400 baud), so call it
+ * from main(), where that wait does no harm.
+ *
+ * The record, multi-byte fields little-endian:
+ *
+ *   'P' 'F' 1          magic and format version
+ *   probes, entries    PROF_PROBES and the ring entries that follow
+ *   counts per second  4 bytes, Fosc/4
+ *   names              length byte, then PROF_NAMES without its 0
+ *   per probe          count, total (4 bytes each), shortest, longest (2)
+ *   per ring entry     id (bit 7 set on an exit), Timer1 (2), oldest first
+ *   check              makes the sum of every byte after the magic 0
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#ifdef PROF_ENABLE
+
+#include <xc.h>
+#include <stdint.h>
+
+#ifndef PROF_PROBES
+#define PROF_PROBES         8
+#endif
+#ifndef PROF_NAMES
+#define PROF_NAMES          ""
+#endif
+#ifndef PROF_TRACE_SIZE
+#define PROF_TRACE_SIZE     32
+#endif
+#ifndef PROF_TX_PPS
+#define PROF_TX_PPS         RC6PPS
+#endif
+#ifndef PROF_BAUD
+#define PROF_BAUD           38400
+#endif
+
+#ifndef _XTAL_FREQ
+#error "profile.h needs _XTAL_FREQ for the baud rate"
+#endif
+#if PROF_PROBES < 1 || PROF_PROBES > 127
+#error "PROF_PROBES must be 1 to 127"
+#endif
+#if (PROF_TRACE_SIZE & (PROF_TRACE_SIZE - 1)) != 0 || PROF_TRACE_SIZE > 128
+#error "PROF_TRACE_SIZE must be a power of two up to 128"
+#endif
+
+#define PROF_VERSION        1
+#define PROF_EXIT_FLAG      0x80    // ring entry id of an exit
+#define PROF_PPS_U1TX       0x13    // RxyPPS: UART1 TX
+#define PROF_BRG            ((_XTAL_FREQ / 4 + PROF_BAUD / 2) / PROF_BAUD - 1)  // BRGS: 4 clocks a bit
+#define PROF_BAUD_MADE      (_XTAL_FREQ / 4 / (PROF_BRG + 1))
+
+#if PROF_BRG < 0 || PROF_BRG > 0xFFFF
+#error "profile.h: PROF_BAUD cannot be made from _XTAL_FREQ"
+#elif PROF_BAUD_MADE * 50 > PROF_BAUD * 51 || PROF_BAUD_MADE * 50 < PROF_BAUD * 49
+#error "profile.h: PROF_BAUD is more than 2% off at _XTAL_FREQ"
+#endif
+
+#define PROF_INIT()         prof_init()
+#define PROF_ENTER(id)      prof_enter(id)
+#define PROF_EXIT(id)       prof_exit(id)
+#define PROF_DUMP()         prof_dump()
+
+typedef struct {
+    uint32_t count;
+    uint32_t total;         // Timer1 counts
+    uint16_t shortest;
+    uint16_t longest;
+} prof_stat_t;
+
+typedef struct {
+    uint8_t id;             // PROF_EXIT_FLAG set on an exit
+    uint16_t stamp;
+} prof_entry_t;
+
+const char prof_names[] = PROF_NAMES;
+prof_stat_t prof_stats[PROF_PROBES];
+uint16_t prof_begin[PROF_PROBES];           // Timer1 at the last enter
+prof_entry_t prof_trace[PROF_TRACE_SIZE];
+uint8_t prof_head = 0;                      // next ring entry to write
+uint8_t prof_entries = 0;                   // entries in the ring, up to PROF_TRACE_SIZE
+volatile uint8_t prof_sending = 0;          // PROF_DUMP() going on: record nothing
+uint8_t prof_check;
+
+void prof_init(void);
+void prof_clear(void);
+uint16_t prof_now(void);
+void prof_enter(uint8_t id);
+void prof_exit(uint8_t id);
+void prof_record(uint8_t id, uint16_t stamp);
+void prof_dump(void);
+void prof_put(uint8_t byte);
+void prof_put16(uint16_t value);
+void prof_put32(uint32_t value);
+
+/*
+ * This function is used to clear the counters and set up Timer1 (if it is
+ * not running yet) and UART1 for the dump. Call it before the first probe.
+ * params: none
+ * return: none
+ */
+void prof_init(void) {
+    prof_clear();
+
+    if (!T1CONbits.ON) {
+        T1CON = 0b00000010;         // off, 16-bit reads (RD16), synchronous, 1:1 prescaler
+        T1CLK = 0b00000001;         // Fosc/4
+        TMR1H = 0;
+        TMR1L = 0;
+        T1CONbits.ON = 1;
+    }
+
+    PROF_TX_PPS = PROF_PPS_U1TX;
+    U1CON1 = 0x00;                  // off while it is set up
+    U1CON0 = 0b10100000;            // BRGS, TXEN, asynchronous 8-bit
+    U1CON2 = 0x00;                  // 1 stop bit, no flow control
+    U1BRGH = (uint8_t)(PROF_BRG >> 8);
+    U1BRGL = (uint8_t)PROF_BRG;
+    U1CON1bits.ON = 1;
+}
+
+// Counters and ring back to empty
+void prof_clear(void) {
+    for (uint8_t i = 0; i < PROF_PROBES; i++) {
+        prof_stats[i].count = 0;
+        prof_stats[i].total = 0;
+        prof_stats[i].shortest = 0xFFFF;
+        prof_stats[i].longest = 0;
+    }
+    prof_head = 0;
+    prof_entries = 0;
+}
+
+// Reading TMR1L latches TMR1H (RD16); called with interrupts off, so no
+// ISR reads it in between
+uint16_t prof_now(void) {
+    uint8_t low = TMR1L;
+    return ((uint16_t)TMR1H << 8) | low;
+}
+
+void prof_enter(uint8_t id) {
+    uint8_t gie = INTCON0bits.GIE;
+
+    di();
+    if (!prof_sending) {
+        prof_begin[id] = prof_now();
+        prof_record(id, prof_begin[id]);
+    }
+    if (gie)
+        ei();
+}
+
+void prof_exit(uint8_t id) {
+    uint8_t gie = INTCON0bits.GIE;
+
+    di();
+    if (!prof_sending) {
+        uint16_t now = prof_now();
+        uint16_t length = now - prof_begin[id];
+        prof_stat_t *stat = &prof_stats[id];
+
+        stat->count++;
+        stat->total += length;
+        if (length < stat->shortest)
+            stat->shortest = length;
+        if (length > stat->longest)
+            stat->longest = length;
+        prof_record(id | PROF_EXIT_FLAG, now);
+    }
+    if (gie)
+        ei();
+}
+
+// Ring entry, over the oldest once the ring is full (interrupts off)
+void prof_record(uint8_t id, uint16_t stamp) {
+    prof_trace[prof_head].id = id;
+    prof_trace[prof_head].stamp = stamp;
+    prof_head = (prof_head + 1) & (PROF_TRACE_SIZE - 1);
+    if (prof_entries < PROF_TRACE_SIZE)
+        prof_entries++;
+}
+
+/*
+ * This function is used to send the record described at the top out of
+ * UART1, waiting for each byte. The counters keep going afterwards; call
+ * prof_clear() to start over.
+ * params: none
+ * return: none
+ */
+void prof_dump(void) {
+    uint8_t index = (prof_head - prof_entries) & (PROF_TRACE_SIZE - 1);
+
+    prof_sending = 1;
+    prof_put('P');
+    prof_put('F');
+    prof_check = 0;
+    prof_put(PROF_VERSION);
+    prof_put(PROF_PROBES);
+    prof_put(prof_entries);
+    prof_put32(_XTAL_FREQ / 4);
+    prof_put(sizeof(prof_names) - 1);
+    for (uint8_t i = 0; i < sizeof(prof_names) - 1; i++)
+        prof_put((uint8_t)prof_names[i]);
+    for (uint8_t i = 0; i < PROF_PROBES; i++) {
+        prof_put32(prof_stats[i].count);
+        prof_put32(prof_stats[i].total);
+        prof_put16(prof_stats[i].shortest);
+        prof_put16(prof_stats[i].longest);
+    }
+    for (uint8_t n = 0; n < prof_entries; n++) {
+        prof_put(prof_trace[index].id);
+        prof_put16(prof_trace[index].stamp);
+        index = (index + 1) & (PROF_TRACE_SIZE - 1);
+    }
+    prof_put((uint8_t)-prof_check);
+    prof_sending = 0;
+}
+
+// One byte into the UART buffer once there is room
+void prof_put(uint8_t byte) {
+    while (U1FIFObits.TXBF);
+    U1TXB = byte;
+    prof_check += byte;
+}
+
+void prof_put16(uint16_t value) {
+    prof_put((uint8_t)value);
+    prof_put((uint8_t)(value >> 8));
+}
+
+void prof_put32(uint32_t value) {
+    prof_put16((uint16_t)value);
+    prof_put16((uint16_t)(value >> 16));
+}
+
+#else
+
+#define PROF_INIT()
+#define PROF_ENTER(id)
+#define PROF_EXIT(id)
+#define PROF_DUMP()
+
+#endif /* PROF_ENABLE */
+
+#endif /* PROFILE_H */
@@ -0,0 +1,194 @@
+/*
+ * File:   scheduler.h
+ * Author: Christian Gonzalez
+ *
+ * Millisecond time base and cooperative task scheduler. The project calls
+ * sched_tick() from a 1 ms timer interrupt and runs sched_run() from its
+ * main loop; include this file once after setting:
+ *
+ *   SCHED_TASKS        task slots (default 8)
+ *   SCHED_BUSY()       nonzero when other work waits for main(), so
+ *                      sched_idle() does not go to sleep (default 0)
+ *   SCHED_WAIT()       how sched_idle() waits for the next interrupt, with
+ *                      interrupts off (default SLEEP(), Idle as sched_init()
+ *                      sets it; pwr_wait() of power.h counts it)
+ *
+ * A task is a plain void function. sched_every() runs it every period ms,
+ * sched_after() runs it once after a delay, and giving a task that already
+ * has a slot a new time just moves it (so sched_after() on a running
+ * one-shot restarts it). Tasks run one after the other from sched_run(),
+ * never from the interrupt, so they must not block: anything that used to
+ * be a __delay_ms() becomes a one-shot that does the second half later.
+ * Tasks may add or cancel tasks, themselves included.
+ *
+ * Times are 16-bit ms compared with wrap-around, so a delay or a deadline
+ * can be up to 32767 ms ahead, and a deadline that has passed only reads
+ * as expired for 32767 ms after it: to ask how long ago something was, keep
+ * its sched_now() and compare (uint16_t)(sched_now() - then). The slot table is only touched from main(),
+ * so an ISR that wants a task run sets a flag that main() hands on.
+ *
+ * sched_idle() puts the core in Idle until the next interrupt (the tick at
+ * the latest). Idle stops the CPU but keeps Fosc, so timers on Fosc/4 keep
+ * counting.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <xc.h>
+#include <stdint.h>
+
+#ifndef SCHED_TASKS
+#define SCHED_TASKS         8
+#endif
+#ifndef SCHED_BUSY
+#define SCHED_BUSY()        0
+#endif
+#ifndef SCHED_WAIT
+#define SCHED_WAIT()        SLEEP()
+#endif
+
+typedef void (*sched_task_t)(void);
+
+typedef struct {
+    sched_task_t task;      // 0 = free slot
+    uint16_t due;           // ms time of the next run
+    uint16_t period;        // 0 = one-shot
+} sched_slot_t;
+
+volatile uint16_t sched_ms = 0;             // ms since sched_init(), sched_tick() only
+uint16_t sched_seen = 0;                    // sched_ms when sched_run() last looked
+sched_slot_t sched_slots[SCHED_TASKS];
+uint8_t sched_full = 0;                     // tasks refused for lack of a slot
+
+void sched_init(void);
+void sched_tick(void);
+uint16_t sched_now(void);
+uint16_t sched_deadline(uint16_t ms);
+uint8_t sched_expired(uint16_t deadline);
+uint8_t sched_add(sched_task_t task, uint16_t delay, uint16_t period);
+uint8_t sched_every(sched_task_t task, uint16_t period);
+uint8_t sched_after(sched_task_t task, uint16_t delay);
+void sched_cancel(sched_task_t task);
+uint8_t sched_pending(sched_task_t task);
+void sched_run(void);
+void sched_idle(void);
+
+/*
+ * This function is used to empty the task table and select Idle for SLEEP.
+ * params: none
+ * return: none
+ */
+void sched_init(void) {
+    for (uint8_t i = 0; i < SCHED_TASKS; i++)
+        sched_slots[i].task = 0;
+    sched_ms = 0;
+    sched_seen = 0;
+    CPUDOZEbits.IDLEN = 1;
+}
+
+// One millisecond passed; called from the timer ISR
+void sched_tick(void) {
+    sched_ms++;
+}
+
+// sched_ms read twice so a tick between its two bytes is not torn
+uint16_t sched_now(void) {
+    uint16_t now;
+    do {
+        now = sched_ms;
+    } while (now != sched_ms);
+    return now;
+}
+
+// Deadline ms from now, for sched_expired()
+uint16_t sched_deadline(uint16_t ms) {
+    return sched_now() + ms;
+}
+
+uint8_t sched_expired(uint16_t deadline) {
+    return (int16_t)(sched_now() - deadline) >= 0;
+}
+
+/*
+ * This function is used to give a task its first run and its period.
+ * params: task, ms to the first run, ms between runs (0 = run once)
+ * return: 1 if it was scheduled, 0 if every slot is taken
+ */
+uint8_t sched_add(sched_task_t task, uint16_t delay, uint16_t period) {
+    uint8_t slot = SCHED_TASKS;
+
+    for (uint8_t i = 0; i < SCHED_TASKS; i++) {
+        if (sched_slots[i].task == task) {
+            slot = i;
+            break;
+        }
+        if (sched_slots[i].task == 0 && slot == SCHED_TASKS)
+            slot = i;
+    }
+    if (slot == SCHED_TASKS) {
+        sched_full++;
+        return 0;
+    }
+    sched_slots[slot].due = sched_now() + delay;
+    sched_slots[slot].period = period;
+    sched_slots[slot].task = task;
+    return 1;
+}
+
+uint8_t sched_every(sched_task_t task, uint16_t period) {
+    return sched_add(task, period, period);
+}
+
+uint8_t sched_after(sched_task_t task, uint16_t delay) {
+    return sched_add(task, delay, 0);
+}
+
+void sched_cancel(sched_task_t task) {
+    for (uint8_t i = 0; i < SCHED_TASKS; i++)
+        if (sched_slots[i].task == task)
+            sched_slots[i].task = 0;
+}
+
+uint8_t sched_pending(sched_task_t task) {
+    for (uint8_t i = 0; i < SCHED_TASKS; i++)
+        if (sched_slots[i].task == task)
+            return 1;
+    return 0;
+}
+
+/*
+ * This function is used to run every task that is due. A periodic task
+ * keeps its phase (due += period) unless it fell a whole period behind.
+ * params: none
+ * return: none
+ */
+void sched_run(void) {
+    uint16_t now = sched_now();
+
+    sched_seen = now;
+    for (uint8_t i = 0; i < SCHED_TASKS; i++) {
+        sched_task_t task = sched_slots[i].task;
+        if (task == 0 || (int16_t)(now - sched_slots[i].due) < 0)
+            continue;
+        if (sched_slots[i].period == 0) {
+            sched_slots[i].task = 0;        // freed first, so it can re-add itself
+        } else {
+            sched_slots[i].due += sched_slots[i].period;
+            if ((int16_t)(now - sched_slots[i].due) >= 0)
+                sched_slots[i].due = now + sched_slots[i].period;
+        }
+        task();
+    }
+}
+
+// Idle until the next interrupt, unless a tick already came in since
+// sched_run() looked (then there may be work due) or SCHED_BUSY() says so
+void sched_idle(void) {
+    di();
+    if (sched_ms == sched_seen && !SCHED_BUSY())
+        SCHED_WAIT();
+    ei();
+}
+
+#endif /* SCHEDULER_H */
@@ -0,0 +1,186 @@
+/*
+ * File:   seg_display.h
+ * Author: Christian Gonzalez
+ *
+ * Multiplexed common-cathode 7-segment display, refreshed one digit at a
+ * time from a timer interrupt. main() only writes the RAM buffer
+ * (display_set(), display_text(), display_brightness()) and never waits on
+ * the display. Define the wiring below, then include this file once:
+ *
+ *   DISPLAY_SEG_PORT   port letter of the segments, a-g on bits 0-6 and
+ *                      the point on bit 7, high = lit
+ *   DISPLAY_DIG_PORT   port letter of the digit selects, high = digit on
+ *                      (each drives the transistor on one cathode)
+ *   DISPLAY_DIG_FIRST  pin of digit 0, the rightmost; consecutive pins
+ *   DISPLAY_DIGITS     number of digits, 1 to 8
+ *   DISPLAY_PR         period register of the timer that calls display_tick()
+ *   DISPLAY_SLOT_COUNTS timer counts each digit gets (default 128)
+ *   DISPLAY_LEVELS     brightness steps, the top one always on (default 8)
+ *
+ * Each digit has a slot of DISPLAY_SLOT_COUNTS, so with DISPLAY_DIGITS
+ * digits each one is refreshed every DISPLAY_DIGITS slots (8 x 1.024 ms
+ * = 122 Hz with an 8 us count, well clear of flicker). A digit below full
+ * brightness is lit for level / DISPLAY_LEVELS of its slot: display_tick()
+ * sets the timer period to the lit part, and on the next match to the
+ * rest of the slot, so the timer does the PWM and a full or dark digit
+ * costs one interrupt per slot, a dimmed one two. The shortest lit part,
+ * DISPLAY_SLOT_COUNTS / DISPLAY_LEVELS counts, has to be longer than the
+ * interrupt takes to write the period, or the match is missed.
+ *
+ * The selects are turned off before the segments change, so the last
+ * digit does not show as a ghost on the next one.
+ *
+ * DISPLAY_COST(cycles) is called on each path of display_tick() with the
+ * cycles of its PIC18 code; it does nothing on the chip and lets HostSim
+ * time the refresh.
+ */
+
+#ifndef SEG_DISPLAY_H
+#define SEG_DISPLAY_H
+
+#include <xc.h>
+#include <stdint.h>
+#include "seg_font.h"
+
+#ifndef DISPLAY_SLOT_COUNTS
+#define DISPLAY_SLOT_COUNTS 128
+#endif
+#ifndef DISPLAY_LEVELS
+#define DISPLAY_LEVELS      8
+#endif
+#ifndef DISPLAY_COST
+#define DISPLAY_COST(cycles)
+#endif
+
+#if DISPLAY_DIGITS < 1 || DISPLAY_DIGITS + DISPLAY_DIG_FIRST > 8
+#error "DISPLAY_DIGITS digits from DISPLAY_DIG_FIRST must fit in one port"
+#endif
+#if DISPLAY_SLOT_COUNTS > 256 || DISPLAY_SLOT_COUNTS % DISPLAY_LEVELS != 0
+#error "DISPLAY_SLOT_COUNTS must be at most 256 and a multiple of DISPLAY_LEVELS"
+#endif
+
+#define DISPLAY_LEVEL_COUNTS (DISPLAY_SLOT_COUNTS / DISPLAY_LEVELS)
+#define DISPLAY_TICK_START  10      // cycles of display_tick() starting a slot
+#define DISPLAY_TICK_DIGIT  20      // more to light the digit
+#define DISPLAY_TICK_DIM    12      // more for a dimmed one
+#define DISPLAY_TICK_END    14      // cycles of display_tick() ending the lit part
+
+// Segments: bit 0 = a ... bit 6 = g, bit 7 = point
+#define DISPLAY_POINT       0x80
+#define DISPLAY_MINUS       0x40
+#define DISPLAY_LOWER_R     0x50
+#define DISPLAY_LOWER_O     0x5C
+
+// Port registers from the port letter: DISPLAY_SFR(LAT, DISPLAY_SEG_PORT) -> LATD
+#define DISPLAY_CAT(reg, port)  reg##port
+#define DISPLAY_SFR(reg, port)  DISPLAY_CAT(reg, port)
+
+#define DISPLAY_DIG_MASK    ((uint8_t)(((1u << DISPLAY_DIGITS) - 1) << DISPLAY_DIG_FIRST))
+
+const uint8_t display_bit[8] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+
+volatile uint8_t display_buffer[DISPLAY_DIGITS];    // segments, digit 0 = rightmost
+volatile uint8_t display_level[DISPLAY_DIGITS];     // 0 = dark ... DISPLAY_LEVELS = full
+uint8_t display_digit = 0;                  // digit of the running slot
+uint8_t display_dark = 0;                   // counts left in the slot once the lit part ends, 0 = none
+
+void display_init(void);
+void display_tick(void);
+void display_clear(void);
+void display_set(uint8_t digit, uint8_t segments);
+void display_brightness(uint8_t digit, uint8_t level);
+void display_text(const char *text);
+uint8_t display_glyph(char c);
+
+/*
+ * This function is used to set the display pins up, all digits off, the
+ * buffer blank and every digit at full brightness. The timer is the
+ * project's: it only has to call display_tick() on each period match.
+ * params: none
+ * return: none
+ */
+void display_init(void) {
+    DISPLAY_SFR(ANSEL, DISPLAY_SEG_PORT) = 0x00;
+    DISPLAY_SFR(LAT, DISPLAY_SEG_PORT) = 0x00;
+    DISPLAY_SFR(TRIS, DISPLAY_SEG_PORT) = 0x00;
+    DISPLAY_SFR(ANSEL, DISPLAY_DIG_PORT) &= (uint8_t)~DISPLAY_DIG_MASK;
+    DISPLAY_SFR(LAT, DISPLAY_DIG_PORT) &= (uint8_t)~DISPLAY_DIG_MASK;
+    DISPLAY_SFR(TRIS, DISPLAY_DIG_PORT) &= (uint8_t)~DISPLAY_DIG_MASK;
+
+    for (uint8_t i = 0; i < DISPLAY_DIGITS; i++)
+        display_level[i] = DISPLAY_LEVELS;
+    display_clear();
+    display_digit = 0;
+    display_dark = 0;
+    DISPLAY_PR = DISPLAY_SLOT_COUNTS - 1;
+}
+
+/*
+ * This function is used from the timer interrupt: it ends the lit part of
+ * a dimmed digit, or else starts the slot of the next digit.
+ * params: none
+ * return: none
+ */
+void display_tick(void) {
+    uint8_t digit;
+    uint8_t level;
+
+    if (display_dark != 0) {
+        DISPLAY_SFR(LAT, DISPLAY_DIG_PORT) &= (uint8_t)~DISPLAY_DIG_MASK;
+        DISPLAY_PR = display_dark - 1;
+        display_dark = 0;
+        DISPLAY_COST(DISPLAY_TICK_END);
+        return;
+    }
+
+    DISPLAY_SFR(LAT, DISPLAY_DIG_PORT) &= (uint8_t)~DISPLAY_DIG_MASK;
+    digit = display_digit + 1;
+    if (digit == DISPLAY_DIGITS)
+        digit = 0;
+    display_digit = digit;
+    level = display_level[digit];
+    DISPLAY_COST(DISPLAY_TICK_START);
+    if (level == 0) {
+        DISPLAY_PR = DISPLAY_SLOT_COUNTS - 1;
+        return;
+    }
+
+    DISPLAY_SFR(LAT, DISPLAY_SEG_PORT) = display_buffer[digit];
+    DISPLAY_SFR(LAT, DISPLAY_DIG_PORT) |= display_bit[DISPLAY_DIG_FIRST + digit];
+    DISPLAY_COST(DISPLAY_TICK_DIGIT);
+    if (level >= DISPLAY_LEVELS) {
+        DISPLAY_PR = DISPLAY_SLOT_COUNTS - 1;
+    } else {
+        uint8_t lit = level * DISPLAY_LEVEL_COUNTS;
+        DISPLAY_PR = lit - 1;
+        display_dark = DISPLAY_SLOT_COUNTS - lit;
+        DISPLAY_COST(DISPLAY_TICK_DIM);
+    }
+}
+
+void display_clear(void) {
+    for (uint8_t i = 0; i < DISPLAY_DIGITS; i++)
+        display_buffer[i] = 0;
+}
+
+void display_set(uint8_t digit, uint8_t segments) {
+    display_buffer[digit] = segments;
+}
+
+// 0 = dark, DISPLAY_LEVELS = full
+void display_brightness(uint8_t digit, uint8_t level) {
+    display_level[digit] = level > DISPLAY_LEVELS ? DISPLAY_LEVELS : level;
+}
+
+// Text from the leftmost digit, cut off or padded with blanks
+void display_text(const char *text) {
+    for (uint8_t i = DISPLAY_DIGITS; i-- > 0;)
+        display_buffer[i] = *text ? display_glyph(*text++) : 0;
+}
+
+// Segments of a character, one read of the shared font (seg_font.h); no glyph is blank
+uint8_t display_glyph(char c) {
+    return SEG_GLYPH(c);
+}
+
+#endif /* SEG_DISPLAY_H */
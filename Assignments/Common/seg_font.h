@@ -0,0 +1,46 @@
+/*
+ * File:   seg_font.h
+ * Generated by HostSim/seg_font_gen from Common/seg_font.def: edit the
+ * .def and run "make font" in Assignments/HostSim, not this file.
+ *
+ * 7-segment font, bits 0-7: abcdefg., lit = high.
+ * seg_font is indexed by ASCII code, seg_hex by value, so every character
+ * is one table read:
+ *
+ *   LATD = SEG_GLYPH(c);     LATB = seg_hex[n & 0x0F];
+ *
+ * A character the font has no glyph for is blank.
+ */
+
+#ifndef SEG_FONT_H
+#define SEG_FONT_H
+
+#include <stdint.h>
+
+const uint8_t seg_font[128] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // ........
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // ........
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // ........
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // ........
+    0x00, 0x00, 0x22, 0x49, 0x00, 0x00, 0x00, 0x02,    //  !"#$%&'
+    0x39, 0x0F, 0x63, 0x00, 0x00, 0x40, 0x80, 0x52,    // ()*+,-./
+    0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07,    // 01234567
+    0x7F, 0x6F, 0x00, 0x00, 0x00, 0x48, 0x00, 0x53,    // 89:;<=>?
+    0x00, 0x77, 0x7C, 0x39, 0x5E, 0x79, 0x71, 0x3D,    // @ABCDEFG
+    0x76, 0x30, 0x1E, 0x75, 0x38, 0x37, 0x54, 0x3F,    // HIJKLMNO
+    0x73, 0x67, 0x50, 0x6D, 0x78, 0x3E, 0x3E, 0x2A,    // PQRSTUVW
+    0x76, 0x6E, 0x5B, 0x39, 0x64, 0x0F, 0x23, 0x08,    // XYZ[.]^_
+    0x00, 0x77, 0x7C, 0x58, 0x5E, 0x79, 0x71, 0x3D,    // `abcdefg
+    0x74, 0x10, 0x1E, 0x75, 0x38, 0x37, 0x54, 0x5C,    // hijklmno
+    0x73, 0x67, 0x50, 0x6D, 0x78, 0x1C, 0x3E, 0x2A,    // pqrstuvw
+    0x76, 0x6E, 0x5B, 0x00, 0x30, 0x00, 0x00, 0x00,    // xyz{|}~.
+};
+
+const uint8_t seg_hex[16] = {
+    0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07,
+    0x7F, 0x6F, 0x77, 0x7C, 0x39, 0x5E, 0x79, 0x71,
+};
+
+#define SEG_GLYPH(c)      (seg_font[(uint8_t)(c) & 0x7F])
+
+#endif /* SEG_FONT_H */
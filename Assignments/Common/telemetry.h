@@ -0,0 +1,206 @@
+/*
+ * File:   telemetry.h
+ * Author: Christian Gonzalez
+ *
+ * ADC samples streamed out of UART1 in binary packets, sent by DMA2: the
+ * CPU only builds a packet, and DMA2, triggered by U1TXIF whenever the
+ * UART has room, writes it into U1TXB byte by byte. HostSim/tlm_decode
+ * reads the stream back. Include this file once, after
+ * "../Common/events.h" and after defining _XTAL_FREQ, having set:
+ *
+ *   TLM_SAMPLES        samples a packet holds at most (default 8)
+ *   TLM_TX_PPS         RxyPPS register of the TX pin (default RC6PPS); the
+ *                      pin must be an output (TRISx) already
+ *   TLM_BAUD           default 125000 (exact at 4 MHz); the build stops if
+ *                      _XTAL_FREQ cannot make it within 2%
+ *
+ * A packet, multi-byte fields little-endian:
+ *
+ *   0xA5 0x5A          sync
+ *   sequence           1 byte, one more every packet (lost ones show)
+ *   count              samples in it
+ *   first              4 bytes: number of its first sample
+ *   period             2 bytes: us from one sample to the next
+ *   per sample         2 bytes: ADC code (bits 0-11), channel (bits 12-15)
+ *   check              2 bytes: Fletcher-16 of sequence to the last sample
+ *
+ * so sample i of a packet was taken at (first + i) x period us.
+ *
+ * Two packet buffers: one is sent while the next is built. tlm_send() with
+ * both taken drops the new packet and counts it in tlm_dropped, so a
+ * stream that outruns the baud rate loses whole packets and never makes
+ * the caller wait. DMA2 must not be used for anything else, and the system
+ * arbiter must already be locked (PRLOCKED) for it to run.
+ *
+ * Tlm_ISR() does not post, but is an EVT_ISR() so it goes into the same
+ * vector table.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <xc.h>
+#include <stdint.h>
+
+#ifndef TLM_SAMPLES
+#define TLM_SAMPLES         8
+#endif
+#ifndef TLM_TX_PPS
+#define TLM_TX_PPS          RC6PPS
+#endif
+#ifndef TLM_BAUD
+#define TLM_BAUD            125000
+#endif
+
+#ifndef _XTAL_FREQ
+#error "telemetry.h needs _XTAL_FREQ for the baud rate"
+#endif
+#if TLM_SAMPLES < 1 || TLM_SAMPLES > 120
+#error "TLM_SAMPLES must be 1 to 120"
+#endif
+
+#define TLM_SYNC0           0xA5
+#define TLM_SYNC1           0x5A
+#define TLM_HEADER          10      // sync, sequence, count, first, period
+#define TLM_PACKET          (TLM_HEADER + 2 * TLM_SAMPLES + 2)
+#define TLM_PPS_U1TX        0x13    // RxyPPS: UART1 TX
+#define TLM_TRIGGER_U1TX    28      // DMAxSIRQ: U1TXIF
+#define TLM_BRG             ((_XTAL_FREQ / 4 + TLM_BAUD / 2) / TLM_BAUD - 1)  // BRGS: 4 clocks a bit
+#define TLM_BAUD_MADE       (_XTAL_FREQ / 4 / (TLM_BRG + 1))
+
+#if TLM_BRG < 0 || TLM_BRG > 0xFFFF
+#error "telemetry.h: TLM_BAUD cannot be made from _XTAL_FREQ"
+#elif TLM_BAUD_MADE * 50 > TLM_BAUD * 51 || TLM_BAUD_MADE * 50 < TLM_BAUD * 49
+#error "telemetry.h: TLM_BAUD is more than 2% off at _XTAL_FREQ"
+#endif
+
+uint8_t tlm_buf[2][TLM_PACKET];
+uint8_t tlm_length[2];
+uint8_t tlm_current = 0;                // buffer DMA2 sends (or sent last)
+volatile uint8_t tlm_busy = 0;          // DMA2 is sending it
+volatile uint8_t tlm_queued = 0;        // the other one is built and waits
+uint8_t tlm_sequence = 0;
+volatile uint16_t tlm_packets = 0;      // packets sent
+uint16_t tlm_dropped = 0;               // packets lost to two full buffers
+
+void tlm_init(void);
+uint8_t tlm_send(uint8_t channel, uint32_t first, uint16_t period,
+                 const uint16_t *codes, uint8_t count);
+void tlm_start(uint8_t buffer);
+EVT_ISR(Tlm_ISR, irq(IRQ_DMA2SCNT));
+
+/*
+ * This function is used to set up UART1 on TLM_TX_PPS and DMA2 from a
+ * packet buffer into U1TXB. Call it after the arbiter is locked.
+ * params: none
+ * return: none
+ */
+void tlm_init(void) {
+    tlm_current = 0;
+    tlm_busy = 0;
+    tlm_queued = 0;
+    tlm_sequence = 0;
+    tlm_packets = 0;
+    tlm_dropped = 0;
+
+    U1CON1 = 0x00;                  // off while it is set up
+    DMA2CON0 = 0x00;
+    DMA2CON1 = 0b00000011;          // DMODE = 00 fixed, SMR = 00 data space, SMODE = 01 increment, SSTP
+    DMA2DSA = (__uint24)&U1TXB;
+    DMA2DSZ = 1;
+    DMA2SIRQ = TLM_TRIGGER_U1TX;
+    PIR5bits.DMA2SCNTIF = 0;
+    PIE5bits.DMA2SCNTIE = 1;
+
+    TLM_TX_PPS = TLM_PPS_U1TX;
+    U1CON0 = 0b10100000;            // BRGS, TXEN, asynchronous 8-bit
+    U1CON2 = 0x00;                  // 1 stop bit, no flow control
+    U1BRGH = (uint8_t)(TLM_BRG >> 8);
+    U1BRGL = (uint8_t)TLM_BRG;
+    U1CON1bits.ON = 1;
+}
+
+/*
+ * This function is used to queue one packet of samples, all from one
+ * channel and taken one period apart. Call it from main().
+ * params: channel (0-15), number of the first sample, period in us, the
+ *         12-bit codes and how many (up to TLM_SAMPLES)
+ * return: 1 if it went out or waits, 0 if both buffers were taken
+ */
+uint8_t tlm_send(uint8_t channel, uint32_t first, uint16_t period,
+                 const uint16_t *codes, uint8_t count) {
+    uint8_t buffer;
+    uint8_t *p;
+    uint8_t sum1 = 0, sum2 = 0;
+
+    if (tlm_queued) {
+        tlm_dropped++;
+        return 0;
+    }
+    buffer = tlm_busy ? tlm_current ^ 1 : tlm_current;   // not the one being sent
+    if (count > TLM_SAMPLES)
+        count = TLM_SAMPLES;
+
+    p = tlm_buf[buffer];
+    *p++ = TLM_SYNC0;
+    *p++ = TLM_SYNC1;
+    *p++ = tlm_sequence++;
+    *p++ = count;
+    *p++ = (uint8_t)first;
+    *p++ = (uint8_t)(first >> 8);
+    *p++ = (uint8_t)(first >> 16);
+    *p++ = (uint8_t)(first >> 24);
+    *p++ = (uint8_t)period;
+    *p++ = (uint8_t)(period >> 8);
+    for (uint8_t i = 0; i < count; i++) {
+        uint16_t sample = (codes[i] & 0x0FFF) | ((uint16_t)channel << 12);
+        *p++ = (uint8_t)sample;
+        *p++ = (uint8_t)(sample >> 8);
+    }
+    for (uint8_t *q = &tlm_buf[buffer][2]; q < p; q++) {
+        sum1 += *q;                 // Fletcher-16: sums mod 255
+        if (sum1 < *q || sum1 == 255)
+            sum1 -= 255;
+        sum2 += sum1;
+        if (sum2 < sum1 || sum2 == 255)
+            sum2 -= 255;
+    }
+    *p++ = sum1;
+    *p++ = sum2;
+    tlm_length[buffer] = (uint8_t)(p - tlm_buf[buffer]);
+
+    di();
+    if (tlm_busy)
+        tlm_queued = 1;             // Tlm_ISR() starts it
+    else
+        tlm_start(buffer);
+    ei();
+    return 1;
+}
+
+// DMA2 from the start of a buffer (interrupts off). EN off and on again
+// reloads the source pointer and count.
+void tlm_start(uint8_t buffer) {
+    tlm_current = buffer;
+    tlm_busy = 1;
+    DMA2CON0 = 0x00;
+    DMA2SSA = (__uint24)tlm_buf[buffer];
+    DMA2SSZ = tlm_length[buffer];
+    DMA2CON0 = 0b11000000;          // EN, SIRQEN: U1TXIF moves the bytes
+}
+
+// The last byte of a packet is in the UART: the waiting one, if any
+EVT_ISR(Tlm_ISR, irq(IRQ_DMA2SCNT)) {
+    EVT_ISR_BEGIN();
+    PIR5bits.DMA2SCNTIF = 0;
+    tlm_packets++;
+    if (tlm_queued) {
+        tlm_queued = 0;
+        tlm_start(tlm_current ^ 1);
+    } else {
+        tlm_busy = 0;
+    }
+    EVT_ISR_END();
+}
+
+#endif /* TELEMETRY_H */
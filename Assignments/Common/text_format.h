@@ -0,0 +1,138 @@
+/*
+ * File:   text_format.h
+ * Author: Christian Gonzalez
+ *
+ * Small number-to-text formatting for the LCD projects, in place of
+ * sprintf() and strcat(). Every function writes exactly the width it is
+ * given, right-aligned and padded with spaces, and returns the position
+ * after it, so a line is built field by field straight into a caller's
+ * buffer (or an LCD shadow row) and can never run past it. Nothing is
+ * NUL-terminated; the caller adds the 0 when it wants a C string. A value
+ * that does not fit fills its field with '#'.
+ *
+ * Only the unsigned integer and text fields are always there; define the
+ * settings below before including this file to add the others:
+ *
+ *   FMT_SIGNED         fmt_int(), signed integers with a '-' sign
+ *   FMT_FIXED          fmt_fixed(), a scaled integer with a decimal point
+ *                      (1234 with 3 places is "1.234")
+ *
+ * Digits come from subtracting powers of ten, at most 9 times per digit,
+ * so there is no division and no printf machinery behind it.
+ */
+
+#ifndef TEXT_FORMAT_H
+#define TEXT_FORMAT_H
+
+#include <stdint.h>
+
+#define FMT_DIGITS          5       // digits of a 16-bit value
+
+const uint16_t fmt_power[FMT_DIGITS - 1] = {10000, 1000, 100, 10};
+
+uint8_t fmt_digits(char *digits, uint16_t value);
+char *fmt_field(char *out, const char *digits, uint8_t count, char sign, uint8_t places, uint8_t width);
+char *fmt_uint(char *out, uint16_t value, uint8_t width);
+char *fmt_text(char *out, const char *text, uint8_t width);
+#ifdef FMT_SIGNED
+char *fmt_int(char *out, int16_t value, uint8_t width);
+#endif
+#ifdef FMT_FIXED
+char *fmt_fixed(char *out, uint16_t value, uint8_t places, uint8_t width);
+#endif
+
+/*
+ * This function is used to split a value into its FMT_DIGITS decimal
+ * digits, leading zeros included.
+ * params: 5-char digit buffer, value
+ * return: digits without the leading zeros (at least 1)
+ */
+uint8_t fmt_digits(char *digits, uint16_t value) {
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < FMT_DIGITS - 1; i++) {
+        char digit = '0';
+        while (value >= fmt_power[i]) {
+            value -= fmt_power[i];
+            digit++;
+        }
+        digits[i] = digit;
+        if (count == 0 && digit != '0')
+            count = FMT_DIGITS - i;
+    }
+    digits[FMT_DIGITS - 1] = '0' + (char)value;
+    return count ? count : 1;
+}
+
+/*
+ * This function is used to write the last count digits right-aligned, with
+ * an optional sign in front and a decimal point before the last places.
+ * params: output, digit buffer, digits to show, sign (0 = none), places, width
+ * return: output position after the field
+ */
+char *fmt_field(char *out, const char *digits, uint8_t count, char sign, uint8_t places, uint8_t width) {
+    uint8_t length = count + (sign ? 1 : 0) + (places ? 1 : 0);
+    char *end = out + width;
+
+    if (length > width) {
+        while (out != end)
+            *out++ = '#';
+        return end;
+    }
+    while (length++ < width)
+        *out++ = ' ';
+    if (sign)
+        *out++ = sign;
+    digits += FMT_DIGITS - count;
+    while (count) {
+        if (count-- == places)
+            *out++ = '.';
+        *out++ = *digits++;
+    }
+    return end;
+}
+
+char *fmt_uint(char *out, uint16_t value, uint8_t width) {
+    char digits[FMT_DIGITS];
+    uint8_t count = fmt_digits(digits, value);
+    return fmt_field(out, digits, count, 0, 0, width);
+}
+
+// Text left-aligned in the field, cut off or padded with spaces
+char *fmt_text(char *out, const char *text, uint8_t width) {
+    char *end = out + width;
+
+    while (out != end && *text)
+        *out++ = *text++;
+    while (out != end)
+        *out++ = ' ';
+    return end;
+}
+
+#ifdef FMT_SIGNED
+char *fmt_int(char *out, int16_t value, uint8_t width) {
+    char digits[FMT_DIGITS];
+    uint16_t magnitude = (value < 0) ? (uint16_t)0 - (uint16_t)value : (uint16_t)value;
+    uint8_t count = fmt_digits(digits, magnitude);
+    return fmt_field(out, digits, count, (value < 0) ? '-' : 0, 0, width);
+}
+#endif
+
+#ifdef FMT_FIXED
+/*
+ * This function is used to write value / 10^places with the decimal point,
+ * keeping one digit before it ("0.05").
+ * params: output, scaled value, places after the point (1-4), width
+ * return: output position after the field
+ */
+char *fmt_fixed(char *out, uint16_t value, uint8_t places, uint8_t width) {
+    char digits[FMT_DIGITS];
+    uint8_t count = fmt_digits(digits, value);
+
+    if (count <= places)
+        count = places + 1;
+    return fmt_field(out, digits, count, 0, places, width);
+}
+#endif
+
+#endif /* TEXT_FORMAT_H */
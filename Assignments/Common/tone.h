@@ -0,0 +1,228 @@
+/*
+ * File:   tone.h
+ * Author: Christian Gonzalez
+ *
+ * Tones and blink patterns made by the peripherals, so the CPU only steps
+ * from one note to the next. Include this file once, after
+ * "../Common/events.h", with one or both of the parts below set up:
+ *
+ *   TONE_PPS           RxyPPS register of the buzzer pin: NCO1 plays a
+ *                      square wave there (tone_play())
+ *   TONE_EVENT         event source for the end of a tone sequence
+ *   BLINK_PPS          RxyPPS register of the LED pin: PWM5 on Timer6
+ *                      blinks it (blink_start())
+ *   BLINK_EVENT        event source for the end of a blink
+ *   TONE_CLOCK_HZ      NCO1 clock, Fosc (default _XTAL_FREQ)
+ *
+ * A sequence is an array of tone_note_t in flash, each a frequency (or a
+ * rest) and a length. NCO1 in fixed duty cycle mode toggles the pin at
+ * TONE_CLOCK_HZ * inc / 2^20, so the tone is half that; Timer4 times the
+ * note in one-shot mode and Tone_ISR() loads the next one. A blink is
+ * PWM5 with Timer6 as its period, so the LED needs no CPU at all and
+ * Blink_ISR() only counts the periods.
+ *
+ * Timer4 and Timer6 count LFINTOSC / 128, 4.13 ms; TONE_MS() gives the
+ * counts for a length in ms, 1 to 1053 ms. At the end, the pin goes back
+ * to its LATx bit and the done handler given to tone_play() or
+ * blink_start() runs from evt_dispatch() (0 for none).
+ *
+ * Both ISRs post, so with priorities on (IPEN) tone_init() puts them at
+ * the high level, with the other ISRs that post. With neither part set
+ * up, only the names above come in (the host benches use the RxyPPS codes).
+ */
+
+#ifndef TONE_H
+#define TONE_H
+
+#include <xc.h>
+#include <stdint.h>
+
+#ifndef TONE_CLOCK_HZ
+#define TONE_CLOCK_HZ       _XTAL_FREQ
+#endif
+
+#define TONE_NCO_FOSC       0x00    // NCO1CLK CKS: Fosc
+#define TONE_TIMER_LFINTOSC 0x04    // TxCLKCON: LFINTOSC
+#define TONE_TIMER_128      0x70    // TxCON CKPS: 1:128 prescaler, 1:1 postscaler
+#define TONE_ONE_SHOT       0x08    // TxHLT MODE: one-shot, started by software
+// RxyPPS output codes, from the PPS output table of the K42 data sheet
+// (DS40001919, Peripheral Pin Select)
+#define TONE_PPS_NCO1       0x27
+#define TONE_PPS_PWM5       0x0D
+#define TONE_PPS_LAT        0x00    // The pin's own LAT bit
+
+// Counts of 4.13 ms (31 kHz / 128) for a length in ms
+#define TONE_MS(ms)         ((uint8_t)(((ms) * 31UL + 64) / 128))
+// NCO1 increment for a tone in Hz (up to 4095 Hz)
+#define TONE_INC(hz)        ((uint16_t)(((hz) * 1048576UL + TONE_CLOCK_HZ / 4) / (TONE_CLOCK_HZ / 2)))
+#define TONE_NOTE(hz, ms)   { TONE_INC(hz), TONE_MS(ms) }
+#define TONE_REST(ms)       { 0, TONE_MS(ms) }
+
+typedef struct {
+    uint16_t inc;           // NCO1 increment, 0 = rest
+    uint8_t counts;         // Timer4 counts
+} tone_note_t;
+
+#ifdef TONE_PPS
+const tone_note_t *tone_note;               // next note to play
+volatile uint8_t tone_left = 0;             // notes after the one playing
+#endif
+#ifdef BLINK_PPS
+volatile uint8_t blink_left = 0;            // periods still to go, 0 = until blink_stop()
+#endif
+
+#if defined(TONE_PPS) || defined(BLINK_PPS)
+void tone_init(void);
+#endif
+#ifdef TONE_PPS
+void tone_play(const tone_note_t *notes, uint8_t count, evt_handler_t done);
+void tone_step(void);
+void tone_stop(void);
+uint8_t tone_busy(void);
+EVT_ISR(Tone_ISR, irq(IRQ_TMR4));
+#endif
+#ifdef BLINK_PPS
+void blink_start(uint8_t period, uint8_t on, uint8_t count, evt_handler_t done);
+void blink_stop(void);
+EVT_ISR(Blink_ISR, irq(IRQ_TMR6));
+#endif
+
+/*
+ * This function is used to set the clocks of NCO1, Timer4 and Timer6, all
+ * of them left off, and the priority of their interrupts.
+ * params: none
+ * return: none
+ */
+#if defined(TONE_PPS) || defined(BLINK_PPS)
+void tone_init(void) {
+#ifdef TONE_PPS
+    NCO1CON = 0x00;                 // off, fixed duty cycle, active high
+    NCO1CLK = TONE_NCO_FOSC;
+    T4CON = TONE_TIMER_128;
+    T4CLKCON = TONE_TIMER_LFINTOSC;
+    T4HLT = TONE_ONE_SHOT;
+    PIR7bits.TMR4IF = 0;
+    IPR7bits.TMR4IP = 1;
+#endif
+#ifdef BLINK_PPS
+    PWM5CON = 0x00;
+    CCPTMRS1bits.P5TSEL0 = 1;       // PWM5 on Timer6 (P5TSEL = 11)
+    CCPTMRS1bits.P5TSEL1 = 1;
+    T6CON = TONE_TIMER_128;
+    T6CLKCON = TONE_TIMER_LFINTOSC;
+    T6HLT = 0x00;                   // free-running period mode
+    PIR9bits.TMR6IF = 0;
+    IPR9bits.TMR6IP = 1;
+#endif
+}
+#endif
+
+#ifdef TONE_PPS
+/*
+ * This function is used to start a sequence, cutting off any that plays.
+ * params: notes (in flash), how many, handler for the end (or 0)
+ * return: none
+ */
+void tone_play(const tone_note_t *notes, uint8_t count, evt_handler_t done) {
+    tone_stop();
+    if (count == 0)
+        return;
+    evt_on(TONE_EVENT, done);
+    tone_note = notes;
+    tone_left = count;
+    tone_step();
+    PIE7bits.TMR4IE = 1;
+}
+
+// Next note on NCO1 and Timer4, or the end of the sequence
+void tone_step(void) {
+    uint16_t inc;
+
+    if (tone_left == 0) {
+        tone_stop();
+        evt_post(TONE_EVENT);
+        return;
+    }
+    tone_left--;
+    inc = tone_note->inc;
+    T4PR = tone_note->counts - 1;
+    tone_note++;
+
+    if (inc != 0) {
+        NCO1INCU = 0;
+        NCO1INCH = (uint8_t)(inc >> 8);
+        NCO1INCL = (uint8_t)inc;    // written last: loads the increment
+        NCO1CONbits.EN = 1;
+        TONE_PPS = TONE_PPS_NCO1;
+    } else {
+        TONE_PPS = TONE_PPS_LAT;    // rest: the pin is its LATx bit
+        NCO1CONbits.EN = 0;
+    }
+    T4TMR = 0;
+    T4CONbits.ON = 1;
+}
+
+void tone_stop(void) {
+    PIE7bits.TMR4IE = 0;
+    T4CONbits.ON = 0;
+    PIR7bits.TMR4IF = 0;
+    TONE_PPS = TONE_PPS_LAT;
+    NCO1CONbits.EN = 0;
+    tone_left = 0;
+}
+
+uint8_t tone_busy(void) {
+    return PIE7bits.TMR4IE;
+}
+
+// Timer4 one-shot ran out: the note is over
+EVT_ISR(Tone_ISR, irq(IRQ_TMR4)) {
+    EVT_ISR_BEGIN();
+    PIR7bits.TMR4IF = 0;
+    tone_step();
+    EVT_ISR_END();
+}
+#endif
+
+#ifdef BLINK_PPS
+/*
+ * This function is used to blink the LED: on for the first part of every
+ * period, count periods long (0 = until blink_stop()).
+ * params: period and on time (TONE_MS() counts), count, handler for the end (or 0)
+ * return: none
+ */
+void blink_start(uint8_t period, uint8_t on, uint8_t count, evt_handler_t done) {
+    blink_stop();
+    evt_on(BLINK_EVENT, done);
+    blink_left = count;
+    T6PR = period - 1;
+    T6TMR = 0;
+    PWM5DCH = on;                   // duty = on / period: 4 per count, low 2 bits 0
+    PWM5DCL = 0;
+    PWM5CON = 0x80;
+    BLINK_PPS = TONE_PPS_PWM5;
+    PIE9bits.TMR6IE = (count != 0);
+    T6CONbits.ON = 1;
+}
+
+void blink_stop(void) {
+    PIE9bits.TMR6IE = 0;
+    T6CONbits.ON = 0;
+    PIR9bits.TMR6IF = 0;
+    BLINK_PPS = TONE_PPS_LAT;
+    PWM5CON = 0x00;
+}
+
+// Timer6 period: one blink done
+EVT_ISR(Blink_ISR, irq(IRQ_TMR6)) {
+    EVT_ISR_BEGIN();
+    PIR9bits.TMR6IF = 0;
+    if (--blink_left == 0) {
+        blink_stop();
+        evt_post(BLINK_EVENT);
+    }
+    EVT_ISR_END();
+}
+#endif
+
+#endif /* TONE_H */
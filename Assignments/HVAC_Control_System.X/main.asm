@@ -1,22 +1,53 @@
 //-----------------------------
 // Title: HVAC Control System
 //-----------------------------
-// Purpose: To determine if an HVAC System shall turn on cooling, heating, or neither. 
-// Dependencies: NONE
+// Purpose: To determine if an HVAC System shall turn on cooling, heating, or neither.
+//   Each of ZONES zones has its own MCP9700 sensor, setpoint and deadband.
+//   The sensors are sampled once a second; between samples the core sleeps
+//   and Timer2, clocked by LFINTOSC, wakes it. In a zone heating starts its
+//   deadband below its setpoint and cooling its deadband above it, and each
+//   keeps running HYSTERESIS past its starting point, so a reading hovering
+//   at a threshold does not toggle the outputs on every sample.
+//   The zones are tables in bank 1 walked with FSR0-FSR2 (POSTINC), so a
+//   pass costs the same cycles per zone for 1 zone as for 32.
+// Dependencies: ../Common/bcd.s (binary to BCD)
 // Compiler: xc8, v3.00
 // Author: Christian Gonzalez
-// OUTPUTS: PORTD 
-// INPUTS: measuredTemp, refTemp 
+// OUTPUTS: PORTB heating, PORTC cooling, PORTD sensor error; bit n is zone n.
+//   Zones 8 and up are in zoneOut only (for external latches).
+// INPUTS: an MCP9700 sensor a zone (500 mV at 0 deg C, 10 mV per deg C).
+//   Up to 8 zones, zone n's sensor is on RAn (ANAn). PORTB-D are outputs,
+//   so above 8 the sensors go through an external 32:1 analog multiplexer
+//   (an ADG732, or four 74HC4051s): RA0-RA4 drive its address lines, its
+//   output is on RA7 (ANA7), and zone n is address n.
+//   refTemp and DEADBAND, the starting setpoint and deadband of every zone
 // Versions:
 //  	V1.0: Mar 11, 2025 - First version
+//  	V1.1: CONVERT_DECIMAL replaced by _bcd_u8 of Common/bcd.s: 25 cycles for
+//  	      any input instead of 23-131, and correct when called with BSR
+//  	      left at another bank (CLRF QU, 1 was banked)
+//  	V2.0: Continuous control: ADC reading of the sensor against the 2.048 V
+//  	      FVR once a second, deadband and hysteresis, Sleep between
+//  	      samples with the FVR and ADC off. An out-of-range reading lights
+//  	      LED3 with both outputs off and sampling goes on, instead of a
+//  	      busy loop; refTempInput is range-checked when assembling
+//  	V3.0: ZONES zones from tables instead of one refTemp/measuredTemp
+//  	      pair. A zone's state is its output bits from the last pass, and
+//  	      the outputs are written a port (8 zones) at a time, so they moved
+//  	      from RD1-RD3 to PORTB/PORTC/PORTD. measuredTemp is zone 0's
+//  	V3.1: More than 8 zones read through an external multiplexer on
+//  	      RA0-RA4/RA7; zone n used to be channel n, so zones 8 and up
+//  	      converted ANB0 and up, the pins driving the outputs
 //-----------------------------
-    
+
 ;---------------------
 ; Initialization - make sure the path is correct
 ;---------------------
 #include ".\myConfigFile.inc"
 #include <xc.inc>
-    
+
+    GLOBAL  _bcd_u8, _bcd_s16, _bcd_value, _bcd_digits, _bcd_sign	; Common/bcd.s
+
 ;----------------
 ; PROGRAM INPUTS
 ;----------------
@@ -24,218 +55,411 @@
 ;It is more flexible and can be used to define complex expressions or sequences of instructions.
 ;It is processed by the preprocessor before the assembly begins.
 
-#define  measuredTempInput 	60 ; this is the input value
-#define  refTempInput	 	10 ; this is the input value
+// (// comments here: these are used in #if and EQU expressions)
+#ifndef ZONES
+#define  ZONES			4   // number of zones, 1 to 32 (or -DZONES=n)
+#endif
+#define  refTempInput	 	20  // this is the input value (deg C, 10 to 50)
+#define  DEADBAND		10  // tenths of a deg C either side of the setpoint with both outputs off
+#define  HYSTERESIS		5   // tenths of a deg C an output keeps running past its starting point
+#define  SAMPLE_COUNTS		242 // Timer2 counts between samples: 242 x 128 / 31 kHz = 1.0 s
+
+#if ZONES < 1 || ZONES > 32
+#error "ZONES must be 1 to 32"
+#endif
+#if refTempInput < 10 || refTempInput > 50
+#error "refTempInput must be 10 to 50 deg C"
+#endif
+#if DEADBAND > 63
+#error "DEADBAND must be at most 63, so that it fits a signed byte in ADC codes"
+#endif
+#if HYSTERESIS > DEADBAND
+#error "HYSTERESIS must not be more than DEADBAND, or an output would run past refTemp"
+#endif
 
 ;---------------------
 ; Definitions
 ;---------------------
-#define SWITCH    LATD,0  
-#define LED1      PORTD,1
-#define LED2	  PORTD,2
-#define LED3	  PORTD,3
-    
+#define HEAT_PORT LATB	  // bit n: zone n heating
+#define COOL_PORT LATC	  // bit n: zone n cooling
+#define ERR_PORT  LATD	  // bit n: zone n reading out of range
+
 ;---------------------
 ; Memory Register Assignments
 ;---------------------
-NUME    EQU   0x23  ; register for number being converted
-QU      EQU   0x24  ; reg for quotient
-RMND_L	EQU   0x25  ; reg for least significant remainder (ones place)
-RMND_M  EQU   0x26  ; reg for middle remainder (tens place)
-RMND_H  EQU   0x27  ; reg for most significant remainder (hundreds place)
+;Common/bcd.s keeps its registers in access RAM, placed by the linker
 
 refTemp		EQU 0x20    ; reg for reference temp
-measuredTemp	EQU 0x21    ; reg for measured temp
-contReg		EQU 0x22    ; reg for control
+measuredTemp	EQU 0x21    ; 2 regs for zone 0's temp, tenths of a deg C, signed
+
+negStatus   EQU 0x28	; reg tracks if zone 0 has a negative measured temp
+zoneCount   EQU 0x29	; zones left in this pass
+groupCount  EQU 0x2A	; zones left in this group of 8
+measured    EQU 0x2B	; 2 regs, this zone's reading
+diff	    EQU 0x2D	; 2 regs, reading - setpoint
+lowLimit    EQU 0x2F	; heat below this diff (signed)
+highLimit   EQU 0x30	; cool above this diff (signed)
+oldHeat	    EQU 0x31	; the group's heating bits from the last pass, shifted out a zone at a time
+oldCool	    EQU 0x32	; the same for cooling
+newHeat	    EQU 0x33	; the group's new bits, shifted in a zone at a time
+newCool	    EQU 0x34
+newError    EQU 0x35
+scratch	    EQU 0x36
+
+; Zone tables in bank 1. Together they are under 256 bytes, so an FSR
+; walking them never carries into FSRnH.
+zoneCfg	    EQU 0x100			; 4 regs a zone: setpoint code (2), deadband codes, ADC channel
+zoneMeas    EQU zoneCfg + 4 * ZONES	; 2 regs a zone: its last ADC code
+zoneOut	    EQU zoneMeas + 2 * ZONES	; 3 regs a group of 8 zones: heating, cooling, error bits
 
-negStatus   EQU 0x28	; reg tracks if we have a negative measured temp
-   
 ;---------------------
 ; Program Constants
 ;---------------------
 ; The EQU (Equals) directive is used to assign a constant value to a symbolic name or label.
 ; It is simpler and is typically used for straightforward assignments.
 ;It directly substitutes the defined value into the code during the assembly process.
-    
-MYDEN	equ   10    ; decimal divisor
+
+; ADC codes: 2 codes a mV against the 2.048 V FVR, so 20 codes a deg C
+CODE_ZERO	EQU 1000				; 0 deg C (500 mV)
+CODE_MIN	EQU CODE_ZERO - 200			; -10 deg C, lowest valid reading
+CODE_MAX	EQU CODE_ZERO + 1200			; 60 deg C, highest valid reading
+CODE_SPAN	EQU CODE_MAX - CODE_MIN + 1		; valid if code - CODE_MIN is below this
+SET_CODE	EQU CODE_ZERO + 20 * refTempInput	; starting setpoint of every zone
+BAND_CODES	EQU 2 * DEADBAND			; starting deadband of every zone
+HYST_CODES	EQU 2 * HYSTERESIS
+ZONE_GROUPS	EQU (ZONES + 7) / 8
+ZONE_SCALE	EQU 1 << (ZONES - 8 * (ZONE_GROUPS - 1))	; 2 ^ zones in the last group
 
 ;---------------------
 ; Main Program
 ;---------------------
     PSECT absdata,abs,ovrld        ; Do not change
-		
+
 ;---------------------
 ; Start Program Memory at 0x20
 ;---------------------
     ORG	    0x20
     GOTO    START
 
-;---------------------
-; Hex-to-Decimal Conversion Subroutine
-;---------------------
-CONVERT_DECIMAL:
-    MOVLW   MYDEN
-    CLRF    QU, 1
-D_1:
-    INCF    QU, 1
-    SUBWF   NUME
-    BC	    D_1
-    ADDWF   NUME
-    DECF    QU, 1
-    MOVFF   NUME, RMND_L  ; store ones place
-    MOVFF   QU, NUME
-    CLRF    QU
-D_2:
-    INCF    QU, 1
-    SUBWF   NUME
-    BC	    D_2
-    ADDWF   NUME
-    DECF    QU, 1
-    MOVFF   NUME, RMND_M  ; store tens place
-    MOVFF   QU, RMND_H    ; store hundreds place
-    RETURN
-    
 START:
-    
-    BANKSEL ANSELD   ; select the correct bank for ANSELD
-    CLRF    ANSELD   ; set PORTD to digital mode (disable analog functions)
 
-    BANKSEL TRISD    ; select the correct bank for TRISD
-    CLRF    TRISD    ; set PORTD as output (0 = output, 1 = input)
+    BANKSEL ANSELB   ; select the correct bank for ANSELB-D
+    CLRF    ANSELB   ; set PORTB-D to digital mode (disable analog functions)
+    CLRF    ANSELC
+    CLRF    ANSELD
 
-    BANKSEL LATD     ; select the correct bank for LATD
-    CLRF    LATD     ; clear LATD to ensure no previous states affect it
+    BANKSEL TRISB    ; select the correct bank for TRISB-D
+    CLRF    TRISB    ; set PORTB-D as output (0 = output, 1 = input)
+    CLRF    TRISC
+    CLRF    TRISD
 
-    
-;---------------------
-; Load Inputs
-;---------------------
-    MOVLW   refTempInput	
-    MOVWF   refTemp
-    MOVLW   measuredTempInput	
-    MOVWF   measuredTemp
-    
-;---------------------
-; Check if refTemp is within range (10 deg celsius to 50 deg celsius)
-;---------------------
-    MOVLW   10		; load lower limit (10 deg celsius)
-    SUBWF   refTemp, 0  ; refTemp - 10
-    BTFSS   STATUS, 0   ; if C is clear, refTemp < 10
-    GOTO    ERROR_STATE ; out of range = ERROR
+    BANKSEL LATB     ; select the correct bank for LATB-D
+    CLRF    LATB     ; clear the latches to ensure no previous states affect them
+    CLRF    LATC
+    CLRF    LATD
 
-    MOVLW   51		; load upper limit (50 deg celsius)
-    SUBWF   refTemp, 0  ; refTemp - 50
-    BTFSC   STATUS, 0   ; if C is set, refTemp > 50
-    GOTO    ERROR_STATE	; out of range = ERROR
+#if ZONES > 8
+    BANKSEL ANSELA
+    MOVLW   0x80     ; RA7 analog: the multiplexer output
+    MOVWF   ANSELA
+    BANKSEL TRISA
+    MOVWF   TRISA    ; RA0-RA6 outputs, RA0-RA4 the multiplexer address
+    BANKSEL LATA
+    CLRF    LATA
+#else
+    BANKSEL ANSELA
+    SETF    ANSELA   ; RA0-RA7 analog inputs for the sensors
+    BANKSEL TRISA
+    SETF    TRISA
+#endif
 
 ;---------------------
-; Validate measuredTemp Range (-10 measuredTemp 60)
-;---------------------
-    BTFSC   measuredTemp,7   ; check if negative
-    GOTO    NEG_CHECK
-
-    MOVLW   61		    ; load upper limit (60 deg celsius)
-    SUBWF   measuredTemp, 0 ; refTemp - 60
-    BTFSC   STATUS, 0	    ; if C is set, refTemp > 60
-    GOTO    ERROR_STATE	    ; out of range = ERROR
-    GOTO    CONT_PROG
+; ADC: FVR reference, ADCRC clock, off between samples
+;---------------------
+    BANKSEL ADREF
+    MOVLW   0x03     ; ADPREF = FVR, ADNREF = VSS
+    MOVWF   ADREF
+#if ZONES > 8
+    MOVLW   0x07     ; channel ANA7 (RA7), the multiplexer output
+    MOVWF   ADPCH
+#else
+    CLRF    ADPCH    ; channel ANA0 (RA0)
+#endif
+    CLRF    ADCON0   ; off
+    BANKSEL FVRCON
+    CLRF    FVRCON   ; FVR off
 
-NEG_CHECK:		    ; used if we have a negative measured temp
-    MOVLW   0x01
-    MOVWF   negStatus	    ; set the negStatus register
-    NEGF    measuredTemp    ; 2's comp of measuredTemp
-    MOVLW   11		    ; load limit (-10, but here 10 since we did NEGF)
-    SUBWF   measuredTemp, 0 ; measuredTemp - 10
-    BTFSC   STATUS, 0	    ; if C is set, measuredTemp > 10 (or less than -10)
-    GOTO    ERROR_STATE	    ; out of range = ERROR
-    GOTO    CONT_PROG	    ; both values are valid, continue
+;---------------------
+; Timer2: LFINTOSC, 1:128, a match every SAMPLE_COUNTS; runs in Sleep
+;---------------------
+    BANKSEL T2CON
+    CLRF    T2CON
+    MOVLW   0b00000100	; LFINTOSC
+    MOVWF   T2CLKCON
+    CLRF    T2HLT	; free-running, not synchronized to Fosc
+    CLRF    T2TMR
+    MOVLW   SAMPLE_COUNTS - 1
+    MOVWF   T2PR
+    MOVLW   0b11110000	; on, 1:128 prescaler, 1:1 postscaler
+    MOVWF   T2CON
+    BANKSEL PIE4
+    BSF     PIE4,2	; TMR2IE: the match wakes the core (GIE stays off, no vector)
 
 ;---------------------
-; ERROR STATE: Handle out-of-range values
+; Load Inputs: every zone starts at refTemp and DEADBAND, zone n on channel
+;   ANAn, or multiplexer address n above 8 zones
 ;---------------------
-ERROR_STATE:
-    BSF	    LED3	; turn on an error LED
-    GOTO    ERROR_STATE ; stay here forever
+    MOVLW   refTempInput
+    MOVWF   refTemp
+
+    LFSR    1, zoneCfg
+    CLRF    zoneCount
+ZONE_INIT:
+    MOVLW   low(SET_CODE)
+    MOVWF   POSTINC1
+    MOVLW   high(SET_CODE)
+    MOVWF   POSTINC1
+    MOVLW   BAND_CODES
+    MOVWF   POSTINC1
+    MOVF    zoneCount, 0	; channel (multiplexer address)
+    MOVWF   POSTINC1
+    INCF    zoneCount, 1
+    MOVLW   ZONES
+    CPFSEQ  zoneCount
+    BRA     ZONE_INIT
 
-CONT_PROG:
+    LFSR    2, zoneOut		; everything off
+    MOVLW   3 * ZONE_GROUPS
+    MOVWF   zoneCount
+OUT_INIT:
+    CLRF    POSTINC2
+    DECFSZ  zoneCount, 1
+    BRA     OUT_INIT
 
 ;---------------------
 ; Convert refTemp to Decimal
 ;---------------------
-    MOVFF   refTemp, NUME   ; store refTemp in NUME
-    CALL    CONVERT_DECIMAL ; convert refTemp
+    MOVFF   refTemp, _bcd_value	; store refTemp in _bcd_value
+    CALL    _bcd_u8		; convert refTemp
 
-    MOVFF   RMND_L,0x60 ; store ones place
-    MOVFF   RMND_M,0x61 ; store tens place
-    MOVFF   RMND_H,0x62	; store hundreds place
+    MOVFF   _bcd_digits,0x60	; store ones place
+    MOVFF   _bcd_digits+1,0x61	; store tens place
+    MOVFF   _bcd_digits+2,0x62	; store hundreds place
 
 ;---------------------
-; Convert measuredTemp to Decimal
+; Sample every zone, decide, write the outputs
 ;---------------------
-    MOVFF   measuredTemp, NUME	; store measuredTemp in NUME
-    CALL    CONVERT_DECIMAL	; convert measuredTemp
+SAMPLE:
+    CALL    SAMPLE_ZONES
+    CALL    EVALUATE_ZONES
 
-    MOVFF   RMND_L,0x70	; store ones place
-    MOVFF   RMND_M,0x71 ; store tens place
-    MOVFF   RMND_H,0x72 ; store hundreds place
-    
-    ;MOVLW   measuredTempInput	; used to replace back to negative value
-    ;MOVWF   measuredTemp
+    BANKSEL zoneOut		; zones 0-7: one write a port
+    MOVF    zoneOut, 0
+    MOVWF   HEAT_PORT
+    MOVF    zoneOut+1, 0
+    MOVWF   COOL_PORT
+    MOVF    zoneOut+2, 0
+    MOVWF   ERR_PORT
 
 ;---------------------
-; HVAC Control Logic for Positive Temps
+; Convert zone 0's measuredTemp to tenths of a deg C, then to Decimal
 ;---------------------
-HVAC_SYS:
-    BTFSC   negStatus, 0    ; check if we have a negative measuredTemp
-    GOTO    HVAC_NEG_SYS
-    
-    MOVF    refTemp, 0      ; load refTemp into W
-    SUBWF   measuredTemp, 0 ; perform W = measuredTemp - refTemp
+    BTFSC   zoneOut+2, 0	; nothing to show for an out-of-range reading
+    BRA     END_LOGIC
+    MOVLW   low(CODE_ZERO)	; (code - CODE_ZERO) / 2
+    SUBWF   zoneMeas, 0
+    MOVWF   measuredTemp
+    MOVLW   high(CODE_ZERO)
+    SUBWFB  zoneMeas+1, 0
+    MOVWF   measuredTemp+1
+    BCF     STATUS, 0
+    BTFSC   measuredTemp+1,7	; keep the sign
+    BSF     STATUS, 0
+    RRCF    measuredTemp+1, 1
+    RRCF    measuredTemp, 1
 
-    BTFSC   STATUS, 2       ; if Zero flag is set, measuredTemp == refTemp
-    GOTO    LED_OFF         ; turn off both heating & cooling
+    MOVFF   measuredTemp, _bcd_value
+    MOVFF   measuredTemp+1, _bcd_value+1
+    CALL    _bcd_s16		; convert measuredTemp
 
-    BTFSC   STATUS, 0       ; if Carry flag is set, measuredTemp >= refTemp
-    GOTO    LED_COOL        ; measuredTemp > refTemp, so turn on cooling
+    MOVFF   _bcd_digits,0x70	; store tenths place
+    MOVFF   _bcd_digits+1,0x71	; store ones place
+    MOVFF   _bcd_digits+2,0x72	; store tens place
+    MOVFF   _bcd_digits+3,0x73	; store hundreds place
+    MOVFF   _bcd_sign,negStatus	; 1 if below 0 deg C
 
-    GOTO    LED_HEAT        ; else: measuredTemp < refTemp, so turn on heating
-    
 ;---------------------
-; HVAC Control Logic With Negative Measured Temp
+; Sleep until the next Timer2 match
 ;---------------------
-HVAC_NEG_SYS:		; measuredTemp is negative so turn on HEAT
-    GOTO    LED_HEAT
+END_LOGIC:
+    BANKSEL PIR4
+    BCF     PIR4,2	; clear TMR2IF
+    SLEEP
+    NOP
+    GOTO    SAMPLE
 
 ;---------------------
-; Turn on Cooling (measuredTemp > refTemp)
-;---------------------
-LED_COOL:
-    MOVLW   2
-    MOVWF   contReg	; set the control register appropriately
-    BSF     LED2        ; turn on cooling
-    BCF     LED1        ; ensure heating is off
-    GOTO    END_LOGIC	
+; Sample the sensors into zoneMeas (FVR and ADC only on for this). The two
+;   instructions between ADPCH and GO (244 us) are the acquisition time.
+;   Above 8 zones ADPCH stays on RA7 and the channel is the multiplexer
+;   address, written to LATA instead (MOVFF: the same 2 cycles).
+;---------------------
+SAMPLE_ZONES:
+    BANKSEL FVRCON
+    MOVLW   0b10000010	; FVR on, 2.048 V to the ADC
+    MOVWF   FVRCON
+FVR_WAIT:
+    BTFSS   FVRCON,6	; wait for FVRRDY
+    BRA     FVR_WAIT
+
+    BANKSEL ADCON0
+    MOVLW   0b10010100	; on, ADCRC clock, right-justified
+    MOVWF   ADCON0
+    LFSR    0, zoneMeas
+    LFSR    1, zoneCfg + 3	; zone 0's channel
+    MOVLW   ZONES
+    MOVWF   zoneCount
+SAMPLE_NEXT:
+    MOVF    INDF1, 0
+#if ZONES > 8
+    MOVWF   LATA	; multiplexer address on RA0-RA4 (access bank)
+#else
+    MOVWF   ADPCH
+#endif
+    MOVLW   4		; on to the next zone's channel
+    ADDWF   FSR1L, 1
+    BSF     ADCON0,0	; GO
+ADC_WAIT:
+    BTFSC   ADCON0,0	; wait for the conversion
+    BRA     ADC_WAIT
+    MOVF    ADRESL, 0
+    MOVWF   POSTINC0
+    MOVF    ADRESH, 0
+    MOVWF   POSTINC0
+    DECFSZ  zoneCount, 1
+    BRA     SAMPLE_NEXT
+    CLRF    ADCON0	; ADC off
+    BANKSEL FVRCON
+    CLRF    FVRCON	; FVR off
+    RETURN
 
 ;---------------------
-; Turn on Heating (measuredTemp < refTemp)
-;---------------------
-LED_HEAT:
+; HVAC Control Logic: zoneMeas and zoneCfg in, zoneOut out, FSR0-FSR2
+;   walking the three. A zone heats while reading - setpoint < lowLimit and
+;   cools while it is > highLimit, where
+;       lowLimit  = -deadband, + HYST_CODES if it was heating
+;       highLimit =  deadband, - HYST_CODES if it was cooling
+;   so what is running decides the threshold without a branch per state
+;   (a heating zone reading above its cooling threshold goes straight to
+;   cooling, where V2.0 went through a pass of neither).
+;   The old bits are shifted out and the new ones in a zone at a time and
+;   stored once a group: every zone runs the same instructions.
+;---------------------
+EVALUATE_ZONES:
+    LFSR    0, zoneMeas
+    LFSR    1, zoneCfg
+    LFSR    2, zoneOut
+    MOVLW   ZONES
+    MOVWF   zoneCount
+ZONE_GROUP:
+    MOVF    INDF2, 0	; the last pass's outputs are the states
+    MOVWF   oldHeat
     MOVLW   1
-    MOVWF   contReg	; set control register appropriately
-    BSF     LED1        ; turn on heating
-    BCF     LED2        ; ensure cooling is off
-    GOTO    END_LOGIC
+    MOVF    PLUSW2, 0
+    MOVWF   oldCool
+    MOVLW   8
+    MOVWF   groupCount
 
-;---------------------
-; Turn off both (measuredTemp == refTemp)
-;---------------------
-LED_OFF:
+ZONE_NEXT:
+    MOVF    POSTINC0, 0	; reading
+    MOVWF   measured
+    MOVF    POSTINC0, 0
+    MOVWF   measured+1
+
+    MOVLW   low(CODE_MIN)	; out of range if reading - CODE_MIN >= CODE_SPAN,
+    SUBWF   measured, 0		; unsigned, as below CODE_MIN wraps round
+    MOVWF   diff
+    MOVLW   high(CODE_MIN)
+    SUBWFB  measured+1, 0
+    MOVWF   diff+1
+    MOVLW   low(CODE_SPAN)
+    SUBWF   diff, 0
+    MOVLW   high(CODE_SPAN)
+    SUBWFB  diff+1, 0
+    RRCF    newError, 1		; C: out of range
+
+    MOVF    POSTINC1, 0		; diff = reading - setpoint
+    SUBWF   measured, 0
+    MOVWF   diff
+    MOVF    POSTINC1, 0
+    SUBWFB  measured+1, 0
+    MOVWF   diff+1
+
+    MOVF    POSTINC1, 0		; deadband
+    MOVWF   highLimit
+    NEGF    WREG
+    MOVWF   lowLimit
+    MOVLW   HYST_CODES
+    RRCF    oldHeat, 1		; C: was heating
+    BTFSC   STATUS, 0
+    ADDWF   lowLimit, 1
+    RRCF    oldCool, 1		; C: was cooling
+    BTFSC   STATUS, 0
+    SUBWF   highLimit, 1
+    MOVF    POSTINC1, 0		; step over the channel
+
+    MOVF    lowLimit, 0		; heat: diff - lowLimit < 0
+    SUBWF   diff, 0
     MOVLW   0
-    MOVWF   contReg ; set control register appropriately
-    BCF     LED1    ; ensure heating is off
-    BCF     LED2    ; ensure cooling is off
+    BTFSC   lowLimit, 7
+    MOVLW   0xFF
+    SUBWFB  diff+1, 0
+    RLCF    WREG, 0		; C: the sign
+    RRCF    newHeat, 1
 
-END_LOGIC:
-    NOP
-    SLEEP
-END
\ No newline at end of file
+    MOVF    diff, 0		; cool: highLimit - diff < 0
+    SUBWF   highLimit, 0
+    MOVLW   0
+    BTFSC   highLimit, 7
+    MOVLW   0xFF
+    MOVWF   scratch
+    MOVF    diff+1, 0
+    SUBWFB  scratch, 0
+    RLCF    WREG, 0		; C: the sign
+    RRCF    newCool, 1
+
+    DECF    zoneCount, 1
+    BZ	    ZONE_LAST
+    DECFSZ  groupCount, 1
+    BRA     ZONE_NEXT
+    RCALL   ZONE_STORE
+    BRA     ZONE_GROUP
+
+ZONE_LAST:			; a part group: shift it down to bit 0,
+    DCFSNZ  groupCount, 1	; x >> unused = (x * ZONE_SCALE) >> 8
+    BRA     ZONE_STORE
+    MOVLW   low(ZONE_SCALE)
+    MULWF   newHeat
+    MOVF    PRODH, 0
+    MOVWF   newHeat
+    MOVLW   low(ZONE_SCALE)
+    MULWF   newCool
+    MOVF    PRODH, 0
+    MOVWF   newCool
+    MOVLW   low(ZONE_SCALE)
+    MULWF   newError
+    MOVF    PRODH, 0
+    MOVWF   newError
+
+ZONE_STORE:			; no output for a zone with a bad reading
+    COMF    newError, 0
+    ANDWF   newHeat, 1
+    ANDWF   newCool, 1
+    MOVF    newHeat, 0
+    MOVWF   POSTINC2
+    MOVF    newCool, 0
+    MOVWF   POSTINC2
+    MOVF    newError, 0
+    MOVWF   POSTINC2
+    RETURN
+END
@@ -0,0 +1,264 @@
+/*
+ * Title: A9_ADC_LCD.X benchmark
+ * ---------------------
+ * Program Details:
+ *  Runs the ADC -> lux -> LCD program on the host model with the board
+ *  wiring: photo-resistor on RA0, potentiometer on RA1 (steady at POT_CODE),
+ *  LCD data on RB0-RB7, RS on RD0, EN on RD1. Each case runs main() for
+ *  10 s and is run twice: with the firmware as it is (Timer2-triggered
+ *  burst averages of both channels copied into a ring by DMA, main() woken
+ *  only by the ADC threshold) and with the V3.2 main loop, which polled one
+ *  conversion of RA0 every 500 ms.
+ *   - noise: steady light with +/- NOISE codes on every conversion; gives
+ *     the spread of the light readings (from the ring, or ADRES for the
+ *     polled loop), wake-ups, CPU time, DMA traffic and LCD traffic
+ *   - ramp: the light steps up every 500 ms without noise; the display
+ *     has to follow it
+ *   - button: the noise case with the RC2 button pressed at 500 ms and a
+ *     12 s window; PWM5 blinks the LED while the readings go on (V3.6
+ *     blinked inside IOC_ISR for 10 s and froze them). Gives the blinks
+ *     and their period from the Timer6 registers, and the worst ISR length
+ *     and event latency counted by Common/events.h
+ *   - conversion: ADC_To_Lux() and ADC_To_mV() against the float formulas
+ *     of V3.3 for all 4096 codes (bench_asm times the float path on the
+ *     chip's instruction set)
+ *   - format: fmt_uint() from Common/text_format.h against printf("%*u")
+ *     for every 16-bit value and field widths 1-5 (bench_asm times the
+ *     sprintf path on the chip's instruction set)
+ *
+ *  CPU time counts the cycles outside SLEEP/Idle; plain C statements are
+ *  not counted by the model, so for the sleeping firmware it is a lower
+ *  bound, while the polled loop is awake in its delay the whole time. The
+ *  firmware also counts its own time in Run and Idle (Common/power.h,
+ *  Timer3 on LFINTOSC), given with a ballpark average current.
+ *
+ *  LCD bytes are queued and sent by LCD_ISR() on Timer0, so the report also
+ *  gives the time to the first character on the display and the number of
+ *  bytes the LCD model saw before it was ready for them.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <xc.h>
+#include "../Common/tone.h"         // RxyPPS codes only: neither part set up
+
+// From A9_ADC_LCD.X/ACD_LCD_main.c
+void adc_lcd_main(void);
+void ADC_Init(void);
+void IOCC2_Init(void);
+void evt_init(void);
+void LCD_Init(void);
+void LCD_Shadow_String_xy(char row, char pos, const char *msg);
+void LCD_Flush(void);
+void LCD_ISR(void);
+void ADT_ISR(void);
+void ADC_Setpoint_ISR(void);
+void IOC_ISR(void);
+void Blink_ISR(void);
+extern volatile uint16_t evt_posts, evt_isr_worst;
+extern uint16_t evt_latency_worst;
+extern uint32_t pwr_time[4], pwr_waits[4];
+unsigned int ADC_Latest(unsigned char slot);
+unsigned int ADC_To_Lux(unsigned int code);
+unsigned int ADC_To_mV(unsigned int code);
+char *fmt_uint(char *out, uint16_t value, uint8_t width);
+
+#define STEPS   20          // 500 ms steps in a run
+#define NOISE   32          // +/- codes in the noise case
+#define POT_CODE 2048      // RA1: 2.500 V
+#define LUX_PER_CODE (85.19 * 5.0 / 4096.0)
+#define SLOT_LIGHT 0
+#define SLOT_POT 1
+#define PRESS_MS 500        // button case: RC2 pressed here for 100 ms
+
+enum { NOISE_RUN, RAMP_RUN, BUTTON_RUN };
+
+// Light readings the firmware got from its ring, and pot readings that
+// were not POT_CODE
+static uint32_t ring_readings, ring_copies, pot_wrong;
+static double ring_sum, ring_sq;
+
+// Wraps ADC_Setpoint_ISR(), which follows every copy into the ring: of the
+// light and the pot in turn, the light first
+static void setpoint_isr(void) {
+    if (ring_copies++ % 2 == SLOT_LIGHT) {
+        unsigned int code = ADC_Latest(SLOT_LIGHT);
+        ring_readings++;
+        ring_sum += code;
+        ring_sq += (double)code * code;
+    } else if (ADC_Latest(SLOT_POT) != POT_CODE) {
+        pot_wrong++;
+    }
+    ADC_Setpoint_ISR();
+}
+
+// Wraps Blink_ISR(): counts the blinks PWM5 made on RC3, with their
+// period and on time
+static uint32_t blinks;
+static double blink_period_ms, blink_on_ms;
+
+static void blink_isr(void) {
+    if (RC3PPS == TONE_PPS_PWM5 && PWM5CONbits.EN)
+        blinks++;
+    blink_period_ms = (T6PR + 1) * 128.0 * 1000.0 / SIM_LFINTOSC_HZ;
+    blink_on_ms = PWM5DCH * 128.0 * 1000.0 / SIM_LFINTOSC_HZ;
+    Blink_ISR();
+}
+
+// The V3.2 main loop, for comparison: one polled conversion every 500 ms
+static void polled_main(void) {
+    char text[24];
+
+    evt_init();
+    ADC_Init();
+    IOCC2_Init();
+    LCD_Init();
+    ADCON2 = 0x00;              // basic mode, no trigger
+    ADCON3 = 0x00;
+    ADACT = 0x00;
+    T2CON = 0x00;
+    DMA1CON0 = 0x00;
+    DMA2CON0 = 0x00;
+    LCD_Shadow_String_xy(1, 0, "The Input Light:");
+    while (1) {
+        ADCON0bits.GO = 1;
+        while (ADCON0bits.GO);
+        int digital = (ADRESH * 256) | ADRESL;
+        int lux = (int)(85.19 * (digital * (5.0 / 4096.0)) + -135.33);
+        if (lux < 0)
+            lux = 0;
+        snprintf(text, sizeof text, "%d LUX    ", lux);
+        LCD_Shadow_String_xy(2, 4, text);
+        LCD_Flush();
+        sim_tick(sim_ms(500));
+    }
+}
+
+// The firmware keeps its state in initialised globals, so each run gets a
+// fresh copy of them, as after a reset, in a child process
+static void run(const char *label, void (*fn)(void), uint8_t mode) {
+    uint8_t ramp = (mode == RAMP_RUN);
+    uint64_t window = sim_ms(500) * STEPS + sim_ms(250);
+
+    fflush(stdout);
+    if (fork() != 0) {
+        wait(NULL);
+        return;
+    }
+    sim_reset();
+    sim_lcd(SIM_PORTB, SIM_PORTD, 0, 1);
+    sim_irq(SIM_IRQ_TMR0, LCD_ISR);
+    sim_irq(SIM_IRQ_ADT, ADT_ISR);
+    sim_irq(SIM_IRQ_DMA2DCNT, setpoint_isr);
+    sim_irq(SIM_IRQ_IOC, IOC_ISR);
+    sim_irq(SIM_IRQ_TMR6, blink_isr);
+    sim_pin(SIM_PORTC, 2, 1);               // RC2 button up (weak pull-up)
+    sim_analog(0x01, POT_CODE);
+    ring_readings = ring_copies = pot_wrong = 0;
+    ring_sum = ring_sq = 0;
+    if (ramp) {
+        sim_analog(0x00, 1000);
+        for (uint8_t i = 1; i < STEPS; i++)
+            sim_analog_at(sim_ms(500) * i, 0x00, (uint16_t)(1000 + 100 * i));
+    } else {
+        sim_analog(0x00, 2000);
+        sim_analog_noise(0x00, NOISE);
+    }
+    if (mode == BUTTON_RUN) {
+        sim_pin_at(sim_ms(PRESS_MS), SIM_PORTC, 2, 0);
+        sim_pin_at(sim_ms(PRESS_MS + 100), SIM_PORTC, 2, 1);
+        window = sim_ms(12000);
+    }
+
+    double t0 = sim_wall_us();
+    sim_run(fn, window);
+    double wall = sim_wall_us() - t0;
+
+    // Light readings: from the ring when the DMA filled it, else every
+    // result of the (single-channel) polled loop
+    uint32_t n = ring_readings ? ring_readings : sim_stats.adc_results;
+    double sum = ring_readings ? ring_sum : sim_stats.adc_result_sum;
+    double sq = ring_readings ? ring_sq : sim_stats.adc_result_sq;
+    double mean = n ? sum / n : 0;
+    double sigma = n ? sqrt(sq / n - mean * mean) : 0;
+    uint64_t awake = sim_cycles - sim_stats.sleep_cycles;
+
+    sim_report(label, 1, sim_cycles, wall);
+    printf("  %u conversions, %u light readings", sim_stats.adc_conversions, n);
+    if (!ramp)
+        printf(" spread %.1f codes (%.2f lux)", sigma, sigma * LUX_PER_CODE);
+    printf("\n  CPU awake %.3f%% of the time, %u wake-ups, %u interrupts\n",
+           100.0 * awake / sim_cycles, sim_stats.wakeups, sim_stats.interrupts);
+    if (fn == adc_lcd_main)
+        sim_power_report(pwr_time, pwr_waits);
+    if (ring_readings) {
+        printf("  DMA: %u bytes, %u triggers lost, %u pot readings off\n",
+               sim_stats.dma_bytes, sim_stats.dma_lost, pot_wrong);
+        printf("  %u events; longest ISR %u us, event to handler at most %u us\n",
+               evt_posts, evt_isr_worst, evt_latency_worst);
+    }
+    if (mode == BUTTON_RUN)
+        printf("  LED: %u blinks of %.1f ms (%.1f ms on) by PWM5, RC3 %s at the end\n",
+               blinks, blink_period_ms, blink_on_ms,
+               RC3PPS == 0 && !((sim_output(SIM_PORTC) >> 3) & 1) ? "off" : "still blinking");
+    printf("  LCD: %u commands, %u chars, first char at %.1f ms, %u bytes sent too early\n",
+           sim_stats.lcd_commands, sim_stats.lcd_chars,
+           sim_stats.lcd_first_char * 1000.0 / (sim_fosc / 4), sim_stats.lcd_overruns);
+    printf("  |%s|\n  |%s|\n", sim_lcd_line(0), sim_lcd_line(1));
+    fflush(stdout);
+    _exit(0);
+}
+
+static void bench_conversion(void) {
+    int worst_lux = 0, worst_mv = 0;
+    unsigned off_lux = 0, at_lux = 0;
+
+    for (unsigned code = 0; code < 4096; code++) {
+        double volts = code * (5.0 / 4096.0);
+        double lux = 85.19 * volts + -135.33;
+        int want = lux < 0 ? 0 : (int)(lux + 0.5);
+        int diff = abs((int)ADC_To_Lux(code) - want);
+        int diff_mv = abs((int)ADC_To_mV(code) - (int)(volts * 1000.0 + 0.5));
+        if (diff) off_lux++;
+        if (diff > worst_lux) { worst_lux = diff; at_lux = code; }
+        if (diff_mv > worst_mv) worst_mv = diff_mv;
+    }
+    printf("conversion: integer table vs float formula, 4096 codes\n");
+    printf("  lux: %u codes off by at most %d (code %u), mV: off by at most %d\n",
+           off_lux, worst_lux, at_lux, worst_mv);
+}
+
+static void bench_format(void) {
+    unsigned wrong = 0;
+
+    for (uint8_t width = 1; width <= 5; width++) {
+        for (uint32_t value = 0; value <= 0xFFFF; value++) {
+            char got[8] = {0}, want[8];
+            char *end = fmt_uint(got, (uint16_t)value, width);
+            snprintf(want, sizeof want, "%*u", width, (unsigned)value);
+            if (strlen(want) > width)
+                memset(want, '#', width), want[width] = 0;
+            if (end != got + width || strcmp(got, want) != 0)
+                wrong++;
+        }
+    }
+    printf("format: fmt_uint vs printf(\"%%*u\"), 65536 values x widths 1-5\n");
+    printf("  %u fields differ\n", wrong);
+}
+
+int main(void) {
+    printf("A9_ADC_LCD.X (virtual cycles at Fosc/4 = %u Hz)\n", sim_fosc / 4);
+    run("noise: DMA scan of RA0 + RA1", adc_lcd_main, NOISE_RUN);
+    run("noise: V3.2 polled loop", polled_main, NOISE_RUN);
+    run("ramp: DMA scan of RA0 + RA1", adc_lcd_main, RAMP_RUN);
+    run("ramp: V3.2 polled loop", polled_main, RAMP_RUN);
+    run("button: 10 s blink during the scan", adc_lcd_main, BUTTON_RUN);
+    bench_conversion();
+    bench_format();
+    return 0;
+}
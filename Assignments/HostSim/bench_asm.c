@@ -0,0 +1,847 @@
+/*
+ * Title: Assembly projects benchmark
+ * ---------------------
+ * Program Details:
+ *  Loads the .hex images MPLAB left in each project's dist/ folder into the
+ *  PIC18 instruction-set simulator (pic18.c) and reports exact cycle counts:
+ *   - 7SegmentCounter.X: one call of DELAY (255 x 255 x 4 loop passes) of
+ *     the V1.0 image and how soon its switch loop shows a press; then V2.0
+ *     (main.asm, assembled here) on a board model of IOC, Timer0 on
+ *     LFINTOSC and wakes from Sleep, through a script of bouncing taps and
+ *     a hold: press-to-display latency, auto-repeat rate and the current
+ *     idle and on average against the polling loop
+ *   - HVAC_Control_System.X: reset to SLEEP of the V1.0 image with the
+ *     built-in inputs, then its CONVERT_DECIMAL for every 8-bit input,
+ *     called back to back the way the program calls it (BSR left at the
+ *     bank of LATD), the repeated subtraction Common/bcd.s replaced
+ *   - Common/bcd.s, assembled here (no project image has it yet): every
+ *     input of each of the four routines, checked against the host and
+ *     timed, with BSR left at the bank of LATD as above
+ *   - HVAC_Control_System.X V3.1 (main.asm + Common/bcd.s, assembled here)
+ *     for an hour of scripted sensors, on a board model of what it uses:
+ *     Timer2 on LFINTOSC waking it from Sleep, the FVR, the ADC and the
+ *     LP crystal start-up on each wake. The sensors are wired as main.asm
+ *     says (RA0-RA7, or the multiplexer above 8 zones), and any other pin
+ *     converted reads its own output drive; run with the default zones
+ *     and with 12. Every zone's decision is checked
+ *     against a host model of the thresholds, and the time in each power
+ *     state gives the average current (K42_I_* below). Then the zone pass
+ *     (EVALUATE_ZONES) assembled for 1 to 32 zones, on random readings
+ *     and states: cycles a pass and a zone
+ *   - MyFirstAssembly_MPLAB.X: the RD0/RD1 toggle period
+ *   - A9_ADC_LCD.X: the ADC code -> volts -> lux lines of the C image left
+ *     in dist/ (V3.0, XC8 -O0, 32-bit float), for every 12-bit code. This
+ *     is the float path the integer lux table replaced. Also the
+ *     sprintf("%d") + strcat() lines of the same image for every lux the
+ *     calibration gives, the path Common/text_format.h replaced.
+ *   - Calculator.X: calculate() of the V1.0 image (XC8, 16-bit int) for
+ *     each operation on two-digit operands, the int arithmetic that
+ *     Common/arith.h replaced: MULWF inline for multiply, __awdiv for divide
+ *  Labels of the C images are found through the .sym file of the same
+ *  build; those of the assembly images are fixed addresses below.
+ *  Times are given for Fosc = 4 MHz (1 cycle = 1 us), the clock the C
+ *  projects use for _XTAL_FREQ.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pic18.h"
+
+#define SEVEN_SEG   "../7SegmentCounter.X/"
+#define HVAC        "../HVAC_Control_System.X/"
+#define FIRST_ASM   "../MyFirstAssembly_MPLAB.X/"
+#define ADC_LCD     "../A9_ADC_LCD.X/dist/default/production/A9_ADC_LCD.X.production."
+#define CALC        "../Calculator.X/dist/default/production/Calculator.X.production."
+#define BCD         "../Common/bcd.s"
+
+// HVAC_Control_System.X register assignments
+#define NUME        0x23
+#define QU          0x24
+#define RMND_L      0x25
+#define RMND_M      0x26
+#define RMND_H      0x27
+#define CONT_REG    0x22
+// Board models of the sleeping projects. Currents are ballpark
+// PIC18F47K42 data sheet typicals at 3 V, in uA; change them here.
+#define K42_LFINTOSC    31000.0
+#define K42_I_RUN       10.0                // core running at 32 kHz (LP crystal or LFINTOSC)
+#define K42_I_SLEEP     0.05                // Sleep, WDT off
+#define K42_I_TIMER     0.6                 // LFINTOSC + a timer on it
+#define K42_I_BOR       8.0                 // BOREN = SBORDIS keeps BOR on in Sleep too
+#define K42_I_FVR       25.0
+#define K42_I_ADC       280.0               // while converting
+// HVAC_Control_System.X V2.0 and up. Fosc is the LP crystal of
+// myConfigFile.inc (RSTOSC = EXTOSC, FEXTOSC = LP).
+#define HVAC_RUN_S      3600.0
+#define HVAC_FOSC       32768.0
+#define HVAC_OST        (1024 / HVAC_FOSC)  // crystal start-up before the first instruction after a wake
+#define HVAC_FVR_SETTLE 25e-6
+#define HVAC_ADC_TIME   25e-6               // one conversion on ADCRC
+// 7SegmentCounter.X V1.0 image: DELAY (no .sym label left to find it by,
+// main.asm is V2.0 now) and the clock of its myConfigFile.inc
+#define SEVEN_V1_DELAY  0x02AC
+#define SEVEN_V1_FOSC   32768.0
+#define CONVERT_DECIMAL 0x24    // V1.0: first instruction after the GOTO START at 0x20
+#define MOVLW_MYDEN 0x0E0A      // its MOVLW MYDEN
+
+static pic18_t cpu;
+static int unassembled;            // sources pic18.c could not assemble; fails the run
+
+static int load(const char *hex) {
+    pic18_reset(&cpu);
+    if (pic18_load_hex(&cpu, hex) != 0) {
+        printf("  cannot open %s\n", hex);
+        return 0;
+    }
+    return 1;
+}
+
+// Address of a symbol of the last pic18_assemble(), 0 if there is none
+static uint16_t sym16(const char *name) {
+    long addr = pic18_asm_symbol(name);
+    return addr < 0 ? 0 : (uint16_t)addr;
+}
+
+// V1.0 image: DELAY, and how fast the switch loop sees a press
+static void bench_seven_segment(void) {
+    const double tcy = 4 / SEVEN_V1_FOSC;
+    uint64_t fastest = ~0ull, slowest = 0;
+
+    printf("7SegmentCounter.X (V1.0 image, polling)\n");
+    if (!load(SEVEN_SEG "dist/default/production/7SegmentCounter.X.production.hex"))
+        return;
+    uint64_t cycles = pic18_call(&cpu, SEVEN_V1_DELAY, 10000000);
+    printf("  DELAY @0x%04X: %llu cycles (+2 for the CALL), %.1f ms\n",
+           SEVEN_V1_DELAY, (unsigned long long)cycles, cycles / 1000.0);
+
+    // From reset: past the DELAY after the first digit, into the switch
+    // loop; then switch A pressed at each phase of the loop
+    for (unsigned phase = 0; phase < 8; phase++) {
+        load(SEVEN_SEG "dist/default/production/7SegmentCounter.X.production.hex");
+        pic18_run(&cpu, cycles + 1000 + phase);
+        uint8_t shown = pic18_peek(&cpu, PIC18_LATA + 1);
+        uint64_t pressed = cpu.cycles;
+        cpu.pins[3] = 0x01;
+        while (pic18_peek(&cpu, PIC18_LATA + 1) == shown && cpu.cycles - pressed < 1000)
+            pic18_step(&cpu);
+        uint64_t took = cpu.cycles - pressed;
+        if (took < fastest) fastest = took;
+        if (took > slowest) slowest = took;
+    }
+    printf("  at its clock (%.3f kHz LP crystal): a press shown %llu-%llu cycles (%.1f-%.1f ms) after it,\n"
+           "  then DELAY holds off every switch for %.1f s; the core never sleeps: %.1f uA idle\n",
+           SEVEN_V1_FOSC / 1000, (unsigned long long)fastest, (unsigned long long)slowest,
+           fastest * tcy * 1000, slowest * tcy * 1000, cycles * tcy, K42_I_RUN + K42_I_BOR);
+}
+
+// V2.0 switch script: RA0 (bit 0) and RA1 (bit 1) levels from time t on
+typedef struct {
+    double t;
+    uint8_t pins;
+    uint8_t press;          // first edge of a press from none
+} seven_edge_t;
+
+static seven_edge_t seven_script[256];
+static unsigned seven_edges;
+
+// Pins go to level at t, bouncing for the first 1.5 ms
+static void seven_set(double t, uint8_t level) {
+    static const double bounce[] = {0, 0.2e-3, 0.5e-3, 0.9e-3, 1.5e-3};
+    uint8_t before = seven_edges ? seven_script[seven_edges - 1].pins : 0;
+
+    for (unsigned i = 0; i < sizeof bounce / sizeof bounce[0]; i++) {
+        seven_script[seven_edges].t = t + bounce[i];
+        seven_script[seven_edges].press = i == 0 && before == 0 && level != 0;
+        seven_script[seven_edges++].pins = (i % 2 == 0) ? level : before;
+    }
+}
+
+/*
+ * V2.0 main.asm, assembled here, on a board model: Timer0 on LFINTOSC,
+ * IOC on PORTA setting IOCAF and IOCIF, and the core woken from Sleep by
+ * an enabled flag (GIE off: it goes on after the SLEEP). A script of
+ * bouncing taps, a press of both and a 4 s hold; the count is followed
+ * through LATB (each change one step of seg_hex).
+ */
+static void bench_seven_segment_sleep(void) {
+    static const char *const sources[] = {SEVEN_SEG "main.asm"};
+    const double tcy = 4 / K42_LFINTOSC;
+
+    printf("7SegmentCounter.X (V2.0 main.asm, assembled by pic18.c)\n");
+    pic18_reset(&cpu);
+    memset(cpu.flash, 0xFF, sizeof cpu.flash);
+    if (pic18_assemble(&cpu, sources, 1, 0x1000, 0x0000) != 0) {
+        printf("  cannot assemble %s\n", sources[0]);
+        unassembled++;
+        return;
+    }
+    uint16_t t0con0 = sym16("T0CON0"), t0con1 = sym16("T0CON1"), tmr0h = sym16("TMR0H");
+    uint16_t pie0 = sym16("PIE0"), pir0 = sym16("PIR0"), pie3 = sym16("PIE3"), pir3 = sym16("PIR3");
+    uint16_t iocap = sym16("IOCAP"), iocan = sym16("IOCAN"), iocaf = sym16("IOCAF");
+    uint16_t osccon3 = sym16("OSCCON3"), hex = sym16("seg_hex");
+    uint8_t seg_hex[16];
+
+    for (int v = 0; v < 16; v++)
+        seg_hex[v] = cpu.flash[hex + v];
+
+    // Taps of A and B, both pressed (B 30 ms after A), a 4 s hold of A,
+    // then quick taps 60 ms apart
+    struct { double at, len; uint8_t keys; } taps[] = {
+        {0.5, 0.150, 1}, {1.0, 0.080, 1}, {1.5, 0.120, 2}, {2.0, 0.300, 3},
+        {3.0, 4.000, 1}, {8.0, 0.100, 2}, {8.5, 0.060, 1}, {8.62, 0.060, 1},
+        {8.74, 0.060, 1}, {8.86, 0.060, 1},
+    };
+    seven_edges = 0;
+    for (unsigned i = 0; i < sizeof taps / sizeof taps[0]; i++) {
+        if (taps[i].keys == 3) {
+            seven_set(taps[i].at, 1);
+            seven_set(taps[i].at + 0.030, 3);
+        } else {
+            seven_set(taps[i].at, taps[i].keys);
+        }
+        seven_set(taps[i].at + taps[i].len, 0);
+    }
+
+    double t = 0, t0_next = -1, period = 0, press_at = -1, awake = 0, timer_on = 0;
+    double first_repeat = 0, hold_gap = 1e9, last_step = 0, hold_start = 3.0;
+    double latency_min = 1e9, latency_max = 0;
+    unsigned next = 0, wakes = 0, steps = 0, hold_steps = 0, wrong = 0, presses = 0;
+    int count = 0, stuck = 0;
+    uint8_t shown = 0, level = 0;
+
+    pic18_poke(&cpu, osccon3, 0x10);            // ORDY: the clock switch is immediate here
+    while (t < 10.0) {
+        // The script, and IOC on its edges
+        while (next < seven_edges && seven_script[next].t <= t) {
+            uint8_t now = seven_script[next].pins;
+            uint8_t rise = (uint8_t)(now & ~level), fall = (uint8_t)(level & ~now);
+            uint8_t flags = (uint8_t)((rise & pic18_peek(&cpu, iocap)) | (fall & pic18_peek(&cpu, iocan)));
+            pic18_poke(&cpu, iocaf, (uint8_t)(pic18_peek(&cpu, iocaf) | flags));
+            if (seven_script[next++].press) {
+                press_at = t;
+                presses++;
+            }
+            level = now;
+            cpu.pins[0] = now;
+        }
+        pic18_poke(&cpu, pir0, (uint8_t)((pic18_peek(&cpu, pir0) & 0x7F) | (pic18_peek(&cpu, iocaf) ? 0x80 : 0)));
+
+        // Timer0: TMR0IF every (TMR0H + 1) x prescaler LFINTOSC periods
+        uint8_t tc = pic18_peek(&cpu, t0con0);
+        if (!(tc & 0x80)) {
+            t0_next = -1;
+        } else if (t0_next < 0) {
+            period = (pic18_peek(&cpu, tmr0h) + 1.0) * (1u << (pic18_peek(&cpu, t0con1) & 0x0F)) /
+                     K42_LFINTOSC;
+            t0_next = t + period;
+        }
+        while (t0_next >= 0 && t >= t0_next) {
+            pic18_poke(&cpu, pir3, pic18_peek(&cpu, pir3) | 0x80);
+            t0_next += period;
+        }
+
+        if (cpu.asleep) {
+            if ((pic18_peek(&cpu, pir0) & pic18_peek(&cpu, pie0) & 0x80) ||
+                (pic18_peek(&cpu, pir3) & pic18_peek(&cpu, pie3) & 0x80)) {
+                cpu.asleep = 0;
+                wakes++;
+                continue;
+            }
+            // Asleep until the next edge or tick
+            double until = next < seven_edges ? seven_script[next].t : 10.0;
+            if (t0_next >= 0 && t0_next < until)
+                until = t0_next;
+            if (!(pic18_peek(&cpu, pie0) & 0x80) && t0_next < 0) {
+                stuck = 1;
+                break;
+            }
+            timer_on += t0_next >= 0 ? until - t : 0;
+            t = until;
+            continue;
+        }
+
+        unsigned c = pic18_step(&cpu);
+        t += c * tcy;
+        awake += c * tcy;
+        uint8_t lat = pic18_peek(&cpu, PIC18_LATA + 1);
+        if (lat == shown)
+            continue;
+        // One step: +1 or -1 (mod 16), or back to 0 for both
+        int v = -1;
+        for (int g = 0; g < 16; g++)
+            if (seg_hex[g] == lat)
+                v = g;
+        if (v < 0 || (v != ((count + 1) & 15) && v != ((count + 15) & 15) && v != 0))
+            wrong++;
+        count = v;
+        shown = lat;
+        steps++;
+        if (press_at >= 0) {
+            double latency = t - press_at;
+            if (latency < latency_min) latency_min = latency;
+            if (latency > latency_max) latency_max = latency;
+            press_at = -1;
+        }
+        if (t >= hold_start && t < hold_start + 4.0) {
+            if (hold_steps == 1)
+                first_repeat = t - last_step;
+            else if (hold_steps > 1 && t - last_step < hold_gap)
+                hold_gap = t - last_step;
+            hold_steps++;
+            last_step = t;
+        }
+    }
+    if (stuck) {
+        printf("  asleep with no wake-up source at %.3f s\n", t);
+        return;
+    }
+
+    // Expected: 1, 2, 1, then 2 and back to 0, the hold counting up, -1, +4
+    int expect = (hold_steps - 1 + 4) & 15;
+    double base = K42_I_SLEEP + K42_I_BOR;
+    printf("  Fosc 31 kHz (LFINTOSC), %u presses in %.0f s, %u steps shown, %u not one step, "
+           "count %d (%s)\n", presses, t, steps, wrong, count, count == expect ? "right" : "wrong");
+    printf("  a press shown %.1f-%.1f ms after its first edge (%.0f-%.0f cycles)\n",
+           latency_min * 1000, latency_max * 1000, latency_min / tcy, latency_max / tcy);
+    printf("  4 s hold: %u steps, first repeat after %.0f ms, then down to every %.0f ms\n",
+           hold_steps, first_repeat * 1000, hold_gap * 1000);
+    printf("  %u wake-ups, awake %.2f%% of the time; current idle %.2f uA (Sleep + BOR), "
+           "held %.2f uA, %.2f uA on average here\n", wakes, 100 * awake / t, base,
+           base + K42_I_TIMER, (base * t + K42_I_RUN * awake + K42_I_TIMER * timer_on) / t);
+}
+
+static void bench_hvac(void) {
+    printf("HVAC_Control_System.X (V1.0 image)\n");
+    if (!load(HVAC "dist/default/debug/HVAC_Control_System.X.debug.hex"))
+        return;
+    // main.asm no longer has the label, so the image is checked instead
+    long convert = CONVERT_DECIMAL;
+    if ((cpu.flash[convert] | cpu.flash[convert + 1] << 8) != MOVLW_MYDEN) {
+        printf("  CONVERT_DECIMAL not at 0x%04lX\n", convert);
+        return;
+    }
+
+    int slept = pic18_run(&cpu, 100000);
+    printf("  reset -> SLEEP: %llu cycles%s, contReg = %u, LATD = 0x%02X\n",
+           (unsigned long long)cpu.cycles, slept ? "" : " (no SLEEP)",
+           pic18_peek(&cpu, CONT_REG), pic18_peek(&cpu, PIC18_LATA + 3));
+
+    uint64_t min = UINT64_MAX, max = 0;
+    unsigned wrong = 0, at_min = 0, at_max = 0;
+    cpu.asleep = 0;
+    for (unsigned n = 0; n < 256; n++) {
+        pic18_poke(&cpu, NUME, (uint8_t)n);
+        uint64_t cycles = pic18_call(&cpu, (uint32_t)convert, 100000);
+        unsigned digits = pic18_peek(&cpu, RMND_H) * 100u + pic18_peek(&cpu, RMND_M) * 10u +
+                          pic18_peek(&cpu, RMND_L);
+        if (digits != n)
+            wrong++;
+        if (cycles < min) { min = cycles; at_min = n; }
+        if (cycles > max) { max = cycles; at_max = n; }
+        if (n == 10 || n == 60 || n == 255)
+            printf("  CONVERT_DECIMAL(%3u): %llu cycles\n", n, (unsigned long long)cycles);
+    }
+    printf("  CONVERT_DECIMAL @0x%04lX: %llu cycles (n = %u) to %llu cycles (n = %u)\n",
+           convert, (unsigned long long)min, at_min, (unsigned long long)max, at_max);
+    printf("  %u of 256 inputs give wrong digits when called back to back\n", wrong);
+}
+
+static void bench_first_assembly(void) {
+    printf("MyFirstAssembly_MPLAB.X\n");
+    if (!load(FIRST_ASM "dist/default/debug/MyFirstAssembly_MPLAB.X.debug.hex"))
+        return;
+
+    uint8_t last = 0;
+    uint64_t edges[3];
+    unsigned n = 0;
+    while (n < 3 && cpu.cycles < 100000) {
+        pic18_step(&cpu);
+        uint8_t out = pic18_peek(&cpu, PIC18_LATA + 3) & 0x03;
+        if (out != last) {
+            edges[n++] = cpu.cycles;
+            last = out;
+        }
+    }
+    if (n == 3)
+        printf("  RD0/RD1 toggle every %llu cycles\n",
+               (unsigned long long)(edges[2] - edges[1]));
+}
+
+// ACD_LCD_main.c lines 174-176 of that build: voltage = ..., lux = (int)(...)
+static void bench_adc_lcd_float(void) {
+    printf("A9_ADC_LCD.X (V3.0 image, float conversion)\n");
+    if (!load(ADC_LCD "hex"))
+        return;
+    long start = pic18_line(ADC_LCD "sym", "ACD_LCD_main.c", 174);
+    long end = pic18_line(ADC_LCD "sym", "ACD_LCD_main.c", 177);
+    long digital = pic18_symbol(ADC_LCD "sym", "_digital");
+    long lux = pic18_symbol(ADC_LCD "sym", "main@lux");
+    if (start < 0 || end < 0 || digital < 0 || lux < 0) {
+        printf("  symbols not found\n");
+        return;
+    }
+
+    uint64_t min = UINT64_MAX, max = 0, total = 0;
+    unsigned wrong = 0, at_min = 0, at_max = 0;
+    for (unsigned code = 0; code < 4096; code++) {
+        pic18_poke(&cpu, (uint16_t)digital, (uint8_t)code);
+        pic18_poke(&cpu, (uint16_t)digital + 1, (uint8_t)(code >> 8));
+        cpu.pc = (uint32_t)start;
+        uint64_t begin = cpu.cycles;
+        while (cpu.pc != (uint32_t)end && cpu.cycles - begin < 100000)
+            pic18_step(&cpu);
+        uint64_t cycles = cpu.cycles - begin;
+        int got = (int16_t)(pic18_peek(&cpu, (uint16_t)lux) | (pic18_peek(&cpu, (uint16_t)lux + 1) << 8));
+        int want = (int)(85.19f * (code * (5.0f / 4096.0f)) + -135.33f);
+        if (got != want)
+            wrong++;
+        total += cycles;
+        if (cycles < min) { min = cycles; at_min = code; }
+        if (cycles > max) { max = cycles; at_max = code; }
+    }
+    printf("  code -> lux: %llu cycles (code %u) to %llu cycles (code %u), %.0f on average\n",
+           (unsigned long long)min, at_min, (unsigned long long)max, at_max, total / 4096.0);
+    printf("  %u of 4096 codes differ from the host float result\n", wrong);
+}
+
+static void bench_adc_lcd_sprintf(void) {
+    printf("A9_ADC_LCD.X (V3.0 image, sprintf + strcat)\n");
+    if (!load(ADC_LCD "hex"))
+        return;
+    long start = pic18_line(ADC_LCD "sym", "ACD_LCD_main.c", 181);
+    long end = pic18_line(ADC_LCD "sym", "ACD_LCD_main.c", 184);
+    long lux = pic18_symbol(ADC_LCD "sym", "main@lux");
+    if (start < 0 || end < 0 || lux < 0) {
+        printf("  symbols not found\n");
+        return;
+    }
+
+    uint64_t min = UINT64_MAX, max = 0, total = 0;
+    unsigned at_min = 0, at_max = 0, count = 0;
+    for (unsigned value = 0; value <= 291; value++) {
+        pic18_poke(&cpu, (uint16_t)lux, (uint8_t)value);
+        pic18_poke(&cpu, (uint16_t)lux + 1, (uint8_t)(value >> 8));
+        cpu.pc = (uint32_t)start;
+        uint64_t begin = cpu.cycles;
+        while (cpu.pc != (uint32_t)end && cpu.cycles - begin < 100000)
+            pic18_step(&cpu);
+        uint64_t cycles = cpu.cycles - begin;
+        total += cycles;
+        count++;
+        if (cycles < min) { min = cycles; at_min = value; }
+        if (cycles > max) { max = cycles; at_max = value; }
+    }
+    printf("  lux -> text: %llu cycles (lux %u) to %llu cycles (lux %u), %.0f on average\n",
+           (unsigned long long)min, at_min, (unsigned long long)max, at_max, (double)total / count);
+}
+
+// calculate() with X and Y set and the operation key in Operation_REG
+static void bench_calculator_int(void) {
+    static const char ops[4] = {'A', 'B', 'C', 'D'};
+    static const char *names[4] = {"add", "sub", "mul", "div"};
+
+    printf("Calculator.X (V1.0 image, int calculate())\n");
+    if (!load(CALC "hex"))
+        return;
+    long calculate = pic18_symbol(CALC "sym", "_calculate");
+    long x = pic18_symbol(CALC "sym", "_X_Input_REG");
+    long y = pic18_symbol(CALC "sym", "_Y_Input_REG");
+    long op = pic18_symbol(CALC "sym", "_Operation_REG");
+    long result = pic18_symbol(CALC "sym", "_Display_Result_REG");
+    if (calculate < 0 || x < 0 || y < 0 || op < 0 || result < 0) {
+        printf("  symbols not found\n");
+        return;
+    }
+
+    for (uint8_t i = 0; i < 4; i++) {
+        uint64_t min = UINT64_MAX, max = 0;
+        for (unsigned a = 0; a < 100; a++)
+            for (unsigned b = 1; b < 100; b++) {
+                pic18_poke(&cpu, (uint16_t)x, (uint8_t)a);
+                pic18_poke(&cpu, (uint16_t)x + 1, 0);
+                pic18_poke(&cpu, (uint16_t)y, (uint8_t)b);
+                pic18_poke(&cpu, (uint16_t)y + 1, 0);
+                pic18_poke(&cpu, (uint16_t)op, (uint8_t)ops[i]);
+                uint64_t cycles = pic18_call(&cpu, (uint32_t)calculate, 100000);
+                if (cycles < min) min = cycles;
+                if (cycles > max) max = cycles;
+            }
+        // 49 op 12, the operands bench_calculator times Common/arith.h with
+        pic18_poke(&cpu, (uint16_t)x, 49);
+        pic18_poke(&cpu, (uint16_t)x + 1, 0);
+        pic18_poke(&cpu, (uint16_t)y, 12);
+        pic18_poke(&cpu, (uint16_t)y + 1, 0);
+        pic18_poke(&cpu, (uint16_t)op, (uint8_t)ops[i]);
+        uint64_t cycles = pic18_call(&cpu, (uint32_t)calculate, 100000);
+        printf("  %s: 49 %c 12 in %llu cycles, %llu to %llu for all two-digit operands\n",
+               names[i], ops[i], (unsigned long long)cycles,
+               (unsigned long long)min, (unsigned long long)max);
+    }
+    printf("  (each includes displayOnLEDs() and clearing the inputs)\n");
+}
+
+// Every input of one routine; signed inputs are sign-extended to 16 bits
+static void bench_bcd_routine(const char *name, unsigned bits, int is_signed) {
+    long entry = pic18_asm_symbol(name);
+    long value = pic18_asm_symbol("_bcd_value");
+    long digits = pic18_asm_symbol("_bcd_digits");
+    long sign = pic18_asm_symbol("_bcd_sign");
+    unsigned count = 1u << bits, wrong = 0;
+    uint64_t min = UINT64_MAX, max = 0;
+    long at_min = 0, at_max = 0;
+
+    for (unsigned n = 0; n < count; n++) {
+        long number = (is_signed && n >= count / 2) ? (long)n - (long)count : (long)n;
+        long magnitude = number < 0 ? -number : number;
+        pic18_poke(&cpu, PIC18_BSR, 0x3F);
+        pic18_poke(&cpu, (uint16_t)value, (uint8_t)n);
+        pic18_poke(&cpu, (uint16_t)value + 1, bits == 8 ? 0xA5 : (uint8_t)(n >> 8));
+        uint64_t cycles = pic18_call(&cpu, (uint32_t)entry, 10000);
+        long got = 0;
+        for (int i = 4; i >= 0; i--) {
+            uint8_t d = pic18_peek(&cpu, (uint16_t)(digits + i));
+            got = got * 10 + (d > 9 ? 100000 : d);
+        }
+        if (got != magnitude || pic18_peek(&cpu, (uint16_t)sign) != (number < 0) ||
+            pic18_peek(&cpu, PIC18_BSR) != 0x3F)
+            wrong++;
+        if (cycles < min) { min = cycles; at_min = number; }
+        if (cycles > max) { max = cycles; at_max = number; }
+    }
+    printf("  %-8s %6u inputs, %u wrong, %llu cycles (%ld) to %llu cycles (%ld)\n",
+           name, count, wrong, (unsigned long long)min, at_min, (unsigned long long)max, at_max);
+}
+
+static void bench_bcd(void) {
+    printf("Common/bcd.s (assembled by pic18.c)\n");
+    pic18_reset(&cpu);
+    memset(cpu.flash, 0xFF, sizeof cpu.flash);
+    static const char *const sources[] = {BCD};
+    if (pic18_assemble(&cpu, sources, 1, 0x0200, 0x0000) != 0) {
+        printf("  cannot assemble %s\n", BCD);
+        unassembled++;
+        return;
+    }
+    bench_bcd_routine("_bcd_u8", 8, 0);
+    bench_bcd_routine("_bcd_s8", 8, 1);
+    bench_bcd_routine("_bcd_u16", 16, 0);
+    bench_bcd_routine("_bcd_s16", 16, 1);
+    printf("  (+2 cycles for the CALL; min = max means the time does not depend on the input)\n");
+}
+
+// Sensors: MCP9700s read against the 2.048 V FVR, 2 codes a mV. Zone n
+// reads 18 +- 4 deg C over 30 minutes, each zone a little later than the
+// one before, with +-0.15 deg C of noise; zone 0 unplugged (code 0) from
+// 2400 s to 2460 s.
+static unsigned hvac_noise = 12345;
+
+static unsigned hvac_random(void) {
+    hvac_noise = hvac_noise * 1103515245u + 12345u;
+    return (hvac_noise >> 16) & 0x7FFF;
+}
+
+static uint16_t hvac_sensor(unsigned zone, double t) {
+    if (zone == 0 && t >= 2400 && t < 2460)
+        return 0;
+    double noise = hvac_random() / 32767.0 * 0.3 - 0.15;
+    double temp = 18.0 + 4.0 * sin(2 * M_PI * t / 1800.0 - 0.7 * zone) + noise;
+    double code = (500.0 + 10.0 * temp) * 2.0 + 0.5;
+    return code < 0 ? 0 : code > 4095 ? 4095 : (uint16_t)code;
+}
+
+// The pin ADPCH converts, as wired: up to 8 zones, RAn is zone n's sensor;
+// above 8, RA7 is the multiplexer output and LATA<4:0> its address. Any
+// other pin of PORTA-D is a digital output and reads its own drive.
+static uint16_t hvac_input(unsigned zones, uint8_t channel, double t) {
+    if (zones > 8 && channel == 0x07)
+        return hvac_sensor(pic18_peek(&cpu, PIC18_LATA) & 0x1F, t);
+    if (zones <= 8 && channel < 8)
+        return hvac_sensor(channel, t);
+    if (channel < 0x20)
+        return (pic18_peek(&cpu, (uint16_t)(PIC18_LATA + (channel >> 3))) >> (channel & 7)) & 1 ? 4095 : 0;
+    return 0;
+}
+
+// Host model of one zone's thresholds (state 0 off, 1 heating, 2 cooling):
+// what is running moves its own threshold HYST_CODES further on. error is
+// an out-of-range reading, with both outputs off
+static int hvac_decide(int state, long code, long setpoint, long band, int *error) {
+    long hyst = pic18_asm_symbol("HYST_CODES");
+    long heat_below = setpoint - band + (state == 1 ? hyst : 0);
+    long cool_above = setpoint + band - (state == 2 ? hyst : 0);
+
+    *error = code < pic18_asm_symbol("CODE_MIN") || code > pic18_asm_symbol("CODE_MAX");
+    if (*error)
+        return 0;
+    return code < heat_below ? 1 : code > cool_above ? 2 : 0;
+}
+
+static uint16_t peek16(uint16_t addr) {
+    return (uint16_t)(pic18_peek(&cpu, addr) | pic18_peek(&cpu, (uint16_t)(addr + 1)) << 8);
+}
+
+// State of zone z from zoneOut, as the host model numbers it
+static int hvac_zone_state(uint16_t out, unsigned z) {
+    uint16_t group = (uint16_t)(out + 3 * (z / 8));
+    unsigned bit = z % 8;
+
+    return ((pic18_peek(&cpu, group) >> bit) & 1) ? 1 :
+           ((pic18_peek(&cpu, (uint16_t)(group + 1)) >> bit) & 1) ? 2 : 0;
+}
+
+// main.asm with its own ZONES, or -DZONES=define if that is not 0
+static void bench_hvac_loop(unsigned define) {
+    static const char *const sources[] = {HVAC "main.asm", BCD};
+    const double tcy = 4 / HVAC_FOSC;
+    char text[8];
+
+    printf("HVAC_Control_System.X (V3.1 main.asm + Common/bcd.s, assembled by pic18.c%s)\n",
+           define ? ", -DZONES" : "");
+    if (define) {
+        snprintf(text, sizeof text, "%u", define);
+        pic18_asm_define("ZONES", text);
+    }
+    pic18_reset(&cpu);
+    memset(cpu.flash, 0xFF, sizeof cpu.flash);
+    if (pic18_assemble(&cpu, sources, 2, 0x1000, 0x0000) != 0) {
+        printf("  cannot assemble %s\n", sources[0]);
+        unassembled++;
+        return;
+    }
+    uint16_t fvrcon = sym16("FVRCON"), adcon0 = sym16("ADCON0"), adresl = sym16("ADRESL");
+    uint16_t adpch = sym16("ADPCH");
+    uint16_t t2con = sym16("T2CON"), t2pr = sym16("T2PR"), pie4 = sym16("PIE4"), pir4 = sym16("PIR4");
+    uint16_t cfg = sym16("zoneCfg"), meas = sym16("zoneMeas"), out = sym16("zoneOut");
+    uint16_t temp_reg = sym16("measuredTemp");
+    unsigned zones = (unsigned)(meas - cfg) / 4;     // ZONES is a #define, not a symbol
+
+    double t = 0, fvr_on = -1, adc_end = -1, t2_next = -1, period = 0;
+    double awake = 0, q_run = 0, q_fvr = 0, q_adc = 0, q_sleep = 0, q_base = 0;
+    unsigned passes = 0, decisions = 0, wrong = 0, digits_wrong = 0, errors = 0;
+    unsigned changes = 0, naive_changes = 0, no_fvr = 0, stuck = 0;
+    int state[32] = {0}, naive[32] = {0}, was_error[32] = {0};
+    uint64_t wake_cycles = 0, max_cycles = 0;
+    uint16_t sample = 0;
+
+    if (zones < 1 || zones > 32) {
+        printf("  ZONES = %u, not 1 to 32\n", zones);
+        return;
+    }
+    cpu.pc = 0x20;
+    while (t < HVAC_RUN_S) {
+        if (!cpu.asleep) {
+            unsigned c = pic18_step(&cpu);
+            double dt = c * tcy;
+            int fvr = (pic18_peek(&cpu, fvrcon) & 0x80) != 0;
+            t += dt;
+            awake += dt;
+            q_run += K42_I_RUN * dt;
+            q_fvr += fvr ? K42_I_FVR * dt : 0;
+            q_base += (K42_I_BOR + K42_I_TIMER) * dt;
+
+            // FVR: ready HVAC_FVR_SETTLE after it is turned on
+            if (!fvr)
+                fvr_on = -1;
+            else if (fvr_on < 0)
+                fvr_on = t;
+            pic18_poke(&cpu, fvrcon, (uint8_t)((pic18_peek(&cpu, fvrcon) & ~0x40) |
+                                              (fvr && t - fvr_on >= HVAC_FVR_SETTLE ? 0x40 : 0)));
+
+            // ADC: GO clears HVAC_ADC_TIME after it is set, with the
+            // sensor on ADPCH
+            uint8_t ad = pic18_peek(&cpu, adcon0);
+            if ((ad & 0x81) == 0x81 && adc_end < 0) {
+                adc_end = t + HVAC_ADC_TIME;
+                q_adc += K42_I_ADC * HVAC_ADC_TIME;
+                if (!(pic18_peek(&cpu, fvrcon) & 0x40))
+                    no_fvr++;
+                sample = hvac_input(zones, pic18_peek(&cpu, adpch), t);
+            }
+            if (adc_end >= 0 && t >= adc_end) {
+                pic18_poke(&cpu, adresl, (uint8_t)sample);
+                pic18_poke(&cpu, adresl + 1, (uint8_t)(sample >> 8));
+                pic18_poke(&cpu, adcon0, (uint8_t)(ad & ~0x01));
+                adc_end = -1;
+            }
+
+            // Timer2: a match every (T2PR + 1) x prescaler x postscaler LFINTOSC periods
+            uint8_t tc = pic18_peek(&cpu, t2con);
+            if (!(tc & 0x80)) {
+                t2_next = -1;
+            } else if (t2_next < 0) {
+                period = (pic18_peek(&cpu, t2pr) + 1.0) * (1u << ((tc >> 4) & 7)) *
+                         ((tc & 0x0F) + 1) / K42_LFINTOSC;
+                t2_next = t + period;
+            }
+            while (t2_next >= 0 && t >= t2_next) {
+                pic18_poke(&cpu, pir4, pic18_peek(&cpu, pir4) | 0x04);
+                t2_next += period;
+            }
+
+            if (!cpu.asleep)
+                continue;
+            // SLEEP: one pass made. A flag already up makes it a NOP.
+            uint64_t cycles = cpu.cycles - wake_cycles;
+            if (passes > 0 && cycles > max_cycles)
+                max_cycles = cycles;
+            for (unsigned z = 0; z < zones; z++) {
+                uint16_t zc = (uint16_t)(cfg + 4 * z);
+                long code = peek16((uint16_t)(meas + 2 * z)), setpoint = peek16(zc);
+                int error, want = hvac_decide(state[z], code, setpoint, pic18_peek(&cpu, zc + 2), &error);
+                int got = hvac_zone_state(out, z);
+                int got_error = (pic18_peek(&cpu, (uint16_t)(out + 3 * (z / 8) + 2)) >> (z % 8)) & 1;
+                if (got != want || got_error != error)
+                    wrong++;
+                if (z < 8 && (((pic18_peek(&cpu, PIC18_LATA + 1) >> z) & 1) != (want == 1) ||
+                              ((pic18_peek(&cpu, PIC18_LATA + 2) >> z) & 1) != (want == 2) ||
+                              ((pic18_peek(&cpu, PIC18_LATA + 3) >> z) & 1) != error))
+                    wrong++;
+                if (z == 0 && !error) {
+                    int16_t tenths = (int16_t)peek16(temp_reg);
+                    int mag = tenths < 0 ? -tenths : tenths;
+                    int shown = pic18_peek(&cpu, 0x73) * 1000 + pic18_peek(&cpu, 0x72) * 100 +
+                                pic18_peek(&cpu, 0x71) * 10 + pic18_peek(&cpu, 0x70);
+                    if (tenths != (code - 1000) / 2 - ((code - 1000) < 0 && (code & 1)) || shown != mag)
+                        digits_wrong++;
+                }
+                if (error && !was_error[z])
+                    errors++;
+                was_error[z] = error;
+                if (want != state[z])
+                    changes++;
+                state[z] = want;
+                // V1.x rule on the same readings: heat below the setpoint, cool above
+                int n = error ? 0 : code < setpoint ? 1 : code > setpoint ? 2 : 0;
+                if (n != naive[z])
+                    naive_changes++;
+                naive[z] = n;
+                decisions++;
+            }
+            passes++;
+            if ((pic18_peek(&cpu, pir4) & 0x04) && (pic18_peek(&cpu, pie4) & 0x04))
+                cpu.asleep = 0;
+        } else {
+            if (!(pic18_peek(&cpu, pie4) & 0x04) || t2_next < 0) {
+                stuck = 1;
+                break;
+            }
+            double dt = t2_next - t;
+            q_sleep += K42_I_SLEEP * dt;
+            q_base += (K42_I_BOR + K42_I_TIMER) * dt;
+            q_fvr += (pic18_peek(&cpu, fvrcon) & 0x80) ? K42_I_FVR * dt : 0;
+            t = t2_next;
+            t2_next += period;
+            pic18_poke(&cpu, pir4, pic18_peek(&cpu, pir4) | 0x04);
+            // The crystal restarts before the core runs again
+            t += HVAC_OST;
+            awake += HVAC_OST;
+            q_run += K42_I_RUN * HVAC_OST;
+            q_base += (K42_I_BOR + K42_I_TIMER) * HVAC_OST;
+            cpu.asleep = 0;
+            wake_cycles = cpu.cycles;
+        }
+    }
+    if (stuck) {
+        printf("  asleep with no wake-up source at %.1f s\n", t);
+        return;
+    }
+
+    double total = q_run + q_fvr + q_adc + q_sleep + q_base;
+    printf("  Fosc %.3f kHz (LP crystal), %u zones sampled every %.3f s (Timer2 on LFINTOSC)%s\n",
+           HVAC_FOSC / 1000, zones, period, zones > 8 ? ", through the multiplexer on RA0-RA4/RA7" : "");
+    printf("  %.0f s: %u passes (%.2f per second), %u zone decisions, %u differ from the host model, "
+           "%u with wrong digits\n", t, passes, passes / t, decisions, wrong, digits_wrong);
+    printf("  awake %.1f ms a pass (%.1f ms crystal start-up + up to %llu cycles), %.2f%% of the time\n",
+           awake / passes * 1000, HVAC_OST * 1000, (unsigned long long)max_cycles,
+           100 * awake / t);
+    printf("  %u output changes with the deadband and hysteresis, %u for heat below / cool above "
+           "the setpoint on the same readings\n", changes, naive_changes);
+    printf("  %u sensor error%s (error bit, outputs off) and back, %u conversions before the FVR was ready\n",
+           errors, errors == 1 ? "" : "s", no_fvr);
+    printf("  average current %.2f uA: core %.2f, FVR %.3f, ADC %.4f, Sleep %.2f, BOR + Timer2 %.2f\n",
+           total / t, q_run / t, q_fvr / t, q_adc / t, q_sleep / t, q_base / t);
+    printf("  (the same loop polling instead of sleeping, FVR left on: %.1f uA)\n",
+           K42_I_RUN + K42_I_FVR + K42_I_BOR + K42_I_TIMER);
+}
+
+// EVALUATE_ZONES of main.asm assembled with -DZONES=n: random readings
+// (some out of range), setpoints, deadbands and last states, checked
+// against the host model
+static void bench_hvac_zones(void) {
+    static const char *const sources[] = {HVAC "main.asm", BCD};
+    static const unsigned counts[] = {1, 2, 4, 8, 9, 16, 24, 32};
+    uint64_t first = 0;
+
+    printf("HVAC_Control_System.X zone pass (EVALUATE_ZONES, -DZONES=n)\n");
+    for (size_t i = 0; i < sizeof counts / sizeof counts[0]; i++) {
+        unsigned zones = counts[i], wrong = 0;
+        uint64_t min = UINT64_MAX, max = 0;
+        char text[8];
+
+        pic18_reset(&cpu);
+        memset(cpu.flash, 0xFF, sizeof cpu.flash);
+        snprintf(text, sizeof text, "%u", zones);
+        pic18_asm_define("ZONES", text);
+        if (pic18_assemble(&cpu, sources, 2, 0x1000, 0x0000) != 0) {
+            printf("  cannot assemble %s\n", sources[0]);
+            unassembled++;
+            return;
+        }
+        long entry = pic18_asm_symbol("EVALUATE_ZONES");
+        uint16_t cfg = sym16("zoneCfg"), meas = sym16("zoneMeas"), out = sym16("zoneOut");
+        long hyst = pic18_asm_symbol("HYST_CODES");
+
+        for (unsigned z = 0; z < 3 * ((zones + 7) / 8); z++)
+            pic18_poke(&cpu, (uint16_t)(out + z), 0);
+        for (int pass = 0; pass < 2000; pass++) {
+            int want[32], error[32];
+            for (unsigned z = 0; z < zones; z++) {
+                uint16_t zc = (uint16_t)(cfg + 4 * z);
+                long setpoint = 1200 + 20 * (hvac_random() % 41);
+                long band = hyst + hvac_random() % (127 - hyst);
+                // mostly near the setpoint, where the state matters
+                long code = hvac_random() % 8 ? setpoint - band - 20 + (long)(hvac_random() % (2 * band + 41))
+                                              : 600 + (long)(hvac_random() % 1800);
+                pic18_poke(&cpu, zc, (uint8_t)setpoint);
+                pic18_poke(&cpu, (uint16_t)(zc + 1), (uint8_t)(setpoint >> 8));
+                pic18_poke(&cpu, (uint16_t)(zc + 2), (uint8_t)band);
+                pic18_poke(&cpu, (uint16_t)(meas + 2 * z), (uint8_t)code);
+                pic18_poke(&cpu, (uint16_t)(meas + 2 * z + 1), (uint8_t)(code >> 8));
+                want[z] = hvac_decide(hvac_zone_state(out, z), code, setpoint, band, &error[z]);
+            }
+            pic18_poke(&cpu, PIC18_BSR, 0x3F);
+            uint64_t cycles = pic18_call(&cpu, (uint32_t)entry, 100000);
+            for (unsigned z = 0; z < zones; z++)
+                if (hvac_zone_state(out, z) != want[z] ||
+                    ((pic18_peek(&cpu, (uint16_t)(out + 3 * (z / 8) + 2)) >> (z % 8)) & 1) != error[z])
+                    wrong++;
+            if (cycles < min) min = cycles;
+            if (cycles > max) max = cycles;
+        }
+        if (i == 0)
+            first = max;
+        printf("  %2u zone%s  %5llu-%-5llu cycles a pass, %5.1f a zone, %4.1f each zone past the first; "
+               "%u wrong in 2000 passes\n", zones, zones == 1 ? " " : "s", (unsigned long long)min,
+               (unsigned long long)max, (double)max / zones,
+               zones > 1 ? (double)(max - first) / (zones - 1) : 0.0, wrong);
+    }
+    printf("  (+2 cycles for the CALL; at 32.768 kHz a cycle is 122 us)\n");
+}
+
+int main(void) {
+    printf("Assembly projects (PIC18 ISS, exact instruction cycles)\n");
+    bench_seven_segment();
+    bench_seven_segment_sleep();
+    bench_hvac();
+    bench_bcd();
+    bench_hvac_loop(0);
+    bench_hvac_loop(12);
+    bench_hvac_zones();
+    bench_first_assembly();
+    bench_adc_lcd_float();
+    bench_adc_lcd_sprintf();
+    bench_calculator_int();
+    return unassembled != 0;
+}
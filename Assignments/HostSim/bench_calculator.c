@@ -0,0 +1,511 @@
+/*
+ * Title: Calculator.X benchmark
+ * ---------------------
+ * Program Details:
+ *  Runs the 4x4 keypad calculator on the host model. The keypad sits on
+ *  PORTB with rows on RB0-RB3 and columns on RB4-RB7, like the board, and
+ *  is read by the IOC and Timer0 interrupts from keypad.h. The model runs
+ *  at its default Fosc of 4 MHz (1 MHz instruction clock), the clock
+ *  setup() selects: HFINTOSC at 4 MHz, divider 1:1 (header.h, main.c).
+ *   - scan: cost of one keypad_tick() (one row) and of a full 4-row scan
+ *   - idle: one second with no key down, how much of it the core sleeps,
+ *     and the time the firmware counts in each power state (Common/power.h)
+ *   - typing: "12C34#" typed at a steady rate, measuring the time from each
+ *     key going down to handleInput() returning for it
+ *   - busy: the same keys typed fast while every handleInput() is followed
+ *     by 150 ms of other work, to check that no key is lost
+ *   - display: the 7-segment bank on PORTD (segments) and PORTA (digit
+ *     selects) refreshed from Timer2, for one second at full brightness and
+ *     one dimmed: refresh interrupts, cycles per refresh, the share of the
+ *     CPU they take, and how often and how long each digit is lit
+ *   - expressions: chained key sequences with precedence, reuse of the
+ *     last result, replaced operators and errors, checked against their
+ *     expected results, then random expressions of 1 to 6 operands checked
+ *     against a host evaluator; the cycles of each handleInput() call
+ *     (key to result on the display buffer) and the worst key seen
+ *   - arithmetic: cycles of each Common/arith.h operation for 2-, 4- and
+ *     8-digit operands (the firmware is built for 8), from the ARITH_COST()
+ *     steps, and a check of every operation against the host's own integer
+ *     arithmetic for random operands of 1 to 8 digits
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xc.h>
+
+// From Calculator.X/main.c and keypad.h
+void setup(void);
+void resetAll(void);
+void handleInput(char key);
+char keypad_get(void);
+void keypad_tick(void);
+void IOC_ISR(void);
+void TMR0_ISR(void);
+void TMR2_ISR(void);
+
+// Common/power.h
+#define PWR_SLEEP       3
+void pwr_wait(uint8_t state);
+extern uint32_t pwr_time[4], pwr_waits[4];
+
+// Common/arith.h with ARITH_DIGITS 8
+typedef struct {
+    uint8_t neg;
+    uint8_t mag[4];
+} arith_t;
+#define ARITH_OK        0
+#define ARITH_OVERFLOW  1
+#define ARITH_DIV_ZERO  2
+#define ARITH_MAX       99999999LL
+void arith_clear(arith_t *x);
+int32_t arith_to_long(const arith_t *x);
+uint8_t arith_digit(arith_t *x, uint8_t digit);
+uint8_t arith_add(arith_t *r, const arith_t *x, const arith_t *y);
+uint8_t arith_sub(arith_t *r, const arith_t *x, const arith_t *y);
+uint8_t arith_mul(arith_t *r, const arith_t *x, const arith_t *y);
+uint8_t arith_div(arith_t *q, arith_t *rem, const arith_t *x, const arith_t *y);
+extern arith_t Display_Result_REG;
+extern uint8_t Calc_Status_REG;
+extern arith_t expr_remainder;
+
+// Common/seg_display.h with DISPLAY_DIGITS 8
+#define DISPLAY_DIGITS  8
+extern volatile uint8_t display_buffer[DISPLAY_DIGITS];
+extern const uint8_t seg_hex[16];
+extern volatile uint8_t keypad_head, keypad_tail, keypad_dropped;
+
+static const uint8_t row_bits[4] = {0, 1, 2, 3};
+static const uint8_t col_bits[4] = {4, 5, 6, 7};
+static const char layout[4][4] = {
+    {'1', '2', '3', 'A'},
+    {'4', '5', '6', 'B'},
+    {'7', '8', '9', 'C'},
+    {'*', '0', '#', 'D'}
+};
+
+// Refresh interrupts and the digits they light
+static struct {
+    uint32_t calls;
+    uint64_t cycles;            // inside TMR2_ISR(), without the entry latency
+    uint64_t worst;
+    uint8_t lit;                // digit selects after the last call
+    uint64_t lit_at;
+    uint64_t on_cycles[DISPLAY_DIGITS];
+    uint32_t refreshes[DISPLAY_DIGITS];
+} refresh;
+
+static uint64_t handled_at[16];
+static uint8_t handled;
+static uint32_t busy_ms;
+static uint32_t passes;
+
+// The while (1) body of main(), with a hook for the handled time
+static void main_loop(void) {
+    while (1) {
+        char key = keypad_get();
+        passes++;
+        if (key != 0) {
+            handleInput(key);
+            handled_at[handled++ & 15] = sim_cycles;
+            sim_tick((uint32_t)sim_ms(busy_ms));
+        } else {
+            di();
+            if (keypad_tail == keypad_head)
+                pwr_wait(PWR_SLEEP);
+            ei();
+        }
+    }
+}
+
+static void script_key(uint64_t at, char key, uint32_t hold_ms) {
+    for (uint8_t r = 0; r < 4; r++)
+        for (uint8_t c = 0; c < 4; c++)
+            if (layout[r][c] == key) {
+                sim_key_at(at, r, c, 1);
+                sim_key_at(at + sim_ms(hold_ms), r, c, 0);
+            }
+}
+
+static void display_isr(void) {
+    uint64_t start = sim_cycles;
+    TMR2_ISR();
+    uint64_t cycles = sim_cycles - start;
+    uint8_t lit = sim_output(SIM_PORTA);
+
+    refresh.calls++;
+    refresh.cycles += cycles;
+    if (cycles > refresh.worst)
+        refresh.worst = cycles;
+    if (lit != refresh.lit) {
+        for (uint8_t d = 0; d < DISPLAY_DIGITS; d++) {
+            if (refresh.lit & (1u << d))
+                refresh.on_cycles[d] += sim_cycles - refresh.lit_at;
+            if (lit & (1u << d))
+                refresh.refreshes[d]++;
+        }
+        refresh.lit = lit;
+        refresh.lit_at = sim_cycles;
+    }
+}
+
+// The display buffer read back as text, leftmost digit first
+static const char *display_shown(void) {
+    static char text[2 * DISPLAY_DIGITS + 1];
+    char *out = text;
+
+    for (uint8_t i = DISPLAY_DIGITS; i-- > 0;) {
+        uint8_t seg = display_buffer[i] & 0x7F;
+        char c = '?';
+        if (seg == 0) c = ' ';
+        else if (seg == 0x40) c = '-';
+        else if (seg == 0x50) c = 'r';
+        else if (seg == 0x5C) c = 'o';
+        for (uint8_t g = 0; g < 16; g++)
+            if (seg_hex[g] == seg)
+                c = "0123456789AbCdEF"[g];
+        *out++ = c;
+        if (display_buffer[i] & 0x80)
+            *out++ = '.';
+    }
+    *out = 0;
+    return text;
+}
+
+static void boot(void) {
+    sim_reset();
+    sim_keypad(SIM_PORTB, row_bits, 4, col_bits, 4);
+    sim_irq(SIM_IRQ_IOC, IOC_ISR);
+    sim_irq(SIM_IRQ_TMR0, TMR0_ISR);
+    sim_irq(SIM_IRQ_TMR2, display_isr);
+    memset(&refresh, 0, sizeof refresh);
+    setup();
+    resetAll();
+    handled = 0;
+    passes = 0;
+}
+
+// keypad_tick() called directly, with a key held so events are queued too
+static void bench_scan(void) {
+    const uint32_t ticks = 40000;
+
+    boot();
+    INTCON0bits.GIE = 0;
+    sim_key(1, 1, 1);                       // '5' held
+    uint64_t start = sim_cycles;
+    double t0 = sim_wall_us();
+    for (uint32_t i = 0; i < ticks; i++)
+        keypad_tick();
+    double wall = sim_wall_us() - t0;
+    sim_report("keypad_tick (one row)", ticks, sim_cycles - start, wall);
+    sim_report("full scan (4 rows)", ticks / 4, sim_cycles - start, wall);
+}
+
+static void bench_idle(void) {
+    boot();
+    busy_ms = 0;
+    double t0 = sim_wall_us();
+    sim_run(main_loop, sim_ms(1000));
+    sim_report("idle, 1 s (main loop passes)", passes, sim_cycles, sim_wall_us() - t0);
+    printf("  asleep %.1f%% of the time, %u interrupts\n",
+           100.0 * sim_stats.sleep_cycles / sim_cycles, sim_stats.interrupts);
+    sim_power_report(pwr_time, pwr_waits);
+}
+
+static void bench_typing(const char *label, uint32_t hold_ms, uint32_t gap_ms, uint32_t work_ms) {
+    const char *keys = "12C34#";
+    uint64_t pressed_at[8];
+    uint8_t n = 0;
+
+    boot();
+    busy_ms = work_ms;
+    for (uint64_t at = sim_ms(10); keys[n]; n++, at += sim_ms(hold_ms + gap_ms)) {
+        pressed_at[n] = at;
+        script_key(at, keys[n], hold_ms);
+    }
+
+    uint64_t end = pressed_at[n - 1] + sim_ms(hold_ms + gap_ms) + sim_ms(work_ms) * n;
+    double t0 = sim_wall_us();
+    sim_run(main_loop, end);
+    double wall = sim_wall_us() - t0;
+
+    uint64_t worst = 0, total = 0;
+    for (uint8_t i = 0; i < handled && i < n; i++) {
+        uint64_t latency = handled_at[i] - pressed_at[i];
+        total += latency;
+        if (latency > worst)
+            worst = latency;
+    }
+    sim_report(label, passes, sim_cycles, wall);
+    printf("  keys handled %u/%u (%u dropped), press->handled avg %.1f cyc, worst %llu cyc\n",
+           handled, n, keypad_dropped, handled ? (double)total / handled : 0.0,
+           (unsigned long long)worst);
+    printf("  result %d (status %u), display \"%s\", asleep %.1f%%, %u interrupts\n",
+           arith_to_long(&Display_Result_REG), Calc_Status_REG, display_shown(),
+           100.0 * sim_stats.sleep_cycles / sim_cycles, sim_stats.interrupts);
+}
+
+// One second of refresh with the keys typed at the start, then the results
+static void bench_display(const char *label, const char *keys) {
+    boot();
+    busy_ms = 0;
+    for (const char *k = keys; *k; k++)
+        handleInput(*k);
+    memset(&refresh, 0, sizeof refresh);
+    refresh.lit = sim_output(SIM_PORTA);
+    refresh.lit_at = sim_cycles;
+
+    uint64_t start = sim_cycles;
+    uint64_t slept = sim_stats.sleep_cycles;
+    double t0 = sim_wall_us();
+    sim_run(main_loop, sim_cycles + sim_ms(1000));
+    double wall = sim_wall_us() - t0;
+    uint64_t total = sim_cycles - start;
+
+    sim_report(label, refresh.calls, refresh.cycles, wall);
+    printf("  display \"%s\": %.1f cyc per refresh ISR (worst %llu) + %u entry latency, %.2f%% of the CPU, asleep %.1f%%\n",
+           display_shown(), refresh.calls ? (double)refresh.cycles / refresh.calls : 0.0,
+           (unsigned long long)refresh.worst, SIM_IRQ_LATENCY,
+           100.0 * (refresh.cycles + (uint64_t)refresh.calls * SIM_IRQ_LATENCY) / total,
+           100.0 * (sim_stats.sleep_cycles - slept) / total);
+    printf("  per digit (left to right), refreshes/s and lit %%:");
+    for (uint8_t d = DISPLAY_DIGITS; d-- > 0;)
+        printf(" %u/%.1f", refresh.refreshes[d], 100.0 * refresh.on_cycles[d] / total);
+    printf("\n");
+}
+
+// handleInput() for each key, keeping the slowest call of each kind
+static uint64_t worst_key[3];               // digit, operator, '#'
+static char worst_script[3][64];
+
+static void type_keys(const char *keys) {
+    for (const char *k = keys; *k; k++) {
+        uint8_t kind = (*k >= '0' && *k <= '9') ? 0 : (*k == '#') ? 2 : (*k == '*') ? 0 : 1;
+        uint64_t start = sim_cycles;
+        handleInput(*k);
+        uint64_t cycles = sim_cycles - start;
+        if (cycles > worst_key[kind]) {
+            worst_key[kind] = cycles;
+            snprintf(worst_script[kind], sizeof worst_script[kind], "%s", keys);
+        }
+    }
+}
+
+// Host evaluator: the same precedence, and every step range-checked like arith.h
+static uint8_t host_apply(long long *x, long long y, char op) {
+    long long r;
+    if (op == 'A') r = *x + y;
+    else if (op == 'B') r = *x - y;
+    else if (op == 'C') r = *x * y;
+    else if (y == 0) return ARITH_DIV_ZERO;
+    else r = *x / y;
+    if (r > 99999999LL || r < -99999999LL)
+        return ARITH_OVERFLOW;
+    *x = r;
+    return ARITH_OK;
+}
+
+static uint8_t host_eval(const long long *values, const char *ops, uint8_t count, long long *result) {
+    long long stack[8];
+    char pending[8];
+    uint8_t depth = 0, waiting = 0, status;
+
+    stack[depth++] = values[0];
+    for (uint8_t i = 1; i <= count; i++) {
+        uint8_t prec = i < count ? (ops[i - 1] == 'C' || ops[i - 1] == 'D') + 1 : 0;
+        while (waiting > 0 && (pending[waiting - 1] == 'C' || pending[waiting - 1] == 'D') + 1 >= prec) {
+            depth--;
+            if ((status = host_apply(&stack[depth - 1], stack[depth], pending[--waiting])) != ARITH_OK)
+                return status;
+        }
+        if (i < count) {
+            pending[waiting++] = ops[i - 1];
+            stack[depth++] = values[i];
+        }
+    }
+    *result = stack[0];
+    return ARITH_OK;
+}
+
+static void bench_expressions(void) {
+    static const struct {
+        const char *keys;
+        long long result;
+        uint8_t status;
+    } cases[] = {
+        {"2A3C4#", 14, ARITH_OK},
+        {"C2#", 28, ARITH_OK},              // goes on from the 14 before
+        {"2C3A4#", 10, ARITH_OK},
+        {"9B4B3#", 2, ARITH_OK},            // left to right
+        {"64D4D2#", 8, ARITH_OK},
+        {"100D7#", 14, ARITH_OK},           // remainder 2
+        {"5AC3#", 15, ARITH_OK},            // 'C' replaces 'A'
+        {"5A#", 5, ARITH_OK},               // trailing operator dropped
+        {"1B2#", -1, ARITH_OK},
+        {"C5#", -5, ARITH_OK},
+        {"7D0#", 0, ARITH_DIV_ZERO},
+        {"5#", 0, ARITH_DIV_ZERO},          // keys wait for '*' after an error
+        {"*A1#", 1, ARITH_OK},              // and the last result is then 0
+        {"99999999A1#", 0, ARITH_OVERFLOW},
+        {"12*34A5#", 39, ARITH_OK},
+        {"99999999B98765432D87654321A1#", 99999999, ARITH_OK},
+        {"1A98765432D87654321#", 2, ARITH_OK},
+    };
+    unsigned wrong = 0, checked = 0;
+
+    boot();
+    memset(worst_key, 0, sizeof worst_key);
+    handleInput('*');
+    for (unsigned i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+        type_keys(cases[i].keys);
+        long long got = arith_to_long(&Display_Result_REG);
+        if (Calc_Status_REG != cases[i].status || (cases[i].status == ARITH_OK && got != cases[i].result)) {
+            printf("  \"%s\" gave %lld (status %u), expected %lld (status %u)\n", cases[i].keys,
+                   got, Calc_Status_REG, cases[i].result, cases[i].status);
+            wrong++;
+        }
+        if (i == 5 && arith_to_long(&expr_remainder) != 2)
+            wrong++;
+        checked++;
+    }
+
+    srand(47);
+    for (unsigned i = 0; i < 10000; i++) {
+        static const char op_keys[4] = {'A', 'B', 'C', 'D'};
+        long long values[6] = {0}, want = 0;
+        char ops[5], keys[64], *k = keys;
+        uint8_t count = 1 + rand() % 6;
+
+        for (uint8_t v = 0; v < count; v++) {
+            long long m = 1;
+            for (int d = 1 + rand() % 8; d > 0; d--)
+                m *= 10;
+            values[v] = rand() % m;
+            k += sprintf(k, "%lld", values[v]);
+            if (v + 1 < count) {
+                ops[v] = op_keys[rand() % 4];
+                *k++ = ops[v];
+            }
+        }
+        *k++ = '#';
+        *k = 0;
+        uint8_t want_status = host_eval(values, ops, count, &want);
+        handleInput('*');
+        type_keys(keys);
+        if (Calc_Status_REG != want_status ||
+            (want_status == ARITH_OK && arith_to_long(&Display_Result_REG) != want))
+            wrong++;
+        checked++;
+    }
+
+    printf("  %u expressions, %u wrong\n", checked, wrong);
+    printf("  worst handleInput(): digit %llu cyc, operator %llu cyc, '#' %llu cyc\n",
+           (unsigned long long)worst_key[0], (unsigned long long)worst_key[1],
+           (unsigned long long)worst_key[2]);
+    printf("    (operator in \"%s\", '#' in \"%s\")\n", worst_script[1], worst_script[2]);
+}
+
+// A number entered the way handleInput() does, a digit at a time
+static void enter(arith_t *x, long long value, uint8_t neg) {
+    char text[24];
+
+    arith_clear(x);
+    snprintf(text, sizeof text, "%lld", value);
+    for (char *c = text; *c; c++)
+        arith_digit(x, (uint8_t)(*c - '0'));
+    x->neg = neg && value != 0;
+}
+
+static uint8_t run_op(uint8_t op, arith_t *r, arith_t *rem, const arith_t *x, const arith_t *y) {
+    switch (op) {
+    case 0: return arith_add(r, x, y);
+    case 1: return arith_sub(r, x, y);
+    case 2: return arith_mul(r, x, y);
+    default: return arith_div(r, rem, x, y);
+    }
+}
+
+static void bench_arith(void) {
+    static const uint8_t widths[3] = {2, 4, 8};
+    arith_t x, y, r, rem;
+
+    printf("  arithmetic, cycles per operation (x = 4999..., y = 1234... of the same width):\n");
+    printf("    %-9s %8s %8s %8s %8s\n", "operands", "add", "sub", "mul", "div");
+    for (uint8_t w = 0; w < 3; w++) {
+        long long first = 4, second = 1;
+        uint64_t cycles[4];
+        uint8_t status[4];
+
+        for (uint8_t d = 1; d < widths[w]; d++) {
+            first = first * 10 + 9;
+            second = second * 10 + d + 1;
+        }
+        sim_reset();
+        enter(&x, first, 0);
+        enter(&y, second, 0);
+        for (uint8_t op = 0; op < 4; op++) {
+            uint64_t start = sim_cycles;
+            status[op] = run_op(op, &r, &rem, &x, &y);
+            cycles[op] = sim_cycles - start;
+        }
+        printf("    %u digits ", widths[w]);
+        for (uint8_t op = 0; op < 4; op++)
+            printf(" %7llu%c", (unsigned long long)cycles[op], status[op] == ARITH_OK ? ' ' : '!');
+        printf("\n");
+    }
+    printf("    (! = overflow reported: 8 x 8 digits is up to 16)\n");
+
+    // Random operands against the host, with the status the host expects
+    unsigned checked = 0, wrong = 0, overflows = 0, div_zero = 0;
+    srand(310);
+    for (unsigned i = 0; i < 20000; i++) {
+        long long a = rand() % 100000000LL, b;
+        uint8_t a_neg = rand() & 1, b_neg = rand() & 1;
+        long long m = 1;
+        for (int d = rand() % 8; d >= 0; d--)
+            m *= 10;
+        b = i % 1000 == 0 ? 0 : rand() % m;
+        a %= (i & 1) ? m * 10 : 100000000LL;
+        enter(&x, a, a_neg);
+        enter(&y, b, b_neg);
+        long long sa = a_neg ? -a : a, sb = b_neg ? -b : b;
+
+        for (uint8_t op = 0; op < 4; op++) {
+            long long want = 0, want_rem = 0;
+            uint8_t want_status = ARITH_OK;
+            if (op == 0) want = sa + sb;
+            else if (op == 1) want = sa - sb;
+            else if (op == 2) want = sa * sb;
+            else if (sb == 0) want_status = ARITH_DIV_ZERO;
+            else { want = sa / sb; want_rem = sa % sb; }
+            if (want_status == ARITH_OK && (want > ARITH_MAX || want < -ARITH_MAX))
+                want_status = ARITH_OVERFLOW;
+
+            arith_clear(&r);
+            arith_clear(&rem);
+            uint8_t got = run_op(op, &r, &rem, &x, &y);
+            checked++;
+            if (got != want_status)
+                wrong++;
+            else if (got == ARITH_OK && (arith_to_long(&r) != want || (op == 3 && arith_to_long(&rem) != want_rem)))
+                wrong++;
+            overflows += got == ARITH_OVERFLOW;
+            div_zero += got == ARITH_DIV_ZERO;
+        }
+    }
+    printf("  %u random operations, %u differ from the host (%u overflows and %u divides by 0 reported)\n",
+           checked, wrong, overflows, div_zero);
+}
+
+int main(void) {
+    printf("Calculator.X (virtual cycles at Fosc/4 = %u Hz)\n", sim_fosc / 4);
+    bench_scan();
+    bench_idle();
+    bench_typing("typing \"12C34#\" (main loop passes)", 40, 60, 0);
+    bench_typing("fast typing, 150 ms work per key", 30, 20, 150);
+    bench_display("display, 1 s at full (refresh ISRs)", "1234C5#");
+    bench_display("display, 1 s dimmed (refresh ISRs)", "9876543B");
+    bench_expressions();
+    bench_arith();
+    return 0;
+}
@@ -0,0 +1,495 @@
+/*
+ * Title: InterfacingWithSensors_A8.X (safebox) benchmark
+ * ---------------------
+ * Program Details:
+ *  Runs the safebox on the host model with the board wiring: 3x4 keypad rows
+ *  on RB1-RB4 and columns on RB5-RB7, photo-resistors on RE0/RE1 (ANE0/ANE1,
+ *  reading LIT when lit and DARK when covered, with +/- NOISE), confirm
+ *  button on RC4, motor relay on RC7.
+ *   - set code: boot, then type 1 and 2 on the keypad for the first code
+ *   - scan: cost of one keypad_tick() (one row) and of a full 4-row scan
+ *   - idle: main() for 1 s with nothing happening; awake cycles per tick,
+ *     and the time the firmware counts in each power state (Common/power.h)
+ *   - unlock: set code 12, tap 1 on PR1 and confirm on RC4, then tap 2 on
+ *     PR2 (a shadow too short to be a tap in between) and confirm by
+ *     covering PR2 for 1.2 s; time how long after the last uncover the
+ *     motor turns on, and for each PR edge how long after the light
+ *     changed Light_ISR() saw it and how long its handler took
+ *   - unlock during alarm: the same with the INT0 button (RB0) pressed just
+ *     before the last confirm, so the emergency melody is playing; gives
+ *     the notes NCO1 played (from NCO1INC and Timer4) and the LED blinks
+ *   - late unlock: the unlock 40 s after boot, once the confirm button's
+ *     last press is over 32.767 s old (a 16-bit ms deadline from then
+ *     would look ahead again)
+ *   - queued edges: three taps on PR1 queued as edges before main() gets
+ *     to them; each must count once (the edges carry their own state and
+ *     hold time)
+ *   - keep code: set code 12, then how long its record took to reach the
+ *     data EEPROM and how much CPU that cost; a reset (the EEPROM kept)
+ *     and the time to a box that is ready to unlock, and the unlock
+ *   - cut write: a reset in the middle of a record, which must fall back
+ *     to the one before
+ *   - wear: 1000 code changes through ee_log_write(), and the most and
+ *     fewest writes any EEPROM byte took
+ *
+ *  Every run also checks that IVTBASE holds IVT_BASE, the base() of the
+ *  firmware's ISRs, and the unlock runs give the worst ISR length and
+ *  event latency counted by Common/events.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <xc.h>
+#include "../Common/tone.h"         // RxyPPS codes only: neither part set up
+
+// From InterfacingWithSensors_A8.X
+void safebox_main(void);
+void keypad_tick(void);
+void TMR0_ISR(void);
+void INT0_ISR(void);
+void Tone_ISR(void);
+void Blink_ISR(void);
+void Light_ISR(void);
+void Confirm_ISR(void);
+void NVM_ISR(void);
+void init_system(void);
+void evt_dispatch(void);
+void light_edge(uint8_t gate, uint8_t covered, uint16_t ms);
+uint8_t ee_log_init(void *data);
+void ee_log_write(const void *data);
+extern volatile uint8_t ee_log_busy;
+extern uint16_t ee_log_seq, ee_log_slot;
+extern uint8_t code_step;
+extern uint8_t SECRET_CODE;
+extern volatile uint8_t light_state, light_gate;
+extern volatile uint16_t light_held[2];
+extern uint16_t light_response_worst;
+extern volatile uint16_t light_lost;
+extern uint8_t pr_sensor, pr_count;
+extern volatile uint16_t evt_posts, evt_isr_worst;
+extern uint16_t evt_latency_worst;
+extern uint32_t pwr_time[4], pwr_waits[4];
+
+#define IVT_BASE 0x4008     // EVT_IVT_BASE, in every EVT_ISR() of the firmware
+
+static const uint8_t row_bits[4] = {1, 2, 3, 4};
+static const uint8_t col_bits[3] = {5, 6, 7};
+
+#define PR1     0x20        // ADPCH of RE0 and RE1
+#define PR2     0x21
+#define LIT     800         // ADC codes of a photo-resistor in the light
+#define DARK    3300        // and covered
+#define NOISE   40
+
+// Light_ISR() wrapped: when each PR edge was seen, against the last
+// light change shade() scripted for that PR before it
+#define EDGES_MAX 16
+static struct {
+    uint8_t gate, covered;
+    uint16_t held;          // ms covered, by the firmware's count
+    double seen_ms;         // from the light change to the conversion
+} edges[EDGES_MAX];
+static uint32_t edge_count;
+static struct {
+    uint64_t at;
+    uint8_t gate;
+} changes[2 * EDGES_MAX];
+static uint32_t change_count;
+
+static uint64_t light_changed(uint8_t gate) {
+    uint64_t at = 0;
+
+    for (uint32_t i = 0; i < change_count; i++)
+        if (changes[i].gate == gate && changes[i].at <= sim_cycles && changes[i].at > at)
+            at = changes[i].at;
+    return at;
+}
+
+// Tone_ISR() and Blink_ISR() wrapped: the notes NCO1 was given, and the
+// blinks PWM5 made
+#define NOTES_MAX 32
+static struct {
+    double hz;              // 0 for a rest
+    double ms;
+} notes[NOTES_MAX];
+static uint32_t note_count, blinks;
+
+static void log_note(uint8_t playing) {
+    uint32_t inc = ((uint32_t)NCO1INCU << 16) | ((uint32_t)NCO1INCH << 8) | NCO1INCL;
+
+    if (!playing || note_count == NOTES_MAX)
+        return;
+    notes[note_count].hz = (NCO1CONbits.EN && RC6PPS == TONE_PPS_NCO1) ? sim_fosc * (double)inc / 2097152.0 : 0;
+    notes[note_count].ms = (T4PR + 1) * 128.0 * 1000.0 / SIM_LFINTOSC_HZ;
+    note_count++;
+}
+
+static void tone_isr(void) {
+    if (note_count == 0)
+        log_note(1);                        // the first note, from tone_play()
+    Tone_ISR();
+    log_note(T4CONbits.ON);
+}
+
+static void blink_isr(void) {
+    if (RC3PPS == TONE_PPS_PWM5 && PWM5CONbits.EN)
+        blinks++;
+    Blink_ISR();
+}
+
+static void light_isr(void) {
+    uint8_t gate = light_gate, was = light_state;
+
+    Light_ISR();
+    if (((was ^ light_state) >> gate & 1) && edge_count < EDGES_MAX) {
+        edges[edge_count].gate = gate;
+        edges[edge_count].covered = light_state >> gate & 1;
+        edges[edge_count].held = edges[edge_count].covered ? 0 : light_held[gate];
+        edges[edge_count].seen_ms = (double)(sim_cycles - light_changed(gate)) * 1000.0 / (sim_fosc / 4);
+        edge_count++;
+    }
+}
+
+// NVM_ISR() wrapped: records written and when the last one was done
+static uint32_t ee_records, ee_isr_cycles;
+static uint64_t ee_first, ee_done;      // first and last byte of the last record
+
+static void nvm_isr(void) {
+    uint64_t start = sim_cycles;
+
+    if (ee_first <= ee_done)
+        ee_first = sim_cycles;
+    NVM_ISR();
+    ee_isr_cycles += (uint32_t)(sim_cycles - start);
+    if (!ee_log_busy) {
+        ee_records++;
+        ee_done = sim_cycles;
+    }
+}
+
+static void boot(void) {
+    sim_reset();
+    sim_keypad(SIM_PORTB, row_bits, 4, col_bits, 3);
+    sim_irq(SIM_IRQ_TMR0, TMR0_ISR);
+    sim_irq(SIM_IRQ_INT0, INT0_ISR);
+    sim_irq(SIM_IRQ_TMR4, tone_isr);
+    sim_irq(SIM_IRQ_TMR6, blink_isr);
+    sim_irq(SIM_IRQ_AD, light_isr);
+    sim_irq(SIM_IRQ_IOC, Confirm_ISR);
+    sim_irq(SIM_IRQ_NVM, nvm_isr);
+    sim_analog(PR1, LIT);
+    sim_analog(PR2, LIT);
+    sim_analog_noise(PR1, NOISE);
+    sim_analog_noise(PR2, NOISE);
+}
+
+static void press(uint64_t at, uint8_t row, uint8_t col) {
+    sim_key_at(at, row, col, 1);
+    sim_key_at(at + sim_ms(100), row, col, 0);
+}
+
+static void cover(uint64_t at, uint8_t port, uint8_t bit, uint32_t ms) {
+    sim_pin_at(at, port, bit, 1);
+    sim_pin_at(at + sim_ms(ms), port, bit, 0);
+}
+
+// A hand over a photo-resistor for ms
+static void shade(uint64_t at, uint8_t pr, uint32_t ms) {
+    sim_analog_at(at, pr, DARK);
+    sim_analog_at(at + sim_ms(ms), pr, LIT);
+    if (change_count + 2 <= sizeof changes / sizeof changes[0]) {
+        changes[change_count].at = at;
+        changes[change_count++].gate = pr - PR1;
+        changes[change_count].at = at + sim_ms(ms);
+        changes[change_count++].gate = pr - PR1;
+    }
+}
+
+// After init_system(): the vector table the ISRs were built for
+static void check_ivt(void) {
+    uint32_t ivt = ((uint32_t)IVTBASEU << 16) | ((uint32_t)IVTBASEH << 8) | IVTBASEL;
+
+    if (ivt != IVT_BASE) {
+        printf("  IVTBASE 0x%05X, the ISRs are at base(0x%05X)\n", ivt, IVT_BASE);
+        exit(1);
+    }
+}
+
+// Keys 1 and 2 for code 12, done by about 2.3 s
+static void type_code_12(void) {
+    press(sim_ms(100), 0, 0);               // '1'
+    press(sim_ms(1300), 0, 1);              // '2'
+}
+
+static void bench_set_code(void) {
+    boot();
+    type_code_12();
+    double t0 = sim_wall_us();
+    sim_run(safebox_main, sim_ms(3000));
+    sim_report("boot -> first code set (3 s window)", 1, sim_cycles, sim_wall_us() - t0);
+    check_ivt();
+    printf("  code %u, keys at 100 ms and 1300 ms\n", SECRET_CODE);
+}
+
+// keypad_tick() called directly, with a key held so events are queued too
+static void bench_scan(void) {
+    const uint32_t ticks = 40000;
+
+    boot();
+    sim_key(1, 1, 1);                       // '5' held
+    uint64_t start = sim_cycles;
+    double t0 = sim_wall_us();
+    for (uint32_t i = 0; i < ticks; i++)
+        keypad_tick();
+    double wall = sim_wall_us() - t0;
+    sim_report("keypad_tick (one row)", ticks, sim_cycles - start, wall);
+    sim_report("full scan (4 rows)", ticks / 4, sim_cycles - start, wall);
+}
+
+static void bench_idle(void) {
+    const uint32_t ms = 1000;
+
+    boot();
+    double t0 = sim_wall_us();
+    sim_run(safebox_main, sim_ms(ms));
+    uint64_t awake = sim_cycles - sim_stats.sleep_cycles;
+    sim_report("idle main() per 1 ms tick, awake", ms, awake, sim_wall_us() - t0);
+    check_ivt();
+    printf("  %.1f%% of the time in Idle\n", 100.0 * sim_stats.sleep_cycles / sim_cycles);
+    sim_power_report(pwr_time, pwr_waits);
+}
+
+// PR gestures and a confirm from start_ms on; returns the end of the
+// last one, the hold that confirms
+static uint64_t enter_code_12(uint32_t start_ms) {
+    uint64_t t = sim_ms(start_ms);
+
+    shade(t + sim_ms(100), PR1, 120);               // PR1 tap: high digit 1
+    cover(t + sim_ms(300), SIM_PORTC, 4, 100);      // confirm
+    shade(t + sim_ms(450), PR2, 10);                // a passing shadow, no tap
+    shade(t + sim_ms(500), PR2, 120);               // PR2 tap: low digit 1
+    shade(t + sim_ms(700), PR2, 120);               // PR2 tap again: low digit 2
+    shade(t + sim_ms(900), PR2, 1200);              // PR2 held: confirm
+    return t + sim_ms(2100);
+}
+
+static double ms_of(uint64_t cycles) {
+    return (double)cycles * 1000.0 / (sim_fosc / 4);
+}
+
+static void unlock(const char *label, uint8_t alarm, uint32_t start_ms) {
+    uint64_t confirm;
+
+    boot();
+    type_code_12();
+    confirm = enter_code_12(start_ms);         // once the code is set
+    if (alarm)
+        cover(confirm - sim_ms(100), SIM_PORTB, 0, 50);     // INT0 button
+    sim_watch(SIM_PORTC, 7);
+
+    double t0 = sim_wall_us();
+    sim_run(safebox_main, sim_ms(start_ms + (alarm ? 9000 : 5000)));   // the melody lasts 5 s
+    double wall = sim_wall_us() - t0;
+
+    uint64_t motor = sim_watch_time();
+    sim_report(label, 1, sim_cycles, wall);
+    check_ivt();
+    printf("  %u interrupts, %u events; longest ISR %u us, event to handler at most %u us\n",
+           sim_stats.interrupts, evt_posts, evt_isr_worst, evt_latency_worst);
+    if (motor)
+        printf("  motor on %.2f ms after the last PR was uncovered\n",
+               (double)(motor - confirm) * 1000.0 / (sim_fosc / 4));
+    else
+        printf("  motor never turned on\n");
+    for (uint32_t i = 0; i < edge_count; i++) {
+        if (edges[i].covered)
+            printf("  PR%u covered,   seen %.2f ms after\n", edges[i].gate + 1, edges[i].seen_ms);
+        else
+            printf("  PR%u uncovered, seen %.2f ms after, %u ms covered\n",
+                   edges[i].gate + 1, edges[i].seen_ms, edges[i].held);
+    }
+    printf("  PR edge to the end of its handler at most %u us, %u edges lost; code in %.2f s "
+           "from the first PR\n", light_response_worst, light_lost, motor ? ms_of(motor - sim_ms(start_ms + 100)) / 1000.0 : 0.0);
+    if (note_count) {
+        double total = 0;
+        printf("  tones:");
+        for (uint32_t i = 0; i < note_count; i++) {
+            total += notes[i].ms;
+            if (i < 3)
+                printf(notes[i].hz ? " %.1f Hz %.0f ms," : " rest %.0f ms,",
+                       notes[i].hz ? notes[i].hz : notes[i].ms, notes[i].ms);
+        }
+        printf(" ... %u notes, %.0f ms; %u LED blinks by PWM5\n", note_count, total, blinks);
+    }
+}
+
+static void bench_unlock(void) {
+    unlock("unlock with code 12 (8 s window)", 0, 3000);
+}
+
+static void bench_unlock_alarm(void) {
+    unlock("unlock during the alarm melody", 1, 3000);
+}
+
+static void bench_unlock_late(void) {
+    unlock("unlock 40 s after boot", 0, 40000);
+}
+
+// Edges queued as Light_ISR() does, all handed over by one evt_dispatch()
+static void bench_queued_edges(void) {
+    boot();
+    type_code_12();
+    sim_run(safebox_main, sim_ms(3000));
+    for (uint8_t i = 0; i < 3; i++) {
+        light_edge(0, 1, 0);
+        light_edge(0, 0, 100 + 10 * i);
+    }
+    evt_dispatch();
+    printf("queued edges: 3 taps on PR1 before main() ran\n");
+    printf("  PR%u counted %u, %u edges lost\n", pr_sensor + 1, pr_count, light_lost);
+    if (pr_sensor != 0 || pr_count != 3 || light_lost)
+        exit(1);
+}
+
+static void bench_keep_code(void) {
+    uint64_t confirm;
+
+    boot();
+    type_code_12();                         // second key at 1300 ms, shown 1 s
+    double t0 = sim_wall_us();
+    sim_run(safebox_main, sim_ms(3000));
+    sim_report("set code 12, kept in the EEPROM", 1, sim_cycles, sim_wall_us() - t0);
+    printf("  %u record (seq %u, slot %u) in the EEPROM %.1f ms after it started, "
+           "%u NVM interrupts, %u cycles in them\n", ee_records, ee_log_seq, ee_log_slot,
+           ms_of(ee_done - ee_first + sim_ms(SIM_EE_WRITE_MS)), sim_stats.ee_writes, ee_isr_cycles);
+
+    boot();                                 // power cycle: only the EEPROM is kept
+    note_count = blinks = edge_count = change_count = 0;
+    SECRET_CODE = 0;                        // the firmware's values after a reset
+    code_step = 0;
+    t0 = sim_wall_us();
+    sim_run(init_system, sim_ms(1000));
+    uint8_t code = 0;
+    uint8_t found = ee_log_init(&code);
+    sim_report("reset -> ready (init_system, ee_log_init)", 1, sim_cycles, sim_wall_us() - t0);
+    printf("  %s code %u, %u EEPROM reads (256 slots of 4 bytes)\n",
+           found ? "found" : "no", code, sim_stats.ee_reads);
+
+    boot();
+    confirm = enter_code_12(0);
+    sim_watch(SIM_PORTC, 7);
+    sim_run(safebox_main, sim_ms(8000));
+    uint64_t motor = sim_watch_time();
+    printf("  after the reset: code %u, no keypad set-up; ", SECRET_CODE);
+    if (motor)
+        printf("unlocked %.2f s after the reset (%.2f ms after the last PR)\n",
+               ms_of(motor) / 1000.0, ms_of(motor - confirm));
+    else
+        printf("motor never turned on\n");
+}
+
+// The record of code 34 cut off after its second byte (4 ms a byte)
+static void write_34_cut(void) {
+    uint8_t code = 12;
+
+    init_system();
+    ee_log_init(&code);
+    code = 12;
+    ee_log_write(&code);
+    while (ee_log_busy)
+        SLEEP();
+    code = 34;
+    ee_log_write(&code);
+    while (1)
+        SLEEP();
+}
+
+static void bench_cut_write(void) {
+    uint8_t code = 0;
+
+    boot();
+    sim_run(write_34_cut, sim_ms(16 + 6));
+    printf("cut write: reset 6 ms into the record of code 34, after code 12's\n");
+    boot();
+    uint8_t found = ee_log_init(&code);
+    printf("  read back: %s code %u (seq %u)\n", found ? "found" : "no", code, ee_log_seq);
+    if (!found || code != 12)
+        exit(1);
+}
+
+#define WEAR_CHANGES 1000
+
+static void change_code(void) {
+    uint8_t code = 0;
+
+    init_system();
+    ee_log_init(&code);
+    for (uint32_t i = 0; i < WEAR_CHANGES; i++) {
+        code = (uint8_t)(i % 45);
+        ee_log_write(&code);
+        while (ee_log_busy) {
+            evt_dispatch();
+            SLEEP();
+        }
+    }
+}
+
+static void bench_wear(void) {
+    uint32_t most = 0, fewest = UINT32_MAX;
+    uint8_t code = 0;
+
+    boot();
+    double t0 = sim_wall_us();
+    sim_run(change_code, sim_ms(WEAR_CHANGES * 20));
+    sim_report("code changes, one record each", WEAR_CHANGES, sim_cycles, sim_wall_us() - t0);
+    for (uint16_t a = 0; a < SIM_EEPROM_SIZE; a++) {
+        uint32_t w = sim_eeprom_wear(a);
+        if (w > most)
+            most = w;
+        if (w < fewest)
+            fewest = w;
+    }
+    printf("  %u bytes written; each EEPROM byte %u to %u times, not %u on one\n",
+           sim_stats.ee_writes, fewest, most, WEAR_CHANGES);
+    printf("  %.1f%% of the time in Sleep, %u records\n",
+           100.0 * sim_stats.sleep_cycles / sim_cycles, ee_records);
+    boot();
+    ee_log_init(&code);
+    printf("  read back: code %u (seq %u), the last one written was %u\n",
+           code, ee_log_seq, (WEAR_CHANGES - 1) % 45);
+    if (code != (WEAR_CHANGES - 1) % 45)
+        exit(1);
+}
+
+// The firmware keeps its state in initialised globals, so each run gets a
+// fresh copy of them, as after a reset, in a child process
+static void fresh(void (*bench)(void)) {
+    int status;
+
+    fflush(stdout);
+    if (fork() == 0) {
+        bench();
+        fflush(stdout);
+        _exit(0);
+    }
+    wait(&status);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        exit(1);
+}
+
+int main(void) {
+    printf("InterfacingWithSensors_A8.X (virtual cycles at Fosc/4 = %u Hz)\n", sim_fosc / 4);
+    fresh(bench_set_code);
+    fresh(bench_scan);
+    fresh(bench_idle);
+    fresh(bench_unlock);
+    fresh(bench_unlock_alarm);
+    fresh(bench_unlock_late);
+    fresh(bench_queued_edges);
+    fresh(bench_keep_code);
+    fresh(bench_cut_write);
+    fresh(bench_wear);
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Title: A9_ADC_LCD.X telemetry run
+ * ---------------------
+ * Program Details:
+ *  Runs the ADC -> lux -> LCD program built with TLM_ENABLE
+ *  (Common/telemetry.h) on the host model, wired as in bench_adc_lcd, for
+ *  RUN_MS with a noisy light on RA0 and the pot on RA1. Every block of
+ *  bursts goes out of UART1 as a packet, moved into U1TXB by DMA2; the
+ *  bytes the UART sent go to the file given (default build/adc_lcd.tlm),
+ *  which tlm_decode checks and counts; "make bench" runs both.
+ *
+ *  The report gives the samples the ADC took, the blocks Show_Readings()
+ *  skipped (overwritten before main() got to them) and the packets the
+ *  firmware sent or dropped, the UART's share of its baud rate and the samples per
+ *  second that rate could carry at most in packets of this size, bytes
+ *  written to a full UART buffer, and how much of the time the CPU was
+ *  awake (the DMA does the sending, so it should stay close to the
+ *  build without telemetry). A skipped or dropped block fails the run.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <xc.h>
+
+// From A9_ADC_LCD.X/ACD_LCD_main.c, built with TLM_ENABLE
+void adc_lcd_main(void);
+void LCD_ISR(void);
+void ADC_Ring_ISR(void);
+void IOC_ISR(void);
+void Blink_ISR(void);
+void Tlm_ISR(void);
+extern volatile uint32_t adc_blocks;
+extern uint32_t adc_skipped;
+extern volatile uint16_t tlm_packets;
+extern uint16_t tlm_dropped;
+
+#define RUN_MS      2000
+#define NOISE       32      // +/- codes on the light
+#define POT_CODE    2048    // RA1: 2.500 V
+#define SAMPLES     8       // TLM_SAMPLES of the firmware
+#define PACKET      (10 + 2 * SAMPLES + 2)
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "build/adc_lcd.tlm";
+    const uint8_t *bytes;
+    uint32_t count;
+    FILE *out;
+
+    printf("A9_ADC_LCD.X with TLM_ENABLE (virtual cycles at Fosc/4 = %u Hz)\n", sim_fosc / 4);
+    sim_reset();
+    sim_lcd(SIM_PORTB, SIM_PORTD, 0, 1);
+    sim_irq(SIM_IRQ_TMR0, LCD_ISR);
+    sim_irq(SIM_IRQ_DMA1DCNT, ADC_Ring_ISR);
+    sim_irq(SIM_IRQ_IOC, IOC_ISR);
+    sim_irq(SIM_IRQ_TMR6, Blink_ISR);
+    sim_irq(SIM_IRQ_DMA2SCNT, Tlm_ISR);
+    sim_pin(SIM_PORTC, 2, 1);               // RC2 button up (weak pull-up)
+    sim_analog(0x00, 2000);
+    sim_analog_noise(0x00, NOISE);
+    sim_analog(0x01, POT_CODE);
+
+    double t0 = sim_wall_us();
+    sim_run(adc_lcd_main, sim_ms(RUN_MS));
+    double wall = sim_wall_us() - t0;
+
+    double seconds = (double)sim_cycles / (sim_fosc / 4);
+    double baud = (sim_fosc / 4.0) / (((U1BRGH << 8) | U1BRGL) + 1);   // BRGS
+    uint64_t awake = sim_cycles - sim_stats.sleep_cycles;
+    count = sim_uart_output(&bytes);
+    sim_report("2 s of telemetry", 1, sim_cycles, wall);
+    printf("  %u blocks of %u samples: %.1f samples/s taken, %u skipped, %u packets sent, %u dropped\n",
+           adc_blocks, SAMPLES, adc_blocks * SAMPLES / seconds, adc_skipped, tlm_packets, tlm_dropped);
+    printf("  UART1: %u bytes at %.0f baud, busy %.1f%% of the time, %u written to a full buffer; "
+           "at most %.0f samples/s in %u-byte packets\n",
+           count, baud, 100.0 * count * 10 / baud / seconds, sim_stats.uart_overruns,
+           baud / 10 / PACKET * SAMPLES, PACKET);
+    printf("  CPU awake %.3f%% of the time, %u interrupts, %u DMA bytes\n",
+           100.0 * awake / sim_cycles, sim_stats.interrupts, sim_stats.dma_bytes);
+    printf("  LCD: %u bytes latched too soon\n  |%s|\n  |%s|\n",
+           sim_stats.lcd_overruns, sim_lcd_line(0), sim_lcd_line(1));
+    if (!(out = fopen(path, "wb")) || fwrite(bytes, 1, count, out) != count || fclose(out)) {
+        perror(path);
+        return 1;
+    }
+    printf("  written to %s\n", path);
+    return count == 0 || adc_skipped || tlm_dropped || sim_stats.uart_overruns;
+}
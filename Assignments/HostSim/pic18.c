@@ -0,0 +1,1274 @@
+/*
+ * Title: PIC18F47K42 instruction-set simulator
+ * ---------------------
+ * Program Details:
+ *  Decoder, data-memory model, Intel HEX / .sym loaders and the module
+ *  assembler for pic18.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "pic18.h"
+
+#define W(cpu)      ((cpu)->ram[PIC18_WREG])
+#define STATUS(cpu) ((cpu)->ram[PIC18_STATUS])
+#define BSR(cpu)    ((cpu)->ram[PIC18_BSR])
+
+// ---------------------------------------------------------------------------
+// Data memory
+// ---------------------------------------------------------------------------
+
+// Address of file register f: access bank (a = 0) or BSR bank (a = 1)
+static uint16_t file_addr(const pic18_t *cpu, uint8_t f, uint8_t a) {
+    if (a)
+        return (uint16_t)(((BSR(cpu) & 0x3F) << 8) | f);
+    return (f < 0x60) ? f : (uint16_t)(0x3F00 | f);
+}
+
+// FSR number for INDFn/POSTINCn/POSTDECn/PREINCn/PLUSWn, -1 otherwise
+static int fsr_of(uint16_t addr) {
+    if (addr >= PIC18_PLUSW0 && addr <= PIC18_INDF0) return 0;
+    if (addr >= PIC18_PLUSW1 && addr <= PIC18_INDF1) return 1;
+    if (addr >= PIC18_PLUSW2 && addr <= PIC18_INDF2) return 2;
+    return -1;
+}
+
+static uint16_t fsr_base(int n) {
+    return (n == 0) ? PIC18_FSR0L : (n == 1) ? PIC18_FSR1L : PIC18_FSR2L;
+}
+
+static uint16_t fsr_get(const pic18_t *cpu, int n) {
+    uint16_t base = fsr_base(n);
+    return (uint16_t)(((cpu->ram[base + 1] & 0x3F) << 8) | cpu->ram[base]);
+}
+
+static void fsr_set(pic18_t *cpu, int n, uint16_t value) {
+    uint16_t base = fsr_base(n);
+    cpu->ram[base] = (uint8_t)value;
+    cpu->ram[base + 1] = (uint8_t)((value >> 8) & 0x3F);
+}
+
+// Resolves an indirect register to the address it points at, applying the
+// pre/post increment or decrement
+static uint16_t indirect(pic18_t *cpu, uint16_t addr) {
+    int n = fsr_of(addr);
+    uint16_t base = (uint16_t)(fsr_base(n) + 6);    // INDFn
+    uint16_t fsr = fsr_get(cpu, n);
+    uint16_t target = fsr;
+
+    switch (base - addr) {
+        case 0: break;                                          // INDFn
+        case 1: fsr_set(cpu, n, fsr + 1); break;                // POSTINCn
+        case 2: fsr_set(cpu, n, fsr - 1); break;                // POSTDECn
+        case 3: target = fsr + 1; fsr_set(cpu, n, target); break;   // PREINCn
+        case 4: target = (uint16_t)(fsr + (int8_t)W(cpu)); break;   // PLUSWn
+    }
+    return target & 0x3FFF;
+}
+
+static int is_port(uint16_t addr) {
+    return addr >= PIC18_PORTA && addr <= PIC18_PORTE;
+}
+
+static uint8_t mem_read(pic18_t *cpu, uint16_t addr) {
+    if (fsr_of(addr) >= 0) {
+        addr = indirect(cpu, addr);
+        if (fsr_of(addr) >= 0)
+            return 0;
+    }
+    if (is_port(addr)) {
+        uint8_t p = (uint8_t)(addr - PIC18_PORTA);
+        uint8_t tris = cpu->ram[PIC18_TRISA + p];
+        uint8_t digital = (uint8_t)~cpu->ram[PIC18_ANSELA + p * 0x10];    // analog pins read 0
+        return (uint8_t)((cpu->ram[PIC18_LATA + p] & ~tris) | (cpu->pins[p] & tris & digital));
+    }
+    if (addr == PIC18_PCL) {
+        cpu->ram[PIC18_PCLATH] = (uint8_t)(cpu->pc >> 8);
+        cpu->ram[PIC18_PCLATU] = (uint8_t)((cpu->pc >> 16) & 0x1F);
+        return (uint8_t)cpu->pc;
+    }
+    return cpu->ram[addr & 0x3FFF];
+}
+
+// Returns 1 if the write moved the program counter (a write to PCL)
+static int mem_write(pic18_t *cpu, uint16_t addr, uint8_t value) {
+    if (fsr_of(addr) >= 0) {
+        addr = indirect(cpu, addr);
+        if (fsr_of(addr) >= 0)
+            return 0;
+    }
+    if (is_port(addr)) {
+        cpu->ram[PIC18_LATA + (addr - PIC18_PORTA)] = value;
+        return 0;
+    }
+    if (addr == PIC18_PCL) {
+        cpu->pc = ((uint32_t)(cpu->ram[PIC18_PCLATU] & 0x1F) << 16) |
+                  ((uint32_t)cpu->ram[PIC18_PCLATH] << 8) | (value & 0xFE);
+        return 1;
+    }
+    cpu->ram[addr & 0x3FFF] = value;
+    return 0;
+}
+
+uint8_t pic18_peek(const pic18_t *cpu, uint16_t addr) {
+    return cpu->ram[addr & 0x3FFF];
+}
+
+void pic18_poke(pic18_t *cpu, uint16_t addr, uint8_t value) {
+    cpu->ram[addr & 0x3FFF] = value;
+}
+
+// ---------------------------------------------------------------------------
+// Stack and program memory
+// ---------------------------------------------------------------------------
+
+static void tos_update(pic18_t *cpu) {
+    uint32_t tos = cpu->sp ? cpu->stack[cpu->sp - 1] : 0;
+    cpu->ram[PIC18_TOSL] = (uint8_t)tos;
+    cpu->ram[PIC18_TOSL + 1] = (uint8_t)(tos >> 8);
+    cpu->ram[PIC18_TOSL + 2] = (uint8_t)((tos >> 16) & 0x1F);
+    cpu->ram[PIC18_STKPTR] = cpu->sp;
+}
+
+static void push(pic18_t *cpu, uint32_t addr) {
+    if (cpu->sp < PIC18_STACK_DEPTH)
+        cpu->stack[cpu->sp++] = addr;
+    tos_update(cpu);
+}
+
+static uint32_t pop(pic18_t *cpu) {
+    uint32_t addr = cpu->sp ? cpu->stack[--cpu->sp] : 0;
+    tos_update(cpu);
+    return addr;
+}
+
+static uint16_t fetch(const pic18_t *cpu, uint32_t addr) {
+    if (addr + 1 >= PIC18_FLASH_SIZE)
+        return 0xFFFF;
+    return (uint16_t)(cpu->flash[addr] | (cpu->flash[addr + 1] << 8));
+}
+
+static uint8_t table_read(const pic18_t *cpu, uint32_t addr) {
+    if (addr < PIC18_FLASH_SIZE)
+        return cpu->flash[addr];
+    if (addr >= 0x300000 && addr < 0x300010)
+        return cpu->config[addr - 0x300000];
+    if (addr >= 0x310000 && addr < 0x310400)
+        return cpu->eeprom[addr - 0x310000];
+    return 0xFF;
+}
+
+static uint32_t tblptr(const pic18_t *cpu) {
+    return ((uint32_t)(cpu->ram[PIC18_TBLPTRU] & 0x3F) << 16) |
+           ((uint32_t)cpu->ram[PIC18_TBLPTRH] << 8) | cpu->ram[PIC18_TBLPTRL];
+}
+
+static void tblptr_set(pic18_t *cpu, uint32_t value) {
+    cpu->ram[PIC18_TBLPTRL] = (uint8_t)value;
+    cpu->ram[PIC18_TBLPTRH] = (uint8_t)(value >> 8);
+    cpu->ram[PIC18_TBLPTRU] = (uint8_t)((value >> 16) & 0x3F);
+}
+
+// ---------------------------------------------------------------------------
+// ALU helpers
+// ---------------------------------------------------------------------------
+
+static void set_flags(pic18_t *cpu, uint8_t mask, uint8_t flags) {
+    STATUS(cpu) = (uint8_t)((STATUS(cpu) & ~mask) | (flags & mask));
+}
+
+static uint8_t zn(uint8_t r) {
+    return (uint8_t)((r == 0 ? PIC18_Z : 0) | ((r & 0x80) ? PIC18_N : 0));
+}
+
+// a + b + carry_in with all five flags; subtraction is a + ~b + 1
+static uint8_t add(pic18_t *cpu, uint8_t a, uint8_t b, uint8_t carry_in) {
+    unsigned sum = (unsigned)a + b + carry_in;
+    uint8_t r = (uint8_t)sum;
+    uint8_t flags = zn(r);
+
+    if (sum > 0xFF) flags |= PIC18_C;
+    if (((a & 0x0F) + (b & 0x0F) + carry_in) > 0x0F) flags |= PIC18_DC;
+    if ((~(a ^ b) & (a ^ r)) & 0x80) flags |= PIC18_OV;
+    set_flags(cpu, PIC18_C | PIC18_DC | PIC18_Z | PIC18_OV | PIC18_N, flags);
+    return r;
+}
+
+static uint8_t carry(const pic18_t *cpu) {
+    return STATUS(cpu) & PIC18_C;
+}
+
+// Words taken by the instruction at addr, used by the skip instructions
+static unsigned words_at(const pic18_t *cpu, uint32_t addr) {
+    uint16_t op = fetch(cpu, addr);
+
+    if ((op & 0xF000) == 0xC000) return 2;          // MOVFF
+    if ((op & 0xFE00) == 0xEC00) return 2;          // CALL
+    if ((op & 0xFF00) == 0xEF00) return 2;          // GOTO
+    if ((op & 0xFFC0) == 0xEE00) return 2;          // LFSR
+    if ((op & 0xFFF0) == 0x0060) return 3;          // MOVFFL
+    return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Execution
+// ---------------------------------------------------------------------------
+
+void pic18_reset(pic18_t *cpu) {
+    memset(cpu->ram, 0, sizeof cpu->ram);
+    for (uint16_t p = 0; p < 5; p++) {
+        cpu->ram[PIC18_TRISA + p] = 0xFF;           // all pins input
+        cpu->ram[PIC18_ANSELA + p * 0x10] = 0xFF;   // all analog
+    }
+    memset(cpu->pins, 0, sizeof cpu->pins);
+    cpu->pc = 0;
+    cpu->sp = 0;
+    cpu->asleep = 0;
+    cpu->cycles = 0;
+    tos_update(cpu);
+}
+
+// Executes one instruction and returns the cycles it took
+unsigned pic18_step(pic18_t *cpu) {
+    uint32_t at = cpu->pc;
+    uint16_t op = fetch(cpu, at);
+    uint8_t  f = op & 0xFF;
+    uint8_t  a = (op >> 8) & 1;
+    uint8_t  d = (op >> 9) & 1;
+    uint8_t  bit = (op >> 9) & 7;
+    uint16_t addr = file_addr(cpu, f, a);
+    unsigned cycles = 1;
+    uint8_t  v, r;
+
+    if (cpu->asleep) {
+        cpu->cycles++;
+        return 1;
+    }
+    cpu->pc = at + 2;
+
+// Writes a byte-op result to W (d = 0) or back to f (d = 1)
+#define RESULT(value) \
+    do { if (d) { if (mem_write(cpu, addr, (value))) cycles = 2; } \
+         else W(cpu) = (value); } while (0)
+#define SKIP_IF(cond) \
+    do { if (cond) { cycles += words_at(cpu, cpu->pc); \
+                     cpu->pc += 2 * words_at(cpu, cpu->pc); } } while (0)
+
+    switch (op >> 12) {
+    case 0x0:
+        if (op == 0x0000) break;                                    // NOP
+        if (op == 0x0003) { cpu->asleep = 1; break; }               // SLEEP
+        if (op == 0x0004) break;                                    // CLRWDT
+        if (op == 0x0005) { push(cpu, cpu->pc); break; }            // PUSH
+        if (op == 0x0006) { pop(cpu); break; }                      // POP
+        if (op == 0x0007) {                                         // DAW
+            unsigned w = W(cpu);
+            if ((w & 0x0F) > 9 || (STATUS(cpu) & PIC18_DC)) w += 0x06;
+            if ((w & 0xF0) > 0x90 || carry(cpu) || w > 0xFF) w += 0x60;
+            W(cpu) = (uint8_t)w;
+            set_flags(cpu, PIC18_C, w > 0xFF ? PIC18_C : 0);
+            break;
+        }
+        if ((op & 0xFFFC) == 0x0008) {                              // TBLRD
+            uint32_t p = tblptr(cpu);
+            if ((op & 3) == 3) p++;                                 // TBLRD+*
+            cpu->ram[PIC18_TABLAT] = table_read(cpu, p);
+            if ((op & 3) == 1) p++;                                 // TBLRD*+
+            if ((op & 3) == 2) p--;                                 // TBLRD*-
+            tblptr_set(cpu, p);
+            cycles = 2;
+            break;
+        }
+        if ((op & 0xFFFC) == 0x000C) {                              // TBLWT
+            uint32_t p = tblptr(cpu);
+            if ((op & 3) == 3) p++;
+            if ((op & 3) == 1) p++;
+            if ((op & 3) == 2) p--;
+            tblptr_set(cpu, p);
+            cycles = 2;
+            break;
+        }
+        if ((op & 0xFFFE) == 0x0010 || (op & 0xFFFE) == 0x0012) {   // RETFIE/RETURN
+            cpu->pc = pop(cpu);
+            if (op & 1) {
+                W(cpu) = cpu->shadow_w;
+                STATUS(cpu) = cpu->shadow_status;
+                BSR(cpu) = cpu->shadow_bsr;
+            }
+            cycles = 2;
+            break;
+        }
+        if (op == 0x00FF) { pic18_reset(cpu); break; }              // RESET
+        if ((op & 0xFFF0) == 0x0060) {                              // MOVFFL
+            uint16_t w2 = fetch(cpu, cpu->pc), w3 = fetch(cpu, cpu->pc + 2);
+            uint16_t src = (uint16_t)(((op & 0x0F) << 10) | ((w2 >> 2) & 0x3FF));
+            uint16_t dst = (uint16_t)(((w2 & 3) << 12) | (w3 & 0xFFF));
+            cpu->pc += 4;
+            if (mem_write(cpu, dst, mem_read(cpu, src))) cycles = 4;
+            else cycles = 3;
+            break;
+        }
+        if ((op & 0xFFC0) == 0x0100) { BSR(cpu) = op & 0x3F; break; }   // MOVLB
+        if ((op & 0xFE00) == 0x0200) {                              // MULWF
+            unsigned prod = (unsigned)W(cpu) * mem_read(cpu, addr);
+            cpu->ram[PIC18_PRODL] = (uint8_t)prod;
+            cpu->ram[PIC18_PRODH] = (uint8_t)(prod >> 8);
+            break;
+        }
+        if ((op & 0xFC00) == 0x0400) {                              // DECF
+            r = add(cpu, mem_read(cpu, addr), 0xFF, 0);
+            RESULT(r);
+            break;
+        }
+        switch (op & 0xFF00) {
+        case 0x0800: W(cpu) = add(cpu, f, (uint8_t)~W(cpu), 1); break;  // SUBLW
+        case 0x0900: W(cpu) |= f; set_flags(cpu, PIC18_Z | PIC18_N, zn(W(cpu))); break;  // IORLW
+        case 0x0A00: W(cpu) ^= f; set_flags(cpu, PIC18_Z | PIC18_N, zn(W(cpu))); break;  // XORLW
+        case 0x0B00: W(cpu) &= f; set_flags(cpu, PIC18_Z | PIC18_N, zn(W(cpu))); break;  // ANDLW
+        case 0x0C00: W(cpu) = f; cpu->pc = pop(cpu); cycles = 2; break;     // RETLW
+        case 0x0D00: {                                                      // MULLW
+            unsigned prod = (unsigned)W(cpu) * f;
+            cpu->ram[PIC18_PRODL] = (uint8_t)prod;
+            cpu->ram[PIC18_PRODH] = (uint8_t)(prod >> 8);
+            break;
+        }
+        case 0x0E00: W(cpu) = f; break;                                     // MOVLW
+        case 0x0F00: W(cpu) = add(cpu, W(cpu), f, 0); break;                // ADDLW
+        }
+        break;
+
+    case 0x1:
+        v = mem_read(cpu, addr);
+        switch ((op >> 10) & 3) {
+        case 0: r = v | W(cpu); break;                              // IORWF
+        case 1: r = v & W(cpu); break;                              // ANDWF
+        case 2: r = v ^ W(cpu); break;                              // XORWF
+        default: r = (uint8_t)~v; break;                            // COMF
+        }
+        set_flags(cpu, PIC18_Z | PIC18_N, zn(r));
+        RESULT(r);
+        break;
+
+    case 0x2:
+        v = mem_read(cpu, addr);
+        switch ((op >> 10) & 3) {
+        case 0: r = add(cpu, W(cpu), v, carry(cpu)); RESULT(r); break;  // ADDWFC
+        case 1: r = add(cpu, W(cpu), v, 0); RESULT(r); break;           // ADDWF
+        case 2: r = add(cpu, v, 1, 0); RESULT(r); break;                // INCF
+        default: r = (uint8_t)(v - 1); RESULT(r); SKIP_IF(r == 0); break;   // DECFSZ
+        }
+        break;
+
+    case 0x3:
+        v = mem_read(cpu, addr);
+        switch ((op >> 10) & 3) {
+        case 0:                                                     // RRCF
+            r = (uint8_t)((v >> 1) | (carry(cpu) << 7));
+            set_flags(cpu, PIC18_C | PIC18_Z | PIC18_N, (uint8_t)((v & 1) | zn(r)));
+            RESULT(r);
+            break;
+        case 1:                                                     // RLCF
+            r = (uint8_t)((v << 1) | carry(cpu));
+            set_flags(cpu, PIC18_C | PIC18_Z | PIC18_N, (uint8_t)((v >> 7) | zn(r)));
+            RESULT(r);
+            break;
+        case 2: r = (uint8_t)((v << 4) | (v >> 4)); RESULT(r); break;   // SWAPF
+        default: r = (uint8_t)(v + 1); RESULT(r); SKIP_IF(r == 0); break;   // INCFSZ
+        }
+        break;
+
+    case 0x4:
+        v = mem_read(cpu, addr);
+        switch ((op >> 10) & 3) {
+        case 0: r = (uint8_t)((v >> 1) | (v << 7)); break;          // RRNCF
+        case 1: r = (uint8_t)((v << 1) | (v >> 7)); break;          // RLNCF
+        case 2: r = (uint8_t)(v + 1); RESULT(r); SKIP_IF(r != 0); goto done;  // INFSNZ
+        default: r = (uint8_t)(v - 1); RESULT(r); SKIP_IF(r != 0); goto done; // DCFSNZ
+        }
+        set_flags(cpu, PIC18_Z | PIC18_N, zn(r));
+        RESULT(r);
+        break;
+
+    case 0x5:
+        v = mem_read(cpu, addr);
+        switch ((op >> 10) & 3) {
+        case 0: r = v; set_flags(cpu, PIC18_Z | PIC18_N, zn(r)); RESULT(r); break;   // MOVF
+        case 1: r = add(cpu, W(cpu), (uint8_t)~v, carry(cpu)); RESULT(r); break;   // SUBFWB
+        case 2: r = add(cpu, v, (uint8_t)~W(cpu), carry(cpu)); RESULT(r); break;   // SUBWFB
+        default: r = add(cpu, v, (uint8_t)~W(cpu), 1); RESULT(r); break;           // SUBWF
+        }
+        break;
+
+    case 0x6:
+        switch ((op >> 9) & 7) {
+        case 0: SKIP_IF(mem_read(cpu, addr) < W(cpu)); break;       // CPFSLT
+        case 1: SKIP_IF(mem_read(cpu, addr) == W(cpu)); break;      // CPFSEQ
+        case 2: SKIP_IF(mem_read(cpu, addr) > W(cpu)); break;       // CPFSGT
+        case 3: SKIP_IF(mem_read(cpu, addr) == 0); break;           // TSTFSZ
+        case 4: if (mem_write(cpu, addr, 0xFF)) cycles = 2; break;  // SETF
+        case 5:                                                     // CLRF
+            set_flags(cpu, PIC18_Z, PIC18_Z);
+            if (mem_write(cpu, addr, 0x00)) cycles = 2;
+            break;
+        case 6: r = add(cpu, 0, (uint8_t)~mem_read(cpu, addr), 1);  // NEGF
+                if (mem_write(cpu, addr, r)) cycles = 2;
+                break;
+        default: if (mem_write(cpu, addr, W(cpu))) cycles = 2; break;   // MOVWF
+        }
+        break;
+
+    case 0x7:                                                       // BTG
+        v = mem_read(cpu, addr);
+        if (mem_write(cpu, addr, (uint8_t)(v ^ (1u << bit)))) cycles = 2;
+        break;
+    case 0x8:                                                       // BSF
+        v = mem_read(cpu, addr);
+        if (mem_write(cpu, addr, (uint8_t)(v | (1u << bit)))) cycles = 2;
+        break;
+    case 0x9:                                                       // BCF
+        v = mem_read(cpu, addr);
+        if (mem_write(cpu, addr, (uint8_t)(v & ~(1u << bit)))) cycles = 2;
+        break;
+    case 0xA: SKIP_IF((mem_read(cpu, addr) >> bit) & 1); break;     // BTFSS
+    case 0xB: SKIP_IF(!((mem_read(cpu, addr) >> bit) & 1)); break;  // BTFSC
+
+    case 0xC: {                                                     // MOVFF
+        uint16_t dst = fetch(cpu, cpu->pc) & 0x0FFF;
+        cpu->pc += 2;
+        if (mem_write(cpu, dst, mem_read(cpu, op & 0x0FFF))) cycles = 3;
+        else cycles = 2;
+        break;
+    }
+
+    case 0xD: {                                                     // BRA/RCALL
+        int32_t n = op & 0x07FF;
+        if (n & 0x0400) n -= 0x0800;
+        if (op & 0x0800) push(cpu, cpu->pc);
+        cpu->pc = (uint32_t)((int32_t)cpu->pc + 2 * n);
+        cycles = 2;
+        break;
+    }
+
+    case 0xE:
+        if ((op & 0x0800) == 0) {                                   // conditional branches
+            uint8_t s = STATUS(cpu), take = 0;
+            switch ((op >> 8) & 7) {
+            case 0: take = (s & PIC18_Z) != 0; break;               // BZ
+            case 1: take = (s & PIC18_Z) == 0; break;               // BNZ
+            case 2: take = (s & PIC18_C) != 0; break;               // BC
+            case 3: take = (s & PIC18_C) == 0; break;               // BNC
+            case 4: take = (s & PIC18_OV) != 0; break;              // BOV
+            case 5: take = (s & PIC18_OV) == 0; break;              // BNOV
+            case 6: take = (s & PIC18_N) != 0; break;               // BN
+            case 7: take = (s & PIC18_N) == 0; break;               // BNN
+            }
+            if (take) {
+                cpu->pc = (uint32_t)((int32_t)cpu->pc + 2 * (int8_t)f);
+                cycles = 2;
+            }
+            break;
+        }
+        if ((op & 0xFE00) == 0xEC00 || (op & 0xFF00) == 0xEF00) {   // CALL/GOTO
+            uint32_t target = (((uint32_t)(fetch(cpu, cpu->pc) & 0x0FFF) << 8) | f) << 1;
+            cpu->pc += 2;
+            if ((op & 0xFE00) == 0xEC00) {
+                if (op & 0x0100) {
+                    cpu->shadow_w = W(cpu);
+                    cpu->shadow_status = STATUS(cpu);
+                    cpu->shadow_bsr = BSR(cpu);
+                }
+                push(cpu, cpu->pc);
+            }
+            cpu->pc = target;
+            cycles = 2;
+            break;
+        }
+        if ((op & 0xFFC0) == 0xEE00) {                              // LFSR
+            uint16_t k = (uint16_t)(((op & 0x0F) << 10) | (fetch(cpu, cpu->pc) & 0x3FF));
+            fsr_set(cpu, (op >> 4) & 3, k);
+            cpu->pc += 2;
+            cycles = 2;
+        }
+        break;
+
+    default:                                                        // 0xF: NOP
+        break;
+    }
+done:
+#undef RESULT
+#undef SKIP_IF
+    cpu->cycles += cycles;
+    return cycles;
+}
+
+// Runs until SLEEP or until max_cycles have passed. Returns 1 on SLEEP.
+int pic18_run(pic18_t *cpu, uint64_t max_cycles) {
+    uint64_t end = cpu->cycles + max_cycles;
+
+    while (cpu->cycles < end) {
+        if (cpu->asleep)
+            return 1;
+        pic18_step(cpu);
+    }
+    return cpu->asleep;
+}
+
+// Calls the subroutine at addr and runs it until it returns. Returns the
+// cycles from its first instruction up to and including the RETURN, or 0 if
+// it did not return within max_cycles.
+uint64_t pic18_call(pic18_t *cpu, uint32_t addr, uint64_t max_cycles) {
+    const uint32_t sentinel = PIC18_FLASH_SIZE;
+    uint8_t depth = cpu->sp;
+    uint64_t start = cpu->cycles;
+
+    push(cpu, sentinel);
+    cpu->pc = addr;
+    while (cpu->cycles - start < max_cycles) {
+        pic18_step(cpu);
+        if (cpu->pc == sentinel && cpu->sp == depth)
+            return cpu->cycles - start;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Loaders
+// ---------------------------------------------------------------------------
+
+static unsigned hex_byte(const char *s) {
+    unsigned v = 0;
+    sscanf(s, "%2x", &v);
+    return v;
+}
+
+// Loads an Intel HEX image (as written by MPLAB into dist/) into flash,
+// configuration and EEPROM. Returns 0 on success.
+int pic18_load_hex(pic18_t *cpu, const char *path) {
+    FILE *fp = fopen(path, "r");
+    char line[600];
+    uint32_t base = 0;
+
+    if (!fp)
+        return -1;
+    memset(cpu->flash, 0xFF, sizeof cpu->flash);
+    memset(cpu->config, 0xFF, sizeof cpu->config);
+    memset(cpu->eeprom, 0xFF, sizeof cpu->eeprom);
+    while (fgets(line, sizeof line, fp)) {
+        if (line[0] != ':')
+            continue;
+        unsigned count = hex_byte(line + 1);
+        unsigned offset = (hex_byte(line + 3) << 8) | hex_byte(line + 5);
+        unsigned type = hex_byte(line + 7);
+
+        if (type == 1)
+            break;
+        if (type == 4) {
+            base = ((hex_byte(line + 9) << 8) | hex_byte(line + 11)) << 16;
+            continue;
+        }
+        if (type != 0)
+            continue;
+        for (unsigned i = 0; i < count; i++) {
+            uint32_t addr = base + offset + i;
+            uint8_t value = (uint8_t)hex_byte(line + 9 + 2 * i);
+            if (addr < PIC18_FLASH_SIZE)
+                cpu->flash[addr] = value;
+            else if (addr >= 0x300000 && addr < 0x300010)
+                cpu->config[addr - 0x300000] = value;
+            else if (addr >= 0x310000 && addr < 0x310400)
+                cpu->eeprom[addr - 0x310000] = value;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+// Finds the address of a label using the project's main.asm and the .sym
+// file from the same build (the .sym maps source lines to addresses). The
+// label's address is that of the first instruction after it. Returns -1 if
+// the label or its line is not found.
+long pic18_label(const char *asm_path, const char *sym_path, const char *label) {
+    FILE *fp = fopen(asm_path, "r");
+    char line[512];
+    size_t len = strlen(label);
+    long label_line = 0, n = 0, best_line = 0, best_addr = -1;
+
+    if (!fp)
+        return -1;
+    while (fgets(line, sizeof line, fp)) {
+        n++;
+        if (strncmp(line, label, len) == 0 && line[len] == ':') {
+            label_line = n;
+            break;
+        }
+    }
+    fclose(fp);
+    if (!label_line || !(fp = fopen(sym_path, "r")))
+        return -1;
+
+    int in_locals = 0;
+    while (fgets(line, sizeof line, fp)) {
+        long src, addr;
+        if (strncmp(line, "%locals", 7) == 0) {
+            in_locals = 1;
+            continue;
+        }
+        if (!in_locals || sscanf(line, "%ld %lx", &src, &addr) != 2)
+            continue;
+        if (src > label_line && (best_line == 0 || src < best_line)) {
+            best_line = src;
+            best_addr = addr;
+        }
+    }
+    fclose(fp);
+    return best_addr;
+}
+
+// Address of a global symbol of a C build: the .sym lists "name address
+// class ..." before %locals. Returns -1 if the name is not there.
+long pic18_symbol(const char *sym_path, const char *name) {
+    FILE *fp = fopen(sym_path, "r");
+    char line[512], sym[256];
+    long addr = -1, value;
+
+    if (!fp)
+        return -1;
+    while (fgets(line, sizeof line, fp)) {
+        if (strncmp(line, "%locals", 7) == 0)
+            break;
+        if (sscanf(line, "%255s %lx", sym, &value) == 2 && strcmp(sym, name) == 0) {
+            addr = value;
+            break;
+        }
+    }
+    fclose(fp);
+    return addr;
+}
+
+// Address of the first instruction of a C source line. Under %locals the
+// .sym names each source file on a line of its own, followed by its
+// "line address" pairs. Returns -1 if the file or line is not there.
+long pic18_line(const char *sym_path, const char *file, long src_line) {
+    FILE *fp = fopen(sym_path, "r");
+    char line[512];
+    size_t len = strlen(file);
+    int in_locals = 0, in_file = 0;
+    long addr = -1;
+
+    if (!fp)
+        return -1;
+    while (fgets(line, sizeof line, fp)) {
+        long src, value;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strncmp(line, "%locals", 7) == 0) {
+            in_locals = 1;
+            continue;
+        }
+        if (!in_locals)
+            continue;
+        if (sscanf(line, "%ld %lx", &src, &value) != 2) {
+            size_t n = strlen(line);
+            in_file = n >= len && strcmp(line + n - len, file) == 0;
+            continue;
+        }
+        if (in_file && src == src_line) {
+            addr = value;
+            break;
+        }
+    }
+    fclose(fp);
+    return addr;
+}
+
+// ---------------------------------------------------------------------------
+// Assembler for sources no image has been built from
+// ---------------------------------------------------------------------------
+
+#define ASM_SYMBOLS     256
+#define ASM_DEFINES     64
+#define ASM_CONDS       8       // #if nesting in one file
+
+enum { ASM_FDA, ASM_FA, ASM_BIT, ASM_LIT, ASM_MOVFF, ASM_CALL, ASM_REL11, ASM_REL8, ASM_LFSR,
+       ASM_NONE };
+
+typedef struct {
+    const char *name;
+    uint16_t op;
+    uint8_t format;
+} asm_op_t;
+
+static const asm_op_t asm_ops[] = {
+    {"ADDWF", 0x2400, ASM_FDA}, {"ADDWFC", 0x2000, ASM_FDA}, {"ANDWF", 0x1400, ASM_FDA},
+    {"COMF", 0x1C00, ASM_FDA}, {"DECF", 0x0400, ASM_FDA}, {"DECFSZ", 0x2C00, ASM_FDA},
+    {"INCF", 0x2800, ASM_FDA}, {"INCFSZ", 0x3C00, ASM_FDA}, {"IORWF", 0x1000, ASM_FDA},
+    {"MOVF", 0x5000, ASM_FDA}, {"RLCF", 0x3400, ASM_FDA}, {"RLNCF", 0x4400, ASM_FDA},
+    {"RRCF", 0x3000, ASM_FDA}, {"RRNCF", 0x4000, ASM_FDA}, {"SUBFWB", 0x5400, ASM_FDA},
+    {"SUBWF", 0x5C00, ASM_FDA}, {"SUBWFB", 0x5800, ASM_FDA}, {"SWAPF", 0x3800, ASM_FDA},
+    {"XORWF", 0x1800, ASM_FDA}, {"DCFSNZ", 0x4C00, ASM_FDA}, {"INFSNZ", 0x4800, ASM_FDA},
+    {"CLRF", 0x6A00, ASM_FA}, {"CPFSEQ", 0x6200, ASM_FA}, {"CPFSGT", 0x6400, ASM_FA},
+    {"CPFSLT", 0x6000, ASM_FA}, {"MOVWF", 0x6E00, ASM_FA}, {"MULWF", 0x0200, ASM_FA},
+    {"NEGF", 0x6C00, ASM_FA}, {"SETF", 0x6800, ASM_FA}, {"TSTFSZ", 0x6600, ASM_FA},
+    {"BCF", 0x9000, ASM_BIT}, {"BSF", 0x8000, ASM_BIT}, {"BTFSC", 0xB000, ASM_BIT},
+    {"BTFSS", 0xA000, ASM_BIT}, {"BTG", 0x7000, ASM_BIT},
+    {"ADDLW", 0x0F00, ASM_LIT}, {"ANDLW", 0x0B00, ASM_LIT}, {"IORLW", 0x0900, ASM_LIT},
+    {"MOVLW", 0x0E00, ASM_LIT}, {"MULLW", 0x0D00, ASM_LIT}, {"RETLW", 0x0C00, ASM_LIT},
+    {"SUBLW", 0x0800, ASM_LIT}, {"XORLW", 0x0A00, ASM_LIT}, {"MOVLB", 0x0100, ASM_LIT},
+    {"MOVFF", 0xC000, ASM_MOVFF}, {"CALL", 0xEC00, ASM_CALL}, {"GOTO", 0xEF00, ASM_CALL},
+    {"BRA", 0xD000, ASM_REL11}, {"RCALL", 0xD800, ASM_REL11},
+    {"BZ", 0xE000, ASM_REL8}, {"BNZ", 0xE100, ASM_REL8}, {"BC", 0xE200, ASM_REL8},
+    {"BNC", 0xE300, ASM_REL8}, {"BOV", 0xE400, ASM_REL8}, {"BNOV", 0xE500, ASM_REL8},
+    {"BN", 0xE600, ASM_REL8}, {"BNN", 0xE700, ASM_REL8}, {"LFSR", 0xEE00, ASM_LFSR},
+    {"RETURN", 0x0012, ASM_NONE}, {"NOP", 0x0000, ASM_NONE}, {"SLEEP", 0x0003, ASM_NONE},
+    {"CLRWDT", 0x0004, ASM_NONE},
+    {"TBLRD*", 0x0008, ASM_NONE}, {"TBLRD*+", 0x0009, ASM_NONE}, {"TBLRD*-", 0x000A, ASM_NONE},
+    {"TBLRD+*", 0x000B, ASM_NONE},
+};
+
+/*
+ * SFRs the sources name. The core registers, ports, IOC and the ADC block
+ * are at their PIC18F47K42 addresses (the ADC ones as in the .sym of the C
+ * builds). The FVR, Timer0, Timer2, oscillator and PIRx/PIEx addresses are
+ * this model's own: the bench reaches every peripheral register by name,
+ * and on the chip pic-as takes the real ones from xc.inc.
+ */
+static const struct { const char *name; uint16_t addr; } asm_sfrs[] = {
+    {"WREG", PIC18_WREG}, {"STATUS", PIC18_STATUS}, {"BSR", PIC18_BSR},
+    {"PRODL", PIC18_PRODL}, {"PRODH", PIC18_PRODH}, {"TABLAT", PIC18_TABLAT},
+    {"TBLPTRL", PIC18_TBLPTRL}, {"TBLPTRH", PIC18_TBLPTRH}, {"TBLPTRU", PIC18_TBLPTRU},
+    {"FSR0L", PIC18_FSR0L}, {"FSR1L", PIC18_FSR1L}, {"FSR2L", PIC18_FSR2L},
+    {"FSR0H", PIC18_FSR0L + 1}, {"FSR1H", PIC18_FSR1L + 1}, {"FSR2H", PIC18_FSR2L + 1},
+    {"INDF0", PIC18_INDF0}, {"POSTINC0", PIC18_INDF0 - 1}, {"POSTDEC0", PIC18_INDF0 - 2},
+    {"PREINC0", PIC18_INDF0 - 3}, {"PLUSW0", PIC18_PLUSW0},
+    {"INDF1", PIC18_INDF1}, {"POSTINC1", PIC18_INDF1 - 1}, {"POSTDEC1", PIC18_INDF1 - 2},
+    {"PREINC1", PIC18_INDF1 - 3}, {"PLUSW1", PIC18_PLUSW1},
+    {"INDF2", PIC18_INDF2}, {"POSTINC2", PIC18_INDF2 - 1}, {"POSTDEC2", PIC18_INDF2 - 2},
+    {"PREINC2", PIC18_INDF2 - 3}, {"PLUSW2", PIC18_PLUSW2},
+    {"PORTA", PIC18_PORTA}, {"PORTB", PIC18_PORTB}, {"PORTC", PIC18_PORTC},
+    {"PORTD", PIC18_PORTD}, {"PORTE", PIC18_PORTE},
+    {"LATA", PIC18_LATA}, {"LATB", PIC18_LATA + 1}, {"LATC", PIC18_LATA + 2},
+    {"LATD", PIC18_LATA + 3}, {"LATE", PIC18_LATA + 4},
+    {"TRISA", PIC18_TRISA}, {"TRISB", PIC18_TRISA + 1}, {"TRISC", PIC18_TRISA + 2},
+    {"TRISD", PIC18_TRISA + 3}, {"TRISE", PIC18_TRISA + 4},
+    {"ANSELA", PIC18_ANSELA}, {"ANSELB", PIC18_ANSELA + 0x10}, {"ANSELC", PIC18_ANSELA + 0x20},
+    {"ANSELD", PIC18_ANSELA + 0x30}, {"ANSELE", PIC18_ANSELA + 0x40},
+    {"ADRESL", 0x3EEF}, {"ADRESH", 0x3EF0}, {"ADPCH", 0x3EF1}, {"ADCON0", 0x3EF8},
+    {"ADCON1", 0x3EF9}, {"ADCON2", 0x3EFA}, {"ADCON3", 0x3EFB}, {"ADREF", 0x3EFD},
+    {"ADCLK", 0x3EFF},
+    {"IOCAP", PIC18_ANSELA + 5}, {"IOCAN", PIC18_ANSELA + 6}, {"IOCAF", PIC18_ANSELA + 7},
+    {"FVRCON", 0x3EA0},
+    {"T2TMR", 0x3EB0}, {"T2PR", 0x3EB1}, {"T2CON", 0x3EB2}, {"T2HLT", 0x3EB3},
+    {"T2CLKCON", 0x3EB4},
+    {"TMR0L", 0x3EB8}, {"TMR0H", 0x3EB9}, {"T0CON0", 0x3EBA}, {"T0CON1", 0x3EBB},
+    {"OSCCON1", 0x3EC0}, {"OSCCON3", 0x3EC2},
+    {"PIE0", 0x3990}, {"PIR0", 0x39A0}, {"PIE3", 0x3993}, {"PIR3", 0x39A3},
+    {"PIE4", 0x3994}, {"PIR4", 0x39A4},
+};
+
+static struct { char name[48]; long value; } asm_symbols[ASM_SYMBOLS];
+static int asm_symbol_count;
+static struct { char name[48]; char text[80]; } asm_defines[ASM_DEFINES];
+static int asm_define_count;
+static int asm_predefine_count;         // the first asm_defines, from pic18_asm_define()
+static int asm_unknown;                 // an expression named a symbol not yet defined
+
+long pic18_asm_symbol(const char *name) {
+    for (int i = 0; i < asm_symbol_count; i++)
+        if (strcmp(asm_symbols[i].name, name) == 0)
+            return asm_symbols[i].value;
+    for (size_t i = 0; i < sizeof asm_sfrs / sizeof asm_sfrs[0]; i++)
+        if (strcasecmp(asm_sfrs[i].name, name) == 0)
+            return asm_sfrs[i].addr;
+    return -1;
+}
+
+static void asm_define_symbol(const char *name, long value) {
+    if (asm_symbol_count < ASM_SYMBOLS) {
+        snprintf(asm_symbols[asm_symbol_count].name, sizeof asm_symbols[0].name, "%.47s", name);
+        asm_symbols[asm_symbol_count++].value = value;
+    }
+}
+
+static int asm_ident(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static void asm_skip(const char **s) {
+    while (**s == ' ' || **s == '\t')
+        (*s)++;
+}
+
+// Expression: numbers (decimal, 0x, 0b), symbols, + - * / ( ), unary -,
+// low() and high()
+static long asm_expr(const char **s);
+
+static long asm_primary(const char **s) {
+    char name[48];
+    size_t n = 0;
+    long v;
+
+    asm_skip(s);
+    if (**s == '(') {
+        (*s)++;
+        v = asm_expr(s);
+        asm_skip(s);
+        if (**s == ')') (*s)++;
+        return v;
+    }
+    if (**s == '-') {
+        (*s)++;
+        return -asm_primary(s);
+    }
+    while (asm_ident(**s) && n < sizeof name - 1)
+        name[n++] = *(*s)++;
+    name[n] = '\0';
+    if (n == 0) {
+        asm_unknown = 1;
+        return 0;
+    }
+    if (name[0] >= '0' && name[0] <= '9') {
+        if (name[0] == '0' && (name[1] == 'b' || name[1] == 'B'))
+            return strtol(name + 2, NULL, 2);
+        return strtol(name, NULL, 0);
+    }
+    asm_skip(s);
+    if (**s == '(' && (strcasecmp(name, "low") == 0 || strcasecmp(name, "high") == 0)) {
+        v = asm_primary(s);
+        return (name[0] == 'l' || name[0] == 'L') ? (v & 0xFF) : ((v >> 8) & 0xFF);
+    }
+    if ((v = pic18_asm_symbol(name)) < 0) {
+        asm_unknown = 1;
+        return 0;
+    }
+    return v;
+}
+
+static long asm_term(const char **s) {
+    long v = asm_primary(s);
+
+    for (;;) {
+        asm_skip(s);
+        if (**s == '*') { (*s)++; v *= asm_primary(s); }
+        else if (**s == '/') { (*s)++; long d = asm_primary(s); v = d ? v / d : 0; }
+        else return v;
+    }
+}
+
+static long asm_sum(const char **s) {
+    long v = asm_term(s);
+
+    for (;;) {
+        asm_skip(s);
+        if (**s == '+') { (*s)++; v += asm_term(s); }
+        else if (**s == '-') { (*s)++; v -= asm_term(s); }
+        else return v;
+    }
+}
+
+static long asm_expr(const char **s) {
+    long v = asm_sum(s);
+
+    for (;;) {
+        asm_skip(s);
+        if (**s == '<' && (*s)[1] == '<') { *s += 2; v <<= asm_sum(s); }
+        else if (**s == '>' && (*s)[1] == '>') { *s += 2; v >>= asm_sum(s); }
+        else return v;
+    }
+}
+
+static long asm_value(const char *s) {
+    return asm_expr(&s);
+}
+
+// a < b, <=, >, >=, == or != b, or just a
+static long asm_compare(const char **s) {
+    long v = asm_expr(s);
+
+    asm_skip(s);
+    if (**s == '<' && (*s)[1] == '=') { *s += 2; return v <= asm_expr(s); }
+    if (**s == '>' && (*s)[1] == '=') { *s += 2; return v >= asm_expr(s); }
+    if (**s == '=' && (*s)[1] == '=') { *s += 2; return v == asm_expr(s); }
+    if (**s == '!' && (*s)[1] == '=') { *s += 2; return v != asm_expr(s); }
+    if (**s == '<') { (*s)++; return v < asm_expr(s); }
+    if (**s == '>') { (*s)++; return v > asm_expr(s); }
+    return v;
+}
+
+// #if condition, #defines already substituted: comparisons joined by || and
+// &&, left to right. A name that is not a symbol counts as 0.
+static int asm_condition(const char *s) {
+    int unknown = asm_unknown;
+    long v = asm_compare(&s);
+
+    for (;;) {
+        asm_skip(&s);
+        if (s[0] == '|' && s[1] == '|') { s += 2; long w = asm_compare(&s); v = v || w; }
+        else if (s[0] == '&' && s[1] == '&') { s += 2; long w = asm_compare(&s); v = v && w; }
+        else break;
+    }
+    asm_unknown = unknown;
+    return v != 0;
+}
+
+static int asm_defined(const char *name) {
+    for (int i = 0; i < asm_define_count; i++)
+        if (strcmp(asm_defines[i].name, name) == 0)
+            return 1;
+    return 0;
+}
+
+// Replaces each #define name in line by its text
+static void asm_substitute(char *line, size_t size) {
+    char out[512];
+
+    for (int round = 0; round < 4; round++) {
+        size_t o = 0;
+        int changed = 0;
+        for (const char *s = line; *s && o < sizeof out - 1;) {
+            if (asm_ident(*s) && (s == line || !asm_ident(s[-1]))) {
+                size_t n = 0;
+                while (asm_ident(s[n])) n++;
+                int i;
+                for (i = 0; i < asm_define_count; i++)
+                    if (strlen(asm_defines[i].name) == n && strncmp(asm_defines[i].name, s, n) == 0)
+                        break;
+                const char *text = i < asm_define_count ? asm_defines[i].text : NULL;
+                if (text) {
+                    for (const char *t = text; *t && o < sizeof out - 1;) out[o++] = *t++;
+                    changed = 1;
+                } else {
+                    for (size_t k = 0; k < n && o < sizeof out - 1; k++) out[o++] = s[k];
+                }
+                s += n;
+            } else {
+                out[o++] = *s++;
+            }
+        }
+        out[o] = '\0';
+        snprintf(line, size, "%s", out);
+        if (!changed)
+            break;
+    }
+}
+
+static int asm_words(uint8_t format) {
+    return (format == ASM_MOVFF || format == ASM_CALL || format == ASM_LFSR) ? 2 : 1;
+}
+
+// Splits "a, b, c" into up to 3 trimmed operands; returns the count
+static int asm_operands(char *s, char *arg[3]) {
+    int n = 0;
+
+    while (*s && n < 3) {
+        while (*s == ' ' || *s == '\t') s++;
+        if (!*s) break;
+        arg[n++] = s;
+        while (*s && *s != ',') s++;
+        char *end = s;
+        if (*s) *s++ = '\0';
+        while (end > arg[n - 1] && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+    }
+    return n;
+}
+
+// Access bit: "c"/0 access, "b"/1 banked; by default the access bank for
+// the registers it reaches, as pic-as does
+static int asm_access(char *arg, long f) {
+    if (!arg)
+        return (f < 0x60 || f >= 0x3F60) ? 0 : 1;
+    if (strcasecmp(arg, "c") == 0) return 0;
+    if (strcasecmp(arg, "b") == 0) return 1;
+    return asm_value(arg) != 0;
+}
+
+// Destination bit: "w"/0 W, "f"/1 the register (the default)
+static int asm_dest(char *arg) {
+    if (!arg || strcasecmp(arg, "f") == 0) return 1;
+    if (strcasecmp(arg, "w") == 0) return 0;
+    return asm_value(arg) != 0;
+}
+
+static void asm_emit(pic18_t *cpu, uint32_t *pc, uint16_t word) {
+    cpu->flash[*pc] = (uint8_t)word;
+    cpu->flash[*pc + 1] = (uint8_t)(word >> 8);
+    *pc += 2;
+}
+
+// Encodes one instruction at *pc; returns 0, or -1 on a bad operand
+static int asm_encode(pic18_t *cpu, uint32_t *pc, const asm_op_t *op, char *args) {
+    char *arg[3] = {0};
+    int n = asm_operands(args, arg);
+    long f;
+    uint16_t word = op->op;
+
+    asm_unknown = 0;
+    f = n > 0 ? asm_value(arg[0]) : 0;
+    switch (op->format) {
+    case ASM_FDA:
+        word |= (uint16_t)((asm_dest(arg[1]) << 9) | (asm_access(arg[2], f) << 8) | (f & 0xFF));
+        break;
+    case ASM_FA:
+        word |= (uint16_t)((asm_access(arg[1], f) << 8) | (f & 0xFF));
+        break;
+    case ASM_BIT: {
+        long bit = n > 1 ? asm_value(arg[1]) : -1;
+        if (bit < 0 || bit > 7)
+            return -1;
+        word |= (uint16_t)((bit << 9) | (asm_access(arg[2], f) << 8) | (f & 0xFF));
+        break;
+    }
+    case ASM_LIT:
+        word |= (uint16_t)(f & (op->op == 0x0100 ? 0x3F : 0xFF));
+        break;
+    case ASM_MOVFF: {
+        long dst = n > 1 ? asm_value(arg[1]) : -1;
+        if (dst < 0 || dst > 0x0FFF || f > 0x0FFF)     // SFRs need MOVFFL on the K42
+            return -1;
+        asm_emit(cpu, pc, (uint16_t)(word | (f & 0x0FFF)));
+        word = (uint16_t)(0xF000 | (dst & 0x0FFF));
+        break;
+    }
+    case ASM_CALL:
+        asm_emit(cpu, pc, (uint16_t)(word | ((f >> 1) & 0xFF)));
+        word = (uint16_t)(0xF000 | ((f >> 9) & 0x0FFF));
+        break;
+    case ASM_REL11:
+        word |= (uint16_t)(((f - (long)*pc - 2) / 2) & 0x07FF);
+        break;
+    case ASM_REL8:
+        word |= (uint16_t)(((f - (long)*pc - 2) / 2) & 0x00FF);
+        break;
+    case ASM_LFSR: {
+        long k = n > 1 ? asm_value(arg[1]) : -1;
+        if (f < 0 || f > 2 || k < 0 || k > 0x3FFF)
+            return -1;
+        asm_emit(cpu, pc, (uint16_t)(word | (f << 4) | (k >> 10)));
+        word = (uint16_t)(0xF000 | (k & 0x03FF));
+        break;
+    }
+    }
+    if (asm_unknown)
+        return -1;
+    asm_emit(cpu, pc, word);
+    return 0;
+}
+
+/*
+ * Defines name as text for the next pic18_assemble() only, as -D does on
+ * the command line: it comes before the sources' own #defines, so a
+ * "#ifndef name / #define name ..." default in a source gives way to it.
+ */
+void pic18_asm_define(const char *name, const char *text) {
+    if (asm_predefine_count < ASM_DEFINES) {
+        snprintf(asm_defines[asm_predefine_count].name, sizeof asm_defines[0].name, "%.47s", name);
+        snprintf(asm_defines[asm_predefine_count++].text, sizeof asm_defines[0].text, "%.79s", text);
+    }
+}
+
+// Where the next instruction, byte or variable goes; shared with included files
+typedef struct {
+    uint32_t reloc, abs;    // relocatable code, abs psect (ORG)
+    uint32_t *pc;           // one of the two
+    uint16_t ram;           // next udata byte
+    int in_data;            // in a udata psect
+    int depth;              // #include nesting
+} asm_place_t;
+
+/*
+ * Assembles one file at place, in the given pass. #include "file" is read
+ * in its place, relative to the file naming it (either slash), as pic-as
+ * does; <xc.inc> and the other system headers are skipped. #if, #ifdef,
+ * #ifndef, #else and #endif leave out lines, and #error in the lines kept
+ * fails the file.
+ */
+static int asm_file(pic18_t *cpu, asm_place_t *at, const char *path, int pass) {
+    char line[512];
+    FILE *fp = fopen(path, "r");
+    int n = 0;
+    int conds = 0;
+    uint8_t live[ASM_CONDS], taken[ASM_CONDS];     // per open #if: lines kept, a branch kept
+
+    if (!fp) {
+        printf("  cannot open %s\n", path);
+        return -1;
+    }
+    while (fgets(line, sizeof line, fp)) {
+        char *s = line, *label = NULL, mnemonic[16];
+        int len = 0;
+
+        n++;
+        s[strcspn(s, ";\r\n")] = '\0';
+        if (strstr(s, "//"))
+            *strstr(s, "//") = '\0';
+        if (s[0] == '#') {
+            char name[48], text[80] = "", file[256];
+            int active = conds == 0 || live[conds - 1];
+            if (sscanf(s, "#if%47s", name) == 1 && (!strcmp(name, "def") || !strcmp(name, "ndef") ||
+                                                    s[3] == ' ' || s[3] == '\t')) {
+                int value = 0;
+                if (conds == ASM_CONDS) {
+                    printf("  %s:%d: #if nested too deep\n", path, n);
+                    fclose(fp);
+                    return -1;
+                }
+                if (active && s[3] != ' ' && s[3] != '\t') {
+                    sscanf(s + 3 + strlen(name), "%47s", name);
+                    value = asm_defined(name) == (s[3] == 'd');
+                } else if (active) {
+                    asm_substitute(s, sizeof line);
+                    value = asm_condition(s + 3);
+                }
+                live[conds] = (uint8_t)(active && value);
+                taken[conds++] = (uint8_t)(!active || value);
+            } else if (strncmp(s, "#else", 5) == 0 && conds > 0) {
+                live[conds - 1] = !taken[conds - 1];
+                taken[conds - 1] = 1;
+            } else if (strncmp(s, "#endif", 6) == 0 && conds > 0) {
+                conds--;
+            } else if (!active) {
+                continue;
+            } else if (strncmp(s, "#error", 6) == 0) {
+                printf("  %s:%d: %s\n", path, n, s);
+                fclose(fp);
+                return -1;
+            } else if (sscanf(s, "#include \"%255[^\"]\"", file) == 1) {
+                char inc[512];
+                size_t dir = strrchr(path, '/') ? (size_t)(strrchr(path, '/') - path + 1) : 0;
+                for (char *c = file; *c; c++)
+                    if (*c == '\\') *c = '/';
+                snprintf(inc, sizeof inc, "%.*s%s", (int)dir, path, file);
+                if (at->depth >= 8 || (at->depth++, asm_file(cpu, at, inc, pass) != 0)) {
+                    printf("  %s:%d: in this #include\n", path, n);
+                    fclose(fp);
+                    return -1;
+                }
+                at->depth--;
+            } else if (pass == 0 && asm_define_count < ASM_DEFINES &&
+                       sscanf(s, "#define %47s %79[^\n]", name, text) >= 1) {
+                char *end = text + strlen(text);
+                while (end > text && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+                snprintf(asm_defines[asm_define_count].name, sizeof name, "%s", name);
+                snprintf(asm_defines[asm_define_count++].text, sizeof text, "%s", text);
+            }
+            continue;
+        }
+        if (conds > 0 && !live[conds - 1])
+            continue;
+        asm_substitute(s, sizeof line);
+        if (s[0] != ' ' && s[0] != '\t' && s[0] != '\0') {
+            label = s;
+            s += strcspn(s, ": \t");
+            if (*s) *s++ = '\0';
+        }
+        while (*s == ' ' || *s == '\t') s++;
+        if (sscanf(s, "%15s%n", mnemonic, &len) != 1) {
+            if (label && pass == 0)
+                asm_define_symbol(label, at->in_data ? at->ram : (long)*at->pc);
+            continue;
+        }
+        s += len;
+        if (strcasecmp(mnemonic, "EQU") == 0) {
+            if (label && pass == 0)
+                asm_define_symbol(label, asm_value(s));
+            continue;
+        }
+        if (label && pass == 0)
+            asm_define_symbol(label, at->in_data ? at->ram : (long)*at->pc);
+        if (strcasecmp(mnemonic, "PSECT") == 0) {
+            while (*s == ' ' || *s == '\t') s++;
+            at->in_data = strncmp(s, "udata", 5) == 0;
+            at->pc = strstr(s, ",abs") ? &at->abs : &at->reloc;
+            continue;
+        }
+        if (strcasecmp(mnemonic, "ORG") == 0) {
+            at->abs = (uint32_t)asm_value(s);
+            continue;
+        }
+        if (strcasecmp(mnemonic, "GLOBAL") == 0 || strcasecmp(mnemonic, "END") == 0 ||
+            strcasecmp(mnemonic, "CONFIG") == 0)
+            continue;
+        if (strcasecmp(mnemonic, "DS") == 0) {
+            at->ram = (uint16_t)(at->ram + asm_value(s));
+            continue;
+        }
+        if (strcasecmp(mnemonic, "DB") == 0) {
+            char *arg = strtok(s, ",");
+            for (; arg; arg = strtok(NULL, ",")) {
+                asm_unknown = 0;
+                long v = asm_value(arg);
+                if (pass == 1 && asm_unknown) {
+                    printf("  %s:%d: bad operand\n", path, n);
+                    fclose(fp);
+                    return -1;
+                }
+                if (pass == 1)
+                    cpu->flash[*at->pc] = (uint8_t)v;
+                (*at->pc)++;
+            }
+            continue;
+        }
+
+        const asm_op_t *op = NULL;
+        if (strcasecmp(mnemonic, "BANKSEL") == 0) {
+            static const asm_op_t movlb = {"MOVLB", 0x0100, ASM_LIT};
+            char bank[48];
+            asm_unknown = 0;
+            snprintf(bank, sizeof bank, "%ld", asm_value(s) >> 8);
+            if (asm_unknown && pass == 1) {
+                printf("  %s:%d: unknown register\n", path, n);
+                fclose(fp);
+                return -1;
+            }
+            snprintf(s, sizeof line - (size_t)(s - line), " %s", bank);
+            op = &movlb;
+        }
+        for (size_t i = 0; !op && i < sizeof asm_ops / sizeof asm_ops[0]; i++)
+            if (strcasecmp(asm_ops[i].name, mnemonic) == 0)
+                op = &asm_ops[i];
+        if (!op) {
+            printf("  %s:%d: %s not supported\n", path, n, mnemonic);
+            fclose(fp);
+            return -1;
+        }
+        if (*at->pc & 1) {
+            printf("  %s:%d: instruction at an odd address (after an odd DB)\n", path, n);
+            fclose(fp);
+            return -1;
+        }
+        if (pass == 0)
+            *at->pc += 2 * (uint32_t)asm_words(op->format);
+        else if (asm_encode(cpu, at->pc, op, s) != 0) {
+            printf("  %s:%d: bad operand\n", path, n);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * Assembles the sources as one program: relocatable code from address
+ * code, udata psects from data address data, abs psects where their ORG
+ * puts them. Labels, EQUs and #defines are shared between the files, and
+ * then available from pic18_asm_symbol(). Two passes, the first only
+ * placing labels. Returns 0, or -1 with the file line printed if a line
+ * is not understood.
+ */
+int pic18_assemble(pic18_t *cpu, const char *const *paths, int count, uint32_t code, uint16_t data) {
+    asm_symbol_count = 0;
+    asm_define_count = asm_predefine_count;
+    asm_predefine_count = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        asm_place_t at = {code, 0, NULL, data, 0, 0};
+
+        for (int file = 0; file < count; file++) {
+            at.pc = &at.reloc;
+            at.in_data = 0;
+            if (asm_file(cpu, &at, paths[file], pass) != 0)
+                return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Title: PIC18F47K42 instruction-set simulator
+ * ---------------------
+ * Program Details:
+ *  Runs the .hex images that MPLAB builds for the assembly projects
+ *  (7SegmentCounter.X, HVAC_Control_System.X, MyFirstAssembly_MPLAB.X) on a
+ *  PC with exact instruction-cycle counts, so delays and subroutines can be
+ *  timed without the MPLAB simulator.
+ *
+ *  Covers the standard PIC18 instruction set (XINST = OFF, as in every
+ *  myConfigFile.inc) plus the K42 additions used by pic-as: 6-bit MOVLB and
+ *  the three-word MOVFFL. Cycle counts follow the instruction set table:
+ *   - 1 cycle for most instructions
+ *   - 2 for GOTO, CALL, RCALL, BRA, RETURN, RETLW, RETFIE, MOVFF, LFSR,
+ *     TBLRD/TBLWT, taken conditional branches and writes to PCL
+ *   - 3 for MOVFFL
+ *   - a skip adds one cycle per skipped word, so skipping a two-word
+ *     instruction costs 3 cycles in total
+ *
+ *  Data memory is the full 16 KB space; SFRs are plain bytes except the core
+ *  registers (WREG, STATUS, BSR, FSRs, INDF/POSTINC/..., PCL, TBLPTR,
+ *  TABLAT, PROD, TOS, STKPTR) and the ports: reading PORTx returns LATx for
+ *  outputs and the level in pins[] for digital inputs (analog pins read 0),
+ *  and writing PORTx writes LATx.
+ *  SLEEP stops pic18_run() with the core marked asleep.
+ *
+ *  pic18_assemble() assembles pic-as sources straight into flash and RAM,
+ *  for code no MPLAB image has been built from (Common/bcd.s, and the
+ *  projects changed since their dist/ image). It takes the subset they are
+ *  written in: labels, EQU, #define (text substitution), #include "file",
+ *  #if/#ifdef/#ifndef/#else/#endif and #error (other preprocessor lines
+ *  are skipped), ORG and DB in abs psects, DS in
+ *  udata psects, BANKSEL, the byte, bit and literal instructions with w/f
+ *  and c/b (or 0/1) operands or pic-as's defaults, MOVFF, CALL, GOTO,
+ *  RCALL, BRA, the conditional branches, RETURN, SLEEP, NOP and the TBLRD
+ *  forms, and expressions with + - * / << >> ( ), low() and high(). PSECT,
+ *  GLOBAL, CONFIG and END only switch the section or are skipped.
+ */
+
+#ifndef PIC18_H
+#define PIC18_H
+
+#include <stdint.h>
+
+#define PIC18_FLASH_SIZE    0x20000     // 128 KB program flash
+#define PIC18_RAM_SIZE      0x4000      // 16 KB data space, SFRs at the top
+#define PIC18_STACK_DEPTH   31
+
+// SFR addresses used by the simulator and handy for assertions
+#define PIC18_PORTA     0x3FCA
+#define PIC18_PORTB     0x3FCB
+#define PIC18_PORTC     0x3FCC
+#define PIC18_PORTD     0x3FCD
+#define PIC18_PORTE     0x3FCE
+#define PIC18_TRISA     0x3FC2
+#define PIC18_LATA      0x3FBA
+#define PIC18_ANSELA    0x3A40      // ANSELB-ANSELE follow every 0x10
+#define PIC18_STATUS    0x3FD8
+#define PIC18_FSR2L     0x3FD9
+#define PIC18_PLUSW2    0x3FDB
+#define PIC18_INDF2     0x3FDF
+#define PIC18_BSR       0x3FE0
+#define PIC18_FSR1L     0x3FE1
+#define PIC18_PLUSW1    0x3FE3
+#define PIC18_INDF1     0x3FE7
+#define PIC18_WREG      0x3FE8
+#define PIC18_FSR0L     0x3FE9
+#define PIC18_PLUSW0    0x3FEB
+#define PIC18_INDF0     0x3FEF
+#define PIC18_PRODL     0x3FF3
+#define PIC18_PRODH     0x3FF4
+#define PIC18_TABLAT    0x3FF5
+#define PIC18_TBLPTRL   0x3FF6
+#define PIC18_TBLPTRH   0x3FF7
+#define PIC18_TBLPTRU   0x3FF8
+#define PIC18_PCL       0x3FF9
+#define PIC18_PCLATH    0x3FFA
+#define PIC18_PCLATU    0x3FFB
+#define PIC18_STKPTR    0x3FFC
+#define PIC18_TOSL      0x3FFD
+
+// STATUS bits
+#define PIC18_C     0x01
+#define PIC18_DC    0x02
+#define PIC18_Z     0x04
+#define PIC18_OV    0x08
+#define PIC18_N     0x10
+
+typedef struct {
+    uint8_t  flash[PIC18_FLASH_SIZE];
+    uint8_t  config[16];            // 0x300000-0x30000F
+    uint8_t  eeprom[1024];          // 0x310000-0x3103FF
+    uint8_t  ram[PIC18_RAM_SIZE];
+    uint32_t pc;
+    uint32_t stack[PIC18_STACK_DEPTH];
+    uint8_t  sp;                    // number of return addresses on the stack
+    uint8_t  shadow_w, shadow_status, shadow_bsr;
+    uint8_t  pins[5];               // levels driven onto PORTA-PORTE inputs
+    uint8_t  asleep;
+    uint64_t cycles;                // instruction cycles since reset
+} pic18_t;
+
+void pic18_reset(pic18_t *cpu);
+int pic18_load_hex(pic18_t *cpu, const char *path);
+long pic18_label(const char *asm_path, const char *sym_path, const char *label);
+long pic18_symbol(const char *sym_path, const char *name);
+long pic18_line(const char *sym_path, const char *file, long src_line);
+
+unsigned pic18_step(pic18_t *cpu);
+int pic18_run(pic18_t *cpu, uint64_t max_cycles);
+uint64_t pic18_call(pic18_t *cpu, uint32_t addr, uint64_t max_cycles);
+
+int pic18_assemble(pic18_t *cpu, const char *const *paths, int count, uint32_t code, uint16_t data);
+void pic18_asm_define(const char *name, const char *text);
+long pic18_asm_symbol(const char *name);
+
+uint8_t pic18_peek(const pic18_t *cpu, uint16_t addr);
+void pic18_poke(pic18_t *cpu, uint16_t addr, uint8_t value);
+
+#endif /* PIC18_H */
@@ -0,0 +1,205 @@
+/*
+ * Title: Profile dump decoder
+ * ---------------------
+ * Program Details:
+ *  Turns what PROF_DUMP() (Common/profile.h) sent out of the UART into a
+ *  table, one line per probe, and the trace of the last enters and exits:
+ *
+ *     prof_decode [file]     the bytes captured from the TX pin (default
+ *                            stdin)
+ *
+ *  Anything before a record's 'P' 'F' magic is skipped, so a capture can
+ *  start in the middle of other output; every record found is decoded,
+ *  and a bad one is reported and searched past.
+ *  Times are in us, from the counts per second in the record. The trace
+ *  is indented one step per probe still open, and gives each exit the
+ *  time since its enter; its stamps are 16 bits, so a gap of 65536 counts
+ *  or more between two entries shows up shorter by a multiple of that. Exits 1 if no record was found or one fails its
+ *  check.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define PROF_VERSION    1
+#define PROF_EXIT_FLAG  0x80
+#define MAX_PROBES      127
+#define NAME_WIDTH      16
+
+static uint8_t *data;
+static size_t size, pos;
+static uint8_t check;
+
+static int get(uint8_t *byte) {
+    if (pos >= size)
+        return 0;
+    *byte = data[pos++];
+    check += *byte;
+    return 1;
+}
+
+static int get16(uint16_t *value) {
+    uint8_t lo, hi;
+
+    if (!get(&lo) || !get(&hi))
+        return 0;
+    *value = (uint16_t)(lo | hi << 8);
+    return 1;
+}
+
+static int get32(uint32_t *value) {
+    uint16_t lo, hi;
+
+    if (!get16(&lo) || !get16(&hi))
+        return 0;
+    *value = lo | (uint32_t)hi << 16;
+    return 1;
+}
+
+// Name of probe id from the comma separated list, or "probe <id>"
+static const char *probe_name(const char *names, uint8_t id) {
+    static char name[NAME_WIDTH + 1];
+    const char *start = names;
+
+    for (uint8_t i = 0; i < id && start; i++) {
+        start = strchr(start, ',');
+        if (start)
+            start++;
+    }
+    if (!start || !*start || *start == ',') {
+        snprintf(name, sizeof name, "probe %u", id);
+        return name;
+    }
+    size_t length = strcspn(start, ",");
+    if (length > NAME_WIDTH)
+        length = NAME_WIDTH;
+    memcpy(name, start, length);
+    name[length] = 0;
+    return name;
+}
+
+// One record, pos just after its magic. Returns 0 if it is cut short or
+// fails its check.
+static int decode(void) {
+    uint8_t version, probes, entries, length, sum;
+    uint32_t rate;
+    char names[256];
+    struct {
+        uint32_t count, total;
+        uint16_t shortest, longest;
+    } stat[MAX_PROBES];
+    struct {
+        uint8_t id;
+        uint16_t stamp;
+    } trace[128];
+    int32_t opened[MAX_PROBES];         // stamp of the open enter, -1 if none
+
+    check = 0;
+    if (!get(&version) || version != PROF_VERSION || !get(&probes) || !get(&entries) ||
+        probes > MAX_PROBES || entries > 128 || !get32(&rate) || rate == 0 || !get(&length))
+        return 0;
+    for (uint8_t i = 0; i < length; i++)
+        if (!get((uint8_t *)&names[i]))
+            return 0;
+    names[length] = 0;
+    for (uint8_t i = 0; i < probes; i++)
+        if (!get32(&stat[i].count) || !get32(&stat[i].total) ||
+            !get16(&stat[i].shortest) || !get16(&stat[i].longest))
+            return 0;
+    for (uint8_t i = 0; i < entries; i++)
+        if (!get(&trace[i].id) || !get16(&trace[i].stamp))
+            return 0;
+    if (!get(&sum) || check != 0)
+        return 0;
+
+    double us = 1e6 / rate;
+    printf("profile: %u probes, Timer1 at %.3f MHz\n", probes, rate / 1e6);
+    printf("  %-*s %9s %11s %11s %11s %12s\n", NAME_WIDTH, "probe",
+           "count", "shortest", "average", "longest", "total");
+    for (uint8_t i = 0; i < probes; i++) {
+        printf("  %-*s %9u", NAME_WIDTH, probe_name(names, i), stat[i].count);
+        if (stat[i].count)
+            printf(" %8.0f us %8.1f us %8.0f us %9.3f ms\n", stat[i].shortest * us,
+                   (double)stat[i].total / stat[i].count * us, stat[i].longest * us,
+                   stat[i].total * us / 1000);
+        else
+            printf(" %11s %11s %11s %12s\n", "-", "-", "-", "-");
+    }
+
+    printf("  last %u enters/exits (us after the first):\n", entries);
+    for (uint8_t i = 0; i < probes; i++)
+        opened[i] = -1;
+    int depth = 0;
+    uint32_t since = 0;
+    for (uint8_t i = 0; i < entries; i++) {
+        uint8_t id = trace[i].id & (uint8_t)~PROF_EXIT_FLAG;
+        uint8_t leaving = trace[i].id & PROF_EXIT_FLAG;
+        if (i > 0)
+            since += (uint16_t)(trace[i].stamp - trace[i - 1].stamp);
+
+        if (leaving && depth > 0)
+            depth--;
+        printf("  %9.0f  %*s%c %s", since * us, 2 * depth, "", leaving ? '<' : '>',
+               probe_name(names, id));
+        if (leaving && id < probes && opened[id] >= 0)
+            printf(" (%.0f us)", (uint16_t)(trace[i].stamp - opened[id]) * us);
+        printf("\n");
+        if (!leaving) {
+            depth++;
+            if (id < probes)
+                opened[id] = trace[i].stamp;
+        } else if (id < probes) {
+            opened[id] = -1;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    FILE *in = stdin;
+    size_t room = 0;
+    int records = 0, bad = 0;
+
+    if (argc > 2) {
+        fprintf(stderr, "usage: prof_decode [file]\n");
+        return 2;
+    }
+    if (argc == 2 && !(in = fopen(argv[1], "rb"))) {
+        perror(argv[1]);
+        return 1;
+    }
+    for (;;) {
+        if (size == room) {
+            room = room ? 2 * room : 4096;
+            data = realloc(data, room);
+            if (!data)
+                return 1;
+        }
+        size_t got = fread(data + size, 1, room - size, in);
+        if (got == 0)
+            break;
+        size += got;
+    }
+
+    while (pos + 1 < size) {
+        if (data[pos] != 'P' || data[pos + 1] != 'F') {
+            pos++;
+            continue;
+        }
+        size_t start = pos;
+        pos += 2;
+        if (!decode()) {
+            fprintf(stderr, "prof_decode: record at byte %zu is cut short or fails its check\n",
+                    start);
+            pos = start + 1;
+            bad = 1;
+            continue;
+        }
+        records++;
+    }
+    if (records == 0)
+        fprintf(stderr, "prof_decode: no profile record\n");
+    return records == 0 || bad;
+}
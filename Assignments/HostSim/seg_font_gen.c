@@ -0,0 +1,180 @@
+/*
+ * Title: 7-segment font generator
+ * ---------------------
+ * Program Details:
+ *  Turns Common/seg_font.def into the tables the projects index, so C and
+ *  assembly show the same glyphs:
+ *
+ *     seg_font_gen -c [options] > seg_font.h     const tables for XC8
+ *     seg_font_gen -s [options] > seg_font.inc   DB tables for pic-as
+ *
+ *  Both hold <name>_font, 128 bytes indexed by ASCII code (blank where the
+ *  font has no glyph), and <name>_hex, 16 bytes indexed by value 0-15.
+ *  Options:
+ *     -p order   segment on each bit from bit 0, 8 of "abcdefgp"
+ *                (default "abcdefgp": a on bit 0 ... point on bit 7)
+ *     -l         lit is low (common anode); default lit is high
+ *     -n name    table prefix (default "seg")
+ *
+ *  "make font" writes the default pair into Common; another wiring gets
+ *  its own pair under another name, e.g.
+ *     seg_font_gen -c -l -p gfedcbap -n anode > ../Common/anode_font.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+static const struct {
+    char c;
+    const char *segments;
+} glyphs[] = {
+#define SEG_GLYPH(c, segments) {c, segments},
+#include "../Common/seg_font.def"
+#undef SEG_GLYPH
+};
+
+static const char *order = "abcdefgp";
+static const char *name = "seg";
+static int active_low = 0;
+
+static uint8_t encode(const char *segments) {
+    uint8_t bits = 0;
+
+    for (; *segments; segments++)
+        bits |= (uint8_t)(1u << (strchr(order, *segments) - order));
+    return active_low ? (uint8_t)~bits : bits;
+}
+
+// Glyph of c; a lowercase letter without one takes the uppercase one
+static const char *lookup(int c) {
+    for (size_t i = 0; i < sizeof glyphs / sizeof glyphs[0]; i++)
+        if (glyphs[i].c == c)
+            return glyphs[i].segments;
+    if (islower(c))
+        return lookup(toupper(c));
+    if (isupper(c))
+        return lookup(tolower(c));
+    return "";
+}
+
+static int usage(void) {
+    fprintf(stderr, "usage: seg_font_gen -c|-s [-p abcdefgp] [-l] [-n name]\n");
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    int lang = 0;
+    uint8_t font[128], hex[16];
+    char wiring[64];
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "-s") == 0)
+            lang = argv[i][1];
+        else if (strcmp(argv[i], "-l") == 0)
+            active_low = 1;
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            order = argv[++i];
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            name = argv[++i];
+        else
+            return usage();
+    }
+    if (!lang)
+        return usage();
+    if (strlen(order) != 8 || strspn(order, "abcdefgp") != 8) {
+        fprintf(stderr, "seg_font_gen: -p needs each of abcdefgp once\n");
+        return 2;
+    }
+    for (const char *s = "abcdefgp"; *s; s++)
+        if (!strchr(order, *s)) {
+            fprintf(stderr, "seg_font_gen: -p needs each of abcdefgp once\n");
+            return 2;
+        }
+    for (size_t i = 0; i < sizeof glyphs / sizeof glyphs[0]; i++)
+        if (glyphs[i].c < 0 || strspn(glyphs[i].segments, "abcdefgp") != strlen(glyphs[i].segments)) {
+            fprintf(stderr, "seg_font_gen: bad glyph for '%c'\n", glyphs[i].c);
+            return 1;
+        }
+
+    for (int c = 0; c < 128; c++)
+        font[c] = encode(c < ' ' || c == 127 ? "" : lookup(c));
+    for (int v = 0; v < 16; v++)
+        hex[v] = font[(int)"0123456789ABCDEF"[v]];
+
+    int n = snprintf(wiring, sizeof wiring, "bits 0-7: ");
+    for (int i = 0; i < 8; i++)
+        n += snprintf(wiring + n, sizeof wiring - (size_t)n, "%c", order[i] == 'p' ? '.' : order[i]);
+    snprintf(wiring + n, sizeof wiring - (size_t)n, ", lit = %s", active_low ? "low" : "high");
+
+    if (lang == 'c') {
+        char upper[48];
+        size_t i;
+        for (i = 0; name[i] && i < sizeof upper - 1; i++)
+            upper[i] = (char)toupper((unsigned char)name[i]);
+        upper[i] = '\0';
+
+        printf("/*\n");
+        printf(" * File:   %s_font.h\n", name);
+        printf(" * Generated by HostSim/seg_font_gen from Common/seg_font.def: edit the\n");
+        printf(" * .def and run \"make font\" in Assignments/HostSim, not this file.\n");
+        printf(" *\n");
+        printf(" * 7-segment font, %s.\n", wiring);
+        printf(" * %s_font is indexed by ASCII code, %s_hex by value, so every character\n", name, name);
+        printf(" * is one table read:\n");
+        printf(" *\n");
+        printf(" *   LATD = %s_GLYPH(c);     LATB = %s_hex[n & 0x0F];\n", upper, name);
+        printf(" *\n");
+        printf(" * A character the font has no glyph for is blank.\n");
+        printf(" */\n\n");
+        printf("#ifndef %s_FONT_H\n#define %s_FONT_H\n\n#include <stdint.h>\n\n", upper, upper);
+        printf("const uint8_t %s_font[128] = {\n", name);
+        for (int row = 0; row < 128; row += 8) {
+            printf("   ");
+            for (int c = row; c < row + 8; c++)
+                printf(" 0x%02X,", font[c]);
+            printf("    // ");
+            for (int c = row; c < row + 8; c++)
+                putchar(c < ' ' || c == 127 || c == '\\' ? '.' : c);
+            printf("\n");
+        }
+        printf("};\n\n");
+        printf("const uint8_t %s_hex[16] = {\n", name);
+        for (int row = 0; row < 16; row += 8) {
+            printf("   ");
+            for (int v = row; v < row + 8; v++)
+                printf(" 0x%02X,", hex[v]);
+            printf("\n");
+        }
+        printf("};\n\n");
+        printf("#define %s_GLYPH(c)      (%s_font[(uint8_t)(c) & 0x7F])\n\n", upper, name);
+        printf("#endif /* %s_FONT_H */\n", upper);
+    } else {
+        printf("; %s_font.inc: generated by HostSim/seg_font_gen from Common/seg_font.def,\n", name);
+        printf(";   edit the .def and run \"make font\" in Assignments/HostSim, not this file.\n");
+        printf("; 7-segment font, %s. Include it where the\n", wiring);
+        printf(";   tables go; from a 256-byte boundary both stay in one TBLPTRH page:\n");
+        printf(";     %s_hex    16 bytes, by value 0-15\n", name);
+        printf(";     %s_font   128 bytes, by ASCII code (no glyph: blank)\n", name);
+        printf("%s_hex:\n", name);
+        for (int row = 0; row < 16; row += 8) {
+            printf("    DB ");
+            for (int v = row; v < row + 8; v++)
+                printf("0x%02X%s", hex[v], v < row + 7 ? ", " : "");
+            printf("\t; %X-%X\n", row, row + 7);
+        }
+        printf("%s_font:\n", name);
+        for (int row = 0; row < 128; row += 8) {
+            printf("    DB ");
+            for (int c = row; c < row + 8; c++)
+                printf("0x%02X%s", font[c], c < row + 7 ? ", " : "");
+            printf("\t; 0x%02X ", row);
+            for (int c = row; c < row + 8; c++)
+                putchar(c < ' ' || c == 127 || c == ';' ? '.' : c);
+            printf("\n");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,1236 @@
+/*
+ * Title: Host simulation layer for the C projects
+ * ---------------------
+ * Program Details:
+ *  Storage for every simulated SFR plus the pin, keypad, ADC, LCD, timer and
+ *  interrupt models described in sim.h.
+ */
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <xc.h>
+
+// SFR storage, one union per entry of sim_sfr.def
+#define SFR(name, ...)          volatile __##name##bits_t name##bits;
+#define SFR2(name, ...)         volatile __##name##bits_t name##bits;
+#define SFR_HOOKED(name, ...)   volatile __##name##bits_t sim_##name;
+#define SFR2_HOOKED(name, ...)  volatile __##name##bits_t sim_##name;
+#define SFR_WIDE(name, type)    volatile type name;
+#include "sim_sfr.def"
+
+// The byte-wide SFRs in list order, which is address order for the pairs
+// (xxxL before xxxH), so DMA can step from one to the next
+static volatile uint8_t *const sfr_bus[] = {
+#define SFR(name, ...)          &name##bits.reg,
+#define SFR2(name, ...)         &name##bits.reg,
+#define SFR_HOOKED(name, ...)   &sim_##name.reg,
+#define SFR2_HOOKED(name, ...)  &sim_##name.reg,
+#include "sim_sfr.def"
+};
+
+uint64_t sim_cycles;
+uint32_t sim_fosc = 4000000;
+sim_stats_t sim_stats;
+
+// Ports A-E
+static volatile uint8_t *const port_reg[5] = {
+    &sim_PORTA.reg, &sim_PORTB.reg, &sim_PORTC.reg, &sim_PORTD.reg, &sim_PORTE.reg
+};
+static volatile uint8_t *const lat_reg[5] = {
+    &sim_LATA.reg, &sim_LATB.reg, &sim_LATC.reg, &sim_LATD.reg, &sim_LATE.reg
+};
+static volatile uint8_t *const tris_reg[5] = {
+    &TRISAbits.reg, &TRISBbits.reg, &TRISCbits.reg, &TRISDbits.reg, &TRISEbits.reg
+};
+static uint8_t port_seen[5];    // PORTx value handed out last time
+static uint8_t pin_level[5];    // levels driven onto the pins by the script
+
+// Interrupt-on-change (PORTD has none)
+static volatile uint8_t *const iocp_reg[5] = {
+    &IOCAPbits.reg, &IOCBPbits.reg, &IOCCPbits.reg, NULL, &IOCEPbits.reg
+};
+static volatile uint8_t *const iocn_reg[5] = {
+    &IOCANbits.reg, &IOCBNbits.reg, &IOCCNbits.reg, NULL, &IOCENbits.reg
+};
+static volatile uint8_t *const iocf_reg[5] = {
+    &IOCAFbits.reg, &IOCBFbits.reg, &IOCCFbits.reg, NULL, &IOCEFbits.reg
+};
+
+// Interrupt flags and enables, PIRn/PIEn at index n
+static volatile uint8_t *const pir_reg[] = {
+    &PIR0bits.reg, &PIR1bits.reg, &PIR2bits.reg, &PIR3bits.reg, &PIR4bits.reg,
+    &PIR5bits.reg, &PIR6bits.reg, &PIR7bits.reg, &PIR8bits.reg, &PIR9bits.reg
+};
+static volatile uint8_t *const pie_reg[] = {
+    &PIE0bits.reg, &PIE1bits.reg, &PIE2bits.reg, &PIE3bits.reg, &PIE4bits.reg,
+    &PIE5bits.reg, &PIE6bits.reg, &PIE7bits.reg, &PIE8bits.reg, &PIE9bits.reg
+};
+#define SIM_IRQS    (8 * sizeof pir_reg / sizeof pir_reg[0])
+static void (*irq_handler[SIM_IRQS])(void);
+static uint8_t in_isr;
+static uint8_t sleeping;
+
+// DMA channels, the registers of DMAn at index n - 1
+typedef struct {
+    volatile uint8_t *con0, *con1, *sirq, *buf, *pr;
+    volatile uintptr_t *ssa, *sptr, *dsa, *dptr;
+    volatile uint16_t *ssz, *scnt, *dsz, *dcnt;
+    uint8_t scnt_irq, dcnt_irq;
+} dma_regs_t;
+#define SIM_DMA_REGS(n)                                                        \
+    { &DMA##n##CON0bits.reg, &DMA##n##CON1bits.reg, &DMA##n##SIRQbits.reg,     \
+      &DMA##n##BUFbits.reg, &DMA##n##PRbits.reg,                               \
+      &DMA##n##SSA, &DMA##n##SPTR, &DMA##n##DSA, &DMA##n##DPTR,                \
+      &DMA##n##SSZ, &DMA##n##SCNT, &DMA##n##DSZ, &DMA##n##DCNT,                \
+      SIM_IRQ_DMA##n##SCNT, SIM_IRQ_DMA##n##DCNT }
+static const dma_regs_t dma[2] = { SIM_DMA_REGS(1), SIM_DMA_REGS(2) };
+
+// SSA/SSZ and DSA/DSZ the pointers and counts of each channel were last
+// loaded from
+typedef struct {
+    uintptr_t ssa, dsa;
+    uint16_t ssz, dsz;
+} dma_loaded_t;
+static dma_loaded_t dma_loaded[2];
+
+// Timer0: acc collects clock-source Hz x cycles, one count costs
+// Fcy x prescaler of it
+static struct {
+    uint64_t acc;
+    uint8_t post;               // postscaler outputs so far
+} tmr0;
+
+// Matrix keypad
+static struct {
+    uint8_t attached;
+    uint8_t port;
+    uint8_t rows, cols;
+    uint8_t row_bits[8], col_bits[8];
+    uint8_t down[8];            // bit c of down[r] = key (r, c) held
+} keypad;
+
+// Timer1 and Timer3, counted like Timer0
+typedef struct {
+    volatile uint8_t *con, *clk, *tmrl, *tmrh;
+    uint8_t irq;
+    uint8_t pmd;                // TMRnMD in PMD1
+    uint64_t acc;
+} tmr16_t;
+#define SIM_TMR16(n)                                                           \
+    { &T##n##CONbits.reg, &T##n##CLKbits.reg, &TMR##n##Lbits.reg,              \
+      &TMR##n##Hbits.reg, SIM_IRQ_TMR##n, 1u << n, 0 }
+static tmr16_t tmr16[2] = { SIM_TMR16(1), SIM_TMR16(3) };
+#define TMR16_COUNT (sizeof tmr16 / sizeof tmr16[0])
+#define TMR16_ON    0x01        // TxCON
+
+// Timer2, Timer4 and Timer6, counted like Timer0. A postscaler output
+// raises TMRnIF and sets fired (the ADC trigger looks at Timer2's).
+typedef struct {
+    volatile uint8_t *con, *clkcon, *hlt, *tmr, *pr;
+    uint8_t irq;
+    uint8_t pmd;                // TMRnMD in PMD1
+    uint64_t acc;
+    uint8_t post;
+    uint8_t fired;
+} tmrx_t;
+#define SIM_TMRX(n)                                                            \
+    { &T##n##CONbits.reg, &T##n##CLKCONbits.reg, &T##n##HLTbits.reg,           \
+      &T##n##TMRbits.reg, &T##n##PRbits.reg, SIM_IRQ_TMR##n, 1u << n, 0, 0, 0 }
+static tmrx_t tmrx[3] = { SIM_TMRX(2), SIM_TMRX(4), SIM_TMRX(6) };
+#define TMRX_COUNT  (sizeof tmrx / sizeof tmrx[0])
+#define TMRX_ON     0x80        // TxCON
+#define TMRX_ONE_SHOT 0x08      // TxHLT MODE: one-shot, started by software
+
+// Analog channels, indexed by ADPCH, each with an optional +/- noise
+static uint16_t analog_code[64];
+static uint16_t analog_noise[64];
+static uint32_t noise_seed;
+static uint8_t adc_busy;
+static uint64_t adc_done;
+static uint64_t adc_auto_done;  // end of a triggered burst, UINT64_MAX if none
+
+#define ADACT_TMR2  0x04        // ADACT value for the Timer2 postscaler output
+
+// Data EEPROM: contents and wear outlive sim_reset(), like a power cycle
+static uint8_t eeprom[SIM_EEPROM_SIZE];
+static uint32_t eeprom_wear[SIM_EEPROM_SIZE];
+static uint8_t eeprom_blank = 1;    // not initialised yet: erase on first reset
+static uint64_t nvm_done = UINT64_MAX; // end of the byte write, UINT64_MAX if none
+static uint16_t nvm_addr;
+
+#define NVM_RD      0x01            // NVMCON1
+#define NVM_WR      0x02
+#define NVM_WREN    0x04
+#define NVM_REG     0xC0            // 00 = data EEPROM
+
+// UART1 transmitter: one byte of buffer in front of the shift register
+static struct {
+    uint8_t written;            // U1TXB was handed out: take it at the next step
+    uint8_t buf_full, buf;
+    uint8_t shift;
+    uint64_t shift_done;        // end of the byte being sent, UINT64_MAX if none
+    uint32_t count;             // bytes kept in uart_out
+} uart;
+static uint8_t uart_out[SIM_UART_CAPTURE];
+
+// HD44780 in 8-bit mode
+static struct {
+    uint8_t attached;
+    uint8_t data_port, ctrl_port, rs_bit, en_bit;
+    uint8_t en_was_high;
+    uint8_t addr;
+    uint64_t ready_at;          // cycle the last byte has finished executing
+    uint8_t ddram[128];
+    char line[2][21];
+} lcd;
+
+// Output pin watched for its first rising edge
+static struct {
+    uint8_t armed, port, bit;
+    uint64_t at;
+} watch;
+
+// Scripted events, kept sorted by time
+#define SIM_MAX_EVENTS  256
+enum { EV_PIN, EV_ANALOG, EV_KEY };
+static struct {
+    uint64_t at;
+    uint8_t kind, a, b;
+    uint16_t c;
+} events[SIM_MAX_EVENTS];
+static uint16_t event_count;
+
+// Budget for sim_run()
+static jmp_buf run_exit;
+static uint64_t run_deadline = UINT64_MAX;
+
+static void apply_event(uint16_t i) {
+    switch (events[i].kind) {
+        case EV_PIN:    sim_pin(events[i].a, events[i].b, (uint8_t)events[i].c); break;
+        case EV_ANALOG: sim_analog(events[i].a, events[i].c); break;
+        case EV_KEY:    sim_key(events[i].a, events[i].b, (uint8_t)events[i].c); break;
+    }
+}
+
+static void sync_pins(void);
+
+// Fosc is only stopped by SLEEP proper; in Idle (IDLEN) it keeps running
+static int fosc_stopped(void) {
+    return sleeping && !CPUDOZEbits.IDLEN;
+}
+
+// A module whose PMDx bit is set is held off: it does not run (its
+// registers are not cleared, as they would be on the chip)
+#define PMD_OFF(pmd, mask)  ((pmd##bits.reg & (mask)) != 0)
+
+// Clock cycles n instruction cycles take: in Doze the core runs one in
+// 2^(DOZE + 1)
+static uint64_t cpu_cycles(uint64_t n) {
+    if (CPUDOZEbits.DOZEN)
+        return n << ((CPUDOZEbits.reg & 0x07) + 1);
+    return n;
+}
+
+// Next address of a DMA pointer, SMODE/DMODE 1 counting up and 2 down. An
+// SFR steps to its neighbour in sfr_bus[], anything else (RAM) by a byte.
+static uintptr_t dma_step(uintptr_t addr, uint8_t mode) {
+    const size_t count = sizeof sfr_bus / sizeof sfr_bus[0];
+    int step = mode == 1 ? 1 : mode == 2 ? -1 : 0;
+
+    if (step == 0)
+        return addr;
+    for (size_t i = 0; i < count; i++) {
+        if ((uintptr_t)sfr_bus[i] == addr)
+            return (i + step < count) ? (uintptr_t)sfr_bus[i + step] : addr;
+    }
+    return addr + step;
+}
+
+static void irq_raise(uint8_t irq);
+static void uart_take(void);
+
+/*
+ * One DMA trigger: bytes go from SPTR to DPTR (through DMAxBUF) until SCNT
+ * or DCNT reaches 0. A count that runs out reloads its pointer and count
+ * from SSA/SSZ or DSA/DSZ and raises its flag once the transfer is over;
+ * SSTP/DSTP also clear SIRQEN. Counters left at 0 (after reset) are loaded
+ * by the first trigger, and so are ones whose SSA/SSZ or DSA/DSZ were
+ * changed since (on the chip the firmware turns EN off and on for that).
+ * A byte written to U1TXB is sent like one the CPU wrote.
+ */
+static void dma_run(const dma_regs_t *d) {
+    uint8_t smode = (*d->con1 >> 1) & 0x03;
+    uint8_t dmode = (*d->con1 >> 6) & 0x03;
+    uint8_t src_done = 0, dst_done = 0;
+    dma_loaded_t *loaded = &dma_loaded[d - dma];
+
+    if (*d->scnt == 0 || *d->ssa != loaded->ssa || *d->ssz != loaded->ssz) {
+        *d->sptr = loaded->ssa = *d->ssa;
+        *d->scnt = loaded->ssz = *d->ssz;
+    }
+    if (*d->dcnt == 0 || *d->dsa != loaded->dsa || *d->dsz != loaded->dsz) {
+        *d->dptr = loaded->dsa = *d->dsa;
+        *d->dcnt = loaded->dsz = *d->dsz;
+    }
+    if (*d->scnt == 0 || *d->dcnt == 0)
+        return;
+
+    *d->con0 |= 0x20;                               // DGO
+    while (!src_done && !dst_done) {
+        *d->buf = *(volatile uint8_t *)*d->sptr;
+        *(volatile uint8_t *)*d->dptr = *d->buf;
+        if (*d->dptr == (uintptr_t)&sim_U1TXB.reg)
+            uart_take();
+        sim_stats.dma_bytes++;
+        *d->sptr = dma_step(*d->sptr, smode);
+        *d->dptr = dma_step(*d->dptr, dmode);
+        if (--*d->scnt == 0) {
+            *d->sptr = *d->ssa;
+            *d->scnt = *d->ssz;
+            src_done = 1;
+        }
+        if (--*d->dcnt == 0) {
+            *d->dptr = *d->dsa;
+            *d->dcnt = *d->dsz;
+            dst_done = 1;
+        }
+    }
+    *d->con0 &= (uint8_t)~0x20;
+    if ((src_done && (*d->con1 & 0x01)) || (dst_done && (*d->con1 & 0x20)))
+        *d->con0 &= (uint8_t)~0x40;                 // SSTP/DSTP: SIRQEN off
+    if (src_done)
+        irq_raise(d->scnt_irq);
+    if (dst_done)
+        irq_raise(d->dcnt_irq);
+}
+
+// Sets an interrupt flag and starts every DMA channel waiting for it,
+// the one with the lower DMAxPR first
+static void irq_raise(uint8_t irq) {
+    uint8_t first = (*dma[1].pr < *dma[0].pr) ? 1 : 0;
+
+    *pir_reg[irq >> 3] |= (uint8_t)(1u << (irq & 7));
+    for (uint8_t i = 0; i < 2; i++) {
+        const dma_regs_t *d = &dma[i ^ first];
+        if ((*d->con0 & 0xC0) != 0xC0 || *d->sirq != irq || !PRLOCKbits.PRLOCKED ||
+            PMD_OFF(PMD7, 1u << (i ^ first)))
+            continue;
+        if (fosc_stopped())
+            sim_stats.dma_lost++;
+        else
+            dma_run(d);
+    }
+}
+
+// Timer0 clock in Hz, or 0 while it is stopped
+static uint32_t tmr0_clock(void) {
+    uint8_t cs = T0CON1bits.reg >> 5;
+    uint8_t runs = T0CON1bits.ASYNC || !fosc_stopped();
+
+    if (!T0CON0bits.EN || PMD_OFF(PMD1, _PMD1_TMR0MD_MASK))
+        return 0;
+    switch (cs) {
+        case 2: return fosc_stopped() ? 0 : sim_fosc / 4;  // Fosc/4
+        case 3: return fosc_stopped() ? 0 : sim_fosc;      // HFINTOSC
+        case 4: return runs ? SIM_LFINTOSC_HZ : 0;
+        case 5: return runs ? SIM_MFINTOSC_HZ : 0;
+        case 6: return runs ? SIM_SOSC_HZ : 0;
+        default: return 0;                              // T0CKI, CLC1
+    }
+}
+
+static uint64_t tmr0_unit(void) {
+    return (uint64_t)(sim_fosc / 4) << (T0CON1bits.reg & 0x0F);
+}
+
+// Counts left until the next output pulse; in 8-bit mode the count after
+// TMR0L == TMR0H resets TMR0L
+static uint32_t tmr0_to_output(void) {
+    if (T0CON0bits.MD16)
+        return 65536u - (((uint32_t)TMR0H << 8) | TMR0L);
+    return (uint8_t)(TMR0H - TMR0L) + 1u;
+}
+
+static void tmr0_count(uint64_t n) {
+    while (n > 0) {
+        uint32_t left = tmr0_to_output();
+        if (n < left) {
+            uint32_t value = (T0CON0bits.MD16 ? ((uint32_t)TMR0H << 8) | TMR0L : TMR0L) + (uint32_t)n;
+            if (T0CON0bits.MD16)
+                TMR0H = (uint8_t)(value >> 8);
+            TMR0L = (uint8_t)value;
+            return;
+        }
+        n -= left;
+        TMR0L = 0;
+        if (T0CON0bits.MD16)
+            TMR0H = 0;
+        if (++tmr0.post > (T0CON0bits.reg & 0x0F)) {
+            tmr0.post = 0;
+            irq_raise(SIM_IRQ_TMR0);
+        }
+    }
+}
+
+// Cycles until Timer0 next raises TMR0IF, or UINT64_MAX if it is stopped
+static uint64_t tmr0_next(void) {
+    uint32_t hz = tmr0_clock();
+
+    if (hz == 0)
+        return UINT64_MAX;
+    uint8_t outps = T0CON0bits.reg & 0x0F;
+    uint32_t period = T0CON0bits.MD16 ? 65536u : TMR0H + 1u;
+    uint64_t counts = tmr0_to_output() +
+                      (uint64_t)(tmr0.post < outps ? outps - tmr0.post : 0) * period;
+    return (counts * tmr0_unit() - tmr0.acc + hz - 1) / hz;
+}
+
+// Timer1/3 clock in Hz, or 0 while it is stopped. As with Timer2, the
+// internal oscillators keep it running in Sleep (nSYNC set).
+static uint32_t tmr16_clock(const tmr16_t *t) {
+    if (!(*t->con & TMR16_ON) || PMD_OFF(PMD1, t->pmd))
+        return 0;
+    switch (*t->clk & 0x1F) {
+        case 1: return fosc_stopped() ? 0 : sim_fosc / 4;  // Fosc/4
+        case 2:                                             // Fosc
+        case 3: return fosc_stopped() ? 0 : sim_fosc;      // HFINTOSC
+        case 4: return SIM_LFINTOSC_HZ;
+        case 5: return SIM_MFINTOSC_HZ;
+        default: return 0;                              // T1CKI, SOSC, ...
+    }
+}
+
+static uint64_t tmr16_unit(const tmr16_t *t) {
+    return (uint64_t)(sim_fosc / 4) << ((*t->con >> 4) & 0x03);
+}
+
+// TMRxH:TMRxL counts up; the count after 0xFFFF raises TMRxIF
+static void tmr16_count(tmr16_t *t, uint64_t n) {
+    uint32_t value = ((uint32_t)*t->tmrh << 8) | *t->tmrl;
+
+    value += (uint32_t)(n % 65536u);
+    if (n >= 65536u || value > 0xFFFFu)
+        irq_raise(t->irq);
+    *t->tmrh = (uint8_t)(value >> 8);
+    *t->tmrl = (uint8_t)value;
+}
+
+// Cycles until the timer overflows, or UINT64_MAX if it is stopped or its
+// interrupt is off (then only the count, or the flag, is read, which needs
+// no stop)
+static uint64_t tmr16_next(const tmr16_t *t) {
+    uint32_t hz = tmr16_clock(t);
+
+    if (hz == 0 || !((*pie_reg[t->irq >> 3] >> (t->irq & 7)) & 1))
+        return UINT64_MAX;
+    uint64_t counts = 65536u - (((uint32_t)*t->tmrh << 8) | *t->tmrl);
+    return (counts * tmr16_unit(t) - t->acc + hz - 1) / hz;
+}
+
+// Timer2/4/6 clock in Hz, or 0 while it is stopped. The internal
+// oscillators keep it running in Sleep (asynchronous, PSYNC = 0).
+static uint32_t tmrx_clock(const tmrx_t *t) {
+    if (!(*t->con & TMRX_ON) || PMD_OFF(PMD1, t->pmd))
+        return 0;
+    switch (*t->clkcon & 0x0F) {
+        case 1: return fosc_stopped() ? 0 : sim_fosc / 4;  // Fosc/4
+        case 2:                                             // Fosc
+        case 3: return fosc_stopped() ? 0 : sim_fosc;      // HFINTOSC
+        case 4: return SIM_LFINTOSC_HZ;
+        case 5: return SIM_MFINTOSC_HZ;
+        default: return 0;
+    }
+}
+
+static uint64_t tmrx_unit(const tmrx_t *t) {
+    return (uint64_t)(sim_fosc / 4) << ((*t->con >> 4) & 0x07);
+}
+
+// The count after TxTMR == TxPR resets TxTMR and clocks the postscaler;
+// in one-shot mode that output also turns the timer off
+static void tmrx_count(tmrx_t *t, uint64_t n) {
+    while (n > 0) {
+        uint32_t left = (uint8_t)(*t->pr - *t->tmr) + 1u;
+        if (n < left) {
+            *t->tmr = (uint8_t)(*t->tmr + n);
+            return;
+        }
+        n -= left;
+        *t->tmr = 0;
+        if (++t->post > (*t->con & 0x0F)) {
+            t->post = 0;
+            t->fired = 1;
+            irq_raise(t->irq);
+            if ((*t->hlt & 0x1F) == TMRX_ONE_SHOT) {
+                *t->con &= (uint8_t)~TMRX_ON;
+                return;
+            }
+        }
+    }
+}
+
+// A DMA channel is on and started by irq
+static uint8_t dma_waits(uint8_t irq) {
+    for (uint8_t i = 0; i < 2; i++) {
+        if ((*dma[i].con0 & 0xC0) == 0xC0 && *dma[i].sirq == irq)
+            return 1;
+    }
+    return 0;
+}
+
+// Cycles until the next postscaler output, or UINT64_MAX if the timer is
+// stopped or nothing listens to it (its interrupt, the ADC trigger or a
+// DMA channel)
+static uint64_t tmrx_next(const tmrx_t *t) {
+    uint32_t hz = tmrx_clock(t);
+    uint8_t listened = (*pie_reg[t->irq >> 3] >> (t->irq & 7)) & 1;
+
+    if ((t == &tmrx[0] && ADACT == ADACT_TMR2) || dma_waits(t->irq))
+        listened = 1;
+    if (hz == 0 || !listened)
+        return UINT64_MAX;
+    uint8_t outps = *t->con & 0x0F;
+    uint64_t counts = (uint8_t)(*t->pr - *t->tmr) + 1u +
+                      (uint64_t)(t->post < outps ? outps - t->post : 0) * (*t->pr + 1u);
+    return (counts * tmrx_unit(t) - t->acc + hz - 1) / hz;
+}
+
+static void run_peripherals(uint64_t cycles) {
+    uint32_t hz = tmr0_clock();
+
+    if (!T0CON0bits.EN) {
+        tmr0.acc = 0;
+        tmr0.post = 0;
+    } else if (hz != 0) {
+        uint64_t unit = tmr0_unit();
+        tmr0.acc += cycles * hz;
+        tmr0_count(tmr0.acc / unit);
+        tmr0.acc %= unit;
+    }
+
+    for (uint8_t i = 0; i < TMR16_COUNT; i++) {
+        tmr16_t *t = &tmr16[i];
+        uint32_t hz16 = tmr16_clock(t);
+        if (!(*t->con & TMR16_ON)) {
+            t->acc = 0;
+        } else if (hz16 != 0) {
+            uint64_t unit = tmr16_unit(t);
+            t->acc += cycles * hz16;
+            tmr16_count(t, t->acc / unit);
+            t->acc %= unit;
+        }
+    }
+
+    for (uint8_t i = 0; i < TMRX_COUNT; i++) {
+        tmrx_t *t = &tmrx[i];
+        uint32_t hzx = tmrx_clock(t);
+        if (!(*t->con & TMRX_ON)) {
+            t->acc = 0;
+            t->post = 0;
+        } else if (hzx != 0) {
+            uint64_t unit = tmrx_unit(t);
+            t->acc += cycles * hzx;
+            tmrx_count(t, t->acc / unit);
+            t->acc %= unit;
+        }
+    }
+}
+
+// One conversion of the selected channel, with its scripted noise
+static uint16_t adc_sample(void) {
+    uint8_t ch = ADPCH & 0x3F;
+    int32_t code = analog_code[ch];
+
+    if (analog_noise[ch]) {
+        noise_seed = noise_seed * 1103515245u + 12345u;
+        code += (int32_t)((noise_seed >> 16) % (2u * analog_noise[ch] + 1u)) - analog_noise[ch];
+    }
+    if (code < 0)
+        code = 0;
+    if (code > 0x0FFF)
+        code = 0x0FFF;
+    return (uint16_t)code;
+}
+
+// Conversions one GO or trigger starts: ADRPT in burst average mode
+static uint8_t adc_burst(void) {
+    return (ADCON2bits.reg & 0x07) == 3 && ADRPT ? ADRPT : 1;
+}
+
+// Threshold test of ADERR against ADLTH/ADUTH, by ADCON3.TMD
+static uint8_t adc_threshold(int16_t err) {
+    int16_t lth = (int16_t)(((uint16_t)ADLTHH << 8) | ADLTHL);
+    int16_t uth = (int16_t)(((uint16_t)ADUTHH << 8) | ADUTHL);
+
+    ADSTATbits.LTHR = err < lth;
+    ADSTATbits.UTHR = err > uth;
+    switch (ADCON3bits.reg & 0x07) {
+        case 1: return err < lth;
+        case 2: return err >= lth;
+        case 3: return err < lth || err > uth;
+        case 4: return err >= lth && err <= uth;
+        case 5: return err <= uth;
+        case 6: return err > uth;
+        case 7: return 1;
+        default: return 0;
+    }
+}
+
+/*
+ * Result of one conversion through the computation engine (ADCON2.MD):
+ * basic, accumulate, average, burst average (ADRPT conversions per GO or
+ * trigger) and low-pass filter. Average and burst average start over once
+ * ADCNT has reached ADRPT. ADERR (ADCON3.CALC) and the threshold test run
+ * after every conversion in basic and accumulate mode, and once ADRPT
+ * samples are in for the others.
+ */
+static void adc_compute(uint16_t res) {
+    uint8_t md = ADCON2bits.reg & 0x07;
+    uint8_t crs = (ADCON2bits.reg >> 4) & 0x07;
+    uint16_t old = (uint16_t)(((uint16_t)ADRESH << 8) | ADRESL);
+    uint32_t acc = ((uint32_t)ADACCU << 16) | ((uint16_t)ADACCH << 8) | ADACCL;
+    int16_t flt = (int16_t)(((uint16_t)ADFLTRH << 8) | ADFLTRL);
+    int16_t stpt = (int16_t)(((uint16_t)ADSTPTH << 8) | ADSTPTL);
+    uint16_t prev = ADCON2bits.PSIS ? (uint16_t)flt : old;
+    uint8_t done = 1;
+    int16_t err;
+
+    if (!sim_ADCON0.FM)
+        old >>= 4;                                  // left justified
+    if (ADCON2bits.ACLR || ((md == 2 || md == 3) && ADCNT >= ADRPT)) {
+        acc = 0;
+        ADCNT = 0;
+        ADCON2bits.ACLR = 0;
+    }
+    if (sim_ADCON0.FM) {
+        ADRESH = (uint8_t)(res >> 8);
+        ADRESL = (uint8_t)res;
+    } else {
+        ADRESH = (uint8_t)(res >> 4);
+        ADRESL = (uint8_t)(res << 4);
+    }
+    ADPREVH = (uint8_t)(prev >> 8);
+    ADPREVL = (uint8_t)prev;
+
+    if (md != 0) {
+        if (md == 4)
+            acc = acc - (acc >> crs) + res;
+        else
+            acc += res;
+        acc &= 0x3FFFF;
+        if (ADCNT < 255)
+            ADCNT++;
+        if (md >= 2) {
+            done = ADCNT >= ADRPT;
+            if (done || md == 4)
+                flt = (int16_t)(acc >> crs);
+        }
+        ADACCU = (uint8_t)(acc >> 16);
+        ADACCH = (uint8_t)(acc >> 8);
+        ADACCL = (uint8_t)acc;
+        ADFLTRH = (uint8_t)((uint16_t)flt >> 8);
+        ADFLTRL = (uint8_t)flt;
+    }
+    irq_raise(SIM_IRQ_AD);
+    sim_stats.adc_conversions++;
+    if (!done)
+        return;
+
+    switch ((ADCON3bits.reg >> 4) & 0x07) {
+        case 0: err = (int16_t)(res - prev); break;         // ADRES - ADPREV
+        case 1: err = (int16_t)(res - stpt); break;         // ADRES - ADSTPT
+        case 4: err = (int16_t)(prev - flt); break;         // ADPREV - ADFLTR
+        case 5: err = (int16_t)(flt - stpt); break;         // ADFLTR - ADSTPT
+        default: err = 0; break;
+    }
+    ADERRH = (uint8_t)((uint16_t)err >> 8);
+    ADERRL = (uint8_t)err;
+    ADSTATbits.MATH = 1;
+    if (adc_threshold(err))
+        irq_raise(SIM_IRQ_ADT);
+
+    double result = md >= 2 ? flt : res;
+    sim_stats.adc_results++;
+    sim_stats.adc_result_sum += result;
+    sim_stats.adc_result_sq += result * result;
+}
+
+// Auto-conversion: a Timer2 output starts a burst if the ADC is free and
+// has a clock (ADCRC runs in Sleep); the burst ends SIM_ADC_CYCLES per
+// conversion later
+static void adc_auto(void) {
+    if (tmrx[0].fired) {
+        tmrx[0].fired = 0;
+        if (ADACT == ADACT_TMR2 && sim_ADCON0.ON && !PMD_OFF(PMD2, _PMD2_ADCMD_MASK) &&
+            adc_auto_done == UINT64_MAX &&
+            (sim_ADCON0.CS || !fosc_stopped()))
+            adc_auto_done = sim_cycles + (uint64_t)SIM_ADC_CYCLES * adc_burst();
+    }
+    if (sim_cycles >= adc_auto_done) {
+        for (uint8_t i = adc_burst(); i > 0; i--)
+            adc_compute(adc_sample());
+        adc_auto_done = UINT64_MAX;
+    }
+}
+
+// WR seen: start the byte write; SIM_EE_WRITE_MS later it is done, WR
+// clears and NVMIF goes up (the EEPROM needs no Fosc, so also in Sleep)
+static void nvm_step(void) {
+    if ((sim_NVMCON1.reg & NVM_WR) && nvm_done == UINT64_MAX) {
+        if (!(sim_NVMCON1.reg & NVM_WREN) || (sim_NVMCON1.reg & NVM_REG) || PMD_OFF(PMD0, _PMD0_NVMMD_MASK)) {
+            sim_NVMCON1.reg &= (uint8_t)~NVM_WR;
+            return;
+        }
+        nvm_addr = (uint16_t)(((NVMADRHbits.reg << 8) | NVMADRLbits.reg) % SIM_EEPROM_SIZE);
+        nvm_done = sim_cycles + sim_ms(SIM_EE_WRITE_MS);
+    }
+    if (sim_cycles >= nvm_done) {
+        eeprom[nvm_addr] = sim_NVMDAT.reg;
+        eeprom_wear[nvm_addr]++;
+        sim_stats.ee_writes++;
+        sim_NVMCON1.reg &= (uint8_t)~NVM_WR;
+        nvm_done = UINT64_MAX;
+        irq_raise(SIM_IRQ_NVM);
+    }
+}
+
+static int uart_on(void) {
+    return U1CON1bits.ON && U1CON0bits.TXEN && !PMD_OFF(PMD6, _PMD6_U1MD_MASK);
+}
+
+// Instruction cycles per byte: start, 8 data and stop bits of
+// (U1BRG + 1) x 4 (BRGS) or x 16 Fosc clocks each
+static uint64_t uart_byte_cycles(void) {
+    uint32_t brg = ((uint32_t)U1BRGHbits.reg << 8) | U1BRGLbits.reg;
+
+    return 10ull * (brg + 1) * (U1CON0bits.BRGS ? 1 : 4);
+}
+
+// The byte in U1TXB goes into the buffer, or is lost if that is full
+static void uart_take(void) {
+    if (uart.buf_full) {
+        sim_stats.uart_overruns++;
+    } else {
+        uart.buf = sim_U1TXB.reg;
+        uart.buf_full = 1;
+    }
+}
+
+// A byte written to U1TXB goes into the buffer, the buffer moves into the
+// shift register once that is free, and the status bits follow. U1TXIF is
+// up while the buffer is empty, and raised again at every step, so a DMA
+// channel it triggers keeps filling the buffer as it empties.
+static void uart_step(void) {
+    if (uart.written) {
+        uart.written = 0;
+        uart_take();
+    }
+    if (sim_cycles >= uart.shift_done) {
+        if (uart.count < SIM_UART_CAPTURE)
+            uart_out[uart.count++] = uart.shift;
+        sim_stats.uart_bytes++;
+        sim_stats.uart_last = uart.shift_done;
+        uart.shift_done = UINT64_MAX;
+    }
+    for (;;) {
+        if (uart.buf_full && uart.shift_done == UINT64_MAX && uart_on() && !fosc_stopped()) {
+            uart.shift = uart.buf;
+            uart.buf_full = 0;
+            uart.shift_done = sim_cycles + uart_byte_cycles();
+        }
+        sim_U1FIFO.TXBF = uart.buf_full;
+        sim_U1FIFO.TXBE = !uart.buf_full;
+        U1ERRIRbits.TXMTIF = !uart.buf_full && uart.shift_done == UINT64_MAX;
+        if (!uart_on() || uart.buf_full) {
+            PIR3bits.U1TXIF = 0;
+            return;
+        }
+        irq_raise(SIM_IRQ_U1TX);
+        if (!uart.buf_full)
+            return;                 // no DMA wrote it
+    }
+}
+
+static int irq_pending(uint8_t irq) {
+    return (*pir_reg[irq >> 3] & *pie_reg[irq >> 3]) >> (irq & 7) & 1;
+}
+
+// Any enabled flag wakes the core from SLEEP, whatever GIE says
+static int wake_pending(void) {
+    for (uint8_t i = 0; i < sizeof pir_reg / sizeof pir_reg[0]; i++)
+        if (*pir_reg[i] & *pie_reg[i])
+            return 1;
+    return 0;
+}
+
+static void advance(uint64_t cycles);
+
+// Runs the handler of every pending vector, lowest number first, and
+// returns the cycles that took. ISRs do not nest.
+static uint64_t take_interrupts(void) {
+    uint64_t start = sim_cycles;
+
+    if (in_isr || sleeping || !INTCON0bits.GIE)
+        return 0;
+    for (uint8_t irq = 0; irq < SIM_IRQS; irq++) {
+        if (!irq_handler[irq] || !irq_pending(irq))
+            continue;
+        in_isr = 1;
+        sim_stats.interrupts++;
+        if (CPUDOZEbits.ROI)
+            CPUDOZEbits.DOZEN = 0;      // full speed for the ISR
+        advance(cpu_cycles(SIM_IRQ_LATENCY));
+        irq_handler[irq]();
+        sync_pins();
+        if (CPUDOZEbits.DOE)
+            CPUDOZEbits.DOZEN = 1;      // back to Doze on the return
+        in_isr = 0;
+        irq = (uint8_t)-1;      // rescan from vector 0
+    }
+    return sim_cycles - start;
+}
+
+// Earliest of the end of the step, the next event and the next timer flag
+static uint64_t next_stop(uint64_t target) {
+    uint64_t stop = target;
+    uint64_t timer = tmr0_next();
+
+    if (event_count > 0 && events[0].at > sim_cycles && events[0].at < stop)
+        stop = events[0].at;
+    if (timer != UINT64_MAX && sim_cycles + timer < stop)
+        stop = sim_cycles + timer;
+    for (uint8_t i = 0; i < TMR16_COUNT; i++) {
+        uint64_t timer16 = tmr16_next(&tmr16[i]);
+        if (timer16 != UINT64_MAX && sim_cycles + timer16 < stop)
+            stop = sim_cycles + timer16;
+    }
+    for (uint8_t i = 0; i < TMRX_COUNT; i++) {
+        uint64_t timerx = tmrx_next(&tmrx[i]);
+        if (timerx != UINT64_MAX && sim_cycles + timerx < stop)
+            stop = sim_cycles + timerx;
+    }
+    if (adc_auto_done > sim_cycles && adc_auto_done < stop)
+        stop = adc_auto_done;
+    if (nvm_done > sim_cycles && nvm_done < stop)
+        stop = nvm_done;
+    if (uart.shift_done > sim_cycles && uart.shift_done < stop)
+        stop = uart.shift_done;
+    if (run_deadline < stop)
+        stop = run_deadline;
+    return stop;
+}
+
+// Advances the clock, firing every event that falls inside the step and
+// taking interrupts at the cycle their flag goes up. Time spent in an ISR
+// lengthens the step, like an ISR stretches a delay loop on the chip.
+static void advance(uint64_t cycles) {
+    uint64_t target = sim_cycles + cycles;
+
+    while (sim_cycles < target) {
+        uint64_t stop = next_stop(target);
+        run_peripherals(stop - sim_cycles);
+        if (sleeping)
+            sim_stats.sleep_cycles += stop - sim_cycles;
+        else if (CPUDOZEbits.DOZEN)
+            sim_stats.doze_cycles += stop - sim_cycles;
+        sim_cycles = stop;
+        adc_auto();
+        nvm_step();
+        uart_step();
+        while (event_count > 0 && events[0].at <= sim_cycles) {
+            apply_event(0);
+            event_count--;
+            memmove(&events[0], &events[1], event_count * sizeof events[0]);
+        }
+        if (sim_cycles >= run_deadline)
+            longjmp(run_exit, 1);
+        sync_pins();
+        target += take_interrupts();
+    }
+}
+
+static void event_add(uint64_t at, uint8_t kind, uint8_t a, uint8_t b, uint16_t c) {
+    uint16_t i = event_count;
+
+    if (event_count == SIM_MAX_EVENTS)
+        return;
+    while (i > 0 && events[i - 1].at > at) {
+        events[i] = events[i - 1];
+        i--;
+    }
+    events[i].at = at;
+    events[i].kind = kind;
+    events[i].a = a;
+    events[i].b = b;
+    events[i].c = c;
+    event_count++;
+}
+
+static void lcd_latch(uint8_t rs, uint8_t value) {
+    uint32_t exec_us = (!rs && value >= 0x01 && value <= 0x03) ? 1520 : 37;
+
+    if (sim_cycles < lcd.ready_at)
+        sim_stats.lcd_overruns++;
+    lcd.ready_at = sim_cycles + (uint64_t)exec_us * (sim_fosc / 4000000u);
+
+    if (!rs) {
+        sim_stats.lcd_commands++;
+        if (value & 0x80) {
+            lcd.addr = value & 0x7F;                // set DDRAM address
+        } else if (value == 0x01) {
+            memset(lcd.ddram, ' ', sizeof lcd.ddram);   // clear display
+            lcd.addr = 0;
+        } else if ((value & 0xFE) == 0x02) {
+            lcd.addr = 0;                           // return home
+        }
+        return;
+    }
+    if (sim_stats.lcd_chars++ == 0)
+        sim_stats.lcd_first_char = sim_cycles;
+    lcd.ddram[lcd.addr & 0x7F] = value;
+    lcd.addr = (lcd.addr == 0x27) ? 0x40 : (lcd.addr == 0x67) ? 0x00 : lcd.addr + 1;
+}
+
+// Brings PORTx and the LCD up to date with LATx/TRISx and the script
+static void sync_pins(void) {
+    for (uint8_t p = 0; p < 5; p++) {
+        if (*port_reg[p] != port_seen[p])
+            *lat_reg[p] = *port_reg[p];             // a write to PORTx lands in LATx
+
+        uint8_t in = pin_level[p];
+        if (keypad.attached && keypad.port == p) {
+            for (uint8_t r = 0; r < keypad.rows; r++) {
+                uint8_t row = keypad.row_bits[r];
+                uint8_t driven_low = !((*tris_reg[p] >> row) & 1) && !((*lat_reg[p] >> row) & 1);
+                for (uint8_t c = 0; driven_low && c < keypad.cols; c++)
+                    if (keypad.down[r] & (1u << c))
+                        in &= (uint8_t)~(1u << keypad.col_bits[c]);
+            }
+        }
+        uint8_t level = (uint8_t)((*lat_reg[p] & ~*tris_reg[p]) | (in & *tris_reg[p]));
+        uint8_t changed = level ^ port_seen[p];
+        if (p == SIM_PORTB && (changed & 0x01) &&
+            (level & 0x01) == INTCON0bits.INT0EDG)  // INT0 on RB0
+            irq_raise(SIM_IRQ_INT0);
+        if (iocf_reg[p] && !PMD_OFF(PMD0, _PMD0_IOCMD_MASK)) {
+            *iocf_reg[p] |= (uint8_t)((changed & level & *iocp_reg[p]) |
+                                      (changed & ~level & *iocn_reg[p]));
+        }
+        port_seen[p] = level;
+        *port_reg[p] = level;
+    }
+    PIR0bits.IOCIF = (IOCAFbits.reg | IOCBFbits.reg | IOCCFbits.reg | IOCEFbits.reg) != 0;
+
+    if (watch.armed && ((*lat_reg[watch.port] & ~*tris_reg[watch.port]) >> watch.bit) & 1) {
+        watch.at = sim_cycles;
+        watch.armed = 0;
+    }
+
+    if (lcd.attached) {
+        uint8_t ctrl = *lat_reg[lcd.ctrl_port];
+        uint8_t en = (ctrl >> lcd.en_bit) & 1;
+        if (lcd.en_was_high && !en)
+            lcd_latch((ctrl >> lcd.rs_bit) & 1, *lat_reg[lcd.data_port]);
+        lcd.en_was_high = en;
+    }
+}
+
+// Pins are synced before the step too, so a write made just before a delay
+// shows up at the start of the delay rather than the end
+void sim_tick(uint32_t cycles) {
+    sync_pins();
+    advance(cpu_cycles(cycles));
+    sync_pins();
+}
+
+void sim_io(void) {
+    sim_stats.io_accesses++;
+    sim_tick(1);
+}
+
+void sim_adc(void) {
+    sim_stats.io_accesses++;
+    advance(cpu_cycles(1));
+    if (!sim_ADCON0.ON || !sim_ADCON0.GO || PMD_OFF(PMD2, _PMD2_ADCMD_MASK)) {
+        adc_busy = 0;
+        return;
+    }
+    if (!adc_busy) {
+        adc_busy = 1;
+        adc_done = sim_cycles + (uint64_t)SIM_ADC_CYCLES * adc_burst();
+    } else if (sim_cycles >= adc_done) {
+        for (uint8_t i = adc_burst(); i > 0; i--)
+            adc_compute(adc_sample());
+        sim_ADCON0.GO = 0;
+        adc_busy = 0;
+    }
+}
+
+// Before each NVMCON1/NVMDAT access: a write set up by the last one starts, and
+// a read is done at once
+void sim_nvm(void) {
+    sim_stats.io_accesses++;
+    advance(cpu_cycles(1));
+    nvm_step();
+    if ((sim_NVMCON1.reg & NVM_RD) && !(sim_NVMCON1.reg & NVM_REG) && !PMD_OFF(PMD0, _PMD0_NVMMD_MASK)) {
+        sim_NVMDAT.reg = eeprom[((NVMADRHbits.reg << 8) | NVMADRLbits.reg) % SIM_EEPROM_SIZE];
+        sim_stats.ee_reads++;
+        sim_NVMCON1.reg &= (uint8_t)~NVM_RD;
+    }
+}
+
+// Before each U1FIFO access: the transmitter catches up with the clock
+void sim_uart(void) {
+    sim_stats.io_accesses++;
+    advance(cpu_cycles(1));
+    uart_step();
+}
+
+// Before each U1TXB access: the same, then whatever is written there is
+// sent (taken at the next step; ignored while the UART is off)
+void sim_uart_tx(void) {
+    sim_uart();
+    if (uart_on())
+        uart.written = 1;
+}
+
+// SLEEP lasts until an enabled interrupt flag goes up. If nothing is left
+// that could raise one, it runs out the sim_run() budget.
+void sim_sleep(void) {
+    sync_pins();
+    sleeping = 1;
+    while (!wake_pending()) {
+        uint64_t stop = next_stop(UINT64_MAX);
+        if (stop == UINT64_MAX)
+            break;
+        advance(stop - sim_cycles);
+    }
+    sleeping = 0;
+    if (wake_pending())
+        sim_stats.wakeups++;
+    sim_tick(1);
+}
+
+// A flag that went up while GIE was clear is taken straight after ei()
+void sim_ei(void) {
+    INTCON0bits.GIE = 1;
+    take_interrupts();
+}
+
+void sim_reset(void) {
+    if (eeprom_blank) {
+        sim_eeprom_erase();
+        eeprom_blank = 0;
+    } else if (nvm_done != UINT64_MAX) {
+        eeprom[nvm_addr] = 0xFF;                // cut off half-way: erased, not written
+        eeprom_wear[nvm_addr]++;
+    }
+#define SFR(name, ...)          name##bits.reg = 0;
+#define SFR2(name, ...)         name##bits.reg = 0;
+#define SFR_HOOKED(name, ...)   sim_##name.reg = 0;
+#define SFR2_HOOKED(name, ...)  sim_##name.reg = 0;
+#define SFR_WIDE(name, type)    name = 0;
+#include "sim_sfr.def"
+    TRISAbits.reg = TRISBbits.reg = TRISCbits.reg = TRISDbits.reg = TRISEbits.reg = 0xFF;
+
+    sim_cycles = 0;
+    memset(&sim_stats, 0, sizeof sim_stats);
+    memset(port_seen, 0, sizeof port_seen);
+    memset(pin_level, 0, sizeof pin_level);
+    memset(&keypad, 0, sizeof keypad);
+    memset(analog_code, 0, sizeof analog_code);
+    memset(analog_noise, 0, sizeof analog_noise);
+    noise_seed = 1;
+    memset(&lcd, 0, sizeof lcd);
+    memset(lcd.ddram, ' ', sizeof lcd.ddram);
+    memset(&watch, 0, sizeof watch);
+    memset(irq_handler, 0, sizeof irq_handler);
+    memset(&tmr0, 0, sizeof tmr0);
+    for (uint8_t i = 0; i < TMR16_COUNT; i++)
+        tmr16[i].acc = 0;
+    for (uint8_t i = 0; i < TMRX_COUNT; i++)
+        tmrx[i].acc = tmrx[i].post = tmrx[i].fired = 0;
+    adc_auto_done = UINT64_MAX;
+    nvm_done = UINT64_MAX;
+    memset(&uart, 0, sizeof uart);
+    memset(dma_loaded, 0, sizeof dma_loaded);
+    uart.shift_done = UINT64_MAX;
+    in_isr = 0;
+    sleeping = 0;
+    adc_busy = 0;
+    event_count = 0;
+    run_deadline = UINT64_MAX;
+}
+
+uint64_t sim_ms(uint32_t ms) {
+    return (uint64_t)ms * (sim_fosc / 4000u);
+}
+
+void sim_pin(uint8_t port, uint8_t bit, uint8_t level) {
+    if (level)
+        pin_level[port] |= (uint8_t)(1u << bit);
+    else
+        pin_level[port] &= (uint8_t)~(1u << bit);
+}
+
+void sim_analog(uint8_t channel, uint16_t code) {
+    analog_code[channel & 0x3F] = code;
+}
+
+// Every conversion of the channel is off by up to +/- amplitude codes
+void sim_analog_noise(uint8_t channel, uint16_t amplitude) {
+    analog_noise[channel & 0x3F] = amplitude;
+}
+
+// Column inputs idle high (weak pull-ups), a held key pulls its column low
+// while its row is driven low
+void sim_keypad(uint8_t port, const uint8_t *row_bits, uint8_t rows,
+                const uint8_t *col_bits, uint8_t cols) {
+    keypad.attached = 1;
+    keypad.port = port;
+    keypad.rows = rows;
+    keypad.cols = cols;
+    memcpy(keypad.row_bits, row_bits, rows);
+    memcpy(keypad.col_bits, col_bits, cols);
+    memset(keypad.down, 0, sizeof keypad.down);
+    for (uint8_t c = 0; c < cols; c++)
+        sim_pin(port, col_bits[c], 1);
+}
+
+void sim_key(uint8_t row, uint8_t col, uint8_t down) {
+    if (down)
+        keypad.down[row] |= (uint8_t)(1u << col);
+    else
+        keypad.down[row] &= (uint8_t)~(1u << col);
+}
+
+void sim_lcd(uint8_t data_port, uint8_t ctrl_port, uint8_t rs_bit, uint8_t en_bit) {
+    lcd.attached = 1;
+    lcd.data_port = data_port;
+    lcd.ctrl_port = ctrl_port;
+    lcd.rs_bit = rs_bit;
+    lcd.en_bit = en_bit;
+    lcd.ready_at = sim_cycles + sim_ms(15);     // power-on wait at Vcc = 5 V
+}
+
+// A blank part: every byte 0xFF, no wear
+void sim_eeprom_erase(void) {
+    memset(eeprom, 0xFF, sizeof eeprom);
+    memset(eeprom_wear, 0, sizeof eeprom_wear);
+    eeprom_blank = 0;
+}
+
+uint8_t sim_eeprom(uint16_t addr) {
+    return eeprom[addr % SIM_EEPROM_SIZE];
+}
+
+uint32_t sim_eeprom_wear(uint16_t addr) {
+    return eeprom_wear[addr % SIM_EEPROM_SIZE];
+}
+
+uint32_t sim_uart_output(const uint8_t **bytes) {
+    *bytes = uart_out;
+    return uart.count;
+}
+
+void sim_uart_clear(void) {
+    uart.count = 0;
+}
+
+// Registers the function compiled from `__interrupt(irq(...))` for a vector
+void sim_irq(uint8_t irq, void (*isr)(void)) {
+    if (irq < SIM_IRQS)
+        irq_handler[irq] = isr;
+}
+
+void sim_pin_at(uint64_t cycle, uint8_t port, uint8_t bit, uint8_t level) {
+    event_add(cycle, EV_PIN, port, bit, level);
+}
+
+void sim_analog_at(uint64_t cycle, uint8_t channel, uint16_t code) {
+    event_add(cycle, EV_ANALOG, channel, 0, code);
+}
+
+void sim_key_at(uint64_t cycle, uint8_t row, uint8_t col, uint8_t down) {
+    event_add(cycle, EV_KEY, row, col, down);
+}
+
+int sim_run(void (*fn)(void), uint64_t budget) {
+    run_deadline = sim_cycles + budget;
+    if (setjmp(run_exit)) {
+        run_deadline = UINT64_MAX;
+        in_isr = 0;
+        sleeping = 0;
+        return 0;
+    }
+    fn();
+    run_deadline = UINT64_MAX;
+    return 1;
+}
+
+uint8_t sim_output(uint8_t port) {
+    sync_pins();
+    return (uint8_t)(*lat_reg[port] & ~*tris_reg[port]);
+}
+
+// Records the cycle at which an output pin next goes high
+void sim_watch(uint8_t port, uint8_t bit) {
+    watch.armed = 1;
+    watch.port = port;
+    watch.bit = bit;
+    watch.at = 0;
+}
+
+uint64_t sim_watch_time(void) {
+    return watch.at;
+}
+
+const char *sim_lcd_line(uint8_t row) {
+    uint8_t base = row ? 0x40 : 0x00;
+
+    for (uint8_t i = 0; i < 20; i++)
+        lcd.line[row][i] = (char)lcd.ddram[base + i];
+    lcd.line[row][20] = '\0';
+    return lcd.line[row];
+}
+
+double sim_wall_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// One line of benchmark output: totals and the per-iteration averages
+void sim_report(const char *label, uint32_t iterations, uint64_t cycles, double wall_us) {
+    if (iterations == 0)
+        iterations = 1;
+    printf("  %-34s %8u iter %12llu cyc %10.1f cyc/iter %9.3f us/iter (host)\n",
+           label, iterations, (unsigned long long)cycles,
+           (double)cycles / iterations, wall_us / iterations);
+}
+
+void sim_power_report(const uint32_t *time, const uint32_t *waits) {
+    static const char *const names[4] = {"run", "doze", "idle", "sleep"};
+    static const double ua_mhz[4] = {SIM_UA_RUN_MHZ, SIM_UA_IDLE_MHZ, SIM_UA_IDLE_MHZ, 0};
+    uint32_t total = time[0] + time[1] + time[2] + time[3];
+    double charge = 0;
+
+    if (total == 0) {
+        printf("  power: no time counted\n");
+        return;
+    }
+    printf("  power (Timer3, %.3f s):", (double)total / SIM_LFINTOSC_HZ);
+    for (int s = 0; s < 4; s++) {
+        printf(" %s %.2f%%", names[s], 100.0 * time[s] / total);
+        if (s > 0)
+            printf(" (%u waits)", waits[s]);
+        printf(s < 3 ? "," : "\n");
+        charge += time[s] * (s == 3 ? SIM_UA_SLEEP : ua_mhz[s] * sim_fosc / 1e6);
+    }
+    printf("  model: Sleep/Idle %.2f%%, Doze %.2f%%; about %.0f uA average (ballpark currents)\n",
+           sim_cycles ? 100.0 * sim_stats.sleep_cycles / sim_cycles : 0,
+           sim_cycles ? 100.0 * sim_stats.doze_cycles / sim_cycles : 0, charge / total);
+}
@@ -0,0 +1,188 @@
+/*
+ * Title: Host simulation layer for the C projects
+ * ---------------------
+ * Program Details:
+ *  Small model of the PIC18F47K42 parts the C projects use, so their code can
+ *  run on a PC with scripted inputs:
+ *   - a virtual clock in instruction cycles (Fosc/4), advanced by the delay
+ *     macros and by every access to a hooked register
+ *   - port pins: outputs follow LATx/TRISx, inputs come from the script
+ *   - a matrix keypad wired to one port (rows driven low, columns pulled up)
+ *   - the ADC: setting GO starts a conversion that finishes SIM_ADC_CYCLES
+ *     later with the scripted code (plus optional noise) for the selected
+ *     channel in ADRESH:ADRESL. The computation engine (accumulate,
+ *     average, burst average, low-pass, ADERR and threshold interrupt) and
+ *     auto-conversion from Timer2 are modelled too
+ *   - an HD44780 LCD in 8-bit mode that latches on the falling edge of EN
+ *     and counts bytes sent before it was ready (15 ms after power-on,
+ *     1.52 ms after clear/home, 37 us after anything else)
+ *   - interrupt-on-change on PORTA/B/C/E, INT0 on RB0, Timer0 in 8- and
+ *     16-bit mode, Timer1 and Timer3 as free-running 16-bit counters, and Timer2,
+ *     Timer4 and Timer6 in free-running period or one-shot mode
+ *   - the 1 KB data EEPROM: NVMCON1.RD copies the byte at NVMADRH:NVMADRL
+ *     into NVMDAT at once; WR (with WREN, REG = 00) writes NVMDAT there
+ *     SIM_EE_WRITE_MS later, keeps running in Sleep and raises NVMIF. The
+ *     unlock sequence on NVMCON2 is not checked. The contents survive
+ *     sim_reset(), like a power cycle; a write still going is cut off and
+ *     leaves its byte erased (0xFF). Each byte counts its writes (wear)
+ *   - the UART1 transmitter: a byte written to U1TXB (with ON and TXEN)
+ *     waits in the one-byte buffer until the shift register is free, then
+ *     takes 10 bit times at the U1BRG/BRGS rate. U1FIFO.TXBF/TXBE,
+ *     U1ERRIR.TXMTIF and U1TXIF (up while the buffer is empty) follow it,
+ *     a byte written to a full buffer is lost. Every byte sent is kept for
+ *     sim_uart_output() whatever pin PPS routes TX to (the pin itself keeps
+ *     showing LATx); a shift under way still ends in Sleep
+ *   - NCO1 and PWM5 only as registers: a pin routed to them through PPS
+ *     keeps showing LATx, and benchmarks read the registers instead
+ *   - DMA1 and DMA2 started by an interrupt flag going up (DMAxSIRQ; the
+ *     flag need not be cleared for the next one): each trigger
+ *     moves bytes until the source or destination count runs out, which
+ *     reloads it and raises the matching SCNT/DCNT flag. New SSA/SSZ or
+ *     DSA/DSZ values are loaded at the next trigger (the chip needs EN
+ *     turned off and on). Transfers take no CPU cycles in the model and
+ *     need Fosc, so Sleep loses them. U1TXIF triggers a channel as long as
+ *     the UART1 buffer has room, so a DMA into U1TXB sends a block
+ *   - vectored interrupts: when GIE is set and an enabled flag is raised,
+ *     the handler registered for that vector runs at that cycle, even in
+ *     the middle of a delay (which then ends later, as on the chip)
+ *   - SLEEP, which lasts until an enabled interrupt flag is raised. Only
+ *     peripherals on a clock that runs in Sleep keep counting, or all of
+ *     them in Idle (CPUDOZE.IDLEN set)
+ *   - Doze (CPUDOZE.DOZEN): every instruction cycle the firmware spends
+ *     takes 2^(DOZE + 1) cycles of the clock; ROI turns it off when an
+ *     ISR starts and DOE back on when it returns
+ *   - PMD0-PMD7: a timer, the ADC, the data EEPROM, interrupt-on-change,
+ *     UART1 or a DMA channel whose bit is set does not run (its registers
+ *     keep what was written, where the chip would clear them)
+ *
+ *  A benchmark resets the model, attaches the keypad/LCD it needs, queues
+ *  input events at given cycle times and then calls into the firmware.
+ *  sim_run() gives a cycle budget, so firmware that never returns (main(),
+ *  spin-waits on a sensor) can be stopped cleanly.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+// Port numbers for the sim_* functions
+#define SIM_PORTA   0
+#define SIM_PORTB   1
+#define SIM_PORTC   2
+#define SIM_PORTD   3
+#define SIM_PORTE   4
+
+#define SIM_ADC_CYCLES  23  // ~14 TAD on ADCRC at Fosc = 4 MHz
+#define SIM_EEPROM_SIZE 1024
+#define SIM_EE_WRITE_MS 4   // data EEPROM byte write (erase and write), typical
+#define SIM_UART_CAPTURE 65536  // bytes sent by UART1 that sim_uart_output() keeps
+
+// Interrupt vector numbers (PIRn bit b is vector 8 * n + b), as on the chip
+#define SIM_IRQ_NVM     4
+#define SIM_IRQ_IOC     7
+#define SIM_IRQ_INT0    8
+#define SIM_IRQ_AD      10
+#define SIM_IRQ_ADT     11
+#define SIM_IRQ_DMA1SCNT 16
+#define SIM_IRQ_DMA1DCNT 17
+#define SIM_IRQ_U1TX    28
+#define SIM_IRQ_TMR0    31
+#define SIM_IRQ_TMR1    32
+#define SIM_IRQ_TMR2    34
+#define SIM_IRQ_TMR3    54
+#define SIM_IRQ_TMR4    56
+#define SIM_IRQ_TMR6    72
+#define SIM_IRQ_DMA2SCNT 42
+#define SIM_IRQ_DMA2DCNT 43
+#define SIM_IRQ_LATENCY 3   // cycles from the flag to the first ISR instruction
+
+// Internal oscillators a timer can count
+#define SIM_LFINTOSC_HZ 31000u
+#define SIM_MFINTOSC_HZ 500000u
+#define SIM_SOSC_HZ     32768u
+
+// Ballpark PIC18F47K42 data sheet typicals at 3 V, in uA, for the average
+// current sim_power_report() works out of the firmware's state times
+#define SIM_UA_RUN_MHZ  140.0           // core running, per MHz of Fosc
+#define SIM_UA_IDLE_MHZ 45.0            // Idle or Doze, per MHz of Fosc
+#define SIM_UA_SLEEP    1.5             // Sleep with LFINTOSC and a few timers on it
+
+// Counters the benchmarks report
+typedef struct {
+    uint32_t io_accesses;       // hooked register accesses
+    uint32_t adc_conversions;   // finished conversions
+    uint32_t lcd_commands;      // bytes latched with RS = 0
+    uint32_t lcd_chars;         // bytes latched with RS = 1
+    uint32_t lcd_overruns;      // bytes latched while the LCD was still busy
+    uint64_t lcd_first_char;    // cycle the first character was latched
+    uint32_t interrupts;        // ISR calls
+    uint64_t sleep_cycles;      // cycles spent in SLEEP or Idle
+    uint64_t doze_cycles;       // and awake in Doze
+    uint32_t wakeups;           // SLEEP/Idle periods ended by an interrupt flag
+    uint32_t adc_results;       // ADC results that reached the threshold test
+    double adc_result_sum;      // sum and sum of squares of those results
+    double adc_result_sq;       // (ADFLTR in the averaging modes, else ADRES)
+    uint32_t dma_bytes;         // bytes moved by DMA1/DMA2
+    uint32_t dma_lost;          // DMA triggers while Fosc was stopped
+    uint32_t ee_reads;          // data EEPROM bytes read
+    uint32_t ee_writes;         // and written
+    uint32_t uart_bytes;        // bytes UART1 finished sending
+    uint32_t uart_overruns;     // bytes written to U1TXB while its buffer was full
+    uint64_t uart_last;         // cycle the last one finished
+} sim_stats_t;
+
+extern uint64_t sim_cycles;     // virtual instruction cycles since sim_reset()
+extern uint32_t sim_fosc;       // oscillator in Hz, only used for conversions
+extern sim_stats_t sim_stats;
+
+// Called from the stand-in <xc.h>
+void sim_tick(uint32_t cycles);
+void sim_io(void);
+void sim_adc(void);
+void sim_nvm(void);
+void sim_uart(void);
+void sim_uart_tx(void);
+void sim_sleep(void);
+void sim_ei(void);
+
+// Set-up and scripting
+void sim_reset(void);
+uint64_t sim_ms(uint32_t ms);
+void sim_pin(uint8_t port, uint8_t bit, uint8_t level);
+void sim_analog(uint8_t channel, uint16_t code);
+void sim_analog_noise(uint8_t channel, uint16_t amplitude);
+void sim_keypad(uint8_t port, const uint8_t *row_bits, uint8_t rows,
+                const uint8_t *col_bits, uint8_t cols);
+void sim_key(uint8_t row, uint8_t col, uint8_t down);
+void sim_lcd(uint8_t data_port, uint8_t ctrl_port, uint8_t rs_bit, uint8_t en_bit);
+void sim_irq(uint8_t irq, void (*isr)(void));
+void sim_pin_at(uint64_t cycle, uint8_t port, uint8_t bit, uint8_t level);
+void sim_analog_at(uint64_t cycle, uint8_t channel, uint16_t code);
+void sim_key_at(uint64_t cycle, uint8_t row, uint8_t col, uint8_t down);
+
+// Data EEPROM, kept across sim_reset(); blank (0xFF) until written
+void sim_eeprom_erase(void);
+uint8_t sim_eeprom(uint16_t addr);
+uint32_t sim_eeprom_wear(uint16_t addr);
+
+// What UART1 has sent since sim_reset() or sim_uart_clear(), up to
+// SIM_UART_CAPTURE bytes
+uint32_t sim_uart_output(const uint8_t **bytes);
+void sim_uart_clear(void);
+
+// Runs fn for at most budget cycles. Returns 1 if fn returned on its own.
+int sim_run(void (*fn)(void), uint64_t budget);
+
+// Observing the outputs
+uint8_t sim_output(uint8_t port);
+void sim_watch(uint8_t port, uint8_t bit);
+uint64_t sim_watch_time(void);
+const char *sim_lcd_line(uint8_t row);
+double sim_wall_us(void);
+void sim_report(const char *label, uint32_t iterations, uint64_t cycles, double wall_us);
+// The pwr_time and pwr_waits counts of Common/power.h (run, doze, idle,
+// sleep), beside the model's own Sleep/Idle and Doze share
+void sim_power_report(const uint32_t *time, const uint32_t *waits);
+
+#endif /* SIM_H */
@@ -0,0 +1,195 @@
+/*
+ * Title: Telemetry stream decoder
+ * ---------------------
+ * Program Details:
+ *  Reads the packets Common/telemetry.h sends and reports what arrived:
+ *
+ *     tlm_decode [-c] [source]
+ *
+ *  source is a capture file, or a serial port or pty (set to raw; the
+ *  stream ends after 1 s without a byte); default stdin. -c also prints
+ *  every sample as "time_us,channel,code", in the order received.
+ *
+ *  The decoder finds each packet by its sync bytes and keeps it only if
+ *  its Fletcher-16 matches, so it picks up in the middle of a stream and
+ *  after noise. The report gives the good and bad packets, the ones lost
+ *  on the way (sequence gaps) or dropped by the firmware (gaps in the
+ *  sample numbers with no sequence gap), the samples of each channel and
+ *  the sustained rate: samples per second of the firmware's own clock
+ *  (sample numbers x period), and when reading a port, of the wall clock
+ *  too. Exits 1 if no good packet came.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SYNC0       0xA5
+#define SYNC1       0x5A
+#define HEADER      10
+#define MAX_SAMPLES 120
+#define CHANNELS    16
+
+static uint8_t buf[4096];
+static size_t have;
+static int csv;
+
+static struct {
+    uint32_t good, bad, lost, dropped;
+    uint64_t bytes, skipped;
+    uint32_t samples[CHANNELS];
+    uint32_t total;
+    int started;
+    uint8_t sequence;
+    uint32_t next_sample;       // first sample number the next packet should have
+    double first_us, last_us, period_us;
+} st;
+
+static double now_s(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+// Fletcher-16 of bytes, sums mod 255, returned as sum1 | sum2 << 8
+static uint16_t fletcher16(const uint8_t *bytes, size_t count) {
+    uint16_t sum1 = 0, sum2 = 0;
+
+    while (count--) {
+        sum1 = (sum1 + *bytes++) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return (uint16_t)(sum1 | sum2 << 8);
+}
+
+// One good packet: counts, gaps and the samples
+static void packet(const uint8_t *p) {
+    uint8_t sequence = p[2], count = p[3];
+    uint32_t first = get16(p + 4) | (uint32_t)get16(p + 6) << 16;
+    uint16_t period = get16(p + 8);
+
+    if (st.started) {
+        uint8_t missing = (uint8_t)(sequence - st.sequence - 1);
+        st.lost += missing;
+        if (!missing && first != st.next_sample)
+            st.dropped++;
+    } else {
+        st.first_us = (double)first * period;
+        st.started = 1;
+    }
+    st.sequence = sequence;
+    st.next_sample = first + count;
+    st.period_us = period;
+    st.last_us = (double)(first + count) * period;
+    st.good++;
+    for (uint8_t i = 0; i < count; i++) {
+        uint16_t sample = get16(p + HEADER + 2 * i);
+        uint8_t channel = sample >> 12;
+        st.samples[channel]++;
+        st.total++;
+        if (csv)
+            printf("%.0f,%u,%u\n", (double)(first + i) * period, channel, sample & 0x0FFF);
+    }
+}
+
+// Takes every whole packet at the front of buf; keeps a partial one
+static void scan(void) {
+    size_t pos = 0;
+
+    while (have - pos >= HEADER) {
+        const uint8_t *p = buf + pos;
+        if (p[0] != SYNC0 || p[1] != SYNC1 || p[3] == 0 || p[3] > MAX_SAMPLES) {
+            pos++;
+            st.skipped++;
+            continue;
+        }
+        size_t length = HEADER + 2 * (size_t)p[3] + 2;
+        if (have - pos < length)
+            break;
+        if (fletcher16(p + 2, length - 4) != get16(p + length - 2)) {
+            st.bad++;
+            pos++;
+            st.skipped++;
+            continue;
+        }
+        packet(p);
+        pos += length;
+    }
+    memmove(buf, buf + pos, have - pos);
+    have -= pos;
+}
+
+int main(int argc, char **argv) {
+    const char *source = NULL;
+    int fd = 0, port = 0;
+    double wall_start = 0, wall_end = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-c"))
+            csv = 1;
+        else if (!source && argv[i][0] != '-')
+            source = argv[i];
+        else {
+            fprintf(stderr, "usage: tlm_decode [-c] [source]\n");
+            return 2;
+        }
+    }
+    if (source && (fd = open(source, O_RDONLY | O_NOCTTY)) < 0) {
+        perror(source);
+        return 1;
+    }
+    if (isatty(fd)) {
+        struct termios tio;
+
+        port = 1;
+        tcgetattr(fd, &tio);
+        cfmakeraw(&tio);
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 10;       // read() gives up after 1 s of silence
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    for (;;) {
+        ssize_t got = read(fd, buf + have, sizeof buf - have);
+        if (got <= 0)
+            break;
+        if (st.bytes == 0)
+            wall_start = now_s();
+        wall_end = now_s();
+        st.bytes += (size_t)got;
+        have += (size_t)got;
+        scan();
+    }
+
+    FILE *out = csv ? stderr : stdout;
+    double span = (st.last_us - st.first_us) / 1e6;
+    fprintf(out, "telemetry: %llu bytes, %u packets, %u bad, %u lost, %u dropped by the firmware, "
+            "%llu bytes skipped\n", (unsigned long long)st.bytes, st.good, st.bad, st.lost,
+            st.dropped, (unsigned long long)st.skipped);
+    fprintf(out, "  %u samples", st.total);
+    for (int c = 0; c < CHANNELS; c++)
+        if (st.samples[c])
+            fprintf(out, ", channel %d: %u", c, st.samples[c]);
+    fprintf(out, "\n");
+    if (st.good && span > 0)
+        fprintf(out, "  %.3f s of samples %.0f us apart: %.1f samples/s sustained, %.1f%% of "
+                "the sample numbers arrived, %.1f payload bytes in 100\n",
+                span, st.period_us, st.total / span,
+                100.0 * st.total * st.period_us / 1e6 / span,
+                100.0 * 2 * st.total / (st.bytes ? st.bytes : 1));
+    if (port && wall_end > wall_start)
+        fprintf(out, "  wall clock: %.3f s, %.0f bytes/s, %.1f samples/s\n",
+                wall_end - wall_start, st.bytes / (wall_end - wall_start),
+                st.total / (wall_end - wall_start));
+    return st.good == 0;
+}
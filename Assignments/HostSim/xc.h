@@ -0,0 +1,182 @@
+/*
+ * Title: Host stand-in for <xc.h>
+ * ---------------------
+ * Program Details:
+ *  Lets the C projects (Calculator.X, InterfacingWithSensors_A8.X and
+ *  A9_ADC_LCD.X) compile with a normal host compiler. Every SFR from
+ *  sim_sfr.def becomes a variable with the same name and the same
+ *  <name>bits bit-field view as the XC8 device header. Ports and the ADC are
+ *  reached through sim.c so that reads see the scripted inputs (keypad,
+ *  switches, photo-resistors, analog channels) and the LCD sees every write.
+ *  NVMCON1 and NVMDAT go through sim.c too, for the data EEPROM, and
+ *  U1FIFO and U1TXB for the UART1 transmitter.
+ *
+ *  Interrupt functions compile as plain functions; a benchmark registers
+ *  them with sim_irq() and sim.c calls them when their flag is raised.
+ *
+ *  __delay_ms(), __delay_us() and NOP() advance a virtual clock that counts
+ *  instruction cycles (Fosc/4) instead of burning host time. Each hooked
+ *  register access also costs one cycle. Plain C statements are not counted,
+ *  so the virtual cycle count is a lower bound that is dominated by the
+ *  delays, which is exactly where the firmware spends its time.
+ *
+ *  This file is found before the real <xc.h> because HostSim is first on
+ *  the include path (see HostSim/Makefile).
+ */
+
+#ifndef SIM_XC_H
+#define SIM_XC_H
+
+#include <stdint.h>
+
+// Register types and declarations, one per entry of sim_sfr.def
+#define SIM_BITS(b0, b1, b2, b3, b4, b5, b6, b7)                              \
+        struct { uint8_t b0:1; uint8_t b1:1; uint8_t b2:1; uint8_t b3:1;       \
+                 uint8_t b4:1; uint8_t b5:1; uint8_t b6:1; uint8_t b7:1; };
+#define SFR(name, b0, b1, b2, b3, b4, b5, b6, b7)                              \
+    typedef union {                                                            \
+        SIM_BITS(b0, b1, b2, b3, b4, b5, b6, b7)                               \
+        uint8_t reg;                                                           \
+    } __##name##bits_t;                                                        \
+    extern volatile __##name##bits_t name##bits;                               \
+    extern volatile uint8_t name __asm__(#name "bits");
+#define SFR2(name, b0, b1, b2, b3, b4, b5, b6, b7, a0, a1, a2, a3, a4, a5, a6, a7) \
+    typedef union {                                                            \
+        SIM_BITS(b0, b1, b2, b3, b4, b5, b6, b7)                               \
+        SIM_BITS(a0, a1, a2, a3, a4, a5, a6, a7)                               \
+        uint8_t reg;                                                           \
+    } __##name##bits_t;                                                        \
+    extern volatile __##name##bits_t name##bits;                               \
+    extern volatile uint8_t name __asm__(#name "bits");
+#define SFR_HOOKED(name, b0, b1, b2, b3, b4, b5, b6, b7)                       \
+    typedef union {                                                            \
+        SIM_BITS(b0, b1, b2, b3, b4, b5, b6, b7)                               \
+        uint8_t reg;                                                           \
+    } __##name##bits_t;                                                        \
+    extern volatile __##name##bits_t sim_##name;
+#define SFR2_HOOKED(name, b0, b1, b2, b3, b4, b5, b6, b7, a0, a1, a2, a3, a4, a5, a6, a7) \
+    typedef union {                                                            \
+        SIM_BITS(b0, b1, b2, b3, b4, b5, b6, b7)                               \
+        SIM_BITS(a0, a1, a2, a3, a4, a5, a6, a7)                               \
+        uint8_t reg;                                                           \
+    } __##name##bits_t;                                                        \
+    extern volatile __##name##bits_t sim_##name;
+#define SFR_WIDE(name, type)                                                   \
+    extern volatile type name;
+#include "sim_sfr.def"
+
+#include "sim.h"
+
+// Hooked registers: sync the pin models first, then hand back the storage
+#define SIM_IO(reg)     (*(sim_io(), &sim_##reg))
+#define PORTAbits       SIM_IO(PORTA)
+#define PORTBbits       SIM_IO(PORTB)
+#define PORTCbits       SIM_IO(PORTC)
+#define PORTDbits       SIM_IO(PORTD)
+#define PORTEbits       SIM_IO(PORTE)
+#define LATAbits        SIM_IO(LATA)
+#define LATBbits        SIM_IO(LATB)
+#define LATCbits        SIM_IO(LATC)
+#define LATDbits        SIM_IO(LATD)
+#define LATEbits        SIM_IO(LATE)
+#define PORTA           (PORTAbits.reg)
+#define PORTB           (PORTBbits.reg)
+#define PORTC           (PORTCbits.reg)
+#define PORTD           (PORTDbits.reg)
+#define PORTE           (PORTEbits.reg)
+#define LATA            (LATAbits.reg)
+#define LATB            (LATBbits.reg)
+#define LATC            (LATCbits.reg)
+#define LATD            (LATDbits.reg)
+#define LATE            (LATEbits.reg)
+
+// Single-bit names the XC8 header also provides
+#define LATD0           LATDbits.LATD0
+#define LATD1           LATDbits.LATD1
+#define LATD2           LATDbits.LATD2
+#define LATD3           LATDbits.LATD3
+
+// _<register>_<bit>_MASK of the XC8 header, for the PMD bits the projects
+// switch off (Common/power.h); taken from the bit-fields of sim_sfr.def, so
+// the positions are written down in one place only
+#define SIM_MASK(r, b)      ((uint8_t)((__##r##bits_t){ .b = 1 }).reg)
+#define _PMD0_IOCMD_MASK        SIM_MASK(PMD0, IOCMD)
+#define _PMD0_CLKRMD_MASK       SIM_MASK(PMD0, CLKRMD)
+#define _PMD0_NVMMD_MASK        SIM_MASK(PMD0, NVMMD)
+#define _PMD0_SCANMD_MASK       SIM_MASK(PMD0, SCANMD)
+#define _PMD0_CRCMD_MASK        SIM_MASK(PMD0, CRCMD)
+#define _PMD0_HLVDMD_MASK       SIM_MASK(PMD0, HLVDMD)
+#define _PMD0_FVRMD_MASK        SIM_MASK(PMD0, FVRMD)
+#define _PMD0_SYSCMD_MASK       SIM_MASK(PMD0, SYSCMD)
+#define _PMD1_TMR0MD_MASK       SIM_MASK(PMD1, TMR0MD)
+#define _PMD1_TMR1MD_MASK       SIM_MASK(PMD1, TMR1MD)
+#define _PMD1_TMR2MD_MASK       SIM_MASK(PMD1, TMR2MD)
+#define _PMD1_TMR3MD_MASK       SIM_MASK(PMD1, TMR3MD)
+#define _PMD1_TMR4MD_MASK       SIM_MASK(PMD1, TMR4MD)
+#define _PMD1_TMR5MD_MASK       SIM_MASK(PMD1, TMR5MD)
+#define _PMD1_TMR6MD_MASK       SIM_MASK(PMD1, TMR6MD)
+#define _PMD1_NCO1MD_MASK       SIM_MASK(PMD1, NCO1MD)
+#define _PMD2_ZCDMD_MASK        SIM_MASK(PMD2, ZCDMD)
+#define _PMD2_CMP1MD_MASK       SIM_MASK(PMD2, CMP1MD)
+#define _PMD2_CMP2MD_MASK       SIM_MASK(PMD2, CMP2MD)
+#define _PMD2_ADCMD_MASK        SIM_MASK(PMD2, ADCMD)
+#define _PMD2_DACMD_MASK        SIM_MASK(PMD2, DACMD)
+#define _PMD3_CCP1MD_MASK       SIM_MASK(PMD3, CCP1MD)
+#define _PMD3_CCP2MD_MASK       SIM_MASK(PMD3, CCP2MD)
+#define _PMD3_CCP3MD_MASK       SIM_MASK(PMD3, CCP3MD)
+#define _PMD3_CCP4MD_MASK       SIM_MASK(PMD3, CCP4MD)
+#define _PMD3_PWM5MD_MASK       SIM_MASK(PMD3, PWM5MD)
+#define _PMD3_PWM6MD_MASK       SIM_MASK(PMD3, PWM6MD)
+#define _PMD3_PWM7MD_MASK       SIM_MASK(PMD3, PWM7MD)
+#define _PMD3_PWM8MD_MASK       SIM_MASK(PMD3, PWM8MD)
+#define _PMD4_CWG1MD_MASK       SIM_MASK(PMD4, CWG1MD)
+#define _PMD4_CWG2MD_MASK       SIM_MASK(PMD4, CWG2MD)
+#define _PMD4_CWG3MD_MASK       SIM_MASK(PMD4, CWG3MD)
+#define _PMD5_CLC1MD_MASK       SIM_MASK(PMD5, CLC1MD)
+#define _PMD5_CLC2MD_MASK       SIM_MASK(PMD5, CLC2MD)
+#define _PMD5_CLC3MD_MASK       SIM_MASK(PMD5, CLC3MD)
+#define _PMD5_CLC4MD_MASK       SIM_MASK(PMD5, CLC4MD)
+#define _PMD5_SMT1MD_MASK       SIM_MASK(PMD5, SMT1MD)
+#define _PMD6_I2C1MD_MASK       SIM_MASK(PMD6, I2C1MD)
+#define _PMD6_I2C2MD_MASK       SIM_MASK(PMD6, I2C2MD)
+#define _PMD6_SPI1MD_MASK       SIM_MASK(PMD6, SPI1MD)
+#define _PMD6_U1MD_MASK         SIM_MASK(PMD6, U1MD)
+#define _PMD6_U2MD_MASK         SIM_MASK(PMD6, U2MD)
+#define _PMD7_DMA1MD_MASK       SIM_MASK(PMD7, DMA1MD)
+#define _PMD7_DMA2MD_MASK       SIM_MASK(PMD7, DMA2MD)
+
+// ADCON0 reads run the conversion model so `while (ADCON0bits.GO);` ends
+#define ADCON0bits      (*(sim_adc(), &sim_ADCON0))
+#define ADCON0          (ADCON0bits.reg)
+
+// NVMCON1 and NVMDAT accesses run the EEPROM model, so RD reads NVMDAT and
+// WR writes it
+#define NVMCON1bits     (*(sim_nvm(), &sim_NVMCON1))
+#define NVMCON1         (NVMCON1bits.reg)
+#define NVMDATbits      (*(sim_nvm(), &sim_NVMDAT))
+#define NVMDAT          (NVMDATbits.reg)
+
+// U1FIFO reads run the UART model, so `while (U1FIFObits.TXBF);` ends; a
+// U1TXB access hands out the buffer, and what was written there is sent
+#define U1FIFObits      (*(sim_uart(), &sim_U1FIFO))
+#define U1FIFO          (U1FIFObits.reg)
+#define U1TXBbits       (*(sim_uart_tx(), &sim_U1TXB))
+#define U1TXB           (U1TXBbits.reg)
+
+// XC8's 24-bit integer, used for DMA addresses; pointer-wide here
+typedef uintptr_t __uint24;
+
+// Compiler intrinsics and qualifiers
+#define __interrupt(...)
+#define __at(addr)
+#define __section(name)
+#define __persistent
+#define NOP()           sim_tick(1)
+#define CLRWDT()        sim_tick(1)
+#define SLEEP()         sim_sleep()
+#define di()            (INTCON0bits.GIE = 0)
+#define ei()            sim_ei()
+#define __delay_ms(x)   sim_tick((uint32_t)(x) * (uint32_t)(_XTAL_FREQ / 4000UL))
+#define __delay_us(x)   sim_tick((uint32_t)(x) * (uint32_t)(_XTAL_FREQ / 4000000UL))
+
+#endif /* SIM_XC_H */
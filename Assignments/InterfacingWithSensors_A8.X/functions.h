@@ -5,80 +5,82 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include "keypad.h"
+
+// Buzzer (RC6) played by NCO1, SYS_LED (RC3) blinked by PWM5
+#define TONE_PPS            RC6PPS
+#define BLINK_PPS           RC3PPS
+#include "../Common/tone.h"
+// PR1 (RE0, ANE0) and PR2 (RE1, ANE1), read by the ADC every 2 ms
+#define LIGHT_CHANNELS      { 0x20, 0x21 }
+#include "../Common/light_gate.h"
+// SECRET_CODE kept in the data EEPROM, one byte a record, 256 records round
+#include "../Common/ee_log.h"
+#include "../Common/seg_font.h"
 
 #define _XTAL_FREQ 4000000                 // Fosc  frequency for _delay()  library
 #define FCY    _XTAL_FREQ/4
 
+// Times of the safebox actions, in scheduler ms
+#define MOTOR_MS        3000    // motor run after a correct code
+#define TAP_MS          30      // shorter PR covers are flicker, not taps
+#define HOLD_MS         1000    // a PR covered this long confirms the digit
+#define CONFIRM_MS      50      // confirm button debounce
+#define SHOW_DIGIT_MS   1000    // new code digit shown before moving on
+#define CHASE_MS        10      // one segment of the waiting animation
+#define MELODY_ROUNDS   5       // siren rounds (and LED blinks) of the emergency melody
+
+#define PR_NONE         2       // no photo-resistor digit being entered
+
 uint8_t SECRET_CODE = 00;
 uint8_t high_digit = 0;
 uint8_t low_digit = 0;
 uint8_t confirmation = 0;
 uint8_t user_code;
-uint8_t input_digit(uint8_t sensor_pin);
+uint8_t code_step = 0;          // 0, or which digit of a new code we wait for (1, 2)
+uint8_t new_code = 0;
+uint8_t chase_segment = 0;
+uint8_t pr_sensor = PR_NONE;    // PR being counted (0 = PR1, 1 = PR2)
+uint8_t pr_count = 0;
+uint16_t button_last = 0;       // sched_now() of the last press taken
+uint8_t alarm_on = 0;           // emergency melody playing
+
+// Emergency melody: a two-tone siren and a rest, 1 s a round, with one
+// LED blink per round
+const tone_note_t emergency_notes[] = {
+    TONE_NOTE(880, 250), TONE_NOTE(660, 250), TONE_REST(500),
+    TONE_NOTE(880, 250), TONE_NOTE(660, 250), TONE_REST(500),
+    TONE_NOTE(880, 250), TONE_NOTE(660, 250), TONE_REST(500),
+    TONE_NOTE(880, 250), TONE_NOTE(660, 250), TONE_REST(500),
+    TONE_NOTE(880, 250), TONE_NOTE(660, 250), TONE_REST(500)
+};
+// Wrong code: 2 s falling from A3 to G3
+const tone_note_t wrong_code_notes[] = {
+    TONE_NOTE(220, 1000), TONE_NOTE(196, 1000)
+};
+
 void display_digit(char digit);
 bool check_code(uint8_t user_code);
 void activate_motor(void);
+void motor_off(void);
 void activate_buzzer(void);
 void emergency_melody(void);
-void __interrupt(irq(IRQ_INT0), base(0x400)) INT0_ISR(void);
-char get_keypad_key(void);
-uint8_t wait_for_keypad_digit(void);
-void check_for_change_code_request(void);
-void check_for_PR_input(void);
+void melody_done(void);
+EVT_ISR(INT0_ISR, irq(IRQ_INT0));
+EVT_ISR(Confirm_ISR, irq(IRQ_IOC));
+void chase_step(void);
+void keypad_task(void);
+void pr_changed(uint8_t gate, uint8_t covered, uint16_t ms);
+void confirm_pressed(void);
+void confirm_digit(void);
 void code_correct_or_wrong(void);
-uint8_t set_new_secret_code(void);
-
-// Handle inputs from the photo-resistors
-uint8_t input_digit(uint8_t sensor_pin) {
-    uint8_t count = 1;
-    while (PORTEbits.RE0 == 1 || PORTEbits.RE1 == 1); // wait til uncovered
-    display_digit((char)(count + '0'));
-    
-    while (1) {
-        
-        if (sensor_pin == 0 && PORTEbits.RE0 == 1 && count < 4) { // PR1
-            __delay_ms(500);
-            count++;
-            while (PORTEbits.RE0 == 1); // wait until uncovered
-            PORTE = 0;
-            display_digit((char)(count + '0'));
-        }
-        else if (sensor_pin == 1 && PORTEbits.RE1 == 1 && count < 4) { // PR2
-            __delay_ms(500);
-            count++;
-            while (PORTEbits.RE1 == 1); // wait until uncovered
-            PORTE = 0;
-            display_digit((char)(count + '0'));
-        }
-
-        // Wait for confirm button press (e.g., RC4)
-        if (PORTCbits.RC4 == 1) {
-            __delay_ms(50);
-            confirmation++;
-            display_digit('E');  // Show 3 lines while waiting
-            return count;
-        }
-    }
-}
+void set_new_secret_code(void);
+void show_digit_done(void);
 
-// Helper to display digits on the 7-segment
+// Helper to display a character on the 7-segment: one read of the shared font
+// (Common/seg_font.h), '#' being the three lines shown while waiting
 void display_digit(char value) {
-    switch (value) {
-        case '0': LATD = 0b00111111; break;
-        case '1': LATD = 0b00000110; break;
-        case '2': LATD = 0b01011011; break;
-        case '3': LATD = 0b01001111; break;
-        case '4': LATD = 0b01100110; break;
-        case '5': LATD = 0b01101101; break;
-        case '6': LATD = 0b01111101; break;
-        case '7': LATD = 0b00000111; break;
-        case '8': LATD = 0b01111111; break;
-        case '9': LATD = 0b01101111; break;
-        case '*': LATD = 0b01100011; break;
-        case '#': LATD = 0b01111001; break;
-        case 'E': LATD = 0b01001001; break;
-        default:  LATD = 0b01001001; break;
-    }
+    LATD = SEG_GLYPH(value);
 }
 
 // Checks if the code is a match
@@ -86,115 +88,133 @@ bool check_code(uint8_t user_code) {
     return user_code == SECRET_CODE;
 }
 
-// Turn motor on for small duration
+// Turn motor on for small duration (a new unlock restarts the time)
 void activate_motor(void) {
     PORTCbits.RC7 = 1; // Motor on
-    __delay_ms(3000);
+    sched_after(motor_off, MOTOR_MS);
+}
+
+void motor_off(void) {
     PORTCbits.RC7 = 0; // Motor off
 }
 
-// Turn buzzer on for small duration
+// Wrong code tone on the buzzer, unless the emergency melody has it
 void activate_buzzer(void) {
-    PORTCbits.RC6 = 1; // Buzzer on
-    __delay_ms(2000);
-    PORTCbits.RC6 = 0; // Buzzer off
+    if (!alarm_on)
+        tone_play(wrong_code_notes, sizeof(wrong_code_notes) / sizeof(wrong_code_notes[0]), 0);
 }
 
-// Play a melody through the buzzer (during interrupts)
+// Play a melody through the buzzer and blink SYS_LED (after an INT0
+// interrupt); NCO1 and PWM5 do it, a new press starts it over
 void emergency_melody(void) {
-    for (uint8_t i = 0; i < 5; i++) {  
-        PORTCbits.RC3 = 0;
-        PORTCbits.RC6 = 1;
-        __delay_ms(500);
-        PORTCbits.RC3 = 1;
-        PORTCbits.RC6 = 0;
-        __delay_ms(500);
-    }
+    alarm_on = 1;
+    tone_play(emergency_notes, sizeof(emergency_notes) / sizeof(emergency_notes[0]), melody_done);
+    blink_start(TONE_MS(1000), TONE_MS(500), MELODY_ROUNDS, 0);
 }
 
-// Interrupt function
-void __interrupt(irq(IRQ_INT0), base(0x4008)) INT0_ISR(void) {
-    emergency_melody();
-    PIR1bits.INT0IF = 0;    // always clear the interrupt flag for INT0 when done
-    //while (1); // halt system
+// End of the melody (TONE_EVENT); SYS_LED is back on its LATC3 bit
+void melody_done(void) {
+    alarm_on = 0;
 }
 
-// Keypad lookup
-char get_keypad_key(void) {
-    char keys[4][3] = {
-        {'1', '2', '3'},
-        {'4', '5', '6'},
-        {'7', '8', '9'},
-        {'*', '0', '#'}
-    };
-
-    for (int row = 0; row < 4; row++) {
-        // Set one row LOW, others HIGH
-        LATBbits.LATB1 = (row == 0) ? 0 : 1;
-        LATBbits.LATB2 = (row == 1) ? 0 : 1;
-        LATBbits.LATB3 = (row == 2) ? 0 : 1;
-        LATBbits.LATB4 = (row == 3) ? 0 : 1;
-
-        __delay_ms(5);  // debounce
-
-        // Check each column (RA4-RA6)
-        if (!PORTBbits.RB5) return keys[row][0];
-        if (!PORTBbits.RB6) return keys[row][1];
-        if (!PORTBbits.RB7) return keys[row][2];
-    }
-
-    return 0; // no key pressed
+// Interrupt function: only posts EVT_ALARM, emergency_melody() runs from
+// main() and the scheduler plays it, so the keypad and the sensors keep
+// working while it sounds
+EVT_ISR(INT0_ISR, irq(IRQ_INT0)) {
+    EVT_ISR_BEGIN();
+    PIR1bits.INT0IF = 0;    // cleared first, so a new press is not lost
+    evt_post(EVT_ALARM);
+    EVT_ISR_END();
 }
 
+// Rising edge on RC4 (the only IOC pin): posts EVT_CONFIRM for confirm_pressed()
+EVT_ISR(Confirm_ISR, irq(IRQ_IOC)) {
+    EVT_ISR_BEGIN();
+    IOCCFbits.IOCCF4 = 0;
+    evt_post(EVT_CONFIRM);
+    EVT_ISR_END();
+}
 
+// Waiting animation while setting a new code: one segment per run
+void chase_step(void) {
+    LATD = (uint8_t)(1 << chase_segment);
+    if (++chase_segment == 6)
+        chase_segment = 0;
+}
 
-// If setting a new code we wait for the keypad to be pressed
-uint8_t wait_for_keypad_digit(void) {
+// Every tick: '*' starts a new code, and while setting one, keys 0-4 are
+// its digits (keys typed while a digit is shown stay queued)
+void keypad_task(void) {
     char key;
-    do {
-        LATD = 0b00000001;
-        __delay_ms(10);
-        LATD = 0b00000010;
-        __delay_ms(10);
-        LATD = 0b00000100;
-        __delay_ms(10);
-        LATD = 0b00001000;
-        __delay_ms(10);
-        LATD = 0b00010000;
-        __delay_ms(10);
-        LATD = 0b00100000;
-        __delay_ms(10);
-        key = get_keypad_key();
-    } while (key < '0' || key > '4'); // Only accept digits 0?4
-    return key - '0';
-}
-
-// Function to check if a new code is wanting to be set, set it
-void check_for_change_code_request(void) {
-    char key = get_keypad_key();
-    if (key == '*'){
-            SECRET_CODE = set_new_secret_code();
-        }
 
+    if (code_step == 0) {
+        if (keypad_get() == '*')
+            set_new_secret_code();
+        return;
+    }
+    if (sched_pending(show_digit_done))
+        return;
+    key = keypad_get();
+    if (key < '0' || key > '4') // Only accept digits 0-4
+        return;
+
+    sched_cancel(chase_step);
+    display_digit(key);
+    if (code_step == 1)
+        new_code = (uint8_t)((key - '0') * 10);
+    else
+        new_code = (uint8_t)(new_code + (key - '0'));
+    sched_after(show_digit_done, SHOW_DIGIT_MS);
 }
 
-// Function to check for photo-resistor inputs
-void check_for_PR_input(void) {
-    if(PORTEbits.RE0 == 1 || PORTEbits.RE1 == 1){
-        if (PORTEbits.RE0 == 1){
-            high_digit = input_digit(0); // PR1
-        
-            __delay_ms(500);
-        }else if (PORTEbits.RE1 == 1){
-            low_digit = input_digit(1); // PR2
-            
-            __delay_ms(500);
-        }
-    
-        user_code = (high_digit * 10) + low_digit;
+// A PR covered or uncovered (LIGHT_EVENT): a tap, TAP_MS to HOLD_MS covered,
+// counts on the chosen PR (the first tapped), a longer cover confirms it
+void pr_changed(uint8_t gate, uint8_t covered, uint16_t ms) {
+    if (code_step != 0 || covered || ms < TAP_MS)
+        return;
+
+    if (pr_sensor == PR_NONE) {
+        if (ms >= HOLD_MS)
+            return;
+        pr_sensor = gate;
+        pr_count = 1;
+        display_digit((char)(pr_count + '0'));
+        return;
+    }
+    if (gate != pr_sensor)
+        return;
+    if (ms >= HOLD_MS) {
+        confirm_digit();
+    } else if (pr_count < 4) {
+        pr_count++;
+        display_digit((char)(pr_count + '0'));
     }
 }
 
+// Confirm button (EVT_CONFIRM), once per CONFIRM_MS for its bounces. The
+// time since the last press, not a deadline: one left behind for over
+// 32767 ms would look ahead again and lock the button out
+void confirm_pressed(void) {
+    if ((uint16_t)(sched_now() - button_last) < CONFIRM_MS)
+        return;
+    button_last = sched_now();
+    if (code_step == 0 && pr_sensor != PR_NONE)
+        confirm_digit();
+}
+
+// The count of the chosen PR is its digit
+void confirm_digit(void) {
+    if (pr_sensor == 0)
+        high_digit = pr_count;
+    else
+        low_digit = pr_count;
+    pr_sensor = PR_NONE;
+    confirmation++;
+    display_digit('#');  // Show 3 lines while waiting
+    user_code = (high_digit * 10) + low_digit;
+    code_correct_or_wrong();
+}
+
 // Handles if the code is correct or wrong then resets variables
 void code_correct_or_wrong(void) {
     if (confirmation == 2) {
@@ -209,21 +229,24 @@ void code_correct_or_wrong(void) {
     }
 }
 
-// Function to set the secret code
-uint8_t set_new_secret_code(void) {
-
-    uint8_t high = wait_for_keypad_digit();  // First digit
-    display_digit((char)(high + '0'));
-    __delay_ms(1000);
+// Start taking a new secret code from the keypad (keypad_task() does the rest)
+void set_new_secret_code(void) {
+    code_step = 1;
+    chase_segment = 0;
+    sched_every(chase_step, CHASE_MS);
+}
 
-    uint8_t low = wait_for_keypad_digit();   // Second digit
-    display_digit((char)(low + '0'));
-    __delay_ms(1000);
-    
-    display_digit('E');
-    
-    uint8_t newCode = (high * 10) + low;
-    return newCode;
+// A digit of the new code has been shown long enough
+void show_digit_done(void) {
+    if (code_step == 1) {
+        code_step = 2;
+        sched_every(chase_step, CHASE_MS);  // Second digit
+    } else {
+        SECRET_CODE = new_code;
+        ee_log_write(&SECRET_CODE);     // kept for the next reset, in the background
+        code_step = 0;
+        display_digit('#');
+    }
 }
 
 
@@ -2,22 +2,32 @@
 #define INIT_H
 
 #include <xc.h>
+#include "keypad.h"
 
 #define _XTAL_FREQ 4000000                 // Fosc  frequency for _delay()  library
 #define FCY    _XTAL_FREQ/4
 
 void init_system(void) {
+    // Fosc 4 MHz, the clock the 1 ms tick and the motor times are counted
+    // in: HFINTOSC at 4 MHz, divider 1:1 (the reset one is 4:1)
+    OSCFRQ = 0b00000010;
+    OSCCON1 = 0b01100000;   // NOSC = HFINTOSC, NDIV = 1:1
+
+    // Unused modules off, before anything is set up; Timer3 counts the
+    // time in each power state
+    pwr_init();
+
     // I/O setup
     TRISB = 0xE1;  // Keypad RB1-RB6 + Input for emergency interrupt (RB0)
     TRISC = 0x10;  // Input for confirmation button (RC4), SYS_LED (RC3), buzzer (RC6)
     TRISD = 0x00;  // Output for 7-segment
-    TRISE = 0x03;  // Inputs for photoresistors
+    TRISE = 0x03;  // Analog inputs for photoresistors (ANE0, ANE1)
 
     //ANSELA = 0x00;
     ANSELB = 0x00;
     ANSELC = 0x00;
     ANSELD = 0x00;
-    ANSELE = 0x00;
+    ANSELE = 0x03;
     
     PORTB = 0;
     PORTC = 0;
@@ -27,6 +37,10 @@ void init_system(void) {
     LATB = 0x1E;  
     LATD = 0;
 
+    // IVTBASE = EVT_IVT_BASE, the base() of every EVT_ISR(), and the Timer1
+    // time stamps of the events, before any interrupt is on
+    evt_init();
+
     // Interrupt on RB0
     // Enable interrupt priority bit in INTCON0 (check INTCON0 register and find the bit)
     INTCON0bits.IPEN = 1;
@@ -44,14 +58,16 @@ void init_system(void) {
 
     //Clear interrupt flag for INT0
     PIR1bits.INT0IF = 0;
+
+    // Confirm button: interrupt on the rising edge of RC4, high priority too
+    IOCCPbits.IOCCP4 = 1;
+    IOCCF = 0;
+    IPR0bits.IOCIP = 1;
+    PIE0bits.IOCIE = 1;
   
-    // Change IVTBASE by doing the following
-    // Set IVTBASEU to 0x00 
-    IVTBASEU = 0x00;
-    // Set IVTBASEH to  0x40; 
-    IVTBASEH = 0x40;
-    // Set IVTBASEL to 0x08; 
-    IVTBASEL = 0x08;
+    // 1 ms Timer0 tick: one keypad row and one scheduler millisecond
+    sched_init();
+    keypad_setup();
 }
 
 #endif
@@ -0,0 +1,84 @@
+#ifndef KEYPAD_H
+#define KEYPAD_H
+
+#include <xc.h>
+
+// 3x4 keypad: rows on RB1-RB4, columns on RB5-RB7
+#define KEYPAD_PORT         B
+#define KEYPAD_ROWS         4
+#define KEYPAD_ROW_FIRST    1
+#define KEYPAD_COLS         3
+#define KEYPAD_COL_FIRST    5
+#define KEYPAD_LAYOUT   {           \
+        {'1', '2', '3'},            \
+        {'4', '5', '6'},            \
+        {'7', '8', '9'},            \
+        {'*', '0', '#'}             \
+    }
+
+// Event sources (every ISR shares the vector table base)
+#define EVT_ALARM           0       // INT0 button: play the emergency melody
+#define TONE_EVENT          1       // "../Common/tone.h": a tone sequence ended
+#define BLINK_EVENT         2       // "../Common/tone.h": a blink ended
+#define EVT_CONFIRM         3       // RC4 button: take the digit
+#define LIGHT_EVENT         4       // "../Common/light_gate.h": PR1 (4) or PR2 (5) changed
+#define EE_LOG_EVENT        6       // "../Common/ee_log.h": the code is in the EEPROM
+#define EVT_SOURCES         7
+
+// Modules left on: IOC, the data EEPROM, Timers 0-4 and 6, NCO1, the ADC
+// and PWM5 (Timer3 counts the time in each power state); everything else
+// is off. The scheduler waits in Idle: the Timer0 tick runs on Fosc/4
+#define PWR_PMD0            (_PMD0_FVRMD_MASK | _PMD0_HLVDMD_MASK | _PMD0_CRCMD_MASK | \
+                             _PMD0_SCANMD_MASK | _PMD0_CLKRMD_MASK)
+#define PWR_PMD1            _PMD1_TMR5MD_MASK
+#define PWR_PMD2            (_PMD2_DACMD_MASK | _PMD2_CMP1MD_MASK | _PMD2_CMP2MD_MASK | \
+                             _PMD2_ZCDMD_MASK)
+#define PWR_PMD3            (_PMD3_PWM6MD_MASK | _PMD3_PWM7MD_MASK | _PMD3_PWM8MD_MASK | \
+                             _PMD3_CCP1MD_MASK | _PMD3_CCP2MD_MASK | _PMD3_CCP3MD_MASK | \
+                             _PMD3_CCP4MD_MASK)
+#define PWR_PMD4            (_PMD4_CWG1MD_MASK | _PMD4_CWG2MD_MASK | _PMD4_CWG3MD_MASK)
+#define PWR_PMD5            (_PMD5_SMT1MD_MASK | _PMD5_CLC1MD_MASK | _PMD5_CLC2MD_MASK | \
+                             _PMD5_CLC3MD_MASK | _PMD5_CLC4MD_MASK)
+#define PWR_PMD6            (_PMD6_U1MD_MASK | _PMD6_U2MD_MASK | _PMD6_SPI1MD_MASK | \
+                             _PMD6_I2C1MD_MASK | _PMD6_I2C2MD_MASK)
+#define PWR_PMD7            (_PMD7_DMA1MD_MASK | _PMD7_DMA2MD_MASK)
+#include "../Common/power.h"
+
+#include "../Common/matrix_keypad.h"
+#include "../Common/events.h"
+#define SCHED_BUSY()        evt_pending()   // an event waiting keeps main() awake
+#define SCHED_WAIT()        pwr_wait(PWR_IDLE)
+#include "../Common/scheduler.h"
+
+// Timer0 ticks every 1 ms: Fosc/4 (1 MHz) / 8 = 125 kHz, 125 counts. Each
+// tick scans one keypad row and is the scheduler's millisecond.
+#define KEYPAD_TICK_COUNTS  125
+
+void keypad_setup(void);
+EVT_ISR(TMR0_ISR, irq(IRQ_TMR0), low_priority);
+
+// Keypad pins and the Timer0 tick (low priority, under the INT0 button)
+void keypad_setup(void) {
+    keypad_init();
+
+    T0CON0 = 0b00000000;    // off, 8-bit, 1:1 postscaler
+    T0CON1 = 0b01000011;    // Fosc/4 (CS = 010), synchronous, 1:8 prescaler
+    TMR0H = KEYPAD_TICK_COUNTS - 1;
+    TMR0L = 0;
+    IPR3bits.TMR0IP = 0;
+    PIR3bits.TMR0IF = 0;
+    PIE3bits.TMR0IE = 1;
+    T0CON0bits.EN = 1;
+}
+
+// Keypad row and scheduler millisecond (timed, but posts nothing: it is
+// low priority and INT0 posts from the high level)
+EVT_ISR(TMR0_ISR, irq(IRQ_TMR0), low_priority) {
+    EVT_ISR_BEGIN();
+    PIR3bits.TMR0IF = 0;
+    keypad_tick();
+    sched_tick();
+    EVT_ISR_END();
+}
+
+#endif
@@ -4,14 +4,16 @@
  * This project implements a secure safebox system using the PIC18F47K42 microcontroller.
  * The system allows a user to unlock the box by entering a pre-set SECRET_CODE using
  * two photo-resistors (PR1 and PR2) as touch-less binary inputs (0?4 range).
- * A 3x4 keypad is used to set or change the secret code by pressing '*'.
+ * A 3x4 keypad is used to set or change the secret code by pressing '*'; the code is kept
+ * in the data EEPROM, so a reset does not ask for it again.
  * A 7-segment display shows the digits being entered. 
  *  
  * I/O:
  * Inputs:  Interrupt Button (one end connected to GND and the other to port RB0)
  *          Confirmation Button (one end connected to GND and the other to port RC4)
  *          3x4 Keypad (Rows connected to RB1-RB4, columns connected to RB5-RB7)
- *          Photo-resistor 1 connected to RE0 and photo-resistor 2 connected to RE1
+ *          Photo-resistor 1 connected to RE0 and photo-resistor 2 connected to RE1 (analog,
+ *              each the ground side of a divider, so the reading rises when covered)
  * Outputs: LED (cathode connected to GND, anode connected to RC3)
  *          7-Segment connected to RD0-RD6 in alphabetical order from 0(a) to 6(g)
  *          Relay (RC7 to IN, DC+ to positive logic power supply, DC- to GND)
@@ -24,6 +26,12 @@
  *      - Header file "config.h" for microcontroller settings
  *      - Initialization file "init.h" to initialize pins on microcontroller
  *      - Functions file "functions.h" that holds all functions of this project
+ *      - Keypad file "keypad.h" with the keypad wiring for "../Common/matrix_keypad.h"
+ *        and the 1 ms tick for "../Common/scheduler.h", and the interrupt events of
+ *        "../Common/events.h", and the buzzer tones and LED blinks of "../Common/tone.h"
+ *      - "../Common/light_gate.h" for the photo-resistors, read by the ADC
+ *      - "../Common/ee_log.h" to keep the secret code in the data EEPROM
+ *      - "../Common/power.h" for the module gating and the time in each power state
  *      - <xc.h> for compiler-specific and device-specific features
  * IDE: MPLAB X IDE v6.20
  * Compiler: XC8, 3.00
@@ -33,6 +41,29 @@
  * Versions:
  *      V1.0: Initial setup, no motor features, no keypad
  *      V2.0: All features integrated, including the ability to enter and change code using the keypad
+ *      V2.1: Keypad scanned one row per Timer0 tick by the shared driver, no more delays per row
+ *      V2.2: Motor, buzzer, melody, animation and sensor polling are scheduler tasks on a 1 ms tick,
+ *            so no __delay_ms() is left and every input is looked at each millisecond
+ *      V2.3: ISRs declared with EVT_ISR() from "../Common/events.h", so their base() and
+ *            IVTBASE both come from EVT_IVT_BASE (the INT0 prototype said 0x400); INT0
+ *            posts an event that main() hands to emergency_melody(), and the worst ISR
+ *            length and post-to-handler latency are counted
+ *      V2.4: Melody and wrong-code tone are note tables played by NCO1 on the buzzer (PPS),
+ *            with SYS_LED blinked by PWM5; the CPU only loads the next note
+ *      V2.5: display_digit() is one indexed read of the shared font (Common/seg_font.h)
+ *            instead of a switch; the waiting glyph (3 lines) is '#'
+ *      V2.6: Photo-resistors read by the ADC (Timer2-triggered, a gate every 2 ms) against
+ *            cover/uncover thresholds with hysteresis, and timed in ms by the conversions;
+ *            a tap counts as soon as it ends (no 500 ms lockout), a cover of 1 s or more
+ *            confirms the digit, and RC4 is an interrupt-on-change event. sensor_task() and
+ *            its 1 ms poll are gone; the time from an edge to the display is counted
+ *      V2.7: SECRET_CODE is kept in the data EEPROM (wear-levelled log, "../Common/ee_log.h"),
+ *            written in the background by the NVM interrupt when a new code is set, so
+ *            after a reset the box takes the code at once instead of asking for one
+ *      V2.8: Unused modules switched off in PMD0-PMD7; the scheduler's Idle goes through
+ *            "../Common/power.h", which counts the time in Run and Idle
+ *      V2.9: Runs on HFINTOSC at 4 MHz instead of the 32.768 kHz crystal, which made
+ *            every 1 ms tick (and with it the debounce and motor times) 122 ms long
  * 
  * Useful links:
  *      V2.0 from GitHub: https://github.com/GonzalezC-Dev/Microcontroller_EE310/tree/main/Assignments/InterfacingWithSensors_A8.X
@@ -54,16 +85,25 @@
 
 void main(void) {
     init_system(); // Initialize the system
+    tone_init();   // NCO1 buzzer and PWM5 LED, off until an alert
     PORTCbits.RC3 = 1; // SYS_LED turned on
-    SECRET_CODE = set_new_secret_code(); // Set the first secret code
+    // Keypad looked at every tick; photo-resistors and the confirm button
+    // come in as events
+    sched_every(keypad_task, 1);
+    light_init(pr_changed);
+    evt_on(EVT_ALARM, emergency_melody);
+    evt_on(EVT_CONFIRM, confirm_pressed);
+    // The code kept in the EEPROM, or a first one from the keypad
+    if (ee_log_init(&SECRET_CODE))
+        display_digit('#');
+    else
+        set_new_secret_code();
 
     while (1) {
-        PORTCbits.RC3 = 1;
-        // Check if user wants to set a new code
-        check_for_change_code_request();
-        // Check if there is an input from PR1 or PR2
-        check_for_PR_input();
-        // Check for code correct or wrong
-        code_correct_or_wrong();
+        // Bottom halves of the interrupts (INT0, RC4, the PRs), then
+        // whatever is due, then idle until the next interrupt
+        evt_dispatch();
+        sched_run();
+        sched_idle();
     }
 }